@@ -0,0 +1,492 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "platform.hpp"
+#include <assert.h>
+#include <errno.h>
+#include <portable_endian.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+
+#include "BinaryMetadata.hpp"
+
+static const char HEADER_MAGIC[8]  = { 'R', 'E', 'H', 'E', 'X', 'M', 'D', '\0' };
+static const char TRAILER_MAGIC[8] = { 'R', 'E', 'H', 'E', 'X', 'E', 'N', 'D' };
+
+static const uint32_t FORMAT_VERSION = 1;
+
+static const size_t HEADER_SIZE  = 16;
+static const size_t TRAILER_SIZE = 24;
+
+/* Size of a record after the offset and length fields. */
+static const size_t COMMENT_TAIL_SIZE   = 4; /* text length (followed by text) */
+static const size_t HIGHLIGHT_TAIL_SIZE = 4; /* colour index */
+
+/* Number of records between each index entry. */
+static const uint64_t INDEX_INTERVAL = 256;
+
+REHex::BinaryMetadataWriter::BinaryMetadataWriter(const std::string &filename):
+	filename(filename), pos(0)
+{
+	fh = fopen(filename.c_str(), "wb");
+	if(fh == NULL)
+	{
+		throw std::runtime_error(std::string("Could not open file: ") + strerror(errno));
+	}
+	
+	try {
+		write(HEADER_MAGIC, sizeof(HEADER_MAGIC));
+		write_u32(FORMAT_VERSION);
+		write_u32(0);
+	}
+	catch(...)
+	{
+		fclose(fh);
+		throw;
+	}
+	
+	comments.first_record_pos = pos;
+}
+
+REHex::BinaryMetadataWriter::~BinaryMetadataWriter()
+{
+	if(fh != NULL)
+	{
+		/* finish() wasn't called - the file is left without its trailer and will be
+		 * rejected by BinaryMetadataReader.
+		*/
+		fclose(fh);
+	}
+}
+
+void REHex::BinaryMetadataWriter::add_comment(off_t offset, off_t length, const char *utf8_text, size_t utf8_length)
+{
+	assert(fh != NULL);
+	assert(highlights.num_records == 0);
+	
+	if(utf8_length > UINT32_MAX)
+	{
+		throw std::runtime_error("Comment too long");
+	}
+	
+	begin_record(comments, offset);
+	
+	write_u64(offset);
+	write_u64(length);
+	write_u32(utf8_length);
+	write(utf8_text, utf8_length);
+}
+
+void REHex::BinaryMetadataWriter::add_highlight(off_t offset, off_t length, int colour)
+{
+	assert(fh != NULL);
+	assert(colour >= 0);
+	
+	begin_record(highlights, offset);
+	
+	write_u64(offset);
+	write_u64(length);
+	write_u32(colour);
+}
+
+void REHex::BinaryMetadataWriter::finish()
+{
+	assert(fh != NULL);
+	
+	if(highlights.num_records == 0)
+	{
+		highlights.first_record_pos = pos;
+	}
+	
+	uint64_t comments_index_pos = pos;
+	write_index(comments);
+	
+	uint64_t highlights_index_pos = pos;
+	write_index(highlights);
+	
+	write_u64(comments_index_pos);
+	write_u64(highlights_index_pos);
+	write(TRAILER_MAGIC, sizeof(TRAILER_MAGIC));
+	
+	int res = fclose(fh);
+	fh = NULL;
+	
+	if(res != 0)
+	{
+		throw std::runtime_error(std::string("Write error: ") + strerror(errno));
+	}
+}
+
+void REHex::BinaryMetadataWriter::write(const void *data, size_t length)
+{
+	if(length > 0 && fwrite(data, length, 1, fh) != 1)
+	{
+		throw std::runtime_error(std::string("Write error: ") + strerror(errno));
+	}
+	
+	pos += length;
+}
+
+void REHex::BinaryMetadataWriter::write_u32(uint32_t value)
+{
+	value = htole32(value);
+	write(&value, sizeof(value));
+}
+
+void REHex::BinaryMetadataWriter::write_u64(uint64_t value)
+{
+	value = htole64(value);
+	write(&value, sizeof(value));
+}
+
+void REHex::BinaryMetadataWriter::begin_record(Section &section, off_t offset)
+{
+	assert(offset >= 0);
+	assert(section.num_records == 0 || offset >= section.last_offset);
+	
+	if(section.num_records == 0)
+	{
+		section.first_record_pos = pos;
+	}
+	
+	if((section.num_records % INDEX_INTERVAL) == 0)
+	{
+		section.index.push_back(IndexEntry(offset, pos, section.num_records));
+	}
+	
+	section.last_offset = offset;
+	++(section.num_records);
+}
+
+void REHex::BinaryMetadataWriter::write_index(const Section &section)
+{
+	write_u64(section.num_records);
+	write_u64(section.first_record_pos);
+	write_u64(section.index.size());
+	
+	for(auto i = section.index.begin(); i != section.index.end(); ++i)
+	{
+		write_u64(i->offset);
+		write_u64(i->position);
+		write_u64(i->record);
+	}
+}
+
+REHex::BinaryMetadataReader::BinaryMetadataReader(const std::string &filename):
+	filename(filename), pos(0)
+{
+	fh = fopen(filename.c_str(), "rb");
+	if(fh == NULL)
+	{
+		throw std::runtime_error(std::string("Could not open file: ") + strerror(errno));
+	}
+	
+	try {
+		if(fseeko(fh, 0, SEEK_END) != 0)
+		{
+			throw std::runtime_error(std::string("fseeko: ") + strerror(errno));
+		}
+		
+		off_t end = ftello(fh);
+		if(end < 0)
+		{
+			throw std::runtime_error(std::string("ftello: ") + strerror(errno));
+		}
+		
+		file_length = end;
+		pos = end;
+		
+		if(file_length < (HEADER_SIZE + TRAILER_SIZE))
+		{
+			throw std::runtime_error("Invalid metadata file: too short");
+		}
+		
+		seek(0);
+		
+		char magic[8];
+		read(magic, sizeof(magic));
+		
+		if(memcmp(magic, HEADER_MAGIC, sizeof(magic)) != 0)
+		{
+			throw std::runtime_error("Invalid metadata file: bad header");
+		}
+		
+		uint32_t version = read_u32();
+		read_u32(); /* flags */
+		
+		if(version != FORMAT_VERSION)
+		{
+			throw std::runtime_error("Unsupported metadata file version");
+		}
+		
+		seek(file_length - TRAILER_SIZE);
+		
+		uint64_t comments_index_pos   = read_u64();
+		uint64_t highlights_index_pos = read_u64();
+		
+		read(magic, sizeof(magic));
+		
+		if(memcmp(magic, TRAILER_MAGIC, sizeof(magic)) != 0)
+		{
+			throw std::runtime_error("Invalid metadata file: bad trailer (incomplete file?)");
+		}
+		
+		if(comments_index_pos < HEADER_SIZE
+			|| highlights_index_pos < comments_index_pos
+			|| highlights_index_pos > (file_length - TRAILER_SIZE))
+		{
+			throw std::runtime_error("Invalid metadata file: bad index position");
+		}
+		
+		read_index(comments,   comments_index_pos,   comments_index_pos);
+		read_index(highlights, highlights_index_pos, comments_index_pos);
+		
+		if(comments.first_record_pos != HEADER_SIZE || highlights.first_record_pos < comments.first_record_pos)
+		{
+			throw std::runtime_error("Invalid metadata file: bad section position");
+		}
+	}
+	catch(...)
+	{
+		fclose(fh);
+		throw;
+	}
+}
+
+REHex::BinaryMetadataReader::~BinaryMetadataReader()
+{
+	fclose(fh);
+}
+
+bool REHex::BinaryMetadataReader::is_binary_metadata(const std::string &filename)
+{
+	FILE *fh = fopen(filename.c_str(), "rb");
+	if(fh == NULL)
+	{
+		return false;
+	}
+	
+	char magic[8];
+	bool is_binary = fread(magic, sizeof(magic), 1, fh) == 1
+		&& memcmp(magic, HEADER_MAGIC, sizeof(magic)) == 0;
+	
+	fclose(fh);
+	
+	return is_binary;
+}
+
+uint64_t REHex::BinaryMetadataReader::comment_count() const
+{
+	return comments.num_records;
+}
+
+uint64_t REHex::BinaryMetadataReader::highlight_count() const
+{
+	return highlights.num_records;
+}
+
+bool REHex::BinaryMetadataReader::next_comment(off_t *offset, off_t *length, std::string *utf8_text)
+{
+	if(comments.next_record >= comments.num_records)
+	{
+		return false;
+	}
+	
+	seek(comments.next_record_pos);
+	
+	*offset = read_u64();
+	*length = read_u64();
+	
+	uint32_t text_length = read_u32();
+	
+	if(pos > highlights.first_record_pos || text_length > (highlights.first_record_pos - pos))
+	{
+		throw std::runtime_error("Invalid metadata file: bad comment length");
+	}
+	
+	utf8_text->resize(text_length);
+	read(&((*utf8_text)[0]), text_length);
+	
+	comments.next_record_pos = pos;
+	++(comments.next_record);
+	
+	return true;
+}
+
+bool REHex::BinaryMetadataReader::next_highlight(off_t *offset, off_t *length, int *colour)
+{
+	if(highlights.next_record >= highlights.num_records)
+	{
+		return false;
+	}
+	
+	seek(highlights.next_record_pos);
+	
+	*offset = read_u64();
+	*length = read_u64();
+	*colour = read_u32();
+	
+	highlights.next_record_pos = pos;
+	++(highlights.next_record);
+	
+	return true;
+}
+
+void REHex::BinaryMetadataReader::seek_comments(off_t offset)
+{
+	seek_section(comments, offset, COMMENT_TAIL_SIZE, true);
+}
+
+void REHex::BinaryMetadataReader::seek_highlights(off_t offset)
+{
+	seek_section(highlights, offset, HIGHLIGHT_TAIL_SIZE, false);
+}
+
+void REHex::BinaryMetadataReader::seek(uint64_t position)
+{
+	if(position == pos)
+	{
+		/* Already there - avoid discarding the stdio buffer. */
+		return;
+	}
+	
+	if(position > file_length || fseeko(fh, position, SEEK_SET) != 0)
+	{
+		throw std::runtime_error(std::string("fseeko: ") + strerror(errno));
+	}
+	
+	pos = position;
+}
+
+void REHex::BinaryMetadataReader::read(void *data, size_t length)
+{
+	if(length > 0 && fread(data, length, 1, fh) != 1)
+	{
+		if(feof(fh))
+		{
+			throw std::runtime_error("Read error: unexpected end of file");
+		}
+		else{
+			throw std::runtime_error(std::string("Read error: ") + strerror(errno));
+		}
+	}
+	
+	pos += length;
+}
+
+uint32_t REHex::BinaryMetadataReader::read_u32()
+{
+	uint32_t value;
+	read(&value, sizeof(value));
+	
+	return le32toh(value);
+}
+
+uint64_t REHex::BinaryMetadataReader::read_u64()
+{
+	uint64_t value;
+	read(&value, sizeof(value));
+	
+	return le64toh(value);
+}
+
+void REHex::BinaryMetadataReader::read_index(Section &section, uint64_t index_pos, uint64_t section_end)
+{
+	seek(index_pos);
+	
+	section.num_records      = read_u64();
+	section.first_record_pos = read_u64();
+	
+	uint64_t index_size = read_u64();
+	
+	/* Each entry is 24 bytes - reject sizes which couldn't possibly fit in the file before
+	 * we try allocating memory for them.
+	*/
+	if(index_size > ((file_length - pos) / 24)
+		|| index_size != ((section.num_records + INDEX_INTERVAL - 1) / INDEX_INTERVAL)
+		|| section.first_record_pos > section_end)
+	{
+		throw std::runtime_error("Invalid metadata file: bad index");
+	}
+	
+	section.index.reserve(index_size);
+	
+	for(uint64_t i = 0; i < index_size; ++i)
+	{
+		uint64_t offset   = read_u64();
+		uint64_t position = read_u64();
+		uint64_t record   = read_u64();
+		
+		if(position < section.first_record_pos || position >= section_end
+			|| record != (i * INDEX_INTERVAL)
+			|| (!section.index.empty() && offset < section.index.back().offset))
+		{
+			throw std::runtime_error("Invalid metadata file: bad index");
+		}
+		
+		section.index.push_back(IndexEntry(offset, position, record));
+	}
+	
+	section.next_record_pos = section.first_record_pos;
+	section.next_record     = 0;
+}
+
+void REHex::BinaryMetadataReader::seek_section(Section &section, off_t offset, size_t record_tail_size, bool has_text)
+{
+	assert(offset >= 0);
+	
+	/* Find the last index entry which starts before the offset we want. Everything before it
+	 * can be skipped without reading.
+	*/
+	
+	section.next_record_pos = section.first_record_pos;
+	section.next_record     = 0;
+	
+	for(auto i = section.index.begin(); i != section.index.end() && i->offset < (uint64_t)(offset); ++i)
+	{
+		section.next_record_pos = i->position;
+		section.next_record     = i->record;
+	}
+	
+	/* Then scan forward to the first record at or after the offset. */
+	
+	while(section.next_record < section.num_records)
+	{
+		seek(section.next_record_pos);
+		
+		uint64_t record_offset = read_u64();
+		
+		if(record_offset >= (uint64_t)(offset))
+		{
+			break;
+		}
+		
+		read_u64(); /* length */
+		
+		uint64_t skip = record_tail_size;
+		
+		if(has_text)
+		{
+			skip += read_u32();
+			skip -= sizeof(uint32_t);
+		}
+		
+		section.next_record_pos = pos + skip;
+		++(section.next_record);
+	}
+}
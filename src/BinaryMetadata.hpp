@@ -0,0 +1,173 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef REHEX_BINARYMETADATA_HPP
+#define REHEX_BINARYMETADATA_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace REHex {
+	/* Compact binary alternative to the JSON .rehex-meta format.
+	 *
+	 * The file is written and read one record at a time, so neither side needs to hold a
+	 * copy of every comment and highlight in memory. All integers are little endian.
+	 *
+	 *   Header      "REHEXMD\0", u32 version, u32 flags (zero)
+	 *   Comments    u64 offset, u64 length, u32 text length, UTF-8 text
+	 *   Highlights  u64 offset, u64 length, u32 colour index
+	 *   Indexes     one per section (see below)
+	 *   Trailer     u64 comment index position, u64 highlight index position, "REHEXEND"
+	 *
+	 * Records within each section are sorted by offset. Each section index holds the number
+	 * of records, the position of the first record and then the offset, position and number
+	 * of every INDEX_INTERVAL'th record, allowing a reader to seek to any offset without
+	 * scanning the whole section.
+	*/
+	
+	class BinaryMetadataWriter
+	{
+		public:
+			BinaryMetadataWriter(const std::string &filename);
+			~BinaryMetadataWriter();
+			
+			/* Records must be added in order of offset, with all comments before any
+			 * highlights.
+			*/
+			void add_comment(off_t offset, off_t length, const char *utf8_text, size_t utf8_length);
+			void add_highlight(off_t offset, off_t length, int colour);
+			
+			/* Writes out the indexes and closes the file. The file is not valid until this
+			 * has been called.
+			*/
+			void finish();
+		
+		private:
+			struct IndexEntry
+			{
+				uint64_t offset;
+				uint64_t position;
+				uint64_t record;
+				
+				IndexEntry(uint64_t offset, uint64_t position, uint64_t record):
+					offset(offset), position(position), record(record) {}
+			};
+			
+			struct Section
+			{
+				uint64_t first_record_pos;
+				uint64_t num_records;
+				off_t last_offset;
+				
+				std::vector<IndexEntry> index;
+				
+				Section(): first_record_pos(0), num_records(0), last_offset(0) {}
+			};
+			
+			std::string filename;
+			FILE *fh;
+			uint64_t pos;
+			
+			Section comments;
+			Section highlights;
+			
+			void write(const void *data, size_t length);
+			void write_u32(uint32_t value);
+			void write_u64(uint64_t value);
+			
+			void begin_record(Section &section, off_t offset);
+			void write_index(const Section &section);
+			
+			/* Prevent copying. */
+			BinaryMetadataWriter(const BinaryMetadataWriter&) = delete;
+			BinaryMetadataWriter &operator=(const BinaryMetadataWriter&) = delete;
+	};
+	
+	class BinaryMetadataReader
+	{
+		public:
+			BinaryMetadataReader(const std::string &filename);
+			~BinaryMetadataReader();
+			
+			/* Returns true if the named file starts with the binary metadata magic. */
+			static bool is_binary_metadata(const std::string &filename);
+			
+			uint64_t comment_count() const;
+			uint64_t highlight_count() const;
+			
+			/* Read the next record from each section, returns false once the end of the
+			 * section has been reached.
+			*/
+			bool next_comment(off_t *offset, off_t *length, std::string *utf8_text);
+			bool next_highlight(off_t *offset, off_t *length, int *colour);
+			
+			/* Position the section so the next record read is the first one at or
+			 * after the given offset.
+			*/
+			void seek_comments(off_t offset);
+			void seek_highlights(off_t offset);
+		
+		private:
+			struct IndexEntry
+			{
+				uint64_t offset;
+				uint64_t position;
+				uint64_t record;
+				
+				IndexEntry(uint64_t offset, uint64_t position, uint64_t record):
+					offset(offset), position(position), record(record) {}
+			};
+			
+			struct Section
+			{
+				uint64_t first_record_pos;
+				uint64_t num_records;
+				
+				uint64_t next_record_pos;
+				uint64_t next_record;
+				
+				std::vector<IndexEntry> index;
+				
+				Section(): first_record_pos(0), num_records(0), next_record_pos(0), next_record(0) {}
+			};
+			
+			std::string filename;
+			FILE *fh;
+			uint64_t pos;
+			uint64_t file_length;
+			
+			Section comments;
+			Section highlights;
+			
+			void seek(uint64_t position);
+			void read(void *data, size_t length);
+			uint32_t read_u32();
+			uint64_t read_u64();
+			
+			void read_index(Section &section, uint64_t index_pos, uint64_t section_end);
+			void seek_section(Section &section, off_t offset, size_t record_tail_size, bool has_text);
+			
+			/* Prevent copying. */
+			BinaryMetadataReader(const BinaryMetadataReader&) = delete;
+			BinaryMetadataReader &operator=(const BinaryMetadataReader&) = delete;
+	};
+}
+
+#endif /* !REHEX_BINARYMETADATA_HPP */
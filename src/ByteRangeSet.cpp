@@ -19,8 +19,7 @@
 
 #include <algorithm>
 #include <assert.h>
-#include <mutex>
-#include <thread>
+#include <iterator>
 
 #include "ByteRangeSet.hpp"
 
@@ -31,8 +30,40 @@ void REHex::ByteRangeSet::set_range(off_t offset, off_t length)
 		return;
 	}
 	
+	/* Find the range of elements that intersects the one we are inserting. They will be erased
+	 * and the one we are creating will grow on either end as necessary to encompass them.
+	*/
+	
+	const_iterator erase_begin = _lower_bound(Range((offset + length), 0));
+	const_iterator erase_end   = erase_begin;
+	
+	while(erase_begin != begin())
+	{
+		const_iterator eb_prev = std::prev(erase_begin);
+		
+		if((eb_prev->offset + eb_prev->length) >= offset)
+		{
+			off_t merged_begin = std::min(eb_prev->offset, offset);
+			off_t merged_end   = std::max((eb_prev->offset + eb_prev->length), (offset + length));
+			
+			offset = merged_begin;
+			length = merged_end - merged_begin;
+			
+			erase_begin = eb_prev;
+		}
+		else{
+			break;
+		}
+	}
+	
+	if(erase_end != end() && erase_end->offset == (offset + length))
+	{
+		length += erase_end->length;
+		++erase_end;
+	}
+	
 	Range range(offset, length);
-	set_ranges(&range, (&range) + 1);
+	_replace(erase_begin, erase_end, &range, (&range) + 1);
 }
 
 void REHex::ByteRangeSet::clear_range(off_t offset, off_t length)
@@ -42,24 +73,70 @@ void REHex::ByteRangeSet::clear_range(off_t offset, off_t length)
 		return;
 	}
 	
-	Range range(offset, length);
-	clear_ranges(&range, (&range) + 1);
+	/* Find the range of elements overlapping the range to be cleared. */
+	
+	const_iterator erase_begin = _lower_bound(Range((offset + length), 0));
+	const_iterator erase_end   = erase_begin;
+	
+	while(erase_begin != begin())
+	{
+		const_iterator eb_prev = std::prev(erase_begin);
+		
+		if((eb_prev->offset + eb_prev->length) > offset)
+		{
+			erase_begin = eb_prev;
+		}
+		else{
+			break;
+		}
+	}
+	
+	if(erase_begin == erase_end)
+	{
+		return;
+	}
+	
+	/* If the elements to be erased do not fall fully within the given range, then we shall
+	 * re-instate the parts of them on either side.
+	*/
+	
+	std::vector<Range> replacements;
+	
+	if(erase_begin->offset < offset)
+	{
+		replacements.push_back(Range(erase_begin->offset, (offset - erase_begin->offset)));
+	}
+	
+	const_iterator erase_last = std::prev(erase_end);
+	
+	if((erase_last->offset + erase_last->length) > (offset + length))
+	{
+		off_t from = offset + length;
+		off_t to   = erase_last->offset + erase_last->length;
+		
+		replacements.push_back(Range(from, (to - from)));
+	}
+	
+	_replace(erase_begin, erase_end, replacements.data(), replacements.data() + replacements.size());
 }
 
 void REHex::ByteRangeSet::clear_all()
 {
-	ranges.clear();
+	chunks.clear();
+	total_ranges = 0;
+	shift_tree.clear();
+	chunk_first_idx_valid = 0;
 }
 
 bool REHex::ByteRangeSet::isset(off_t offset) const
 {
-	auto lb = std::lower_bound(ranges.begin(), ranges.end(), Range(offset, 0));
+	const_iterator lb = _lower_bound(Range(offset, 0));
 	
-	if(lb != ranges.end() && lb->offset == offset)
+	if(lb != end() && lb->offset == offset)
 	{
 		return true;
 	}
-	else if(lb != ranges.begin())
+	else if(lb != begin())
 	{
 		--lb;
 		
@@ -72,132 +149,130 @@ bool REHex::ByteRangeSet::isset(off_t offset) const
 	return false;
 }
 
-const std::vector<REHex::ByteRangeSet::Range> &REHex::ByteRangeSet::get_ranges() const
+REHex::ByteRangeSet::const_iterator REHex::ByteRangeSet::find_first_in(off_t offset, off_t length) const
+{
+	/* Find the first range which ends after the offset, then check it begins before the end of
+	 * the range being searched.
+	 *
+	 * The last range in each chunk ends after every other range in it, so the first chunk
+	 * whose last range ends after the offset is the one containing the range we want.
+	*/
+	
+	size_t lo = 0, hi = chunks.size();
+	
+	while(lo < hi)
+	{
+		size_t mid = lo + ((hi - lo) / 2);
+		const Range &last = chunks[mid].ranges.back();
+		
+		if((last.offset + _chunk_shift(mid) + last.length) > offset)
+		{
+			hi = mid;
+		}
+		else{
+			lo = mid + 1;
+		}
+	}
+	
+	if(lo == chunks.size())
+	{
+		return end();
+	}
+	
+	const std::vector<Range> &ranges = chunks[lo].ranges;
+	off_t rel_offset = offset - _chunk_shift(lo);
+	
+	auto r = std::upper_bound(ranges.begin(), ranges.end(), rel_offset,
+		[](off_t offset, const Range &range)
+		{
+			return offset < (range.offset + range.length);
+		});
+	
+	assert(r != ranges.end());
+	
+	if(r->offset < (rel_offset + length))
+	{
+		return const_iterator(this, lo, (r - ranges.begin()));
+	}
+	else{
+		return end();
+	}
+}
+
+std::vector<REHex::ByteRangeSet::Range> REHex::ByteRangeSet::get_ranges() const
 {
-	return ranges;
+	return std::vector<Range>(begin(), end());
 }
 
-std::vector<REHex::ByteRangeSet::Range>::const_iterator REHex::ByteRangeSet::begin() const
+REHex::ByteRangeSet::const_iterator REHex::ByteRangeSet::begin() const
 {
-	return ranges.begin();
+	return const_iterator(this, 0, 0);
 }
 
-std::vector<REHex::ByteRangeSet::Range>::const_iterator REHex::ByteRangeSet::end() const
+REHex::ByteRangeSet::const_iterator REHex::ByteRangeSet::end() const
 {
-	return ranges.end();
+	return const_iterator(this, chunks.size(), 0);
 }
 
-const REHex::ByteRangeSet::Range &REHex::ByteRangeSet::operator[](size_t idx) const
+REHex::ByteRangeSet::Range REHex::ByteRangeSet::operator[](size_t idx) const
 {
-	assert(idx < ranges.size());
-	return ranges[idx];
+	assert(idx < total_ranges);
+	
+	_update_chunk_first_idx();
+	
+	auto c = std::prev(std::upper_bound(chunk_first_idx.begin(), chunk_first_idx.end(), idx));
+	size_t chunk = c - chunk_first_idx.begin();
+	
+	return *const_iterator(this, chunk, (idx - *c));
 }
 
 size_t REHex::ByteRangeSet::size() const
 {
-	return ranges.size();
+	return total_ranges;
 }
 
 bool REHex::ByteRangeSet::empty() const
 {
-	return ranges.empty();
+	return total_ranges == 0;
 }
 
 void REHex::ByteRangeSet::data_inserted(off_t offset, off_t length)
 {
-	std::mutex lock;
-	std::vector<Range> insert_elem;
-	size_t insert_idx;
+	/* Split any range straddling the insertion point. */
+	
+	const_iterator next = _lower_bound(Range(offset, 0));
 	
-	auto process_block = [&](size_t work_base, size_t work_length)
+	if(next != begin())
 	{
-		for(size_t i = work_base; i < (work_base + work_length); ++i)
+		const_iterator straddle = std::prev(next);
+		
+		if((straddle->offset + straddle->length) > offset)
 		{
-			Range *range = &(ranges[i]);
+			Range split[] = {
+				Range(straddle->offset, (offset - straddle->offset)),
+				Range(offset, ((straddle->offset + straddle->length) - offset)),
+			};
 			
-			if(range->offset >= offset)
-			{
-				/* Range begins after the insertion point, offset it. */
-				range->offset += length;
-			}
-			else if(range->offset < offset && (range->offset + range->length) > offset)
-			{
-				/* Range straddles the insertion point, split it.
-				 *
-				 * The first half of the new range is queued for insertion later,
-				 * after processing is done so threads don't need to synchronise or
-				 * handle the vector moving around.
-				 *
-				 * Second half of the new range replaces the range.
-				*/
-				
-				std::unique_lock<std::mutex> l(lock);
-				
-				assert(insert_elem.empty());
-				
-				insert_elem.push_back(Range(range->offset, (offset - range->offset)));
-				insert_idx = i;
-				
-				range->length -= (offset - range->offset);
-				range->offset = offset + length;
-			}
+			_replace(straddle, next, split, split + 2);
+			next = _lower_bound(Range(offset, 0));
 		}
-	};
-	
-	/* Split the ranges vector up into blocks which can be processed by different threads.
-	 * A thread is spawned for each block up to the CPU limit (including the current thread).
-	*/
-	
-	unsigned int max_threads = std::thread::hardware_concurrency();
-	
-	size_t next_block = 0;
-	size_t thread_block_size = ranges.size() / max_threads;
-	
-	if(ranges.size() < DATA_INSERTED_THREAD_MIN)
-	{
-		/* We don't have enough data to be worth the overhead of spawning threads. */
-		thread_block_size = 0;
-	}
-	
-	std::vector<std::thread> threads;
-	
-	for(unsigned int i = 1; thread_block_size > 0 && i < max_threads; ++i)
-	{
-		threads.emplace_back(process_block, next_block, thread_block_size);
-		next_block += thread_block_size;
 	}
 	
-	/* We process the last block in this thread, up to the end of the vector as
-	 * thread_block_size is likely to have rounding errors.
-	*/
-	process_block(next_block, (ranges.size() - next_block));
+	/* Move along everything from the insertion point onwards. */
 	
-	/* Wait for other threads to finish. */
-	for(auto t = threads.begin(); t != threads.end(); ++t)
-	{
-		t->join();
-	}
-	
-	/* Perform queued insertion, if there was a range straddling the insertion point. */
-	if(!insert_elem.empty())
-	{
-		assert(insert_elem.size() == 1);
-		ranges.insert(std::next(ranges.begin(), insert_idx), insert_elem[0]);
-	}
+	_shift_from(next, length);
 }
 
 void REHex::ByteRangeSet::data_erased(off_t offset, off_t length)
 {
 	/* Find the range of elements overlapping the range to be erased. */
 	
-	auto next = std::lower_bound(ranges.begin(), ranges.end(), Range((offset + length), 0));
-	
-	std::vector<Range>::iterator erase_begin = next;
-	std::vector<Range>::iterator erase_end   = next;
+	const_iterator erase_begin = _lower_bound(Range((offset + length), 0));
+	const_iterator erase_end   = erase_begin;
 	
-	while(erase_begin != ranges.begin())
+	while(erase_begin != begin())
 	{
-		auto sb_prev = std::prev(erase_begin);
+		const_iterator sb_prev = std::prev(erase_begin);
 		
 		if((sb_prev->offset + sb_prev->length) > offset)
 		{
@@ -208,40 +283,91 @@ void REHex::ByteRangeSet::data_erased(off_t offset, off_t length)
 		}
 	}
 	
-	/* Add a single range encompassing the existing range(s) immediately before or after the
-	 * erase window (if any exist).
+	/* Replace the existing range(s) overlapping the erase window (if any exist) with a single
+	 * range encompassing whatever is left of them either side of it.
 	*/
 	
 	if(erase_begin != erase_end)
 	{
-		auto erase_last = std::prev(erase_end);
+		const_iterator erase_last = std::prev(erase_end);
 		
 		off_t begin = std::min(erase_begin->offset, offset);
 		off_t end   = erase_last->offset + erase_last->length;
 		
-		erase_end = ranges.erase(erase_begin, erase_end);
+		std::vector<Range> replacement;
 		
 		if(end > (offset + length))
 		{
 			end -= length;
-			erase_end = ranges.insert(erase_end, Range(begin, (end - begin)));
-			++erase_end;
+			replacement.push_back(Range(begin, (end - begin)));
 		}
 		else if(begin < offset)
 		{
 			end = offset;
-			erase_end = ranges.insert(erase_end, Range(begin, (end - begin)));
-			++erase_end;
+			replacement.push_back(Range(begin, (end - begin)));
 		}
+		
+		_replace(erase_begin, erase_end, replacement.data(), replacement.data() + replacement.size());
 	}
 	
 	/* Adjust the offset of ranges after the erase window. */
 	
-	while(erase_end != ranges.end())
+	_shift_from(_lower_bound(Range((offset + length), 0)), -length);
+}
+
+void REHex::ByteRangeSet::data_replaced(const std::vector<off_t> &offsets, off_t old_length, off_t new_length)
+{
+	const off_t delta = new_length - old_length;
+	
+	std::vector<Range> new_ranges;
+	new_ranges.reserve(total_ranges);
+	
+	auto push_range = [&new_ranges](off_t offset, off_t length)
 	{
-		erase_end->offset -= length;
-		++erase_end;
+		if(!new_ranges.empty() && (new_ranges.back().offset + new_ranges.back().length) == offset)
+		{
+			new_ranges.back().length += length;
+		}
+		else{
+			new_ranges.push_back(Range(offset, length));
+		}
+	};
+	
+	/* Index of the first replacement which ends after the current position, which is
+	 * also the number of replacements before the current position.
+	*/
+	size_t r = 0;
+	
+	for(auto i = begin(); i != end(); ++i)
+	{
+		off_t pos = i->offset;
+		off_t end = i->offset + i->length;
+		
+		while(pos < end)
+		{
+			while(r < offsets.size() && (offsets[r] + old_length) <= pos)
+			{
+				++r;
+			}
+			
+			off_t shift = (off_t)(r) * delta;
+			
+			if(r == offsets.size() || offsets[r] >= end)
+			{
+				push_range((pos + shift), (end - pos));
+				break;
+			}
+			
+			if(offsets[r] > pos)
+			{
+				push_range((pos + shift), (offsets[r] - pos));
+			}
+			
+			pos = std::max(pos, (offsets[r] + old_length));
+		}
 	}
+	
+	_assign_sorted(new_ranges.begin(), new_ranges.end());
 }
 
 REHex::ByteRangeSet REHex::ByteRangeSet::intersection(const ByteRangeSet &a, const ByteRangeSet &b)
@@ -275,7 +401,7 @@ REHex::ByteRangeSet REHex::ByteRangeSet::intersection(const ByteRangeSet &a, con
 			
 			if(overlap_end > overlap_begin)
 			{
-				intersection.set_range(overlap_begin, (overlap_end - overlap_begin));
+				intersection._append(Range(overlap_begin, (overlap_end - overlap_begin)));
 			}
 			
 			if(a_end < b_end)
@@ -295,3 +421,536 @@ REHex::ByteRangeSet REHex::ByteRangeSet::intersection(const ByteRangeSet &a, con
 	
 	return intersection;
 }
+
+REHex::ByteRangeSet REHex::ByteRangeSet::set_union(const ByteRangeSet &a, const ByteRangeSet &b)
+{
+	ByteRangeSet result;
+	
+	auto ai = a.begin(), a_end = a.end();
+	auto bi = b.begin(), b_end = b.end();
+	
+	/* Append the ranges from both sets in order of offset, _append() will merge any which
+	 * overlap or are adjacent.
+	*/
+	
+	while(ai != a_end || bi != b_end)
+	{
+		if(bi == b_end || (ai != a_end && ai->offset <= bi->offset))
+		{
+			result._append(*ai);
+			++ai;
+		}
+		else{
+			result._append(*bi);
+			++bi;
+		}
+	}
+	
+	return result;
+}
+
+REHex::ByteRangeSet REHex::ByteRangeSet::difference(const ByteRangeSet &a, const ByteRangeSet &b)
+{
+	ByteRangeSet result;
+	
+	auto bi = b.begin(), b_end = b.end();
+	
+	for(auto ai = a.begin(); ai != a.end(); ++ai)
+	{
+		off_t a_end = ai->offset + ai->length;
+		off_t cur = ai->offset;
+		
+		/* Skip any ranges in b which end before this one begins. */
+		while(bi != b_end && (bi->offset + bi->length) <= cur)
+		{
+			++bi;
+		}
+		
+		/* Emit the gaps between any ranges in b which intersect this one. The last
+		 * range in b is left if it extends past the end, since it may also intersect
+		 * the next range in a.
+		*/
+		while(bi != b_end && bi->offset < a_end)
+		{
+			off_t b_end_off = bi->offset + bi->length;
+			
+			if(bi->offset > cur)
+			{
+				result._append(Range(cur, (bi->offset - cur)));
+			}
+			
+			cur = std::max(cur, b_end_off);
+			
+			if(b_end_off >= a_end)
+			{
+				break;
+			}
+			
+			++bi;
+		}
+		
+		if(cur < a_end)
+		{
+			result._append(Range(cur, (a_end - cur)));
+		}
+	}
+	
+	return result;
+}
+
+REHex::ByteRangeSet REHex::ByteRangeSet::complement(off_t offset, off_t length) const
+{
+	ByteRangeSet result;
+	
+	off_t end_off = offset + length;
+	off_t cur = offset;
+	
+	for(auto r = find_first_in(offset, length); r != end() && r->offset < end_off; ++r)
+	{
+		if(r->offset > cur)
+		{
+			result._append(Range(cur, (r->offset - cur)));
+		}
+		
+		cur = std::max(cur, (r->offset + r->length));
+	}
+	
+	if(cur < end_off)
+	{
+		result._append(Range(cur, (end_off - cur)));
+	}
+	
+	return result;
+}
+
+void REHex::ByteRangeSet::union_with(const ByteRangeSet &other)
+{
+	if((other.size() * MERGE_RATIO) < size())
+	{
+		for(auto r = other.begin(); r != other.end(); ++r)
+		{
+			set_range(r->offset, r->length);
+		}
+	}
+	else{
+		ByteRangeSet result = set_union(*this, other);
+		_swap_ranges(result);
+	}
+}
+
+void REHex::ByteRangeSet::intersect_with(const ByteRangeSet &other)
+{
+	ByteRangeSet result = intersection(*this, other);
+	_swap_ranges(result);
+}
+
+void REHex::ByteRangeSet::subtract(const ByteRangeSet &other)
+{
+	if((other.size() * MERGE_RATIO) < size())
+	{
+		for(auto r = other.begin(); r != other.end(); ++r)
+		{
+			clear_range(r->offset, r->length);
+		}
+	}
+	else{
+		ByteRangeSet result = difference(*this, other);
+		_swap_ranges(result);
+	}
+}
+
+/* Get the total shift of the ranges in a chunk, including any pending shifts. */
+off_t REHex::ByteRangeSet::_chunk_shift(size_t chunk) const
+{
+	off_t shift = chunks[chunk].shift;
+	
+	if(!shift_tree.empty())
+	{
+		for(size_t i = chunk + 1; i > 0; i -= (i & -i))
+		{
+			shift += shift_tree[i - 1];
+		}
+	}
+	
+	return shift;
+}
+
+/* Add a pending shift to every chunk from the given one onwards. */
+void REHex::ByteRangeSet::_shift_chunks_from(size_t chunk, off_t delta)
+{
+	if(shift_tree.empty())
+	{
+		shift_tree.resize(chunks.size(), 0);
+	}
+	
+	assert(shift_tree.size() == chunks.size());
+	
+	for(size_t i = chunk + 1; i <= shift_tree.size(); i += (i & -i))
+	{
+		shift_tree[i - 1] += delta;
+	}
+}
+
+/* Fold any pending shifts into the chunks. Must be called before adding or removing chunks, as
+ * the Fenwick tree is indexed by chunk.
+*/
+void REHex::ByteRangeSet::_fold_shifts()
+{
+	if(shift_tree.empty())
+	{
+		return;
+	}
+	
+	std::vector<off_t> shifts(chunks.size());
+	
+	for(size_t i = 0; i < chunks.size(); ++i)
+	{
+		shifts[i] = _chunk_shift(i);
+	}
+	
+	for(size_t i = 0; i < chunks.size(); ++i)
+	{
+		chunks[i].shift = shifts[i];
+	}
+	
+	shift_tree.clear();
+}
+
+REHex::ByteRangeSet::const_iterator REHex::ByteRangeSet::_lower_bound(const Range &range) const
+{
+	/* Find the first chunk whose last range isn't less than the one we are searching for, the
+	 * range we want is within it.
+	*/
+	
+	size_t lo = 0, hi = chunks.size();
+	
+	while(lo < hi)
+	{
+		size_t mid = lo + ((hi - lo) / 2);
+		const Range &last = chunks[mid].ranges.back();
+		
+		if(Range((last.offset + _chunk_shift(mid)), last.length) < range)
+		{
+			lo = mid + 1;
+		}
+		else{
+			hi = mid;
+		}
+	}
+	
+	if(lo == chunks.size())
+	{
+		return end();
+	}
+	
+	const std::vector<Range> &ranges = chunks[lo].ranges;
+	
+	auto r = std::lower_bound(ranges.begin(), ranges.end(), Range((range.offset - _chunk_shift(lo)), range.length));
+	assert(r != ranges.end());
+	
+	return const_iterator(this, lo, (r - ranges.begin()));
+}
+
+/* Replace the ranges from first up to last with the ranges from new_begin up to new_end. The
+ * new ranges MUST fit in order between the ranges either side of the ones being replaced.
+*/
+void REHex::ByteRangeSet::_replace(const_iterator first, const_iterator last, const Range *new_begin, const Range *new_end)
+{
+	size_t new_count = new_end - new_begin;
+	
+	/* Inserts the new ranges into a chunk, relative to its shift. */
+	auto insert_new = [&](size_t chunk, size_t idx, const Range *begin, const Range *end)
+	{
+		std::vector<Range> &c = chunks[chunk].ranges;
+		off_t shift = _chunk_shift(chunk);
+		
+		std::vector<Range> rel_ranges;
+		rel_ranges.reserve(end - begin);
+		
+		for(const Range *r = begin; r != end; ++r)
+		{
+			rel_ranges.push_back(Range((r->offset - shift), r->length));
+		}
+		
+		c.insert((c.begin() + idx), rel_ranges.begin(), rel_ranges.end());
+	};
+	
+	if(first.chunk == chunks.size())
+	{
+		/* Appending to the end of the set. */
+		
+		assert(last.chunk == chunks.size());
+		
+		if(new_count == 0)
+		{
+			return;
+		}
+		
+		if(chunks.empty())
+		{
+			chunks.emplace_back();
+		}
+		
+		size_t chunk = chunks.size() - 1;
+		
+		insert_new(chunk, chunks[chunk].ranges.size(), new_begin, new_end);
+		total_ranges += new_count;
+		
+		_rebalance(chunk);
+		
+		return;
+	}
+	
+	size_t chunk = first.chunk;
+	size_t erased;
+	
+	if(last.chunk == chunk)
+	{
+		std::vector<Range> &c = chunks[chunk].ranges;
+		off_t shift = _chunk_shift(chunk);
+		
+		erased = last.idx - first.idx;
+		
+		/* Overwrite the ranges being replaced in place where possible, to avoid moving
+		 * the rest of the chunk around more than once.
+		*/
+		
+		size_t overwrite = std::min(erased, new_count);
+		
+		for(size_t i = 0; i < overwrite; ++i)
+		{
+			c[first.idx + i] = Range((new_begin[i].offset - shift), new_begin[i].length);
+		}
+		
+		if(erased > new_count)
+		{
+			c.erase((c.begin() + first.idx + overwrite), (c.begin() + last.idx));
+		}
+		else if(new_count > erased)
+		{
+			insert_new(chunk, last.idx, (new_begin + overwrite), new_end);
+		}
+		
+		total_ranges = total_ranges - erased + new_count;
+		
+		_rebalance(chunk);
+	}
+	else{
+		/* Erase the ranges from the first chunk, any chunks in between and from the
+		 * start of the last chunk.
+		*/
+		
+		_fold_shifts();
+		
+		std::vector<Range> &fc = chunks[chunk].ranges;
+		
+		erased = fc.size() - first.idx;
+		fc.erase((fc.begin() + first.idx), fc.end());
+		
+		if(last.chunk < chunks.size())
+		{
+			std::vector<Range> &lc = chunks[last.chunk].ranges;
+			
+			erased += last.idx;
+			lc.erase(lc.begin(), (lc.begin() + last.idx));
+		}
+		
+		for(size_t i = chunk + 1; i < last.chunk; ++i)
+		{
+			erased += chunks[i].ranges.size();
+		}
+		
+		chunks.erase((chunks.begin() + chunk + 1), (chunks.begin() + last.chunk));
+		
+		insert_new(chunk, fc.size(), new_begin, new_end);
+		
+		total_ranges = total_ranges - erased + new_count;
+		
+		/* What is left of the last chunk may now be small enough to merge into the first
+		 * one, so rebalance it before the first.
+		*/
+		
+		if((chunk + 1) < chunks.size())
+		{
+			_rebalance(chunk + 1);
+		}
+		
+		_rebalance(chunk);
+	}
+}
+
+/* Split the given chunk if it has grown too large, or remove or merge it with a neighbour if
+ * it has become empty or too small.
+*/
+void REHex::ByteRangeSet::_rebalance(size_t chunk)
+{
+	static const size_t CHUNK_MIN = CHUNK_MAX / 4;
+	
+	/* Changing the size of a chunk changes the index of the first range of every chunk after
+	 * it, as does adding or removing chunks.
+	*/
+	chunk_first_idx_valid = std::min(chunk_first_idx_valid, (chunk + 1));
+	
+	size_t size = chunks[chunk].ranges.size();
+	
+	if(size > CHUNK_MAX)
+	{
+		/* Split the chunk into half-full chunks. */
+		
+		_fold_shifts();
+		
+		Chunk &c = chunks[chunk];
+		
+		size_t n_chunks = (size + (CHUNK_MAX / 2) - 1) / (CHUNK_MAX / 2);
+		size_t per_chunk = (size + n_chunks - 1) / n_chunks;
+		
+		std::vector<Chunk> split;
+		
+		for(size_t i = per_chunk; i < size; i += per_chunk)
+		{
+			split.emplace_back((c.ranges.begin() + i), (c.ranges.begin() + std::min((i + per_chunk), size)), c.shift);
+		}
+		
+		c.ranges.erase((c.ranges.begin() + per_chunk), c.ranges.end());
+		
+		chunks.insert((chunks.begin() + chunk + 1),
+			std::make_move_iterator(split.begin()),
+			std::make_move_iterator(split.end()));
+	}
+	else if(size == 0)
+	{
+		_fold_shifts();
+		chunks.erase(chunks.begin() + chunk);
+	}
+	else if(size < CHUNK_MIN)
+	{
+		/* Moves the ranges from one chunk onto the end of another. */
+		auto merge = [](Chunk &dst, const Chunk &src)
+		{
+			for(auto r = src.ranges.begin(); r != src.ranges.end(); ++r)
+			{
+				dst.ranges.push_back(Range((r->offset + src.shift - dst.shift), r->length));
+			}
+		};
+		
+		if((chunk + 1) < chunks.size() && (size + chunks[chunk + 1].ranges.size()) <= CHUNK_MAX)
+		{
+			_fold_shifts();
+			
+			merge(chunks[chunk], chunks[chunk + 1]);
+			chunks.erase(chunks.begin() + chunk + 1);
+		}
+		else if(chunk > 0 && (chunks[chunk - 1].ranges.size() + size) <= CHUNK_MAX)
+		{
+			_fold_shifts();
+			
+			merge(chunks[chunk - 1], chunks[chunk]);
+			chunks.erase(chunks.begin() + chunk);
+			
+			chunk_first_idx_valid = std::min(chunk_first_idx_valid, chunk);
+		}
+	}
+}
+
+/* Add delta to the offset of every range from the given one onwards. Only the ranges in the
+ * first chunk are adjusted directly, the following chunks are given a pending shift.
+*/
+void REHex::ByteRangeSet::_shift_from(const_iterator from, off_t delta)
+{
+	if(from == end())
+	{
+		return;
+	}
+	
+	size_t next_chunk = from.chunk;
+	
+	if(from.idx > 0)
+	{
+		std::vector<Range> &first_chunk = chunks[from.chunk].ranges;
+		
+		for(size_t i = from.idx; i < first_chunk.size(); ++i)
+		{
+			first_chunk[i].offset += delta;
+		}
+		
+		++next_chunk;
+	}
+	
+	if(next_chunk < chunks.size())
+	{
+		_shift_chunks_from(next_chunk, delta);
+	}
+}
+
+void REHex::ByteRangeSet::_update_chunk_first_idx() const
+{
+	if(chunk_first_idx_valid == chunks.size() && chunk_first_idx.size() == chunks.size())
+	{
+		return;
+	}
+	
+	chunk_first_idx.resize(chunks.size());
+	
+	for(size_t i = chunk_first_idx_valid; i < chunks.size(); ++i)
+	{
+		chunk_first_idx[i] = (i == 0)
+			? 0
+			: chunk_first_idx[i - 1] + chunks[i - 1].ranges.size();
+	}
+	
+	chunk_first_idx_valid = chunks.size();
+}
+
+/* Add a range to the end of a set being built by one of the set operations. Ranges MUST be
+ * appended in order of offset, any which overlap or are adjacent to the last range in the set
+ * are merged into it.
+*/
+void REHex::ByteRangeSet::_append(const Range &range)
+{
+	assert(shift_tree.empty());
+	
+	if(range.length <= 0)
+	{
+		return;
+	}
+	
+	if(!chunks.empty())
+	{
+		assert(chunks.back().shift == 0);
+		
+		Range &last = chunks.back().ranges.back();
+		off_t last_end = last.offset + last.length;
+		
+		assert(range.offset >= last.offset);
+		
+		if(range.offset <= last_end)
+		{
+			last.length = std::max(last_end, (range.offset + range.length)) - last.offset;
+			return;
+		}
+	}
+	
+	/* Chunks are only filled to half capacity, as in _assign_sorted(). */
+	
+	if(chunks.empty() || chunks.back().ranges.size() >= (CHUNK_MAX / 2))
+	{
+		chunks.emplace_back();
+	}
+	
+	chunks.back().ranges.push_back(range);
+	++total_ranges;
+	chunk_first_idx_valid = std::min(chunk_first_idx_valid, (chunks.size() - 1));
+}
+
+/* Replace the ranges in this set with those from another set, leaving the other set with the
+ * ranges which were in this one.
+*/
+void REHex::ByteRangeSet::_swap_ranges(ByteRangeSet &other)
+{
+	chunks.swap(other.chunks);
+	std::swap(total_ranges, other.total_ranges);
+	shift_tree.swap(other.shift_tree);
+	
+	chunk_first_idx_valid = 0;
+	other.chunk_first_idx_valid = 0;
+}
@@ -20,17 +20,22 @@
 
 #include <assert.h>
 #include <iterator>
+#include <stddef.h>
 #include <sys/types.h>
 #include <vector>
 
 namespace REHex
 {
 	/**
-	 * @brief Wrapper around std::set for storing ranges in a file.
+	 * @brief Set of ranges in a file.
 	 *
-	 * This class is a wrapper around std::set that can be used for storing ranges. Any ranges
-	 * which are adjacent or overlapping will be merged to reduce memory consumption, so only
-	 * each unique contiguous range added will take space in memory.
+	 * This class can be used for storing ranges. Any ranges which are adjacent or overlapping
+	 * will be merged to reduce memory consumption, so only each unique contiguous range added
+	 * will take space in memory.
+	 *
+	 * The ranges are stored in order in a list of small sorted chunks (a two level B+-tree),
+	 * so setting or clearing a range only moves the other ranges within one chunk rather than
+	 * every range after it, even when the set contains millions of ranges.
 	*/
 	class ByteRangeSet
 	{
@@ -63,17 +68,196 @@ namespace REHex
 				}
 			};
 			
+			/**
+			 * @brief Bidirectional iterator over the Ranges in a ByteRangeSet.
+			 *
+			 * Ranges are returned by value, as their offsets may have pending shifts
+			 * applied (see data_inserted()). Iterators are invalidated by any
+			 * modification of the set.
+			*/
+			class const_iterator
+			{
+				public:
+					typedef std::bidirectional_iterator_tag iterator_category;
+					typedef Range value_type;
+					typedef ptrdiff_t difference_type;
+					typedef const Range* pointer;
+					typedef Range reference;
+					
+					/* Returned by operator->() so members can be accessed from the
+					 * temporary Range.
+					*/
+					struct arrow_proxy
+					{
+						Range range;
+						
+						arrow_proxy(const Range &range):
+							range(range) {}
+						
+						const Range *operator->() const
+						{
+							return &range;
+						}
+					};
+					
+				private:
+					const ByteRangeSet *set;
+					size_t chunk;
+					size_t idx;
+					off_t shift;  /* Shift of the current chunk. */
+					
+					const_iterator(const ByteRangeSet *set, size_t chunk, size_t idx):
+						set(set), chunk(chunk), idx(idx)
+					{
+						load_shift();
+					}
+					
+					void load_shift()
+					{
+						shift = (chunk < set->chunks.size())
+							? set->_chunk_shift(chunk)
+							: 0;
+					}
+					
+				public:
+					const_iterator():
+						set(NULL), chunk(0), idx(0), shift(0) {}
+					
+					Range operator*() const
+					{
+						const Range &range = set->chunks[chunk].ranges[idx];
+						return Range((range.offset + shift), range.length);
+					}
+					
+					arrow_proxy operator->() const
+					{
+						return arrow_proxy(**this);
+					}
+					
+					const_iterator &operator++()
+					{
+						if(++idx == set->chunks[chunk].ranges.size())
+						{
+							++chunk;
+							idx = 0;
+							
+							load_shift();
+						}
+						
+						return *this;
+					}
+					
+					const_iterator operator++(int)
+					{
+						const_iterator old = *this;
+						++(*this);
+						return old;
+					}
+					
+					const_iterator &operator--()
+					{
+						if(idx == 0)
+						{
+							--chunk;
+							idx = set->chunks[chunk].ranges.size();
+							
+							load_shift();
+						}
+						
+						--idx;
+						
+						return *this;
+					}
+					
+					const_iterator operator--(int)
+					{
+						const_iterator old = *this;
+						--(*this);
+						return old;
+					}
+					
+					bool operator==(const const_iterator &rhs) const
+					{
+						return set == rhs.set && chunk == rhs.chunk && idx == rhs.idx;
+					}
+					
+					bool operator!=(const const_iterator &rhs) const
+					{
+						return !(*this == rhs);
+					}
+					
+				friend ByteRangeSet;
+			};
+			
+			/**
+			 * @brief Maximum number of ranges stored in each chunk.
+			*/
+			static const size_t CHUNK_MAX = 512;
+			
 		private:
-			std::vector<Range> ranges;
+			struct Chunk
+			{
+				/* Offsets of ranges in the chunk are relative to the chunk's shift. */
+				std::vector<Range> ranges;
+				off_t shift;
+				
+				Chunk():
+					shift(0) {}
+				
+				template<typename T> Chunk(const T begin, const T end, off_t shift):
+					ranges(begin, end), shift(shift) {}
+			};
+			
+			/* Chunks of ranges, in order. There are never any empty chunks, so an
+			 * empty set has no chunks at all.
+			*/
+			std::vector<Chunk> chunks;
+			size_t total_ranges;
+			
+			/* Shifts which haven't been folded into the chunks yet, as a Fenwick tree
+			 * indexed by chunk, so moving every chunk from one onwards is O(log n).
+			 * The tree is empty when there are no pending shifts, and is folded into
+			 * the chunks before any chunks are added or removed.
+			*/
+			std::vector<off_t> shift_tree;
+			
+			/* Index of the first range in each chunk, used by operator[]. This is
+			 * only valid for the first chunk_first_idx_valid chunks and is brought up
+			 * to date the next time operator[] is called.
+			*/
+			mutable std::vector<size_t> chunk_first_idx;
+			mutable size_t chunk_first_idx_valid;
+			
+			off_t _chunk_shift(size_t chunk) const;
+			void _shift_chunks_from(size_t chunk, off_t delta);
+			void _fold_shifts();
+			
+			const_iterator _lower_bound(const Range &range) const;
+			void _replace(const_iterator first, const_iterator last, const Range *new_begin, const Range *new_end);
+			void _rebalance(size_t chunk);
+			void _shift_from(const_iterator from, off_t delta);
+			void _update_chunk_first_idx() const;
+			
+			template<typename T> void _assign_sorted(const T begin, const T end);
+			
+			void _append(const Range &range);
+			void _swap_ranges(ByteRangeSet &other);
+			
+			/* When the other set in union_with() or subtract() has fewer than
+			 * 1 / MERGE_RATIO as many ranges as this one, its ranges are applied one
+			 * at a time rather than rebuilding the whole set.
+			*/
+			static const size_t MERGE_RATIO = 16;
 			
 		public:
 			/**
 			 * @brief Construct an empty set.
 			*/
-			ByteRangeSet() {}
+			ByteRangeSet():
+				total_ranges(0), chunk_first_idx_valid(0) {}
 			
 			ByteRangeSet(const ByteRangeSet &src):
-				ranges(src.ranges) {}
+				chunks(src.chunks), total_ranges(src.total_ranges), shift_tree(src.shift_tree), chunk_first_idx_valid(0) {}
 			
 			/**
 			 * @brief Construct a set from a sequence of ranges.
@@ -81,7 +265,10 @@ namespace REHex
 			 * NOTE: The ranges MUST be in order and MUST NOT be adjacent.
 			*/
 			template<typename T> ByteRangeSet(const T begin, const T end):
-				ranges(begin, end) {}
+				total_ranges(0), chunk_first_idx_valid(0)
+			{
+				_assign_sorted(begin, end);
+			}
 			
 			/**
 			 * @brief Set a range of bytes in the set.
@@ -96,14 +283,12 @@ namespace REHex
 			 * @brief Set multiple ranges of bytes in the set.
 			 *
 			 * This method takes a pair of Range iterators (or pointers) and adds all
-			 * of the ranges to the set. It is more efficient than calling set_range()
-			 * multiple times.
+			 * of the ranges to the set.
 			 *
 			 * NOTE: The ranges MUST be in order and MUST NOT be adjacent.
 			 *
-			 * If size_hint is provided and the internal vector is near its limit, the
-			 * vector's capacity will be expanded to size_hint elements instead of only
-			 * growing enough to accomodate this operation.
+			 * If size_hint is provided, space for that many ranges will be reserved
+			 * in the chunk list.
 			*/
 			template<typename T> void set_ranges(const T begin, const T end, size_t size_hint = 0);
 			
@@ -120,8 +305,7 @@ namespace REHex
 			 * @brief Clear multiple ranges of bytes in the set.
 			 *
 			 * This method takes a pair of Range iterators (or pointers) and removes
-			 * all of the ranges from the set. It is more efficient than calling
-			 * clear_range() multiple times.
+			 * all of the ranges from the set.
 			 *
 			 * NOTE: The ranges MUST be in order, MUST NOT be adjacent and MUST NOT be
 			 * within the set itself.
@@ -139,24 +323,36 @@ namespace REHex
 			bool isset(off_t offset) const;
 			
 			/**
-			 * @brief Get a reference to the internal std::set.
+			 * @brief Find the first range which intersects the given range.
+			 *
+			 * Returns end() if no ranges in the set intersect it. Any further
+			 * ranges which intersect it follow the returned range.
 			*/
-			const std::vector<Range> &get_ranges() const;
+			const_iterator find_first_in(off_t offset, off_t length) const;
+			
+			/**
+			 * @brief Get a copy of all the ranges in the set, in order.
+			*/
+			std::vector<Range> get_ranges() const;
 			
 			/**
 			 * @brief Returns a const_iterator to the first Range in the set.
 			*/
-			std::vector<Range>::const_iterator begin() const;
+			const_iterator begin() const;
 			
 			/**
 			 * @brief Returns a const_iterator to the end of the set.
 			*/
-			std::vector<Range>::const_iterator end() const;
+			const_iterator end() const;
 			
 			/**
 			 * @brief Access the n-th range in the set.
+			 *
+			 * NOTE: This updates an internal index if the set has been modified
+			 * since the last call, so it MUST NOT be called concurrently with any
+			 * other method, even const ones.
 			*/
-			const Range &operator[](size_t idx) const;
+			Range operator[](size_t idx) const;
 			
 			/**
 			 * @brief Returns the number of ranges in the set.
@@ -173,14 +369,13 @@ namespace REHex
 			 *
 			 * Ranges after the insertion will be moved along by the size of the
 			 * insertion. Ranges spanning the insertion will be split.
+			 *
+			 * Only the ranges in the chunk containing the insertion point are
+			 * moved immediately, a pending shift is recorded for the chunks after
+			 * it, so this is O(log n) regardless of the size of the set.
 			*/
 			void data_inserted(off_t offset, off_t length);
 			
-			/**
-			 * @brief Minimum number of ranges to make data_inserted() use threads.
-			*/
-			static const size_t DATA_INSERTED_THREAD_MIN = 100000;
-			
 			/**
 			 * @brief Adjust for data being erased from file.
 			 *
@@ -190,6 +385,16 @@ namespace REHex
 			*/
 			void data_erased(off_t offset, off_t length);
 			
+			/**
+			 * @brief Adjust for many ranges of data being replaced at once.
+			 *
+			 * Equivalent to erasing old_length bytes and inserting new_length bytes
+			 * at each offset in turn, but performed in a single pass. The offsets
+			 * are relative to the file BEFORE any replacements and MUST be in order
+			 * and MUST NOT overlap. The replacement bytes are not set.
+			*/
+			void data_replaced(const std::vector<off_t> &offsets, off_t old_length, off_t new_length);
+			
 			/**
 			 * @brief Find the intersection of two sets.
 			 *
@@ -197,260 +402,106 @@ namespace REHex
 			 * in BOTH sets.
 			*/
 			static ByteRangeSet intersection(const ByteRangeSet &a, const ByteRangeSet &b);
-	};
-}
-
-template<typename T> void REHex::ByteRangeSet::set_ranges(const T begin, const T end, size_t size_hint)
-{
-	size_t min_size_hint = ranges.size() + std::distance(begin, end);
-	if(ranges.capacity() < min_size_hint)
-	{
-		ranges.reserve(std::max(min_size_hint, size_hint));
-	}
-	
-	auto next = ranges.begin();
-	
-	/* Existing elements which intersect the ones we are inserting are erased and the new ones
-	 * expand to encompass the whole range.
-	 *
-	 * Adjacent erase and insert operations are merged for performance. The group_erase_begin
-	 * and group_erase_end iterators encompass the full range of adjacent elements to be erased
-	 * from sequential inserts and group_ranges contains all adjacent elements to be inserted.
-	*/
-	std::vector<Range>::iterator group_erase_begin;
-	std::vector<Range>::iterator group_erase_end;
-	std::vector<Range> group_ranges;
-	
-	for(auto r = begin; r != end;)
-	{
-		assert(r == begin || (std::prev(r)->offset + std::prev(r)->length) < r->offset);
-		
-		off_t offset = r->offset;
-		off_t length = r->length;
-		
-		/* Find the range of elements that intersects the one we are inserting. They will be erased
-		 * and the one we are creating will grow on either end as necessary to encompass them.
-		*/
-		
-		next = std::lower_bound(next, ranges.end(), Range((offset + length), 0));
-		
-		std::vector<Range>::iterator erase_begin = next;
-		std::vector<Range>::iterator erase_end   = next;
-		
-		while(erase_begin != ranges.begin())
-		{
-			auto eb_prev = std::prev(erase_begin);
 			
-			if((eb_prev->offset + eb_prev->length) >= offset)
-			{
-				off_t merged_begin = std::min(eb_prev->offset, offset);
-				off_t merged_end   = std::max((eb_prev->offset + eb_prev->length), (offset + length));
-				
-				offset = merged_begin;
-				length = merged_end - merged_begin;
-				
-				erase_begin = eb_prev;
-			}
-			else{
-				break;
-			}
-		}
-		
-		if(erase_end != ranges.end() && erase_end->offset == (offset + length))
-		{
-			length += erase_end->length;
-			++erase_end;
-		}
-		
-		assert(length > 0);
-		
-		if(!group_ranges.empty() && erase_begin != group_erase_end)
-		{
-			/* We have elements pending to be inserted earlier in the vector, flush
-			 * them out so we can start a new group.
+			/**
+			 * @brief Find the union of two sets.
+			 *
+			 * Returns a ByteRangeSet containing the ranges of bytes which are set in
+			 * EITHER set. Both sets are walked once, so this is O(n + m).
 			*/
+			static ByteRangeSet set_union(const ByteRangeSet &a, const ByteRangeSet &b);
 			
-			next = ranges.erase(group_erase_begin, group_erase_end);
+			/**
+			 * @brief Find the difference of two sets.
+			 *
+			 * Returns a ByteRangeSet containing the ranges of bytes which are set in
+			 * a, but NOT in b. Both sets are walked once, so this is O(n + m).
+			*/
+			static ByteRangeSet difference(const ByteRangeSet &a, const ByteRangeSet &b);
 			
-			/* Workaround for older GCC/libstd++ which have the wrong return type
-			 * (void) on multi-element std::vector::insert(), even under C++11 mode.
+			/**
+			 * @brief Find the bytes within a range which are NOT set.
 			 *
-			 * Not 100% sure which version actually fixed it.
+			 * Returns a ByteRangeSet containing the ranges of bytes between offset and
+			 * offset + length which aren't set in this set.
 			*/
+			ByteRangeSet complement(off_t offset, off_t length) const;
 			
-			#if defined(__GNUC__) && (__GNUC__ < 4 || (__GNUC__ == 4 && __GNUC_MINOR__ < 9))
-			for(auto i = group_ranges.begin(); i != group_ranges.end(); ++i)
-			{
-				next = ranges.insert(next, *i);
-				++next;
-			}
-			#else
-			next = ranges.insert(next, group_ranges.begin(), group_ranges.end());
-			std::advance(next, group_ranges.size());
-			#endif
+			/**
+			 * @brief Set all the ranges from another set in this set.
+			 *
+			 * Equivalent to replacing this set with set_union(*this, other). If the
+			 * other set is small relative to this one, its ranges are set one at a
+			 * time instead of rebuilding this set.
+			*/
+			void union_with(const ByteRangeSet &other);
 			
-			group_ranges.clear();
+			/**
+			 * @brief Clear any bytes which aren't set in another set.
+			 *
+			 * Equivalent to replacing this set with intersection(*this, other).
+			*/
+			void intersect_with(const ByteRangeSet &other);
 			
-			/* The erase and insert operations have invalidated the erase_begin and
-			 * erase_end iterators, so start processing this Range again.
+			/**
+			 * @brief Clear all the ranges from another set in this set.
+			 *
+			 * Equivalent to replacing this set with difference(*this, other). If the
+			 * other set is small relative to this one, its ranges are cleared one at
+			 * a time instead of rebuilding this set.
 			*/
-			continue;
-		}
-		
-		if(group_ranges.empty())
+			void subtract(const ByteRangeSet &other);
+	};
+}
+
+template<typename T> void REHex::ByteRangeSet::_assign_sorted(const T begin, const T end)
+{
+	chunks.clear();
+	total_ranges = 0;
+	shift_tree.clear();
+	chunk_first_idx_valid = 0;
+	
+	/* Chunks are only filled to half capacity, so ranges can be added later without
+	 * immediately splitting them.
+	*/
+	
+	for(auto r = begin; r != end; ++r)
+	{
+		if(chunks.empty() || chunks.back().ranges.size() >= (CHUNK_MAX / 2))
 		{
-			/* We are starting a new range of insertions, initialize group_erase_begin
-			 * to the erase_begin of this range.
-			*/
-			group_erase_begin = erase_begin;
+			chunks.emplace_back();
 		}
 		
-		/* Advance group_erase_end to the end of this range's erase block. */
-		group_erase_end = erase_end;
-		
-		group_ranges.push_back(Range(offset, length));
-		
-		++r;
+		chunks.back().ranges.push_back(*r);
+		++total_ranges;
+	}
+}
+
+template<typename T> void REHex::ByteRangeSet::set_ranges(const T begin, const T end, size_t size_hint)
+{
+	size_t chunks_hint = size_hint / (CHUNK_MAX / 2);
+	if(chunks.capacity() < chunks_hint)
+	{
+		chunks.reserve(chunks_hint);
 	}
 	
-	if(!group_ranges.empty())
+	for(auto r = begin; r != end; ++r)
 	{
-		/* Flush pending erase/insert operations. */
+		assert(r == begin || (std::prev(r)->offset + std::prev(r)->length) < r->offset);
+		assert(r->length > 0);
 		
-		next = ranges.erase(group_erase_begin, group_erase_end);
-		ranges.insert(next, group_ranges.begin(), group_ranges.end());
+		set_range(r->offset, r->length);
 	}
 }
 
 template<typename T> void REHex::ByteRangeSet::clear_ranges(const T begin, const T end)
 {
-	auto next = ranges.begin();
-	
-	/* Existing elements which intersect the ones we are clearing are erased and any adjacent
-	 * bytes which become cleared as a side effect are re-inserted as new ranges.
-	 *
-	 * Adjacent erase and insert operations are merged for performance. The group_erase_begin
-	 * and group_erase_end iterators encompass the full range of adjacent elements to be erased
-	 * from sequential inserts and group_replacements contains all adjacent ranges to be
-	 * re-inserted at the same position.
-	*/
-	std::vector<Range>::iterator group_erase_begin = ranges.end();
-	std::vector<Range>::iterator group_erase_end   = ranges.end();
-	std::vector<Range> group_replacements;
-	
-	for(auto r = begin; r != end;)
+	for(auto r = begin; r != end; ++r)
 	{
 		assert(r == begin || (std::prev(r)->offset + std::prev(r)->length) < r->offset);
 		
-		off_t offset = r->offset;
-		off_t length = r->length;
-		
-		/* Find the range of elements overlapping the range to be cleared. */
-		
-		next = std::lower_bound(next, ranges.end(), Range((offset + length), 0));
-		
-		std::vector<Range>::iterator erase_begin = next;
-		std::vector<Range>::iterator erase_end   = next;
-		
-		while(erase_begin != ranges.begin())
-		{
-			auto eb_prev = std::prev(erase_begin);
-			
-			if((eb_prev->offset + eb_prev->length) >= offset)
-			{
-				erase_begin = eb_prev;
-			}
-			else{
-				break;
-			}
-		}
-		
-		if(group_erase_begin != group_erase_end)
-		{
-			if(erase_begin != group_erase_end)
-			{
-				/* We have elements pending to be erased/replaced earlier in the
-				 * vector, flush them out so we can start a new group.
-				*/
-				
-				next = ranges.erase(group_erase_begin, group_erase_end);
-				
-				/* Workaround for older GCC/libstd++ which have the wrong return type
-				 * (void) on multi-element std::vector::insert(), even under C++11 mode.
-				 *
-				 * Not 100% sure which version actually fixed it.
-				*/
-				
-				#if defined(__GNUC__) && (__GNUC__ < 4 || (__GNUC__ == 4 && __GNUC_MINOR__ < 9))
-				for(auto i = group_replacements.begin(); i != group_replacements.end(); ++i)
-				{
-					next = ranges.insert(next, *i);
-					++next;
-				}
-				#else
-				next = ranges.insert(next, group_replacements.begin(), group_replacements.end());
-				std::advance(next, group_replacements.size());
-				#endif
-				
-				group_erase_begin = ranges.end();
-				group_erase_end   = ranges.end();
-				group_replacements.clear();
-				
-				/* The erase and insert operations have invalidated the erase_begin
-				 * and erase_end iterators, so start processing this Range again.
-				*/
-				continue;
-			}
-		}
-		else{
-			group_erase_begin = erase_begin;
-		}
-		
-		/* Advance group_erase_end to the end of this range's erase block. */
-		group_erase_end = erase_end;
-		
-		/* If the elements to be erased to not fall fully within the given range, then we shall
-		 * populate group_replacements with up to two elements to re-instate the lost ranges.
-		*/
-		
-		if(erase_begin != erase_end)
-		{
-			if(erase_begin->offset < offset)
-			{
-				/* Clear range is within erase range, so create a new Range from
-				 * the start of the range to be erased up to the start of the range
-				 * to be cleared.
-				*/
-				
-				group_replacements.push_back(Range(erase_begin->offset, (offset - erase_begin->offset)));
-			}
-			
-			auto erase_last = std::prev(erase_end);
-			
-			if((erase_last->offset + erase_last->length) > (offset + length))
-			{
-				/* Clear range falls short of the end of the range to be erased, so
-				 * create a range from the end of the clear range to the end of the
-				 * erase range.
-				*/
-				
-				off_t from = offset + length;
-				off_t to   = erase_last->offset + erase_last->length;
-				
-				assert(to > from);
-				
-				group_replacements.push_back(Range(from, (to - from)));
-			}
-		}
-		
-		++r;
+		clear_range(r->offset, r->length);
 	}
-	
-	
-	/* Flush pending erase/insert operations. */
-	
-	next = ranges.erase(group_erase_begin, group_erase_end);
-	ranges.insert(next, group_replacements.begin(), group_replacements.end());
 }
 
 #endif /* !REHEX_BYTERANGESET_HPP */
@@ -63,7 +63,7 @@ REHex::CommentTree::CommentTree(wxWindow *parent, SharedDocumentPointer &documen
 	sizer->Add(dvc, 1, wxEXPAND);
 	SetSizerAndFit(sizer);
 	
-	this->document.auto_cleanup_bind(EV_COMMENT_MODIFIED, &REHex::CommentTree::OnCommentModified, this);
+	this->document.auto_cleanup_bind(DOCUMENT_CHANGESET, &REHex::CommentTree::OnCommentModified, this);
 	
 	refresh_comments();
 }
@@ -106,9 +106,13 @@ void REHex::CommentTree::refresh_comments()
 	dvc->Refresh();
 }
 
-void REHex::CommentTree::OnCommentModified(wxCommandEvent &event)
+void REHex::CommentTree::OnCommentModified(ChangeSetEvent &event)
 {
-	refresh_comments();
+	if(event.comments_modified)
+	{
+		refresh_comments();
+	}
+	
 	event.Skip();
 }
 
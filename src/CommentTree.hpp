@@ -24,6 +24,7 @@
 
 #include "CodeCtrl.hpp"
 #include "document.hpp"
+#include "Events.hpp"
 #include "SafeWindowPointer.hpp"
 #include "SharedDocumentPointer.hpp"
 #include "ToolPanel.hpp"
@@ -92,7 +93,7 @@ namespace REHex {
 			
 			void refresh_comments();
 			
-			void OnCommentModified(wxCommandEvent &event);
+			void OnCommentModified(ChangeSetEvent &event);
 			
 			void OnContextMenu(wxDataViewEvent &event);
 			
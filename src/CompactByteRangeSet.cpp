@@ -0,0 +1,279 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "platform.hpp"
+
+#include <algorithm>
+#include <assert.h>
+
+#include "CompactByteRangeSet.hpp"
+
+REHex::CompactByteRangeSet::const_iterator::const_iterator():
+	set(NULL), index(0), data_pos(0), range(0, 0) {}
+
+REHex::CompactByteRangeSet::const_iterator::const_iterator(const CompactByteRangeSet *set, size_t block):
+	set(set), index(block * BLOCK_RANGES), data_pos(0), range(0, 0)
+{
+	if(index < set->n_ranges)
+	{
+		data_pos = set->blocks[block].data_pos;
+		decode(0);
+	}
+	else{
+		index = set->n_ranges;
+	}
+}
+
+/* Decode the range at index from data_pos. The first range in each block is stored as just a
+ * length, with its offset in the block index. Any other range is stored as the gap from the end
+ * of the previous range and then its length.
+*/
+void REHex::CompactByteRangeSet::const_iterator::decode(off_t prev_end)
+{
+	if((index % BLOCK_RANGES) == 0)
+	{
+		range.offset = set->blocks[index / BLOCK_RANGES].first_offset;
+	}
+	else{
+		range.offset = prev_end + _get_varint(set->data, &data_pos);
+	}
+	
+	range.length = _get_varint(set->data, &data_pos);
+}
+
+REHex::CompactByteRangeSet::const_iterator &REHex::CompactByteRangeSet::const_iterator::operator++()
+{
+	assert(index < set->n_ranges);
+	
+	if(++index < set->n_ranges)
+	{
+		decode(range.offset + range.length);
+	}
+	
+	return *this;
+}
+
+REHex::CompactByteRangeSet::CompactByteRangeSet():
+	n_ranges(0), pending(0, 0), last_end(0) {}
+
+REHex::CompactByteRangeSet::CompactByteRangeSet(const ByteRangeSet &set):
+	n_ranges(0), pending(0, 0), last_end(0)
+{
+	for(auto r = set.begin(); r != set.end(); ++r)
+	{
+		_append(*r);
+	}
+	
+	_finish();
+}
+
+bool REHex::CompactByteRangeSet::isset(off_t offset) const
+{
+	/* Find the last block beginning at or before the offset. */
+	
+	auto b = std::upper_bound(blocks.begin(), blocks.end(), offset,
+		[](off_t offset, const Block &block)
+		{
+			return offset < block.first_offset;
+		});
+	
+	if(b == blocks.begin())
+	{
+		return false;
+	}
+	
+	--b;
+	
+	/* Decode ranges in the block until we find one which ends after the offset. */
+	
+	const_iterator i(this, (b - blocks.begin()));
+	size_t block_end = std::min((i.index + BLOCK_RANGES), n_ranges);
+	
+	for(; i.index < block_end; ++i)
+	{
+		if((i->offset + i->length) > offset)
+		{
+			return i->offset <= offset;
+		}
+	}
+	
+	return false;
+}
+
+REHex::CompactByteRangeSet::const_iterator REHex::CompactByteRangeSet::begin() const
+{
+	return const_iterator(this, 0);
+}
+
+REHex::CompactByteRangeSet::const_iterator REHex::CompactByteRangeSet::end() const
+{
+	return const_iterator(this, blocks.size());
+}
+
+size_t REHex::CompactByteRangeSet::size() const
+{
+	return n_ranges;
+}
+
+bool REHex::CompactByteRangeSet::empty() const
+{
+	return n_ranges == 0;
+}
+
+size_t REHex::CompactByteRangeSet::encoded_size() const
+{
+	return data.size() + (blocks.size() * sizeof(Block));
+}
+
+REHex::ByteRangeSet REHex::CompactByteRangeSet::to_byte_range_set() const
+{
+	return ByteRangeSet(begin(), end());
+}
+
+bool REHex::CompactByteRangeSet::operator==(const CompactByteRangeSet &rhs) const
+{
+	/* The encoding of a given set of ranges is always the same. */
+	
+	return n_ranges == rhs.n_ranges
+		&& data == rhs.data
+		&& std::equal(blocks.begin(), blocks.end(), rhs.blocks.begin(),
+			[](const Block &a, const Block &b)
+			{
+				return a.first_offset == b.first_offset && a.data_pos == b.data_pos;
+			});
+}
+
+bool REHex::CompactByteRangeSet::operator!=(const CompactByteRangeSet &rhs) const
+{
+	return !(*this == rhs);
+}
+
+REHex::CompactByteRangeSet REHex::CompactByteRangeSet::merge(const CompactByteRangeSet &a, const CompactByteRangeSet &b)
+{
+	CompactByteRangeSet merged;
+	
+	auto ai = a.begin(), a_end = a.end();
+	auto bi = b.begin(), b_end = b.end();
+	
+	/* Feed the ranges from both sets to _append() in order of offset, which will merge any
+	 * which overlap or are adjacent.
+	*/
+	
+	while(ai != a_end || bi != b_end)
+	{
+		if(bi == b_end || (ai != a_end && ai->offset <= bi->offset))
+		{
+			merged._append(*ai);
+			++ai;
+		}
+		else{
+			merged._append(*bi);
+			++bi;
+		}
+	}
+	
+	merged._finish();
+	
+	return merged;
+}
+
+/* Add a range to the end of the set. Ranges MUST be appended in order of offset, any which
+ * overlap or are adjacent to the previous one are merged into it.
+*/
+void REHex::CompactByteRangeSet::_append(const Range &range)
+{
+	if(range.length <= 0)
+	{
+		return;
+	}
+	
+	if(pending.length > 0)
+	{
+		assert(range.offset >= pending.offset);
+		
+		if(range.offset <= (pending.offset + pending.length))
+		{
+			off_t end = std::max((pending.offset + pending.length), (range.offset + range.length));
+			pending.length = end - pending.offset;
+			
+			return;
+		}
+		
+		_finish();
+	}
+	
+	pending = range;
+}
+
+/* Encode the pending range, if any. */
+void REHex::CompactByteRangeSet::_finish()
+{
+	if(pending.length <= 0)
+	{
+		return;
+	}
+	
+	if((n_ranges % BLOCK_RANGES) == 0)
+	{
+		blocks.push_back(Block(pending.offset, data.size()));
+	}
+	else{
+		_put_varint(data, (pending.offset - last_end));
+	}
+	
+	_put_varint(data, pending.length);
+	
+	last_end = pending.offset + pending.length;
+	++n_ranges;
+	
+	pending = Range(0, 0);
+}
+
+/* Variable length integers are stored 7 bits per byte, least significant first, with the top
+ * bit of each byte set if there are more bytes to follow.
+*/
+
+void REHex::CompactByteRangeSet::_put_varint(std::vector<unsigned char> &data, uint64_t value)
+{
+	while(value >= 0x80)
+	{
+		data.push_back((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	
+	data.push_back(value);
+}
+
+uint64_t REHex::CompactByteRangeSet::_get_varint(const std::vector<unsigned char> &data, size_t *pos)
+{
+	uint64_t value = 0;
+	
+	for(unsigned int shift = 0;; shift += 7)
+	{
+		assert(*pos < data.size());
+		
+		unsigned char byte = data[(*pos)++];
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		
+		if((byte & 0x80) == 0)
+		{
+			break;
+		}
+	}
+	
+	return value;
+}
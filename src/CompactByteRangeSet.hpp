@@ -0,0 +1,218 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef REHEX_COMPACTBYTERANGESET_HPP
+#define REHEX_COMPACTBYTERANGESET_HPP
+
+#include <iterator>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+#include "ByteRangeSet.hpp"
+
+namespace REHex
+{
+	/**
+	 * @brief Compact read-only set of ranges in a file.
+	 *
+	 * Stores the same ranges as a ByteRangeSet, but encoded as variable length integers
+	 * rather than two off_t values per range. Each range is stored as the gap from the end of
+	 * the previous range followed by its length, so a typical range only takes a few bytes.
+	 *
+	 * Ranges are encoded in blocks of BLOCK_RANGES ranges, with the offset of the first range
+	 * in each block and where the block begins held in a skip index, so isset() only needs
+	 * to decode a single block.
+	 *
+	 * Intended for large sets which are built once and then only read, such as the copies of
+	 * the dirty bytes kept in the undo history.
+	*/
+	class CompactByteRangeSet
+	{
+		public:
+			typedef ByteRangeSet::Range Range;
+			
+			/**
+			 * @brief Number of ranges encoded in each block.
+			*/
+			static const size_t BLOCK_RANGES = 64;
+			
+			/**
+			 * @brief Forward iterator over the Ranges in a CompactByteRangeSet.
+			 *
+			 * Ranges are decoded as the iterator advances and returned by value.
+			*/
+			class const_iterator
+			{
+				public:
+					typedef std::forward_iterator_tag iterator_category;
+					typedef Range value_type;
+					typedef ptrdiff_t difference_type;
+					typedef const Range* pointer;
+					typedef const Range& reference;
+				
+				private:
+					const CompactByteRangeSet *set;
+					size_t index;     /* Index of the current range in the set. */
+					size_t data_pos;  /* Position of the next range in the encoded data. */
+					Range range;
+					
+					const_iterator(const CompactByteRangeSet *set, size_t block);
+					
+					void decode(off_t prev_end);
+				
+				public:
+					const_iterator();
+					
+					reference operator*() const
+					{
+						return range;
+					}
+					
+					pointer operator->() const
+					{
+						return &range;
+					}
+					
+					const_iterator &operator++();
+					
+					const_iterator operator++(int)
+					{
+						const_iterator old = *this;
+						++(*this);
+						return old;
+					}
+					
+					bool operator==(const const_iterator &rhs) const
+					{
+						return set == rhs.set && index == rhs.index;
+					}
+					
+					bool operator!=(const const_iterator &rhs) const
+					{
+						return !(*this == rhs);
+					}
+				
+				friend CompactByteRangeSet;
+			};
+		
+		private:
+			struct Block
+			{
+				off_t first_offset;  /* Offset of the first range in the block. */
+				size_t data_pos;     /* Position of the block in the encoded data. */
+				
+				Block(off_t first_offset, size_t data_pos):
+					first_offset(first_offset), data_pos(data_pos) {}
+			};
+			
+			std::vector<unsigned char> data;
+			std::vector<Block> blocks;
+			size_t n_ranges;
+			
+			/* Last range passed to _append(), not encoded until the next range is known
+			 * not to be adjacent to it or _finish() is called.
+			*/
+			Range pending;
+			off_t last_end;
+			
+			void _append(const Range &range);
+			void _finish();
+			
+			static void _put_varint(std::vector<unsigned char> &data, uint64_t value);
+			static uint64_t _get_varint(const std::vector<unsigned char> &data, size_t *pos);
+		
+		public:
+			/**
+			 * @brief Construct an empty set.
+			*/
+			CompactByteRangeSet();
+			
+			/**
+			 * @brief Construct a compact copy of a ByteRangeSet.
+			*/
+			explicit CompactByteRangeSet(const ByteRangeSet &set);
+			
+			/**
+			 * @brief Construct a set from a sequence of ranges.
+			 *
+			 * NOTE: The ranges MUST be in order and MUST NOT overlap. Adjacent ranges
+			 * are merged.
+			*/
+			template<typename T> CompactByteRangeSet(const T begin, const T end);
+			
+			/**
+			 * @brief Check if a byte is set in the set.
+			*/
+			bool isset(off_t offset) const;
+			
+			/**
+			 * @brief Returns a const_iterator to the first Range in the set.
+			*/
+			const_iterator begin() const;
+			
+			/**
+			 * @brief Returns a const_iterator to the end of the set.
+			*/
+			const_iterator end() const;
+			
+			/**
+			 * @brief Returns the number of ranges in the set.
+			*/
+			size_t size() const;
+			
+			/**
+			 * @brief Returns true if the set is empty.
+			*/
+			bool empty() const;
+			
+			/**
+			 * @brief Returns the number of bytes used to encode the ranges.
+			*/
+			size_t encoded_size() const;
+			
+			/**
+			 * @brief Expand the set back into a ByteRangeSet.
+			*/
+			ByteRangeSet to_byte_range_set() const;
+			
+			bool operator==(const CompactByteRangeSet &rhs) const;
+			bool operator!=(const CompactByteRangeSet &rhs) const;
+			
+			/**
+			 * @brief Merge two sets.
+			 *
+			 * Returns a set containing the ranges of bytes which are set in EITHER
+			 * set. Both sets are decoded in a single pass.
+			*/
+			static CompactByteRangeSet merge(const CompactByteRangeSet &a, const CompactByteRangeSet &b);
+	};
+}
+
+template<typename T> REHex::CompactByteRangeSet::CompactByteRangeSet(const T begin, const T end):
+	n_ranges(0), pending(0, 0), last_end(0)
+{
+	for(auto r = begin; r != end; ++r)
+	{
+		_append(*r);
+	}
+	
+	_finish();
+}
+
+#endif /* !REHEX_COMPACTBYTERANGESET_HPP */
@@ -800,3 +800,74 @@ REHex::DocumentCtrl::DataRegion::Highlight REHex::DiffWindow::DiffDataRegion::hi
 			true);
 	}
 }
+
+void REHex::DiffWindow::DiffDataRegion::highlight_runs(off_t offset, off_t length, std::vector<HighlightRun> &runs) const
+{
+	const Highlight diff_highlight(
+		Palette::PAL_DIRTY_TEXT_FG,
+		Palette::PAL_DIRTY_TEXT_BG,
+		true);
+	
+	try {
+		std::vector<unsigned char> my_data = range->doc->read_data(offset, length);
+		
+		assert(offset >= range->offset);
+		off_t off_from_range_begin = offset - range->offset;
+		
+		/* Compare the whole window against each other range at once rather than reading
+		 * every document a byte at a time.
+		*/
+		
+		std::vector<bool> differs(my_data.size(), false);
+		
+		const std::list<Range> &ranges = diff_window->get_ranges();
+		
+		for(auto r = ranges.begin(); r != ranges.end(); ++r)
+		{
+			if(&*r == range)
+			{
+				/* This one is me. */
+				continue;
+			}
+			
+			std::vector<unsigned char> their_data;
+			if(off_from_range_begin < r->length)
+			{
+				their_data = r->doc->read_data(r->offset + off_from_range_begin, std::min<off_t>(my_data.size(), (r->length - off_from_range_begin)));
+			}
+			
+			for(size_t i = 0; i < my_data.size(); ++i)
+			{
+				if(i >= their_data.size() || their_data[i] != my_data[i])
+				{
+					differs[i] = true;
+				}
+			}
+		}
+		
+		for(size_t i = 0; i < differs.size();)
+		{
+			if(!differs[i])
+			{
+				++i;
+				continue;
+			}
+			
+			size_t run_begin = i;
+			while(i < differs.size() && differs[i])
+			{
+				++i;
+			}
+			
+			runs.push_back(HighlightRun((offset + run_begin), (i - run_begin), diff_highlight));
+		}
+	}
+	catch(const std::exception &e)
+	{
+		/* Highlight everything if an exception was thrown - most likely a file I/O error. */
+		
+		fprintf(stderr, "Exception in REHex::DiffWindow::DiffDataRegion::highlight_runs: %s\n", e.what());
+		
+		runs.push_back(HighlightRun(offset, length, diff_highlight));
+	}
+}
@@ -90,6 +90,7 @@ namespace REHex {
 				protected:
 					virtual int calc_width(REHex::DocumentCtrl &doc) override;
 					virtual Highlight highlight_at_off(off_t off) const override;
+					virtual void highlight_runs(off_t offset, off_t length, std::vector<HighlightRun> &runs) const override;
 			};
 			
 			wxToolBarToolBase *show_offsets_button;
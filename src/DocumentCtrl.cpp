@@ -2173,8 +2173,26 @@ void REHex::DocumentCtrl::DataRegion::draw(REHex::DocumentCtrl &doc, wxDC &dc, i
 	
 	off_t cursor_pos = doc.get_cursor_position();
 	
+	/* Find the highlighted runs of bytes within the visible data up front and step through
+	 * them as we draw, rather than looking up the highlight of every byte.
+	*/
+	
+	std::vector<HighlightRun> highlights;
+	highlight_runs(cur_off, data.size(), highlights);
+	
+	auto next_highlight = highlights.begin();
+	const Highlight no_highlight = NoHighlight();
+	
+	/* Likewise, we search for each secondary selection match once as we reach it rather
+	 * than comparing the selection against the data at every byte.
+	*/
+	
 	size_t secondary_selection_remain = 0;
 	
+	auto next_secondary_selection = selection_data.empty()
+		? data.end()
+		: std::search(data.begin(), data.end(), selection_data.begin(), selection_data.end());
+	
 	for(auto di = data.begin();;)
 	{
 		alternate_row = !alternate_row;
@@ -2298,18 +2316,31 @@ void REHex::DocumentCtrl::DataRegion::draw(REHex::DocumentCtrl &doc, wxDC &dc, i
 				hex_x = hex_base_x + doc.hf_string_width(++hex_x_char);
 			}
 			
-			if(secondary_selection_remain == 0
-				&& (size_t)(data.end() - di) >= selection_data.size()
-				&& std::equal(selection_data.begin(), selection_data.end(), di))
+			if(secondary_selection_remain == 0 && next_secondary_selection != data.end())
 			{
-				secondary_selection_remain = selection_data.size();
+				if(next_secondary_selection < di)
+				{
+					next_secondary_selection = std::search(di, data.end(), selection_data.begin(), selection_data.end());
+				}
+				
+				if(next_secondary_selection == di)
+				{
+					secondary_selection_remain = selection_data.size();
+				}
 			}
 			
 			unsigned char byte        = *(di++);
 			unsigned char high_nibble = (byte & 0xF0) >> 4;
 			unsigned char low_nibble  = (byte & 0x0F);
 			
-			auto highlight = highlight_at_off(cur_off);
+			while(next_highlight != highlights.end() && (next_highlight->offset + next_highlight->length) <= cur_off)
+			{
+				++next_highlight;
+			}
+			
+			const Highlight &highlight = (next_highlight != highlights.end() && next_highlight->offset <= cur_off)
+				? next_highlight->highlight
+				: no_highlight;
 			
 			auto draw_nibble = [&](unsigned char nibble, bool invert)
 			{
@@ -2727,6 +2758,30 @@ REHex::DocumentCtrl::DataRegion::Highlight REHex::DocumentCtrl::DataRegion::high
 	return NoHighlight();
 }
 
+void REHex::DocumentCtrl::DataRegion::highlight_runs(off_t offset, off_t length, std::vector<HighlightRun> &runs) const
+{
+	for(off_t off = offset; off < (offset + length); ++off)
+	{
+		Highlight highlight = highlight_at_off(off);
+		if(!highlight.enable)
+		{
+			continue;
+		}
+		
+		if(!runs.empty()
+			&& (runs.back().offset + runs.back().length) == off
+			&& runs.back().highlight.fg_colour_idx == highlight.fg_colour_idx
+			&& runs.back().highlight.bg_colour_idx == highlight.bg_colour_idx
+			&& runs.back().highlight.strong == highlight.strong)
+		{
+			++(runs.back().length);
+		}
+		else{
+			runs.push_back(HighlightRun(off, 1, highlight));
+		}
+	}
+}
+
 REHex::DocumentCtrl::DataRegionDocHighlight::DataRegionDocHighlight(off_t d_offset, off_t d_length, Document &doc):
 	DataRegion(d_offset, d_length), doc(doc) {}
 
@@ -2754,6 +2809,56 @@ REHex::DocumentCtrl::DataRegion::Highlight REHex::DocumentCtrl::DataRegionDocHig
 	}
 }
 
+void REHex::DocumentCtrl::DataRegionDocHighlight::highlight_runs(off_t offset, off_t length, std::vector<HighlightRun> &runs) const
+{
+	const NestedOffsetLengthMap<int> &highlights = doc.get_highlights();
+	const ByteRangeSet &dirty_bytes = doc.get_dirty_bytes();
+	
+	off_t end = offset + length;
+	
+	for(off_t pos = offset; pos < end;)
+	{
+		/* The innermost highlight at pos can only change where a highlight begins or
+		 * where the current one ends, so find the next place a highlight begins.
+		*/
+		
+		off_t next_change = end;
+		
+		auto next_highlight = highlights.upper_bound(NestedOffsetLengthMapKey(pos, std::numeric_limits<off_t>::max()));
+		if(next_highlight != highlights.end())
+		{
+			next_change = std::min(next_change, next_highlight->first.offset);
+		}
+		
+		auto highlight = NestedOffsetLengthMap_get(highlights, pos);
+		if(highlight != highlights.end())
+		{
+			next_change = std::min(next_change, (highlight->first.offset + highlight->first.length));
+			
+			runs.push_back(HighlightRun(pos, (next_change - pos), Highlight(
+				active_palette->get_highlight_fg_idx(highlight->second),
+				active_palette->get_highlight_bg_idx(highlight->second),
+				true)));
+		}
+		else{
+			/* Bytes without a highlight are drawn as dirty if they've been modified. */
+			
+			for(auto d = dirty_bytes.find_first_in(pos, (next_change - pos)); d != dirty_bytes.end() && d->offset < next_change; ++d)
+			{
+				off_t d_begin = std::max(d->offset, pos);
+				off_t d_end   = std::min((d->offset + d->length), next_change);
+				
+				runs.push_back(HighlightRun(d_begin, (d_end - d_begin), Highlight(
+					Palette::PAL_DIRTY_TEXT_FG,
+					Palette::PAL_DIRTY_TEXT_BG,
+					true)));
+			}
+		}
+		
+		pos = next_change;
+	}
+}
+
 REHex::DocumentCtrl::CommentRegion::CommentRegion(off_t c_offset, off_t c_length, const wxString &c_text, bool nest_children, bool truncate):
 	c_offset(c_offset), c_length(c_length), c_text(c_text), truncate(truncate)
 {
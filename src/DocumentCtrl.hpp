@@ -24,6 +24,7 @@
 #include <memory>
 #include <stdint.h>
 #include <utility>
+#include <vector>
 #include <wx/dataobj.h>
 #include <wx/wx.h>
 
@@ -106,6 +107,17 @@ namespace REHex {
 						NoHighlight(): Highlight() {}
 					};
 					
+					/* A range of bytes sharing the same (enabled) Highlight. */
+					struct HighlightRun
+					{
+						off_t offset;
+						off_t length;
+						Highlight highlight;
+						
+						HighlightRun(off_t offset, off_t length, const Highlight &highlight):
+							offset(offset), length(length), highlight(highlight) {}
+					};
+					
 				protected:
 					off_t d_offset;
 					off_t d_length;
@@ -136,6 +148,14 @@ namespace REHex {
 					
 					virtual Highlight highlight_at_off(off_t off) const;
 					
+					/* Append the highlighted runs of bytes within the given range to runs, in
+					 * order of offset. Bytes with no highlight are not included.
+					 *
+					 * The default implementation calls highlight_at_off() for each byte,
+					 * subclasses should override it to find the runs in one pass.
+					*/
+					virtual void highlight_runs(off_t offset, off_t length, std::vector<HighlightRun> &runs) const;
+					
 				friend DocumentCtrl;
 			};
 			
@@ -149,6 +169,7 @@ namespace REHex {
 					
 				protected:
 					virtual Highlight highlight_at_off(off_t off) const override;
+					virtual void highlight_runs(off_t offset, off_t length, std::vector<HighlightRun> &runs) const override;
 			};
 			
 			class CommentRegion: public Region
@@ -36,6 +36,8 @@ wxDEFINE_EVENT(REHex::CURSOR_UPDATE,    REHex::CursorUpdateEvent);
 
 wxDEFINE_EVENT(REHex::DOCUMENT_TITLE_CHANGED,  REHex::DocumentTitleEvent);
 
+wxDEFINE_EVENT(REHex::DOCUMENT_CHANGESET,  REHex::ChangeSetEvent);
+
 REHex::OffsetLengthEvent::OffsetLengthEvent(wxWindow *source, wxEventType event, off_t offset, off_t length):
 	wxEvent(source->GetId(), event), offset(offset), length(length)
 {
@@ -98,3 +100,24 @@ wxEvent *REHex::DocumentTitleEvent::Clone() const
 {
 	return new DocumentTitleEvent(*this);
 }
+
+REHex::ChangeSetEvent::ChangeSetEvent(wxObject *source, const ByteRangeSet &data_modified, off_t resized_from, bool comments_modified, bool highlights_modified):
+	wxEvent(wxID_NONE, DOCUMENT_CHANGESET),
+	data_modified(data_modified),
+	resized_from(resized_from),
+	comments_modified(comments_modified),
+	highlights_modified(highlights_modified)
+{
+	m_propagationLevel = wxEVENT_PROPAGATE_MAX;
+	SetEventObject(source);
+}
+
+wxEvent *REHex::ChangeSetEvent::Clone() const
+{
+	return new ChangeSetEvent(*this);
+}
+
+bool REHex::ChangeSetEvent::data_changed() const
+{
+	return !data_modified.empty() || resized_from >= 0;
+}
@@ -76,6 +76,54 @@ namespace REHex
 	#define EVT_DOCUMENTTITLE(id, func) \
 		wx__DECLARE_EVT1(DOCUMENT_TITLE_CHANGED, id, wxEVENT_HANDLER_CAST(DocumentTitleEventFunction, func))
 	
+	/**
+	 * @brief Coalesced summary of changes made to a Document.
+	 *
+	 * The Document accumulates any data, comment and highlight changes made since the
+	 * last DOCUMENT_CHANGESET event and delivers them in a single event once control
+	 * returns to the event loop, so panels which only need to refresh themselves can
+	 * do so once per burst of edits (holding a key, pasting, etc) rather than once per
+	 * edit.
+	 *
+	 * Handlers which must observe each change as it happens (for example, to adjust
+	 * offsets they hold) should bind the individual DATA_* events instead.
+	*/
+	class ChangeSetEvent: public wxEvent
+	{
+		public:
+			/**
+			 * @brief Ranges of bytes which were overwritten or inserted.
+			 *
+			 * Offsets are relative to the document as it is when the event is
+			 * delivered.
+			*/
+			const ByteRangeSet data_modified;
+			
+			/**
+			 * @brief Lowest offset where data was inserted or erased, -1 if none.
+			 *
+			 * Any data from this offset onwards may have moved.
+			*/
+			const off_t resized_from;
+			
+			const bool comments_modified;
+			const bool highlights_modified;
+			
+			ChangeSetEvent(wxObject *source, const ByteRangeSet &data_modified, off_t resized_from, bool comments_modified, bool highlights_modified);
+			
+			virtual wxEvent *Clone() const override;
+			
+			/**
+			 * @brief Returns true if any data was modified, inserted or erased.
+			*/
+			bool data_changed() const;
+	};
+	
+	typedef void (wxEvtHandler::*ChangeSetEventFunction)(ChangeSetEvent&);
+	
+	#define EVT_CHANGESET(id, func) \
+		wx__DECLARE_EVT1(DOCUMENT_CHANGESET, id, wxEVENT_HANDLER_CAST(ChangeSetEventFunction, func))
+	
 	wxDECLARE_EVENT(COMMENT_LEFT_CLICK,     OffsetLengthEvent);
 	wxDECLARE_EVENT(COMMENT_RIGHT_CLICK,    OffsetLengthEvent);
 	wxDECLARE_EVENT(DATA_RIGHT_CLICK,       wxCommandEvent);
@@ -93,6 +141,8 @@ namespace REHex
 	wxDECLARE_EVENT(CURSOR_UPDATE,    CursorUpdateEvent);
 	
 	wxDECLARE_EVENT(DOCUMENT_TITLE_CHANGED,  DocumentTitleEvent);
+	
+	wxDECLARE_EVENT(DOCUMENT_CHANGESET,  ChangeSetEvent);
 }
 
 #endif /* !REHEX_EVENTS_HPP */
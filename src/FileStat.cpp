@@ -0,0 +1,58 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "platform.hpp"
+#include <errno.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "FileStat.hpp"
+
+bool REHex::stat_file(const std::string &filename, off_t *size, int64_t *mtime)
+{
+	#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attrs;
+	if(!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &attrs))
+	{
+		errno = ENOENT;
+		return false;
+	}
+	
+	*size  = ((off_t)(attrs.nFileSizeHigh) << 32) | attrs.nFileSizeLow;
+	*mtime = ((int64_t)(attrs.ftLastWriteTime.dwHighDateTime) << 32) | attrs.ftLastWriteTime.dwLowDateTime;
+	#else
+	struct stat st;
+	if(stat(filename.c_str(), &st) != 0)
+	{
+		return false;
+	}
+	
+	#ifdef __APPLE__
+	const struct timespec &mtim = st.st_mtimespec;
+	#else
+	const struct timespec &mtim = st.st_mtim;
+	#endif
+	
+	*size  = st.st_size;
+	*mtime = (int64_t)(mtim.tv_sec) * 1000000000 + mtim.tv_nsec;
+	#endif
+	
+	return true;
+}
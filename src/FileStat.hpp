@@ -0,0 +1,36 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef REHEX_FILESTAT_HPP
+#define REHEX_FILESTAT_HPP
+
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+
+namespace REHex
+{
+	/* Get the size and modification time of a file, returns false if it can't be found.
+	 *
+	 * The modification time is in the finest units the platform gives us (nanoseconds on
+	 * POSIX, 100ns intervals on Windows), so a change made within a second of an earlier
+	 * call is still noticed. The size is 64-bit on every platform.
+	*/
+	bool stat_file(const std::string &filename, off_t *size, int64_t *mtime);
+}
+
+#endif /* !REHEX_FILESTAT_HPP */
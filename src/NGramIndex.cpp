@@ -0,0 +1,538 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "platform.hpp"
+#include <algorithm>
+#include <assert.h>
+#include <errno.h>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string.h>
+#include <thread>
+
+#include "FileStat.hpp"
+#include "NGramIndex.hpp"
+
+/* The index file begins with a header:
+ *
+ *   char[8]  magic ("REHEXNGI")
+ *   uint32_t version
+ *   uint32_t n-gram length
+ *   uint32_t sample stride
+ *   uint32_t number of buckets
+ *   uint64_t segment size
+ *   uint64_t size of the indexed file
+ *   int64_t  modification time of the indexed file (see REHex::stat_file())
+ *
+ * Followed by each segment in turn, each one being (buckets + 1) uint32_t indices into the
+ * segment's entries where the posting list of each bucket begins (the last one being the
+ * number of entries), then the entries themselves, each one being the uint32_t offset within
+ * the segment of an n-gram, in ascending order within each bucket.
+ *
+ * All integers are little endian.
+*/
+
+static const char MAGIC[8] = { 'R', 'E', 'H', 'E', 'X', 'N', 'G', 'I' };
+static const uint32_t VERSION = 2;
+
+static const off_t HEADER_SIZE = 48;
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static void put_u64(unsigned char *p, uint64_t v)
+{
+	put_u32(p, v);
+	put_u32((p + 4), (v >> 32));
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+	return (uint32_t)(p[0]) | ((uint32_t)(p[1]) << 8) | ((uint32_t)(p[2]) << 16) | ((uint32_t)(p[3]) << 24);
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+	return (uint64_t)(get_u32(p)) | ((uint64_t)(get_u32(p + 4)) << 32);
+}
+
+REHex::NGramIndex::Builder::Builder(const std::string &filename, unsigned sample_stride):
+	filename(filename),
+	tmp_filename(index_filename(filename) + ".tmp"),
+	sample_stride(sample_stride),
+	out(NULL),
+	next_segment(0),
+	segments_done(0),
+	cancelled(false),
+	pool(std::max((std::thread::hardware_concurrency() / 2), 1U))
+{
+	if(sample_stride == 0 || (sample_stride & (sample_stride - 1)) != 0 || (off_t)(sample_stride) > SEGMENT_SIZE)
+	{
+		throw std::invalid_argument("Sample stride must be a power of two no larger than the segment size");
+	}
+	
+	if(!stat_file(filename, &file_size, &file_mtime))
+	{
+		throw std::runtime_error(std::string("Could not stat file: ") + strerror(errno));
+	}
+	
+	segment_offsets = layout(file_size, sample_stride);
+	
+	out = fopen(tmp_filename.c_str(), "wb");
+	if(out == NULL)
+	{
+		throw std::runtime_error(std::string("Could not open file: ") + strerror(errno));
+	}
+	
+	unsigned char header[HEADER_SIZE];
+	
+	memcpy(header, MAGIC, sizeof(MAGIC));
+	put_u32((header + 8),  VERSION);
+	put_u32((header + 12), NGRAM_LENGTH);
+	put_u32((header + 16), sample_stride);
+	put_u32((header + 20), BUCKETS);
+	put_u64((header + 24), SEGMENT_SIZE);
+	put_u64((header + 32), file_size);
+	put_u64((header + 40), file_mtime);
+	
+	if(fwrite(header, sizeof(header), 1, out) != 1)
+	{
+		int err = errno;
+		
+		fclose(out);
+		remove(tmp_filename.c_str());
+		
+		throw std::runtime_error(std::string("Write error: ") + strerror(err));
+	}
+	
+	job = pool.submit(std::bind(&REHex::NGramIndex::Builder::thread_main, this));
+}
+
+REHex::NGramIndex::Builder::~Builder()
+{
+	if(out != NULL)
+	{
+		cancel();
+		job->wait();
+		
+		fclose(out);
+		remove(tmp_filename.c_str());
+	}
+}
+
+double REHex::NGramIndex::Builder::progress() const
+{
+	size_t n_segments = segment_offsets.size() - 1;
+	return n_segments > 0 ? ((double)(segments_done) / n_segments) : 1.0;
+}
+
+bool REHex::NGramIndex::Builder::finished()
+{
+	return job->finished();
+}
+
+void REHex::NGramIndex::Builder::cancel()
+{
+	cancelled = true;
+	job->cancel();
+}
+
+bool REHex::NGramIndex::Builder::finish()
+{
+	assert(out != NULL);
+	
+	job->wait();
+	
+	bool closed = fclose(out) == 0;
+	int close_err = errno;
+	
+	out = NULL;
+	
+	if(!error.empty() || cancelled || !closed)
+	{
+		remove(tmp_filename.c_str());
+		
+		if(!error.empty())
+		{
+			throw std::runtime_error(error);
+		}
+		else if(!closed)
+		{
+			throw std::runtime_error(std::string("Write error: ") + strerror(close_err));
+		}
+		
+		return false;
+	}
+	
+	/* Windows won't rename over an existing file. */
+	std::string final_filename = index_filename(filename);
+	remove(final_filename.c_str());
+	
+	if(rename(tmp_filename.c_str(), final_filename.c_str()) != 0)
+	{
+		int err = errno;
+		remove(tmp_filename.c_str());
+		
+		throw std::runtime_error(std::string("Could not rename index file: ") + strerror(err));
+	}
+	
+	return true;
+}
+
+void REHex::NGramIndex::Builder::thread_main()
+{
+	size_t n_segments = segment_offsets.size() - 1;
+	
+	FILE *in = fopen(filename.c_str(), "rb");
+	if(in == NULL)
+	{
+		std::unique_lock<std::mutex> l(error_lock);
+		error = std::string("Could not open file: ") + strerror(errno);
+		
+		cancelled = true;
+		return;
+	}
+	
+	std::vector<unsigned char> data;
+	std::vector<uint32_t> buckets;
+	std::vector<uint32_t> starts;
+	std::vector<unsigned char> segment;
+	
+	while(!cancelled)
+	{
+		size_t seg = next_segment++;
+		if(seg >= n_segments)
+		{
+			break;
+		}
+		
+		off_t seg_base = (off_t)(seg) * SEGMENT_SIZE;
+		size_t n_entries = segment_entries(file_size, sample_stride, seg);
+		
+		/* Read the segment, plus enough to complete the n-gram at its last sample. */
+		
+		data.resize(std::min((off_t)(SEGMENT_SIZE + NGRAM_LENGTH - 1), (file_size - seg_base)));
+		
+		if(fseeko(in, seg_base, SEEK_SET) != 0 || fread(data.data(), 1, data.size(), in) != data.size())
+		{
+			std::unique_lock<std::mutex> l(error_lock);
+			error = std::string("Read error: ") + (ferror(in) ? strerror(errno) : "File was truncated");
+			
+			cancelled = true;
+			break;
+		}
+		
+		/* Sort the samples into their buckets, keeping them in ascending order. */
+		
+		buckets.resize(n_entries);
+		starts.assign((BUCKETS + 1), 0);
+		
+		for(size_t i = 0; i < n_entries; ++i)
+		{
+			buckets[i] = bucket(data.data() + (i * sample_stride));
+			++(starts[buckets[i] + 1]);
+		}
+		
+		for(unsigned b = 0; b < BUCKETS; ++b)
+		{
+			starts[b + 1] += starts[b];
+		}
+		
+		segment.resize((size_t)(segment_offsets[seg + 1] - segment_offsets[seg]));
+		
+		for(unsigned b = 0; b <= BUCKETS; ++b)
+		{
+			put_u32((segment.data() + (b * 4)), starts[b]);
+		}
+		
+		unsigned char *entries = segment.data() + ((BUCKETS + 1) * 4);
+		
+		for(size_t i = 0; i < n_entries; ++i)
+		{
+			put_u32((entries + (starts[buckets[i]]++ * 4)), (i * sample_stride));
+		}
+		
+		{
+			std::unique_lock<std::mutex> l(out_lock);
+			
+			if(fseeko(out, segment_offsets[seg], SEEK_SET) != 0 || fwrite(segment.data(), segment.size(), 1, out) != 1)
+			{
+				std::unique_lock<std::mutex> l(error_lock);
+				error = std::string("Write error: ") + strerror(errno);
+				
+				cancelled = true;
+				break;
+			}
+		}
+		
+		++segments_done;
+	}
+	
+	fclose(in);
+}
+
+REHex::NGramIndex::NGramIndex(FILE *fh, unsigned sample_stride, off_t file_size):
+	fh(fh),
+	sample_stride(sample_stride),
+	file_size(file_size),
+	segment_offsets(layout(file_size, sample_stride)) {}
+
+REHex::NGramIndex::~NGramIndex()
+{
+	fclose(fh);
+}
+
+std::shared_ptr<REHex::NGramIndex> REHex::NGramIndex::open(const std::string &filename)
+{
+	off_t file_size;
+	int64_t file_mtime;
+	
+	if(!stat_file(filename, &file_size, &file_mtime))
+	{
+		return NULL;
+	}
+	
+	FILE *fh = fopen(index_filename(filename).c_str(), "rb");
+	if(fh == NULL)
+	{
+		return NULL;
+	}
+	
+	unsigned char header[HEADER_SIZE];
+	
+	if(fread(header, sizeof(header), 1, fh) != 1
+		|| memcmp(header, MAGIC, sizeof(MAGIC)) != 0
+		|| get_u32(header + 8)  != VERSION
+		|| get_u32(header + 12) != NGRAM_LENGTH
+		|| get_u32(header + 20) != BUCKETS
+		|| get_u64(header + 24) != (uint64_t)(SEGMENT_SIZE)
+		|| get_u64(header + 32) != (uint64_t)(file_size)
+		|| (int64_t)(get_u64(header + 40)) != file_mtime)
+	{
+		fclose(fh);
+		return NULL;
+	}
+	
+	uint32_t sample_stride = get_u32(header + 16);
+	
+	if(sample_stride == 0 || (sample_stride & (sample_stride - 1)) != 0 || (off_t)(sample_stride) > SEGMENT_SIZE)
+	{
+		fclose(fh);
+		return NULL;
+	}
+	
+	/* Check the index is complete. */
+	
+	if(fseeko(fh, 0, SEEK_END) != 0 || ftello(fh) != layout(file_size, sample_stride).back())
+	{
+		fclose(fh);
+		return NULL;
+	}
+	
+	return std::shared_ptr<NGramIndex>(new NGramIndex(fh, sample_stride, file_size));
+}
+
+std::string REHex::NGramIndex::index_filename(const std::string &filename)
+{
+	return filename + ".rehex-index";
+}
+
+size_t REHex::NGramIndex::min_pattern_length() const
+{
+	return NGRAM_LENGTH + sample_stride - 1;
+}
+
+bool REHex::NGramIndex::find(const std::vector< std::vector<unsigned char> > &patterns, off_t begin, off_t end, std::vector<off_t> &candidates)
+{
+	candidates.clear();
+	
+	for(auto p = patterns.begin(); p != patterns.end(); ++p)
+	{
+		if(p->size() < min_pattern_length())
+		{
+			return false;
+		}
+	}
+	
+	end = std::min(end, file_size);
+	if(begin >= end)
+	{
+		return true;
+	}
+	
+	std::vector<off_t> matching, positions, both;
+	
+	for(auto p = patterns.begin(); p != patterns.end(); ++p)
+	{
+		/* Any match begins sample_stride - skip bytes before a sample, so the n-grams at
+		 * skip, skip + sample_stride, etc within the pattern are all indexed.
+		*/
+		
+		for(size_t skip = 0; skip < sample_stride; ++skip)
+		{
+			matching.clear();
+			
+			for(size_t at = skip; (at + NGRAM_LENGTH) <= p->size(); at += sample_stride)
+			{
+				positions.clear();
+				
+				if(!read_postings(bucket(p->data() + at), (begin + at), (end + at), at, positions))
+				{
+					return false;
+				}
+				
+				if(at == skip)
+				{
+					matching.swap(positions);
+				}
+				else{
+					both.clear();
+					std::set_intersection(matching.begin(), matching.end(), positions.begin(), positions.end(), std::back_inserter(both));
+					matching.swap(both);
+				}
+				
+				if(matching.empty())
+				{
+					break;
+				}
+			}
+			
+			candidates.insert(candidates.end(), matching.begin(), matching.end());
+			
+			if(candidates.size() > MAX_CANDIDATES)
+			{
+				candidates.clear();
+				return false;
+			}
+		}
+	}
+	
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+	
+	return true;
+}
+
+unsigned REHex::NGramIndex::bucket(const unsigned char *ngram)
+{
+	return (get_u32(ngram) * (uint32_t)(2654435761U)) >> (32 - BUCKET_BITS);
+}
+
+/* Read the positions from begin up to (but not including) end in the posting list of a bucket,
+ * each one less shift.
+ *
+ * Returns false if the list is too long to be worth reading, or can't be read.
+*/
+bool REHex::NGramIndex::read_postings(unsigned bucket, off_t begin, off_t end, off_t shift, std::vector<off_t> &positions)
+{
+	size_t n_segments = segment_offsets.size() - 1;
+	
+	std::vector<unsigned char> buf;
+	
+	for(size_t seg = begin / SEGMENT_SIZE; seg < n_segments && (off_t)(seg) * SEGMENT_SIZE < end; ++seg)
+	{
+		off_t seg_base = (off_t)(seg) * SEGMENT_SIZE;
+		
+		std::unique_lock<std::mutex> l(fh_lock);
+		
+		unsigned char range[8];
+		
+		if(fseeko(fh, (segment_offsets[seg] + (bucket * 4)), SEEK_SET) != 0 || fread(range, sizeof(range), 1, fh) != 1)
+		{
+			return false;
+		}
+		
+		uint32_t first = get_u32(range), last = get_u32(range + 4);
+		
+		if(last < first)
+		{
+			return false;
+		}
+		else if((last - first) > MAX_CANDIDATES)
+		{
+			/* The n-gram is too common here to narrow anything down. */
+			return false;
+		}
+		else if(last == first)
+		{
+			continue;
+		}
+		
+		buf.resize((size_t)(last - first) * 4);
+		
+		if(fseeko(fh, (segment_offsets[seg] + ((BUCKETS + 1) * 4) + (first * 4)), SEEK_SET) != 0 || fread(buf.data(), buf.size(), 1, fh) != 1)
+		{
+			return false;
+		}
+		
+		l.unlock();
+		
+		for(size_t i = 0; i < buf.size(); i += 4)
+		{
+			off_t pos = seg_base + get_u32(buf.data() + i);
+			
+			if(pos >= begin && pos < end)
+			{
+				positions.push_back(pos - shift);
+			}
+		}
+	}
+	
+	return true;
+}
+
+/* Offset of each segment within the index file, followed by the length of the file. */
+std::vector<off_t> REHex::NGramIndex::layout(off_t file_size, unsigned sample_stride)
+{
+	size_t n_segments = (file_size + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+	
+	std::vector<off_t> offsets;
+	offsets.reserve(n_segments + 1);
+	
+	offsets.push_back(HEADER_SIZE);
+	
+	for(size_t seg = 0; seg < n_segments; ++seg)
+	{
+		offsets.push_back(offsets.back() + ((BUCKETS + 1) * 4) + ((off_t)(segment_entries(file_size, sample_stride, seg)) * 4));
+	}
+	
+	return offsets;
+}
+
+/* Number of samples in a segment, one at each multiple of sample_stride where a whole n-gram
+ * begins.
+*/
+size_t REHex::NGramIndex::segment_entries(off_t file_size, unsigned sample_stride, size_t segment)
+{
+	off_t seg_base = (off_t)(segment) * SEGMENT_SIZE;
+	off_t last = file_size - NGRAM_LENGTH;  /* Last offset an n-gram begins at. */
+	
+	if(last < seg_base)
+	{
+		return 0;
+	}
+	
+	off_t seg_last = std::min(last, (off_t)(seg_base + SEGMENT_SIZE - 1));
+	
+	return ((seg_last - seg_base) / sample_stride) + 1;
+}
@@ -0,0 +1,166 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef REHEX_NGRAMINDEX_HPP
+#define REHEX_NGRAMINDEX_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+namespace REHex {
+	/* On-disk index of where n-grams occur in a file, used to find the few places a byte
+	 * sequence might be without reading the whole file.
+	 *
+	 * Only the n-grams which begin at a multiple of the sample stride are indexed, so any
+	 * occurrence of a sequence of at least (NGRAM_LENGTH + sample stride - 1) bytes has an
+	 * indexed n-gram at one of its first sample stride offsets, and the positions in the
+	 * posting lists of the n-grams at that offset (and every sample stride after it) give
+	 * every place it can begin.
+	 *
+	 * The file is divided into segments of SEGMENT_SIZE bytes, each with its own posting
+	 * lists, so segments can be built in parallel and searched without reading the rest of
+	 * the index. N-grams are hashed into BUCKETS posting lists per segment, so candidates
+	 * must still be checked against the file.
+	 *
+	 * The index is stored alongside the file, and records the size and modification time of
+	 * the file it was built from, so it isn't used once the file has changed.
+	*/
+	
+	class NGramIndex
+	{
+		public:
+			static const unsigned NGRAM_LENGTH = 4;
+			static const unsigned BUCKET_BITS = 14;
+			static const unsigned BUCKETS = (1U << BUCKET_BITS);
+			static const off_t SEGMENT_SIZE = 16 * 1024 * 1024;
+			
+			static const unsigned DEFAULT_SAMPLE_STRIDE = 16;
+			
+			/* Give up and let the caller search the data itself once a search turns up
+			 * more candidates than this.
+			*/
+			static const size_t MAX_CANDIDATES = 65536;
+			
+			class Builder
+			{
+				public:
+					/* Begin building the index for filename in the background.
+					 *
+					 * The build runs on its own pool, with half as many workers as
+					 * there are CPU cores, so searches on the shared pool aren't
+					 * queued behind it and still have cores to run on.
+					*/
+					Builder(const std::string &filename, unsigned sample_stride = DEFAULT_SAMPLE_STRIDE);
+					~Builder();
+					
+					/* Fraction of the file indexed so far, from 0.0 to 1.0. */
+					double progress() const;
+					
+					bool finished();
+					void cancel();
+					
+					/* Wait for the index to be built and put it in place.
+					 *
+					 * Returns false if the build was cancelled, throws a
+					 * std::runtime_error if it failed.
+					*/
+					bool finish();
+				
+				private:
+					std::string filename;
+					std::string tmp_filename;
+					
+					unsigned sample_stride;
+					off_t file_size;
+					int64_t file_mtime;
+					
+					std::vector<off_t> segment_offsets;
+					
+					FILE *out;
+					std::mutex out_lock;
+					
+					std::atomic<size_t> next_segment;
+					std::atomic<size_t> segments_done;
+					std::atomic<bool> cancelled;
+					
+					std::mutex error_lock;
+					std::string error;
+					
+					ThreadPool pool;
+					std::shared_ptr<ThreadPool::Job> job;
+					
+					void thread_main();
+					
+					/* Prevent copying. */
+					Builder(const Builder&) = delete;
+					Builder &operator=(const Builder&) = delete;
+			};
+			
+			~NGramIndex();
+			
+			/* Open the index for filename, returns NULL if there isn't one or it was
+			 * built from a different version of the file.
+			*/
+			static std::shared_ptr<NGramIndex> open(const std::string &filename);
+			
+			static std::string index_filename(const std::string &filename);
+			
+			/* Shortest sequence which can be found using the index. */
+			size_t min_pattern_length() const;
+			
+			/* Find every position from begin up to (but not including) end where one of
+			 * the patterns might begin, in ascending order.
+			 *
+			 * Returns false if the index can't narrow the search down (a pattern is
+			 * too short or there are too many candidates), in which case the caller
+			 * must search the data itself. Thread safe.
+			*/
+			bool find(const std::vector< std::vector<unsigned char> > &patterns, off_t begin, off_t end, std::vector<off_t> &candidates);
+			
+			static unsigned bucket(const unsigned char *ngram);
+		
+		private:
+			FILE *fh;
+			std::mutex fh_lock;
+			
+			unsigned sample_stride;
+			off_t file_size;
+			
+			std::vector<off_t> segment_offsets;
+			
+			NGramIndex(FILE *fh, unsigned sample_stride, off_t file_size);
+			
+			bool read_postings(unsigned bucket, off_t begin, off_t end, off_t shift, std::vector<off_t> &positions);
+			
+			static std::vector<off_t> layout(off_t file_size, unsigned sample_stride);
+			static size_t segment_entries(off_t file_size, unsigned sample_stride, size_t segment);
+			
+			/* Prevent copying. */
+			NGramIndex(const NGramIndex&) = delete;
+			NGramIndex &operator=(const NGramIndex&) = delete;
+	};
+}
+
+#endif /* !REHEX_NGRAMINDEX_HPP */
@@ -26,11 +26,16 @@
 #ifndef REHEX_NESTEDOFFSETLENGTHMAP_HPP
 #define REHEX_NESTEDOFFSETLENGTHMAP_HPP
 
+#include <algorithm>
 #include <iterator>
 #include <limits>
 #include <list>
-#include <map>
+#include <set>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <utility>
+#include <vector>
 
 namespace REHex {
 	struct NestedOffsetLengthMapKey
@@ -58,7 +63,1048 @@ namespace REHex {
 		}
 	};
 	
-	template<typename T> using NestedOffsetLengthMap = std::map<NestedOffsetLengthMapKey, T>;
+	/* Ordered map of NestedOffsetLengthMapKey to T, providing the parts of the std::map
+	 * interface used throughout rehex.
+	 *
+	 * The map is stored as a treap (a binary search tree balanced by random node priorities)
+	 * where each node also records the greatest end offset of any key in its subtree. That
+	 * lets the functions below find the keys which span an offset in O(log n) time rather
+	 * than walking back over every key which begins before it.
+	 *
+	 * Nodes can also hold an offset shift which is still to be applied to the keys below
+	 * them, so moving every key after a point in the file is done in O(log n) time and the
+	 * shift is pushed down the tree as it is searched. Because of this, even const access
+	 * may update the tree, so a map must not be accessed from multiple threads at once, even
+	 * if every thread only calls const methods.
+	 *
+	 * As with std::map, iterators remain valid until the element they point to is erased,
+	 * except data_inserted() and data_erased() invalidate all iterators.
+	*/
+	template<typename T> class NestedOffsetLengthMap
+	{
+		public:
+			typedef NestedOffsetLengthMapKey key_type;
+			typedef T mapped_type;
+			typedef size_t size_type;
+			
+			/* Element of the map, used like the std::pair in a std::map.
+			 *
+			 * The map moves keys in place (without changing their order) as data is
+			 * inserted or erased, so the key is stored here and only exposed through the
+			 * const reference in first, rather than being a const member which the map
+			 * would have to cast away.
+			*/
+			class value_type
+			{
+				private:
+					NestedOffsetLengthMapKey key;
+					
+				public:
+					const NestedOffsetLengthMapKey &first;
+					T second;
+					
+					template<typename... Args> value_type(const NestedOffsetLengthMapKey &key, Args&&... args):
+						key(key), first(this->key), second(std::forward<Args>(args)...) {}
+					
+					template<typename K, typename U> value_type(const std::pair<K, U> &pair):
+						key(pair.first), first(key), second(pair.second) {}
+					
+					template<typename K, typename U> value_type(std::pair<K, U> &&pair):
+						key(pair.first), first(key), second(std::move(pair.second)) {}
+					
+					value_type(const value_type &src):
+						key(src.key), first(key), second(src.second) {}
+					
+					value_type(value_type &&src):
+						key(src.key), first(key), second(std::move(src.second)) {}
+					
+					value_type &operator=(const value_type &rhs)
+					{
+						key    = rhs.key;
+						second = rhs.second;
+						
+						return *this;
+					}
+					
+					value_type &operator=(value_type &&rhs)
+					{
+						key    = rhs.key;
+						second = std::move(rhs.second);
+						
+						return *this;
+					}
+					
+					bool operator==(const value_type &rhs) const
+					{
+						return key == rhs.key && second == rhs.second;
+					}
+					
+					bool operator!=(const value_type &rhs) const
+					{
+						return !(*this == rhs);
+					}
+				
+				friend NestedOffsetLengthMap;
+			};
+		
+		private:
+			struct Node
+			{
+				value_type value;
+				
+				Node *parent;
+				Node *left;
+				Node *right;
+				
+				uint32_t priority;
+				
+				/* Greatest (offset + length) of any key in this subtree. */
+				off_t max_end;
+				
+				/* Number of keys in this subtree. */
+				size_t count;
+				
+				/* Offset to be added to every key below this node. */
+				off_t shift;
+				
+				template<typename... Args> Node(uint32_t priority, Args&&... args):
+					value(std::forward<Args>(args)...),
+					parent(NULL), left(NULL), right(NULL),
+					priority(priority),
+					max_end(value.first.offset + value.first.length),
+					count(1),
+					shift(0) {}
+			};
+			
+			Node *root;
+			size_t n_nodes;
+			uint32_t next_priority;
+		
+		public:
+			template<typename VT, typename MT> class base_iterator
+			{
+				public:
+					typedef std::bidirectional_iterator_tag iterator_category;
+					typedef NestedOffsetLengthMap<T>::value_type value_type;
+					typedef ptrdiff_t difference_type;
+					typedef VT* pointer;
+					typedef VT& reference;
+				
+				private:
+					MT *map;
+					Node *node;
+					
+					base_iterator(MT *map, Node *node):
+						map(map), node(node) {}
+				
+				public:
+					base_iterator():
+						map(NULL), node(NULL) {}
+					
+					/* Copy constructor for iterator, conversion from iterator for
+					 * const_iterator.
+					*/
+					base_iterator(const base_iterator<typename NestedOffsetLengthMap<T>::value_type, NestedOffsetLengthMap<T>> &src):
+						map(src.map), node(src.node) {}
+					
+					reference operator*() const
+					{
+						return node->value;
+					}
+					
+					pointer operator->() const
+					{
+						return &(node->value);
+					}
+					
+					base_iterator &operator++()
+					{
+						node = _next(node);
+						return *this;
+					}
+					
+					base_iterator operator++(int)
+					{
+						base_iterator old = *this;
+						node = _next(node);
+						return old;
+					}
+					
+					base_iterator &operator--()
+					{
+						node = node != NULL ? _prev(node) : _last(map->root);
+						return *this;
+					}
+					
+					base_iterator operator--(int)
+					{
+						base_iterator old = *this;
+						--(*this);
+						return old;
+					}
+					
+					friend bool operator==(const base_iterator &lhs, const base_iterator &rhs)
+					{
+						return lhs.node == rhs.node;
+					}
+					
+					friend bool operator!=(const base_iterator &lhs, const base_iterator &rhs)
+					{
+						return lhs.node != rhs.node;
+					}
+				
+				friend NestedOffsetLengthMap;
+				template<typename VT2, typename MT2> friend class base_iterator;
+			};
+			
+			typedef base_iterator<value_type, NestedOffsetLengthMap<T>> iterator;
+			typedef base_iterator<const value_type, const NestedOffsetLengthMap<T>> const_iterator;
+			
+			NestedOffsetLengthMap():
+				root(NULL), n_nodes(0), next_priority(2463534242U) {}
+			
+			NestedOffsetLengthMap(const NestedOffsetLengthMap &src):
+				root(_clone(src.root, NULL)), n_nodes(src.n_nodes), next_priority(src.next_priority) {}
+			
+			NestedOffsetLengthMap(NestedOffsetLengthMap &&src):
+				root(src.root), n_nodes(src.n_nodes), next_priority(src.next_priority)
+			{
+				src.root = NULL;
+				src.n_nodes = 0;
+			}
+			
+			~NestedOffsetLengthMap()
+			{
+				_destroy(root);
+			}
+			
+			NestedOffsetLengthMap &operator=(const NestedOffsetLengthMap &rhs)
+			{
+				if(&rhs != this)
+				{
+					NestedOffsetLengthMap copy(rhs);
+					swap(copy);
+				}
+				
+				return *this;
+			}
+			
+			NestedOffsetLengthMap &operator=(NestedOffsetLengthMap &&rhs)
+			{
+				NestedOffsetLengthMap moved(std::move(rhs));
+				swap(moved);
+				
+				return *this;
+			}
+			
+			bool operator==(const NestedOffsetLengthMap &rhs) const
+			{
+				return size() == rhs.size() && std::equal(begin(), end(), rhs.begin());
+			}
+			
+			bool operator!=(const NestedOffsetLengthMap &rhs) const
+			{
+				return !(*this == rhs);
+			}
+			
+			iterator begin()              { return iterator(this, _first(root)); }
+			const_iterator begin() const  { return const_iterator(this, _first(root)); }
+			const_iterator cbegin() const { return begin(); }
+			
+			iterator end()              { return iterator(this, NULL); }
+			const_iterator end() const  { return const_iterator(this, NULL); }
+			const_iterator cend() const { return end(); }
+			
+			size_t size() const { return n_nodes; }
+			bool empty() const  { return n_nodes == 0; }
+			
+			void clear()
+			{
+				_destroy(root);
+				
+				root = NULL;
+				n_nodes = 0;
+			}
+			
+			void swap(NestedOffsetLengthMap &other)
+			{
+				std::swap(root, other.root);
+				std::swap(n_nodes, other.n_nodes);
+				std::swap(next_priority, other.next_priority);
+			}
+			
+			/* The const lookup methods below (like begin() and moving iterators) push
+			 * pending shifts down the tree as they go, so they must not be called on
+			 * the same map from more than one thread at a time.
+			*/
+			
+			iterator find(const NestedOffsetLengthMapKey &key)             { return iterator(this, _find(key)); }
+			const_iterator find(const NestedOffsetLengthMapKey &key) const { return const_iterator(this, _find(key)); }
+			
+			size_t count(const NestedOffsetLengthMapKey &key) const
+			{
+				return _find(key) != NULL;
+			}
+			
+			iterator lower_bound(const NestedOffsetLengthMapKey &key)             { return iterator(this, _lower_bound(key)); }
+			const_iterator lower_bound(const NestedOffsetLengthMapKey &key) const { return const_iterator(this, _lower_bound(key)); }
+			
+			iterator upper_bound(const NestedOffsetLengthMapKey &key)             { return iterator(this, _upper_bound(key)); }
+			const_iterator upper_bound(const NestedOffsetLengthMapKey &key) const { return const_iterator(this, _upper_bound(key)); }
+			
+			template<typename... Args> std::pair<iterator, bool> emplace(Args&&... args)
+			{
+				Node *node = new Node(_next_priority(), std::forward<Args>(args)...);
+				
+				std::pair<Node*, bool> r = _insert(node);
+				return std::make_pair(iterator(this, r.first), r.second);
+			}
+			
+			/* Inserting at end() with a key greater than any in the map is done without
+			 * searching the tree, so building a map in order is O(n).
+			*/
+			template<typename... Args> iterator emplace_hint(const_iterator hint, Args&&... args)
+			{
+				Node *node = new Node(_next_priority(), std::forward<Args>(args)...);
+				
+				if(hint.node == NULL && (root == NULL || _last(root)->value.first < node->value.first))
+				{
+					_append(node);
+					return iterator(this, node);
+				}
+				
+				return iterator(this, _insert(node).first);
+			}
+			
+			std::pair<iterator, bool> insert(const value_type &value)
+			{
+				return emplace(value);
+			}
+			
+			template<typename P> std::pair<iterator, bool> insert(P &&value)
+			{
+				return emplace(std::forward<P>(value));
+			}
+			
+			T &operator[](const NestedOffsetLengthMapKey &key)
+			{
+				Node *node = _find(key);
+				if(node == NULL)
+				{
+					node = _insert(new Node(_next_priority(), key, T())).first;
+				}
+				
+				return node->value.second;
+			}
+			
+			iterator erase(const_iterator pos)
+			{
+				Node *next = _next(pos.node);
+				_erase(pos.node);
+				
+				return iterator(this, next);
+			}
+			
+			iterator erase(iterator pos)
+			{
+				return erase(const_iterator(pos));
+			}
+			
+			size_t erase(const NestedOffsetLengthMapKey &key)
+			{
+				Node *node = _find(key);
+				if(node == NULL)
+				{
+					return 0;
+				}
+				
+				_erase(node);
+				return 1;
+			}
+			
+			/* Find the last key (in map order) which begins before begin_limit and ends
+			 * after point. Returns end() if there are no such keys.
+			*/
+			const_iterator last_ending_after(off_t begin_limit, off_t point) const
+			{
+				return const_iterator(this, _last_ending_after(root, begin_limit, point));
+			}
+			
+			/* Find all the keys which begin before begin_limit and end after point.
+			 * Returns a list of iterators in map order.
+			*/
+			std::vector<const_iterator> all_ending_after(off_t begin_limit, off_t point) const
+			{
+				std::vector<Node*> nodes;
+				_all_ending_after(root, begin_limit, point, nodes);
+				
+				std::vector<const_iterator> r;
+				r.reserve(nodes.size());
+				
+				for(auto n = nodes.begin(); n != nodes.end(); ++n)
+				{
+					r.push_back(const_iterator(this, *n));
+				}
+				
+				return r;
+			}
+			
+			/* See NestedOffsetLengthMap_data_inserted(). */
+			size_t data_inserted(off_t offset, off_t length)
+			{
+				size_t keys_modified = _count_from(NestedOffsetLengthMapKey(offset, 0));
+				
+				/* Keys which span the insertion point grow. Since they are nested, this
+				 * doesn't change their order.
+				*/
+				
+				std::vector<Node*> spanning;
+				_all_ending_after(root, offset, offset, spanning);
+				
+				for(auto n = spanning.begin(); n != spanning.end(); ++n)
+				{
+					_key(*n).length += length;
+					
+					for(Node *a = *n; a != NULL; a = a->parent)
+					{
+						_update(a);
+					}
+				}
+				
+				keys_modified += spanning.size();
+				
+				/* Keys from the insertion point onwards move up. */
+				_shift_from(NestedOffsetLengthMapKey(offset, 0), length);
+				
+				return keys_modified;
+			}
+			
+			/* See NestedOffsetLengthMap_data_erased(). */
+			size_t data_erased(off_t offset, off_t length)
+			{
+				if(length <= 0)
+				{
+					return 0;
+				}
+				
+				off_t end = offset + length;
+				
+				/* Keys which extend into the erased range from before it, or which begin
+				 * within it, are taken out and added back with their new keys (if they
+				 * still exist). Keys after the range just move down.
+				*/
+				
+				std::vector<Node*> affected;
+				_all_ending_after(root, offset, offset, affected);
+				
+				for(Node *node = _lower_bound(NestedOffsetLengthMapKey(offset, 0)); node != NULL && node->value.first.offset < end; node = _next(node))
+				{
+					affected.push_back(node);
+				}
+				
+				size_t keys_modified = affected.size() + _count_from(NestedOffsetLengthMapKey(end, 0));
+				
+				std::vector<value_type> survivors;
+				
+				for(auto n = affected.begin(); n != affected.end(); ++n)
+				{
+					off_t i_offset = (*n)->value.first.offset;
+					off_t i_length = (*n)->value.first.length;
+					
+					if(offset <= i_offset && end > (i_offset + i_length - (i_length > 0)))
+					{
+						/* This key is wholly encompassed by the deleted range. */
+						continue;
+					}
+					
+					if(offset >= i_offset && offset < (i_offset + i_length))
+					{
+						i_length -= std::min(length, (i_length - (offset - i_offset)));
+					}
+					else if(end > i_offset && end < (i_offset + i_length))
+					{
+						i_length -= end - i_offset;
+					}
+					
+					if(i_offset > offset)
+					{
+						i_offset -= std::min(length, (i_offset - offset));
+					}
+					
+					survivors.emplace_back(NestedOffsetLengthMapKey(i_offset, i_length), std::move((*n)->value.second));
+				}
+				
+				for(auto n = affected.begin(); n != affected.end(); ++n)
+				{
+					_erase(*n);
+				}
+				
+				_shift_from(NestedOffsetLengthMapKey(end, 0), -length);
+				
+				/* Where keys now clash, the one which came first in the map wins, as if the
+				 * map was rebuilt in order. Keys before the erased range come before any
+				 * survivors, and keys after it come after them.
+				*/
+				
+				std::set<const Node*> reinserted;
+				
+				for(auto s = survivors.begin(); s != survivors.end(); ++s)
+				{
+					Node *existing = _find(s->first);
+					
+					if(existing == NULL)
+					{
+						reinserted.insert(_insert(new Node(_next_priority(), std::move(*s))).first);
+					}
+					else if(existing->value.first.offset >= offset && reinserted.find(existing) == reinserted.end())
+					{
+						existing->value.second = std::move(s->second);
+						reinserted.insert(existing);
+					}
+				}
+				
+				return keys_modified;
+			}
+		
+		private:
+			static off_t _end(const Node *node)
+			{
+				return node->value.first.offset + node->value.first.length;
+			}
+			
+			/* Keys are only modified in ways which don't change their order. */
+			static NestedOffsetLengthMapKey &_key(Node *node)
+			{
+				return node->value.key;
+			}
+			
+			static void _apply_shift(Node *node, off_t delta)
+			{
+				_key(node).offset += delta;
+				node->max_end += delta;
+				node->shift += delta;
+			}
+			
+			/* Apply any shift pending on a node's children. Must be done before following a
+			 * node's child pointers or restructuring the tree beneath it.
+			*/
+			static void _push(Node *node)
+			{
+				if(node->shift != 0)
+				{
+					if(node->left != NULL)
+					{
+						_apply_shift(node->left, node->shift);
+					}
+					
+					if(node->right != NULL)
+					{
+						_apply_shift(node->right, node->shift);
+					}
+					
+					node->shift = 0;
+				}
+			}
+			
+			/* Recalculate a node's max_end and count. Any shift pending on the node must have
+			 * been pushed down first.
+			*/
+			static void _update(Node *node)
+			{
+				node->max_end = _end(node);
+				node->count = 1;
+				
+				if(node->left != NULL)
+				{
+					node->max_end = std::max(node->max_end, node->left->max_end);
+					node->count += node->left->count;
+				}
+				
+				if(node->right != NULL)
+				{
+					node->max_end = std::max(node->max_end, node->right->max_end);
+					node->count += node->right->count;
+				}
+			}
+			
+			static Node *_first(Node *node)
+			{
+				while(node != NULL)
+				{
+					_push(node);
+					
+					if(node->left == NULL)
+					{
+						break;
+					}
+					
+					node = node->left;
+				}
+				
+				return node;
+			}
+			
+			static Node *_last(Node *node)
+			{
+				while(node != NULL)
+				{
+					_push(node);
+					
+					if(node->right == NULL)
+					{
+						break;
+					}
+					
+					node = node->right;
+				}
+				
+				return node;
+			}
+			
+			static Node *_next(Node *node)
+			{
+				if(node->right != NULL)
+				{
+					_push(node);
+					return _first(node->right);
+				}
+				
+				while(node->parent != NULL && node->parent->right == node)
+				{
+					node = node->parent;
+				}
+				
+				return node->parent;
+			}
+			
+			static Node *_prev(Node *node)
+			{
+				if(node->left != NULL)
+				{
+					_push(node);
+					return _last(node->left);
+				}
+				
+				while(node->parent != NULL && node->parent->left == node)
+				{
+					node = node->parent;
+				}
+				
+				return node->parent;
+			}
+			
+			static Node *_clone(const Node *src, Node *parent)
+			{
+				if(src == NULL)
+				{
+					return NULL;
+				}
+				
+				Node *node = new Node(src->priority, src->value);
+				node->parent  = parent;
+				node->max_end = src->max_end;
+				node->count   = src->count;
+				node->shift   = src->shift;
+				
+				node->left  = _clone(src->left,  node);
+				node->right = _clone(src->right, node);
+				
+				return node;
+			}
+			
+			static void _destroy(Node *node)
+			{
+				if(node != NULL)
+				{
+					_destroy(node->left);
+					_destroy(node->right);
+					
+					delete node;
+				}
+			}
+			
+			uint32_t _next_priority()
+			{
+				/* xorshift32 */
+				next_priority ^= next_priority << 13;
+				next_priority ^= next_priority >> 17;
+				next_priority ^= next_priority << 5;
+				
+				return next_priority;
+			}
+			
+			Node *_find(const NestedOffsetLengthMapKey &key) const
+			{
+				Node *node = root;
+				
+				while(node != NULL)
+				{
+					_push(node);
+					
+					if(key < node->value.first)
+					{
+						node = node->left;
+					}
+					else if(node->value.first < key)
+					{
+						node = node->right;
+					}
+					else{
+						return node;
+					}
+				}
+				
+				return NULL;
+			}
+			
+			/* First node with a key not less than key. */
+			Node *_lower_bound(const NestedOffsetLengthMapKey &key) const
+			{
+				Node *node = root, *r = NULL;
+				
+				while(node != NULL)
+				{
+					_push(node);
+					
+					if(node->value.first < key)
+					{
+						node = node->right;
+					}
+					else{
+						r = node;
+						node = node->left;
+					}
+				}
+				
+				return r;
+			}
+			
+			/* First node with a key greater than key. */
+			Node *_upper_bound(const NestedOffsetLengthMapKey &key) const
+			{
+				Node *node = root, *r = NULL;
+				
+				while(node != NULL)
+				{
+					_push(node);
+					
+					if(key < node->value.first)
+					{
+						r = node;
+						node = node->left;
+					}
+					else{
+						node = node->right;
+					}
+				}
+				
+				return r;
+			}
+			
+			/* Rotate node above its parent, preserving the order of the tree. */
+			void _rotate_up(Node *node)
+			{
+				Node *parent = node->parent;
+				Node *grandparent = parent->parent;
+				
+				_push(parent);
+				_push(node);
+				
+				if(parent->left == node)
+				{
+					parent->left = node->right;
+					if(node->right != NULL)
+					{
+						node->right->parent = parent;
+					}
+					
+					node->right = parent;
+				}
+				else{
+					parent->right = node->left;
+					if(node->left != NULL)
+					{
+						node->left->parent = parent;
+					}
+					
+					node->left = parent;
+				}
+				
+				parent->parent = node;
+				node->parent = grandparent;
+				
+				if(grandparent == NULL)
+				{
+					root = node;
+				}
+				else if(grandparent->left == parent)
+				{
+					grandparent->left = node;
+				}
+				else{
+					grandparent->right = node;
+				}
+				
+				_update(parent);
+				_update(node);
+			}
+			
+			/* Insert a node into the tree. If a node with the same key already exists, the
+			 * new node is freed and the existing one is returned instead.
+			*/
+			std::pair<Node*, bool> _insert(Node *node)
+			{
+				Node *parent = NULL;
+				Node **link = &root;
+				
+				while(*link != NULL)
+				{
+					parent = *link;
+					_push(parent);
+					
+					if(node->value.first < parent->value.first)
+					{
+						link = &(parent->left);
+					}
+					else if(parent->value.first < node->value.first)
+					{
+						link = &(parent->right);
+					}
+					else{
+						delete node;
+						return std::make_pair(parent, false);
+					}
+				}
+				
+				*link = node;
+				node->parent = parent;
+				
+				for(Node *a = parent; a != NULL; a = a->parent)
+				{
+					a->max_end = std::max(a->max_end, node->max_end);
+					++(a->count);
+				}
+				
+				while(node->parent != NULL && node->parent->priority < node->priority)
+				{
+					_rotate_up(node);
+				}
+				
+				++n_nodes;
+				
+				return std::make_pair(node, true);
+			}
+			
+			/* Insert a node with a key greater than any in the tree. */
+			void _append(Node *node)
+			{
+				/* The new node goes on the right spine of the tree, below any nodes with a
+				 * higher priority, and takes anything below that as its left subtree.
+				*/
+				
+				Node *parent = _last(root);
+				while(parent != NULL && parent->priority < node->priority)
+				{
+					parent = parent->parent;
+				}
+				
+				Node *left = parent != NULL ? parent->right : root;
+				
+				node->left = left;
+				if(left != NULL)
+				{
+					left->parent = node;
+				}
+				
+				node->parent = parent;
+				if(parent != NULL)
+				{
+					parent->right = node;
+				}
+				else{
+					root = node;
+				}
+				
+				_update(node);
+				
+				for(Node *a = parent; a != NULL; a = a->parent)
+				{
+					a->max_end = std::max(a->max_end, node->max_end);
+					++(a->count);
+				}
+				
+				++n_nodes;
+			}
+			
+			void _erase(Node *node)
+			{
+				/* Rotate the node down until it is a leaf, then remove it. */
+				
+				while(node->left != NULL || node->right != NULL)
+				{
+					_push(node);
+					
+					Node *child = (node->right == NULL || (node->left != NULL && node->left->priority > node->right->priority))
+						? node->left
+						: node->right;
+					
+					_rotate_up(child);
+				}
+				
+				Node *parent = node->parent;
+				
+				if(parent == NULL)
+				{
+					root = NULL;
+				}
+				else if(parent->left == node)
+				{
+					parent->left = NULL;
+				}
+				else{
+					parent->right = NULL;
+				}
+				
+				for(Node *a = parent; a != NULL; a = a->parent)
+				{
+					_update(a);
+				}
+				
+				delete node;
+				--n_nodes;
+			}
+			
+			/* Number of keys not less than key. */
+			size_t _count_from(const NestedOffsetLengthMapKey &key) const
+			{
+				size_t r = 0;
+				
+				for(Node *node = root; node != NULL;)
+				{
+					_push(node);
+					
+					if(node->value.first < key)
+					{
+						node = node->right;
+					}
+					else{
+						r += 1 + (node->right != NULL ? node->right->count : 0);
+						node = node->left;
+					}
+				}
+				
+				return r;
+			}
+			
+			/* Add delta to the offset of every key not less than from. The caller must
+			 * ensure this doesn't change the order of the keys.
+			 *
+			 * Only the nodes on the path to from are updated, the rest of the keys are
+			 * shifted lazily.
+			*/
+			void _shift_from(const NestedOffsetLengthMapKey &from, off_t delta)
+			{
+				std::vector<Node*> path;
+				
+				for(Node *node = root; node != NULL;)
+				{
+					_push(node);
+					path.push_back(node);
+					
+					if(node->value.first < from)
+					{
+						node = node->right;
+					}
+					else{
+						if(node->right != NULL)
+						{
+							_apply_shift(node->right, delta);
+						}
+						
+						_key(node).offset += delta;
+						node = node->left;
+					}
+				}
+				
+				for(auto n = path.rbegin(); n != path.rend(); ++n)
+				{
+					_update(*n);
+				}
+			}
+			
+			static Node *_last_ending_after(Node *node, off_t begin_limit, off_t point)
+			{
+				if(node == NULL || node->max_end <= point)
+				{
+					return NULL;
+				}
+				
+				_push(node);
+				
+				if(node->value.first.offset >= begin_limit)
+				{
+					return _last_ending_after(node->left, begin_limit, point);
+				}
+				
+				Node *r = _last_ending_after(node->right, begin_limit, point);
+				if(r != NULL)
+				{
+					return r;
+				}
+				
+				if(_end(node) > point)
+				{
+					return node;
+				}
+				
+				/* Everything in the left subtree begins before begin_limit, so just follow
+				 * max_end down to the last node which ends after point.
+				*/
+				
+				node = node->left;
+				
+				while(node != NULL)
+				{
+					_push(node);
+					
+					if(node->right != NULL && node->right->max_end > point)
+					{
+						node = node->right;
+					}
+					else if(_end(node) > point)
+					{
+						return node;
+					}
+					else{
+						node = node->left;
+					}
+				}
+				
+				return NULL;
+			}
+			
+			static void _all_ending_after(Node *node, off_t begin_limit, off_t point, std::vector<Node*> &r)
+			{
+				if(node == NULL || node->max_end <= point)
+				{
+					return;
+				}
+				
+				_push(node);
+				
+				_all_ending_after(node->left, begin_limit, point, r);
+				
+				if(node->value.first.offset < begin_limit)
+				{
+					if(_end(node) > point)
+					{
+						r.push_back(node);
+					}
+					
+					_all_ending_after(node->right, begin_limit, point, r);
+				}
+			}
+	};
 	
 	/* Check if a key can be inserted without overlapping the start/end of another.
 	 * Returns true if possible, false if it conflicts.
@@ -73,50 +1119,33 @@ namespace REHex {
 		
 		off_t end = offset + length;
 		
-		i = map.lower_bound(NestedOffsetLengthMapKey(offset, 0));
-		if(i == map.end() && !map.empty())
-		{
-			--i;
-		}
+		/* Since no keys in the map partially overlap, the keys spanning any given offset are
+		 * all nested within each other, so only the innermost key spanning each end of the
+		 * new key needs to be checked.
+		*/
 		
-		if(!map.empty())
+		i = map.last_ending_after(offset, offset);
+		if(i != map.end())
 		{
-			for(;; --i)
+			/* Find the shortest key at the same offset which spans the start of the new
+			 * key - that is the innermost one.
+			*/
+			i = map.lower_bound(NestedOffsetLengthMapKey(i->first.offset, (offset - i->first.offset) + 1));
+			
+			if((i->first.offset + i->first.length) < end)
 			{
-				off_t i_offset = i->first.offset;
-				off_t i_end    = i_offset + i->first.length;
-				
-				if(i_offset < offset && i_end > offset && i_end < end)
-				{
-					/* There is an element with a lower offset, which extends into
-					 * the new key, but doesn't fully contain it.
-					*/
-					return false;
-				}
-				
-				if(i == map.begin())
-				{
-					break;
-				}
+				/* There is an element with a lower offset, which extends into
+				 * the new key, but doesn't fully contain it.
+				*/
+				return false;
 			}
 		}
 		
-		i = map.upper_bound(NestedOffsetLengthMapKey(offset, std::numeric_limits<off_t>::max()));
-		for(; i != map.end(); ++i)
+		i = map.last_ending_after(end, end);
+		if(i != map.end() && i->first.offset > offset)
 		{
-			off_t i_offset = i->first.offset;
-			off_t i_end    = i_offset + i->first.length;
-			
-			if(i_offset >= end)
-			{
-				break;
-			}
-			
-			if(end < i_end)
-			{
-				/* We extend into the next element, but do not encompass it. */
-				return false;
-			}
+			/* We extend into the next element, but do not encompass it. */
+			return false;
 		}
 		
 		return true;
@@ -144,46 +1173,118 @@ namespace REHex {
 		return true;
 	}
 	
-	/* Search for the most-specific element which encompasses the given offset.
-	 * Returns map.end() if no match was found.
+	/* Build a map from an unordered list of keys and values in O(n log n) time.
 	 *
-	 * NOTE: Elements with a zero length in the key are NEVER matched by this function.
+	 * The result is the same as calling NestedOffsetLengthMap_set() for each element, except
+	 * when keys partially overlap each other: NestedOffsetLengthMap_set() keeps whichever key
+	 * was inserted first, here the key with the lowest offset (or the longest one, if the
+	 * offsets are equal) is kept. Where the same key appears multiple times, the last value
+	 * wins, as it would with NestedOffsetLengthMap_set().
 	*/
-	template<typename T> typename NestedOffsetLengthMap<T>::const_iterator NestedOffsetLengthMap_get(const NestedOffsetLengthMap<T> &map, off_t offset)
+	template<typename T> NestedOffsetLengthMap<T> NestedOffsetLengthMap_bulk_load(std::vector< std::pair<NestedOffsetLengthMapKey, T> > elements)
 	{
-		auto i = map.lower_bound(NestedOffsetLengthMapKey(offset, 1));
-		auto r = map.end();
+		/* Sort so that every key comes after any keys which could contain it. */
+		
+		std::stable_sort(elements.begin(), elements.end(),
+			[](const std::pair<NestedOffsetLengthMapKey, T> &a, const std::pair<NestedOffsetLengthMapKey, T> &b)
+			{
+				if(a.first.offset == b.first.offset)
+				{
+					return a.first.length > b.first.length;
+				}
+				else{
+					return a.first.offset < b.first.offset;
+				}
+			});
+		
+		/* Sweep through the keys, keeping a stack of the ends of the accepted keys which
+		 * contain the current offset. Since they are all nested, each end is no further
+		 * than the one below it, so a key only needs checking against the top of the stack.
+		*/
 		
-		if(i == map.end() && !map.empty())
+		std::vector<off_t> open_ends;
+		auto keep = elements.begin();
+		
+		for(auto e = elements.begin(); e != elements.end(); ++e)
 		{
-			--i;
+			off_t offset = e->first.offset;
+			off_t end    = offset + e->first.length;
+			
+			if(keep != elements.begin() && std::prev(keep)->first == e->first)
+			{
+				/* Duplicate key - take the later value. */
+				std::prev(keep)->second = std::move(e->second);
+				continue;
+			}
+			
+			while(!open_ends.empty() && open_ends.back() <= offset)
+			{
+				open_ends.pop_back();
+			}
+			
+			if(!open_ends.empty() && open_ends.back() < end)
+			{
+				/* Starts within the top key, but extends beyond its end. */
+				continue;
+			}
+			
+			open_ends.push_back(end);
+			
+			if(keep != e)
+			{
+				*keep = std::move(*e);
+			}
+			
+			++keep;
 		}
 		
-		if(i != map.end())
+		elements.erase(keep, elements.end());
+		
+		/* The map orders keys with equal offsets by ascending length, so each group of keys
+		 * with the same offset is reversed, after which the map can be built by appending
+		 * in order.
+		*/
+		
+		for(auto group_begin = elements.begin(); group_begin != elements.end();)
 		{
-			for(;; --i)
+			auto group_end = std::next(group_begin);
+			while(group_end != elements.end() && group_end->first.offset == group_begin->first.offset)
 			{
-				off_t i_offset = i->first.offset;
-				off_t i_end    = i_offset + i->first.length;
-				
-				if(r != map.end() && i_offset != r->first.offset)
-				{
-					break;
-				}
-				
-				if(i_offset <= offset && i_end > offset)
-				{
-					r = i;
-				}
-				
-				if(i == map.begin())
-				{
-					break;
-				}
+				++group_end;
 			}
+			
+			std::reverse(group_begin, group_end);
+			group_begin = group_end;
 		}
 		
-		return r;
+		NestedOffsetLengthMap<T> map;
+		
+		for(auto e = elements.begin(); e != elements.end(); ++e)
+		{
+			map.emplace_hint(map.end(), std::move(e->first), std::move(e->second));
+		}
+		
+		return map;
+	}
+	
+	/* Search for the most-specific element which encompasses the given offset.
+	 * Returns map.end() if no match was found.
+	 *
+	 * NOTE: Elements with a zero length in the key are NEVER matched by this function.
+	*/
+	template<typename T> typename NestedOffsetLengthMap<T>::const_iterator NestedOffsetLengthMap_get(const NestedOffsetLengthMap<T> &map, off_t offset)
+	{
+		/* Find the key with the highest offset which encompasses the given offset, then the
+		 * shortest key at that offset which does.
+		*/
+		
+		auto i = map.last_ending_after((offset + 1), offset);
+		if(i != map.end())
+		{
+			i = map.lower_bound(NestedOffsetLengthMapKey(i->first.offset, (offset - i->first.offset) + 1));
+		}
+		
+		return i;
 	}
 	
 	/* Search for any elements which apply to the given offset.
@@ -196,42 +1297,29 @@ namespace REHex {
 	{
 		std::list<typename NestedOffsetLengthMap<T>::const_iterator> r;
 		
-		auto i = map.upper_bound(NestedOffsetLengthMapKey(offset, std::numeric_limits<off_t>::max()));
-		if(i == map.end() && !map.empty())
+		/* Any keys which begin at the offset... */
+		
+		for(auto i = map.lower_bound(NestedOffsetLengthMapKey(offset, 0)); i != map.end() && i->first.offset == offset; ++i)
 		{
-			--i;
+			r.push_back(i);
 		}
 		
-		if(i != map.end())
+		/* ...followed by any which begin before and extend over it, grouped by offset from
+		 * the highest to the lowest.
+		*/
+		
+		auto spanning = map.all_ending_after(offset, offset);
+		
+		for(auto group_end = spanning.end(); group_end != spanning.begin();)
 		{
-			off_t this_off = i->first.offset;
-			std::list<typename NestedOffsetLengthMap<T>::const_iterator> this_r;
-			
-			for(;; --i)
+			auto group_begin = std::prev(group_end);
+			while(group_begin != spanning.begin() && (*std::prev(group_begin))->first.offset == (*group_begin)->first.offset)
 			{
-				off_t i_offset = i->first.offset;
-				off_t i_end    = i_offset + i->first.length;
-				
-				if(i_offset != this_off)
-				{
-					r.insert(r.end(), this_r.begin(), this_r.end());
-					this_r.clear();
-					
-					this_off = i_offset;
-				}
-				
-				if((i_offset <= offset && i_end > offset) || i_offset == offset)
-				{
-					this_r.push_front(i);
-				}
-				
-				if(i == map.begin())
-				{
-					break;
-				}
+				--group_begin;
 			}
 			
-			r.insert(r.end(), this_r.begin(), this_r.end());
+			r.insert(r.end(), group_begin, group_end);
+			group_end = group_begin;
 		}
 		
 		return r;
@@ -256,10 +1344,12 @@ namespace REHex {
 		{
 			--j;
 			
-			if(j->first.offset == key.offset)
+			if(j->first.offset != key.offset)
 			{
-				r.push_front(j);
+				break;
 			}
+			
+			r.push_front(j);
 		}
 		
 		/* Add the exact key. */
@@ -286,39 +1376,61 @@ namespace REHex {
 	*/
 	template<typename T> size_t NestedOffsetLengthMap_data_inserted(NestedOffsetLengthMap<T> &map, off_t offset, off_t length)
 	{
-		NestedOffsetLengthMap<T> new_map;
-		size_t keys_modified = 0;
+		return map.data_inserted(offset, length);
+	}
+	
+	/* Update the keys in the map for data being erased from the file.
+	 * Returns the number of keys MODIFIED or ERASED.
+	*/
+	template<typename T> size_t NestedOffsetLengthMap_data_erased(NestedOffsetLengthMap<T> &map, off_t offset, off_t length)
+	{
+		return map.data_erased(offset, length);
+	}
+	
+	/* Update the keys in the map for many ranges of data being replaced at once.
+	 *
+	 * Each replacement is treated as erasing old_length bytes and then inserting new_length
+	 * bytes at the same offset, as if done one after another from the start of the file, but
+	 * the whole map is only rebuilt once. The offsets are relative to the file BEFORE any
+	 * replacements and must be in ascending order and not overlap.
+	 *
+	 * Returns the number of keys MODIFIED or ERASED.
+	*/
+	template<typename T> size_t NestedOffsetLengthMap_data_replaced(NestedOffsetLengthMap<T> &map, const std::vector<off_t> &offsets, off_t old_length, off_t new_length)
+	{
+		const off_t delta = new_length - old_length;
 		
-		for(auto i = map.begin(); i != map.end(); ++i)
+		/* New position of a key beginning at x. If x is within a replaced range, the key
+		 * now begins after the replacement data.
+		*/
+		auto map_begin = [&](off_t x)
 		{
-			off_t i_offset = i->first.offset;
-			off_t i_length = i->first.length;
+			size_t r = std::upper_bound(offsets.begin(), offsets.end(), (x - old_length)) - offsets.begin();
 			
-			if(i_offset >= offset)
+			if(r < offsets.size() && offsets[r] <= x)
 			{
-				new_map.emplace(NestedOffsetLengthMapKey((i_offset + length), i_length), i->second);
-				++keys_modified;
+				return offsets[r] + ((off_t)(r) * delta) + new_length;
+			}
+			else{
+				return x + ((off_t)(r) * delta);
 			}
-			else if(i_offset < offset && (i_offset + i_length) > offset)
+		};
+		
+		/* New position of a key ending at x. If x is within (or at the end of) a replaced
+		 * range, the key now ends before the replacement data.
+		*/
+		auto map_end = [&](off_t x)
+		{
+			size_t r = std::lower_bound(offsets.begin(), offsets.end(), (x - old_length)) - offsets.begin();
+			
+			if(r < offsets.size() && offsets[r] < x)
 			{
-				new_map.emplace(NestedOffsetLengthMapKey(i_offset, (i_length + length)), i->second);
-				++keys_modified;
+				return offsets[r] + ((off_t)(r) * delta);
 			}
 			else{
-				new_map.emplace(*i);
+				return x + ((off_t)(r) * delta);
 			}
-		}
-		
-		map.swap(new_map);
-		return keys_modified;
-	}
-	
-	/* Update the keys in the map for data being erased from the file.
-	 * Returns the number of keys MODIFIED or ERASED.
-	*/
-	template<typename T> size_t NestedOffsetLengthMap_data_erased(NestedOffsetLengthMap<T> &map, off_t offset, off_t length)
-	{
-		off_t end = offset + length;
+		};
 		
 		NestedOffsetLengthMap<T> new_map;
 		size_t keys_modified = 0;
@@ -328,33 +1440,34 @@ namespace REHex {
 			off_t i_offset = i->first.offset;
 			off_t i_length = i->first.length;
 			
-			if(offset <= i_offset && end > (i_offset + i_length - (i_length > 0)))
+			/* Find the replacement which the key begins within, if any. */
+			size_t r = std::upper_bound(offsets.begin(), offsets.end(), (i_offset - old_length)) - offsets.begin();
+			
+			if(r < offsets.size() && offsets[r] <= i_offset && (i_offset + i_length) <= (offsets[r] + old_length))
 			{
-				/* This key is wholly encompassed by the deleted range. */
+				/* This key is wholly encompassed by a replaced range. */
 				++keys_modified;
 				continue;
 			}
 			
-			if(offset >= i_offset && offset < (i_offset + i_length))
-			{
-				i_length -= std::min(length, (i_length - (offset - i_offset)));
-			}
-			else if(end > i_offset && end < (i_offset + i_length))
-			{
-				i_length -= end - i_offset;
-			}
+			off_t i_new_offset = map_begin(i_offset);
+			off_t i_new_length = i_length > 0
+				? map_end(i_offset + i_length) - i_new_offset
+				: 0;
 			
-			if(i_offset > offset)
+			if(i_length > 0 && i_new_length <= 0)
 			{
-				i_offset -= std::min(length, (i_offset - offset));
+				/* Key only spanned replaced data (split over adjacent replacements). */
+				++keys_modified;
+				continue;
 			}
 			
-			if(i_offset != i->first.offset || i_length != i->first.length)
+			if(i_new_offset != i_offset || i_new_length != i_length)
 			{
 				++keys_modified;
 			}
 			
-			new_map.emplace(NestedOffsetLengthMapKey(i_offset, i_length), i->second);
+			new_map.emplace_hint(new_map.end(), NestedOffsetLengthMapKey(i_new_offset, i_new_length), i->second);
 		}
 		
 		map.swap(new_map);
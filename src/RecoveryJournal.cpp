@@ -0,0 +1,542 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "platform.hpp"
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#endif
+
+#include <algorithm>
+#include <assert.h>
+#include <errno.h>
+#include <portable_endian.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#include "RecoveryJournal.hpp"
+
+static const char JOURNAL_MAGIC[8] = { 'R', 'E', 'H', 'E', 'X', 'J', 'N', 'L' };
+static const uint32_t JOURNAL_VERSION = 2;
+
+/* magic, u32 version, u32 flags, u64 file size, u64 file mtime
+ *
+ * The file size and mtime come from REHex::stat_file(). Version 1 journals stored the mtime in
+ * whole seconds and are refused rather than misreported as made against a modified file.
+*/
+static const size_t HEADER_SIZE = 32;
+
+/* u32 type, u64 payload length */
+static const size_t RECORD_HEADER_SIZE = 12;
+
+static bool write_header(FILE *fh, off_t file_size, int64_t file_mtime)
+{
+	std::vector<unsigned char> header;
+	REHex::RecoveryJournal::put_data(header, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+	REHex::RecoveryJournal::put_u32(header, JOURNAL_VERSION);
+	REHex::RecoveryJournal::put_u32(header, 0);
+	REHex::RecoveryJournal::put_u64(header, file_size);
+	REHex::RecoveryJournal::put_u64(header, file_mtime);
+	
+	assert(header.size() == HEADER_SIZE);
+	
+	return fwrite(header.data(), header.size(), 1, fh) == 1;
+}
+
+static bool write_record(FILE *fh, REHex::RecoveryJournal::RecordType type, const std::vector<unsigned char> &payload)
+{
+	std::vector<unsigned char> rh;
+	REHex::RecoveryJournal::put_u32(rh, type);
+	REHex::RecoveryJournal::put_u64(rh, payload.size());
+	
+	return fwrite(rh.data(), rh.size(), 1, fh) == 1
+		&& (payload.empty() || fwrite(payload.data(), payload.size(), 1, fh) == 1);
+}
+
+void REHex::RecoveryJournal::put_u32(std::vector<unsigned char> &payload, uint32_t value)
+{
+	value = htole32(value);
+	put_data(payload, &value, sizeof(value));
+}
+
+void REHex::RecoveryJournal::put_u64(std::vector<unsigned char> &payload, uint64_t value)
+{
+	value = htole64(value);
+	put_data(payload, &value, sizeof(value));
+}
+
+void REHex::RecoveryJournal::put_data(std::vector<unsigned char> &payload, const void *data, size_t length)
+{
+	payload.insert(payload.end(), (const unsigned char*)(data), (const unsigned char*)(data) + length);
+}
+
+REHex::RecoveryJournal::PayloadReader::PayloadReader(const std::vector<unsigned char> &payload):
+	payload(payload), pos(0) {}
+
+uint32_t REHex::RecoveryJournal::PayloadReader::get_u32()
+{
+	uint32_t value;
+	memcpy(&value, get_data(sizeof(value)), sizeof(value));
+	
+	return le32toh(value);
+}
+
+uint64_t REHex::RecoveryJournal::PayloadReader::get_u64()
+{
+	uint64_t value;
+	memcpy(&value, get_data(sizeof(value)), sizeof(value));
+	
+	return le64toh(value);
+}
+
+const unsigned char *REHex::RecoveryJournal::PayloadReader::get_data(size_t length)
+{
+	if(length > remain())
+	{
+		throw std::runtime_error("Invalid journal record: unexpected end of record");
+	}
+	
+	const unsigned char *data = payload.data() + pos;
+	pos += length;
+	
+	return data;
+}
+
+size_t REHex::RecoveryJournal::PayloadReader::remain() const
+{
+	return payload.size() - pos;
+}
+
+REHex::RecoveryJournal::Reader::Reader(const std::string &journal_filename)
+{
+	fh = fopen(journal_filename.c_str(), "rb");
+	if(fh == NULL)
+	{
+		throw std::runtime_error(std::string("Could not open file: ") + strerror(errno));
+	}
+	
+	unsigned char header[HEADER_SIZE];
+	
+	if(fread(header, sizeof(header), 1, fh) != 1
+		|| memcmp(header, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0)
+	{
+		fclose(fh);
+		throw std::runtime_error("Invalid recovery journal");
+	}
+	
+	std::vector<unsigned char> header_v(header, header + sizeof(header));
+	PayloadReader hr(header_v);
+	
+	hr.get_data(sizeof(JOURNAL_MAGIC));
+	
+	uint32_t version = hr.get_u32();
+	hr.get_u32(); /* flags */
+	
+	if(version != JOURNAL_VERSION)
+	{
+		fclose(fh);
+		throw std::runtime_error("Unsupported recovery journal version");
+	}
+	
+	file_size  = hr.get_u64();
+	file_mtime = hr.get_u64();
+	
+	valid_length = HEADER_SIZE;
+	
+	if(fseeko(fh, 0, SEEK_END) != 0
+		|| (journal_length = ftello(fh)) < 0
+		|| fseeko(fh, HEADER_SIZE, SEEK_SET) != 0)
+	{
+		int err = errno;
+		fclose(fh);
+		throw std::runtime_error(std::string("fseeko: ") + strerror(err));
+	}
+}
+
+REHex::RecoveryJournal::Reader::~Reader()
+{
+	fclose(fh);
+}
+
+off_t REHex::RecoveryJournal::Reader::get_file_size() const
+{
+	return file_size;
+}
+
+int64_t REHex::RecoveryJournal::Reader::get_file_mtime() const
+{
+	return file_mtime;
+}
+
+off_t REHex::RecoveryJournal::Reader::get_valid_length() const
+{
+	return valid_length;
+}
+
+bool REHex::RecoveryJournal::Reader::next(RecordType *type, std::vector<unsigned char> *payload)
+{
+	unsigned char rh[RECORD_HEADER_SIZE];
+	
+	if(fread(rh, sizeof(rh), 1, fh) != 1)
+	{
+		return false;
+	}
+	
+	std::vector<unsigned char> rh_v(rh, rh + sizeof(rh));
+	PayloadReader rhr(rh_v);
+	
+	uint32_t r_type   = rhr.get_u32();
+	uint64_t r_length = rhr.get_u64();
+	
+	/* Check the record fits in what's left of the file before allocating memory for it, in
+	 * case the length is garbage.
+	*/
+	if(r_length > (uint64_t)(journal_length - (valid_length + RECORD_HEADER_SIZE)))
+	{
+		return false;
+	}
+	
+	payload->resize(r_length);
+	
+	if(r_length > 0 && fread(payload->data(), r_length, 1, fh) != 1)
+	{
+		return false;
+	}
+	
+	*type = (RecordType)(r_type);
+	valid_length += RECORD_HEADER_SIZE + r_length;
+	
+	return true;
+}
+
+REHex::RecoveryJournal::Lock::Lock(const std::string &lock_filename):
+	lock_filename(lock_filename) {}
+
+std::unique_ptr<REHex::RecoveryJournal::Lock> REHex::RecoveryJournal::Lock::acquire(const std::string &journal_filename)
+{
+	std::unique_ptr<Lock> lock(new Lock(journal_filename + ".lock"));
+	
+	#ifdef _WIN32
+	/* Nobody else can open the file while we have it open without sharing, and it is deleted
+	 * when the last handle is closed.
+	*/
+	
+	lock->handle = CreateFileA(lock->lock_filename.c_str(), (GENERIC_READ | GENERIC_WRITE), 0, NULL,
+		OPEN_ALWAYS, (FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE), NULL);
+	
+	if(lock->handle == INVALID_HANDLE_VALUE)
+	{
+		if(GetLastError() == ERROR_SHARING_VIOLATION)
+		{
+			return NULL;
+		}
+		
+		throw std::runtime_error("Could not open lock file");
+	}
+	#else
+	while(true)
+	{
+		lock->fd = open(lock->lock_filename.c_str(), (O_RDWR | O_CREAT), 0644);
+		if(lock->fd == -1)
+		{
+			throw std::runtime_error(std::string("Could not open lock file: ") + strerror(errno));
+		}
+		
+		if(flock(lock->fd, (LOCK_EX | LOCK_NB)) != 0)
+		{
+			int err = errno;
+			close(lock->fd);
+			
+			if(err == EWOULDBLOCK)
+			{
+				return NULL;
+			}
+			
+			throw std::runtime_error(std::string("Could not lock file: ") + strerror(err));
+		}
+		
+		/* The last holder deletes the lock file when releasing it, so check the file we
+		 * locked is still the one in place, rather than one which was just deleted.
+		*/
+		
+		struct stat fd_st, path_st;
+		if(fstat(lock->fd, &fd_st) == 0 && stat(lock->lock_filename.c_str(), &path_st) == 0
+			&& fd_st.st_dev == path_st.st_dev && fd_st.st_ino == path_st.st_ino)
+		{
+			break;
+		}
+		
+		close(lock->fd);
+	}
+	#endif
+	
+	return lock;
+}
+
+REHex::RecoveryJournal::Lock::~Lock()
+{
+	#ifdef _WIN32
+	CloseHandle(handle);
+	#else
+	unlink(lock_filename.c_str());
+	close(fd);
+	#endif
+}
+
+REHex::RecoveryJournal::RecoveryJournal(const std::string &journal_filename, off_t file_size, int64_t file_mtime):
+	filename(journal_filename), writing(false), stop(false), failed(false)
+{
+	fh = fopen(journal_filename.c_str(), "wb");
+	if(fh == NULL)
+	{
+		throw std::runtime_error(std::string("Could not open file: ") + strerror(errno));
+	}
+	
+	if(!write_header(fh, file_size, file_mtime) || fflush(fh) != 0)
+	{
+		int err = errno;
+		fclose(fh);
+		throw std::runtime_error(std::string("Write error: ") + strerror(err));
+	}
+	
+	writer = std::thread(&REHex::RecoveryJournal::writer_main, this);
+}
+
+REHex::RecoveryJournal::RecoveryJournal(const std::string &journal_filename, off_t valid_length):
+	filename(journal_filename), writing(false), stop(false), failed(false)
+{
+	fh = fopen(journal_filename.c_str(), "r+b");
+	if(fh == NULL)
+	{
+		throw std::runtime_error(std::string("Could not open file: ") + strerror(errno));
+	}
+	
+	/* Chop off any partial record left at the end by a crash. */
+	
+	if(ftruncate(fileno(fh), valid_length) != 0 || fseeko(fh, 0, SEEK_END) != 0)
+	{
+		int err = errno;
+		fclose(fh);
+		throw std::runtime_error(std::string("Could not truncate file: ") + strerror(err));
+	}
+	
+	writer = std::thread(&REHex::RecoveryJournal::writer_main, this);
+}
+
+REHex::RecoveryJournal::~RecoveryJournal()
+{
+	{
+		std::unique_lock<std::mutex> l(lock);
+		stop = true;
+	}
+	
+	cv.notify_all();
+	writer.join();
+	
+	fclose(fh);
+}
+
+void REHex::RecoveryJournal::append(RecordType type, std::vector<unsigned char> &&payload)
+{
+	{
+		std::unique_lock<std::mutex> l(lock);
+		
+		queue.push_back(QueuedRecord());
+		queue.back().type    = type;
+		queue.back().payload = std::move(payload);
+		queue.back().compact = false;
+	}
+	
+	cv.notify_all();
+}
+
+void REHex::RecoveryJournal::compact(const std::vector<RecordType> &drop, std::vector<Record> &&records)
+{
+	{
+		std::unique_lock<std::mutex> l(lock);
+		
+		queue.push_back(QueuedRecord());
+		queue.back().compact         = true;
+		queue.back().compact_drop    = drop;
+		queue.back().compact_records = std::move(records);
+	}
+	
+	cv.notify_all();
+}
+
+void REHex::RecoveryJournal::sync()
+{
+	std::unique_lock<std::mutex> l(lock);
+	cv.wait(l, [this]() { return queue.empty() && !writing; });
+}
+
+bool REHex::RecoveryJournal::ok() const
+{
+	return !failed;
+}
+
+void REHex::RecoveryJournal::writer_main()
+{
+	std::unique_lock<std::mutex> l(lock);
+	
+	while(true)
+	{
+		cv.wait(l, [this]() { return stop || !queue.empty(); });
+		
+		if(queue.empty())
+		{
+			/* Stopping and everything has been written. */
+			break;
+		}
+		
+		/* Take everything queued so far and write it out without holding the lock, so
+		 * the UI thread can keep queueing records.
+		*/
+		
+		std::list<QueuedRecord> records;
+		records.swap(queue);
+		writing = true;
+		
+		l.unlock();
+		
+		for(auto r = records.begin(); r != records.end() && !failed; ++r)
+		{
+			if(r->compact)
+			{
+				if(!write_compacted(*r))
+				{
+					failed = true;
+				}
+			}
+			else if(!write_record(fh, r->type, r->payload))
+			{
+				fprintf(stderr, "Unable to write to recovery journal: %s\n", strerror(errno));
+				failed = true;
+			}
+		}
+		
+		if(!failed && fflush(fh) != 0)
+		{
+			fprintf(stderr, "Unable to write to recovery journal: %s\n", strerror(errno));
+			failed = true;
+		}
+		
+		/* Free the records (which may be holding large copies of data) before taking the
+		 * lock back.
+		*/
+		records.clear();
+		
+		l.lock();
+		writing = false;
+		
+		cv.notify_all();
+	}
+}
+
+/* Copy the records which aren't being dropped by a compaction to a new journal, followed by the
+ * records which replace them, and then put the new journal in place of the old one.
+ *
+ * The old journal is left alone until the new one is complete, so a crash part way through
+ * leaves a journal which can still be recovered from. Returns false on error.
+*/
+bool REHex::RecoveryJournal::write_compacted(const QueuedRecord &compaction)
+{
+	if(fflush(fh) != 0)
+	{
+		fprintf(stderr, "Unable to write to recovery journal: %s\n", strerror(errno));
+		return false;
+	}
+	
+	std::string tmp_filename = filename + ".tmp";
+	
+	FILE *out = fopen(tmp_filename.c_str(), "wb");
+	if(out == NULL)
+	{
+		fprintf(stderr, "Unable to compact recovery journal: %s\n", strerror(errno));
+		return false;
+	}
+	
+	try {
+		Reader reader(filename);
+		
+		if(!write_header(out, reader.get_file_size(), reader.get_file_mtime()))
+		{
+			throw std::runtime_error(std::string("Write error: ") + strerror(errno));
+		}
+		
+		RecordType type;
+		std::vector<unsigned char> payload;
+		
+		while(reader.next(&type, &payload))
+		{
+			if(std::find(compaction.compact_drop.begin(), compaction.compact_drop.end(), type) == compaction.compact_drop.end()
+				&& !write_record(out, type, payload))
+			{
+				throw std::runtime_error(std::string("Write error: ") + strerror(errno));
+			}
+		}
+		
+		for(auto r = compaction.compact_records.begin(); r != compaction.compact_records.end(); ++r)
+		{
+			if(!write_record(out, r->type, r->payload))
+			{
+				throw std::runtime_error(std::string("Write error: ") + strerror(errno));
+			}
+		}
+		
+		if(fflush(out) != 0)
+		{
+			throw std::runtime_error(std::string("Write error: ") + strerror(errno));
+		}
+	}
+	catch(const std::exception &e)
+	{
+		fprintf(stderr, "Unable to compact recovery journal: %s\n", e.what());
+		
+		fclose(out);
+		remove(tmp_filename.c_str());
+		
+		return false;
+	}
+	
+	/* Windows won't rename over an existing (or open) file. */
+	
+	fclose(fh);
+	fh = out;
+	
+	#ifdef _WIN32
+	remove(filename.c_str());
+	#endif
+	
+	if(rename(tmp_filename.c_str(), filename.c_str()) != 0)
+	{
+		fprintf(stderr, "Unable to compact recovery journal: %s\n", strerror(errno));
+		return false;
+	}
+	
+	return true;
+}
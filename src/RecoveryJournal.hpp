@@ -0,0 +1,222 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef REHEX_RECOVERYJOURNAL_HPP
+#define REHEX_RECOVERYJOURNAL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+namespace REHex {
+	/* Append-only journal of the unsaved changes made to a file, from which the changes can be
+	 * replayed if rehex exits without saving them (i.e. crashes).
+	 *
+	 * Records are queued by the UI thread and written out (and flushed) by a background
+	 * thread, so journalling an edit never waits for the disk. Each record is framed with its
+	 * type and length, so a record left half-written by a crash is simply ignored.
+	 *
+	 * The journal header records the size and modification time of the file when the journal
+	 * was started, so the journal can be rejected if the file has since been changed.
+	 *
+	 * Records which are superseded by later ones (such as changes to comments, once there is a
+	 * newer copy of every comment) can be dropped by compacting the journal, which copies the
+	 * records still needed to a new journal in the background and then replaces the old one.
+	*/
+	
+	class RecoveryJournal
+	{
+		public:
+			enum RecordType
+			{
+				REC_OVERWRITE  = 1, /* u64 offset, data */
+				REC_INSERT     = 2, /* u64 offset, data */
+				REC_ERASE      = 3, /* u64 offset, u64 length */
+				REC_REPLACE    = 4, /* u64 old length, u64 new length, u64 data stride, u64 count, u64 offsets..., data */
+				REC_COMMENTS   = 5, /* u64 count, { u64 offset, u64 length, u32 text length, text }... */
+				REC_HIGHLIGHTS = 6, /* u64 count, { u64 offset, u64 length, u32 colour }... */
+				
+				REC_SET_COMMENT     = 7,  /* u64 offset, u64 length, u32 text length, text */
+				REC_ERASE_COMMENT   = 8,  /* u64 offset, u64 length */
+				REC_SET_HIGHLIGHT   = 9,  /* u64 offset, u64 length, u32 colour */
+				REC_ERASE_HIGHLIGHT = 10, /* u64 offset, u64 length */
+			};
+			
+			struct Record
+			{
+				RecordType type;
+				std::vector<unsigned char> payload;
+			};
+			
+			/* Helpers for building/decoding record payloads. */
+			
+			static void put_u32(std::vector<unsigned char> &payload, uint32_t value);
+			static void put_u64(std::vector<unsigned char> &payload, uint64_t value);
+			static void put_data(std::vector<unsigned char> &payload, const void *data, size_t length);
+			
+			class PayloadReader
+			{
+				private:
+					const std::vector<unsigned char> &payload;
+					size_t pos;
+				
+				public:
+					PayloadReader(const std::vector<unsigned char> &payload);
+					
+					uint32_t get_u32();
+					uint64_t get_u64();
+					const unsigned char *get_data(size_t length);
+					
+					size_t remain() const;
+			};
+			
+			class Reader
+			{
+				private:
+					FILE *fh;
+					
+					off_t file_size;
+					int64_t file_mtime;
+					
+					off_t valid_length;
+					off_t journal_length;
+				
+				public:
+					Reader(const std::string &journal_filename);
+					~Reader();
+					
+					off_t get_file_size() const;
+					int64_t get_file_mtime() const;
+					
+					/* Length of the journal up to the end of the last complete record
+					 * read so far.
+					*/
+					off_t get_valid_length() const;
+					
+					/* Read the next record, returns false at the end of the journal or
+					 * when an incomplete record is found.
+					*/
+					bool next(RecordType *type, std::vector<unsigned char> *payload);
+					
+					/* Prevent copying. */
+					Reader(const Reader&) = delete;
+					Reader &operator=(const Reader&) = delete;
+			};
+			
+			/* Exclusive lock on a journal, held by the session which is writing to it
+			 * (or recovering or discarding it) so no other session touches it.
+			 *
+			 * The lock is taken on a separate .lock file alongside the journal, since
+			 * compacting the journal replaces its file. It is released when the Lock
+			 * is destroyed, or by the OS when the process exits, even if it crashes.
+			*/
+			class Lock
+			{
+				public:
+					/* Returns NULL if another session holds the lock, throws a
+					 * std::runtime_error if the lock file can't be opened.
+					*/
+					static std::unique_ptr<Lock> acquire(const std::string &journal_filename);
+					
+					~Lock();
+				
+				private:
+					std::string lock_filename;
+					
+					#ifdef _WIN32
+					void *handle;
+					#else
+					int fd;
+					#endif
+					
+					Lock(const std::string &lock_filename);
+					
+					/* Prevent copying. */
+					Lock(const Lock&) = delete;
+					Lock &operator=(const Lock&) = delete;
+			};
+			
+			/* Start a new journal, replacing any existing one. */
+			RecoveryJournal(const std::string &journal_filename, off_t file_size, int64_t file_mtime);
+			
+			/* Continue appending to an existing journal, discarding anything after the
+			 * first valid_length bytes.
+			*/
+			RecoveryJournal(const std::string &journal_filename, off_t valid_length);
+			
+			/* Writes out any queued records before returning. The journal file is left
+			 * in place.
+			*/
+			~RecoveryJournal();
+			
+			/* Queue a record to be written. */
+			void append(RecordType type, std::vector<unsigned char> &&payload);
+			
+			/* Queue a rewrite of the journal which drops every record of the given types
+			 * written before it and appends the given records in their place. Records
+			 * queued afterwards are written after them.
+			*/
+			void compact(const std::vector<RecordType> &drop, std::vector<Record> &&records);
+			
+			/* Wait for all queued records to be written. */
+			void sync();
+			
+			/* Returns false if writing to the journal has failed. */
+			bool ok() const;
+		
+		private:
+			struct QueuedRecord
+			{
+				RecordType type;
+				std::vector<unsigned char> payload;
+				
+				/* Set on a compaction queued by compact(). */
+				bool compact;
+				std::vector<RecordType> compact_drop;
+				std::vector<Record> compact_records;
+			};
+			
+			std::string filename;
+			FILE *fh;
+			
+			std::mutex lock;
+			std::condition_variable cv;
+			std::list<QueuedRecord> queue;
+			bool writing;
+			bool stop;
+			std::atomic<bool> failed;
+			
+			std::thread writer;
+			
+			void writer_main();
+			bool write_compacted(const QueuedRecord &compaction);
+			
+			/* Prevent copying. */
+			RecoveryJournal(const RecoveryJournal&) = delete;
+			RecoveryJournal &operator=(const RecoveryJournal&) = delete;
+	};
+}
+
+#endif /* !REHEX_RECOVERYJOURNAL_HPP */
@@ -0,0 +1,1199 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "platform.hpp"
+#include <algorithm>
+#include <bitset>
+#include <ctype.h>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "RegexSearchKernel.hpp"
+
+namespace
+{
+	typedef std::bitset<256> ByteSet;
+	
+	const unsigned UNBOUNDED = (unsigned)(-1);
+	
+	/* Limits on the size of expressions, so a typo like a{1000}{1000} doesn't try to
+	 * allocate all the memory in the system.
+	*/
+	const unsigned MAX_REPEAT     = 1000;
+	const size_t   MAX_NFA_STATES = 100000;
+	
+	/* A parsed expression. */
+	struct Node
+	{
+		enum Type
+		{
+			EMPTY,
+			BYTES,        /* One byte from bytes. */
+			CONCAT,       /* Each of children in turn. */
+			ALTERNATION,  /* Any one of children. */
+			REPEAT,       /* children[0], between min and max times. */
+		};
+		
+		Type type;
+		ByteSet bytes;
+		std::vector<Node> children;
+		unsigned min, max;
+		
+		Node(Type type = EMPTY):
+			type(type), min(0), max(0) {}
+	};
+	
+	class Parser
+	{
+		public:
+			Parser(const std::string &pattern, unsigned flags):
+				pattern(pattern), pos(0), flags(flags) {}
+			
+			Node parse()
+			{
+				Node node = parse_alternation();
+				
+				if(pos < pattern.length())
+				{
+					/* parse_alternation() only stops early at a closing bracket. */
+					error("Unmatched ')'");
+				}
+				
+				return node;
+			}
+		
+		private:
+			const std::string &pattern;
+			size_t pos;
+			unsigned flags;
+			
+			void error(const std::string &message)
+			{
+				throw REHex::RegexSearchKernel::ParseError(message + " at character " + std::to_string(pos + 1));
+			}
+			
+			bool at_end() const
+			{
+				return pos >= pattern.length();
+			}
+			
+			char peek() const
+			{
+				return pattern[pos];
+			}
+			
+			Node parse_alternation()
+			{
+				Node node(Node::ALTERNATION);
+				node.children.push_back(parse_concat());
+				
+				while(!at_end() && peek() == '|')
+				{
+					++pos;
+					node.children.push_back(parse_concat());
+				}
+				
+				if(node.children.size() == 1)
+				{
+					return node.children.front();
+				}
+				
+				return node;
+			}
+			
+			Node parse_concat()
+			{
+				Node node(Node::CONCAT);
+				
+				while(!at_end() && peek() != '|' && peek() != ')')
+				{
+					node.children.push_back(parse_repeat());
+				}
+				
+				if(node.children.empty())
+				{
+					return Node(Node::EMPTY);
+				}
+				else if(node.children.size() == 1)
+				{
+					return node.children.front();
+				}
+				
+				return node;
+			}
+			
+			Node parse_repeat()
+			{
+				Node node = parse_atom();
+				
+				while(!at_end())
+				{
+					unsigned min, max;
+					
+					if(peek() == '*')
+					{
+						min = 0;
+						max = UNBOUNDED;
+						++pos;
+					}
+					else if(peek() == '+')
+					{
+						min = 1;
+						max = UNBOUNDED;
+						++pos;
+					}
+					else if(peek() == '?')
+					{
+						min = 0;
+						max = 1;
+						++pos;
+					}
+					else if(peek() == '{' && parse_bounds(&min, &max))
+					{
+						/* parse_bounds() consumed the bounds. */
+					}
+					else{
+						break;
+					}
+					
+					/* Lazy quantifiers find the same matches, only shorter ones, which
+					 * we don't report the length of anyway.
+					*/
+					if(!at_end() && peek() == '?')
+					{
+						++pos;
+					}
+					
+					Node repeat(Node::REPEAT);
+					repeat.min = min;
+					repeat.max = max;
+					repeat.children.push_back(node);
+					
+					node = repeat;
+				}
+				
+				return node;
+			}
+			
+			/* Parses a {n}, {n,} or {n,m} quantifier. Returns false and leaves pos alone if
+			 * there isn't one, in which case the '{' is a literal.
+			*/
+			bool parse_bounds(unsigned *min, unsigned *max)
+			{
+				size_t p = pos + 1;
+				
+				auto parse_number = [&](unsigned *n)
+				{
+					size_t digits_begin = p;
+					unsigned long value = 0;
+					
+					for(; p < pattern.length() && pattern[p] >= '0' && pattern[p] <= '9'; ++p)
+					{
+						value = std::min((value * 10) + (pattern[p] - '0'), (unsigned long)(MAX_REPEAT + 1));
+					}
+					
+					*n = value;
+					return p > digits_begin;
+				};
+				
+				if(!parse_number(min))
+				{
+					return false;
+				}
+				
+				if(p < pattern.length() && pattern[p] == '}')
+				{
+					*max = *min;
+				}
+				else if(p < pattern.length() && pattern[p] == ',')
+				{
+					++p;
+					
+					if(!parse_number(max))
+					{
+						*max = UNBOUNDED;
+					}
+					
+					if(p >= pattern.length() || pattern[p] != '}')
+					{
+						return false;
+					}
+				}
+				else{
+					return false;
+				}
+				
+				if(*min > MAX_REPEAT || (*max != UNBOUNDED && *max > MAX_REPEAT))
+				{
+					error("Repetition count is too large (maximum " + std::to_string(MAX_REPEAT) + ")");
+				}
+				
+				if(*max < *min)
+				{
+					error("Repetition range is backwards");
+				}
+				
+				pos = p + 1;
+				return true;
+			}
+			
+			Node parse_atom()
+			{
+				char c = peek();
+				
+				switch(c)
+				{
+					case '(':
+					{
+						++pos;
+						
+						if(pattern.compare(pos, 2, "?:") == 0)
+						{
+							pos += 2;
+						}
+						else if(!at_end() && peek() == '?')
+						{
+							error("Unsupported group type");
+						}
+						
+						Node node = parse_alternation();
+						
+						if(at_end())
+						{
+							error("Missing ')'");
+						}
+						
+						++pos;
+						return node;
+					}
+					
+					case '[':
+						++pos;
+						return bytes_node(parse_class());
+					
+					case '.':
+					{
+						++pos;
+						
+						ByteSet any;
+						any.set();
+						
+						if(flags & REHex::RegexSearchKernel::TEXT)
+						{
+							any.reset('\n');
+						}
+						
+						return bytes_node(any);
+					}
+					
+					case '\\':
+						++pos;
+						return bytes_node(parse_escape());
+					
+					case '*':
+					case '+':
+					case '?':
+						error("Nothing to repeat");
+					
+					case '^':
+					case '$':
+						error("Anchors are not supported");
+					
+					default:
+					{
+						++pos;
+						
+						ByteSet byte;
+						byte.set((unsigned char)(c));
+						
+						return bytes_node(byte);
+					}
+				}
+				
+				/* Unreachable */
+				return Node();
+			}
+			
+			/* Parses an escape sequence following a backslash. */
+			ByteSet parse_escape()
+			{
+				if(at_end())
+				{
+					error("Trailing backslash");
+				}
+				
+				char c = pattern[pos++];
+				ByteSet set;
+				
+				auto add_range = [&](unsigned char first, unsigned char last)
+				{
+					for(unsigned b = first; b <= last; ++b)
+					{
+						set.set(b);
+					}
+				};
+				
+				switch(c)
+				{
+					case 'd': case 'D':
+						add_range('0', '9');
+						break;
+					
+					case 'w': case 'W':
+						add_range('0', '9');
+						add_range('A', 'Z');
+						add_range('a', 'z');
+						set.set('_');
+						break;
+					
+					case 's': case 'S':
+						set.set(' ');
+						add_range('\t', '\r');
+						break;
+					
+					case 'n': set.set('\n'); break;
+					case 'r': set.set('\r'); break;
+					case 't': set.set('\t'); break;
+					case 'f': set.set('\f'); break;
+					case 'v': set.set('\v'); break;
+					case '0': set.set(0);    break;
+					
+					case 'x':
+					{
+						if((pos + 2) > pattern.length() || !isxdigit(pattern[pos]) || !isxdigit(pattern[pos + 1]))
+						{
+							error("Expected two hex digits after \\x");
+						}
+						
+						set.set(strtoul(pattern.substr(pos, 2).c_str(), NULL, 16));
+						pos += 2;
+						
+						break;
+					}
+					
+					default:
+						if(isalnum(c))
+						{
+							--pos;
+							error(std::string("Unknown escape sequence \\") + c);
+						}
+						
+						set.set((unsigned char)(c));
+						break;
+				}
+				
+				if(c == 'D' || c == 'W' || c == 'S')
+				{
+					set.flip();
+				}
+				
+				return set;
+			}
+			
+			/* Parses a character class following an opening square bracket. */
+			ByteSet parse_class()
+			{
+				ByteSet set;
+				
+				bool negate = !at_end() && peek() == '^';
+				if(negate)
+				{
+					++pos;
+				}
+				
+				for(bool first = true; first || at_end() || peek() != ']'; first = false)
+				{
+					if(at_end())
+					{
+						error("Missing ']'");
+					}
+					
+					/* Returns true and sets byte if the next item is a single byte,
+					 * else adds the set (e.g. \d) to set.
+					*/
+					auto parse_item = [&](unsigned char *byte)
+					{
+						ByteSet item;
+						
+						if(peek() == '\\')
+						{
+							++pos;
+							item = parse_escape();
+						}
+						else if((unsigned char)(peek()) >= 0x80)
+						{
+							error("Only ASCII characters can be used in a character class, use \\xHH for bytes");
+						}
+						else{
+							item.set((unsigned char)(pattern[pos++]));
+						}
+						
+						if(item.count() == 1)
+						{
+							for(*byte = 0; !item.test(*byte); ++(*byte)) {}
+							return true;
+						}
+						
+						set |= item;
+						return false;
+					};
+					
+					unsigned char range_first;
+					if(!parse_item(&range_first))
+					{
+						continue;
+					}
+					
+					if((pos + 1) < pattern.length() && peek() == '-' && pattern[pos + 1] != ']')
+					{
+						++pos;
+						
+						unsigned char range_last;
+						if(!parse_item(&range_last))
+						{
+							error("Invalid range in character class");
+						}
+						
+						if(range_last < range_first)
+						{
+							error("Range in character class is backwards");
+						}
+						
+						for(unsigned b = range_first; b <= range_last; ++b)
+						{
+							set.set(b);
+						}
+					}
+					else{
+						set.set(range_first);
+					}
+				}
+				
+				++pos;  /* Skip ']' */
+				
+				if(negate)
+				{
+					set.flip();
+				}
+				
+				return set;
+			}
+			
+			Node bytes_node(ByteSet bytes)
+			{
+				if(flags & REHex::RegexSearchKernel::IGNORE_CASE)
+				{
+					for(unsigned c = 'a'; c <= 'z'; ++c)
+					{
+						if(bytes.test(c) || bytes.test(c - 'a' + 'A'))
+						{
+							bytes.set(c);
+							bytes.set(c - 'a' + 'A');
+						}
+					}
+				}
+				
+				Node node(Node::BYTES);
+				node.bytes = bytes;
+				
+				return node;
+			}
+	};
+	
+	/* Returns the length of the longest string the expression can match, or SIZE_MAX if
+	 * there is no limit.
+	*/
+	size_t node_max_length(const Node &node)
+	{
+		switch(node.type)
+		{
+			case Node::EMPTY:
+				return 0;
+			
+			case Node::BYTES:
+				return 1;
+			
+			case Node::CONCAT:
+			{
+				size_t total = 0;
+				
+				for(auto c = node.children.begin(); c != node.children.end(); ++c)
+				{
+					size_t len = node_max_length(*c);
+					total = (len > (SIZE_MAX - total)) ? SIZE_MAX : (total + len);
+				}
+				
+				return total;
+			}
+			
+			case Node::ALTERNATION:
+			{
+				size_t longest = 0;
+				
+				for(auto c = node.children.begin(); c != node.children.end(); ++c)
+				{
+					longest = std::max(longest, node_max_length(*c));
+				}
+				
+				return longest;
+			}
+			
+			case Node::REPEAT:
+			{
+				size_t len = node_max_length(node.children.front());
+				
+				if(len == 0 || node.max == 0)
+				{
+					return 0;
+				}
+				else if(node.max == UNBOUNDED || len > (SIZE_MAX / node.max))
+				{
+					return SIZE_MAX;
+				}
+				
+				return len * node.max;
+			}
+		}
+		
+		return SIZE_MAX;
+	}
+	
+	/* Returns true if the expression can match an empty string. */
+	bool node_matches_empty(const Node &node)
+	{
+		switch(node.type)
+		{
+			case Node::EMPTY:
+				return true;
+			
+			case Node::BYTES:
+				return false;
+			
+			case Node::CONCAT:
+				return std::all_of(node.children.begin(), node.children.end(), &node_matches_empty);
+			
+			case Node::ALTERNATION:
+				return std::any_of(node.children.begin(), node.children.end(), &node_matches_empty);
+			
+			case Node::REPEAT:
+				return node.min == 0 || node_matches_empty(node.children.front());
+		}
+		
+		return false;
+	}
+}
+
+/* The expression compiled to an NFA, for matching forwards and backwards. */
+struct REHex::RegexSearchKernel::Program
+{
+	static const uint32_t NO_STATE = (uint32_t)(-1);
+	
+	struct State
+	{
+		enum Type
+		{
+			MATCH,
+			BYTES,  /* Consumes a byte from bytes and moves to out. */
+			SPLIT,  /* Moves to both out and out1 (if not NO_STATE) without consuming anything. */
+		};
+		
+		Type type;
+		ByteSet bytes;
+		uint32_t out, out1;
+	};
+	
+	/* State 0 is the only MATCH state. */
+	std::vector<State> states;
+	
+	uint32_t forward_start;
+	uint32_t reverse_start;  /* Matches the expression backwards. */
+	
+	size_t max_length;
+	bool capped;  /* Expression can match strings longer than max_length. */
+	bool matches_empty;
+	
+	/* The only byte which can begin a match, or -1. */
+	int first_byte;
+	
+	Program(const Node &root, size_t max_length_limit)
+	{
+		states.push_back(State());
+		states.back().type = State::MATCH;
+		
+		forward_start = compile(root, 0, false);
+		reverse_start = compile(root, 0, true);
+		
+		size_t root_max = node_max_length(root);
+		
+		max_length    = std::min(root_max, max_length_limit);
+		capped        = root_max > max_length_limit;
+		matches_empty = node_matches_empty(root);
+		
+		/* Find which bytes can begin a match by following the splits from the start. */
+		
+		ByteSet first_bytes;
+		
+		std::vector<bool> seen(states.size(), false);
+		std::vector<uint32_t> stack(1, forward_start);
+		
+		while(!stack.empty())
+		{
+			uint32_t s = stack.back();
+			stack.pop_back();
+			
+			if(s == NO_STATE || seen[s])
+			{
+				continue;
+			}
+			
+			seen[s] = true;
+			
+			if(states[s].type == State::SPLIT)
+			{
+				stack.push_back(states[s].out);
+				stack.push_back(states[s].out1);
+			}
+			else if(states[s].type == State::BYTES)
+			{
+				first_bytes |= states[s].bytes;
+			}
+		}
+		
+		first_byte = -1;
+		
+		if(first_bytes.count() == 1)
+		{
+			for(first_byte = 0; !first_bytes.test(first_byte); ++first_byte) {}
+		}
+	}
+	
+	uint32_t add_state(State::Type type, const ByteSet &bytes, uint32_t out, uint32_t out1)
+	{
+		if(states.size() >= MAX_NFA_STATES)
+		{
+			throw ParseError("Regular expression is too large");
+		}
+		
+		State state;
+		state.type  = type;
+		state.bytes = bytes;
+		state.out   = out;
+		state.out1  = out1;
+		
+		states.push_back(state);
+		return states.size() - 1;
+	}
+	
+	/* Builds the states to match node and then continue to next, returning the first one.
+	 * If reverse is true, the states match the reversed expression.
+	*/
+	uint32_t compile(const Node &node, uint32_t next, bool reverse)
+	{
+		switch(node.type)
+		{
+			case Node::EMPTY:
+				return next;
+			
+			case Node::BYTES:
+				return add_state(State::BYTES, node.bytes, next, NO_STATE);
+			
+			case Node::CONCAT:
+				if(reverse)
+				{
+					for(auto c = node.children.begin(); c != node.children.end(); ++c)
+					{
+						next = compile(*c, next, reverse);
+					}
+				}
+				else{
+					for(auto c = node.children.rbegin(); c != node.children.rend(); ++c)
+					{
+						next = compile(*c, next, reverse);
+					}
+				}
+				
+				return next;
+			
+			case Node::ALTERNATION:
+			{
+				uint32_t alt = compile(node.children.back(), next, reverse);
+				
+				for(auto c = std::next(node.children.rbegin()); c != node.children.rend(); ++c)
+				{
+					uint32_t this_alt = compile(*c, next, reverse);
+					alt = add_state(State::SPLIT, ByteSet(), this_alt, alt);
+				}
+				
+				return alt;
+			}
+			
+			case Node::REPEAT:
+			{
+				const Node &child = node.children.front();
+				uint32_t s = next;
+				
+				if(node.max == UNBOUNDED)
+				{
+					/* Loop back to the split after each repetition. */
+					s = add_state(State::SPLIT, ByteSet(), NO_STATE, next);
+					
+					uint32_t body = compile(child, s, reverse);
+					states[s].out = body;
+				}
+				else{
+					/* Nested optional repetitions, i.e. (x(x(x)?)?)? */
+					for(unsigned i = node.min; i < node.max; ++i)
+					{
+						uint32_t body = compile(child, s, reverse);
+						s = add_state(State::SPLIT, ByteSet(), body, next);
+					}
+				}
+				
+				for(unsigned i = 0; i < node.min; ++i)
+				{
+					s = compile(child, s, reverse);
+				}
+				
+				return s;
+			}
+		}
+		
+		return next;
+	}
+};
+
+/* A DFA built lazily from the NFA, one set of NFA states at a time. */
+class REHex::RegexSearchKernel::DFA
+{
+	public:
+		static const uint8_t MATCH = (1 << 0);
+		static const uint8_t DEAD  = (1 << 1);  /* Can never reach a MATCH state. */
+		
+		/* Next state for each state and byte, indexed by (state * 256) + byte, or -1 if
+		 * it hasn't been built yet.
+		*/
+		std::vector<int32_t> transitions;
+		std::vector<uint8_t> flags;
+		
+		int32_t start;
+		
+		/* An unanchored DFA can begin a match at any byte, rather than only the first. */
+		DFA(const Program &program, uint32_t nfa_start, bool unanchored):
+			program(program), nfa_start(nfa_start), unanchored(unanchored),
+			mark(program.states.size(), 0), generation(0)
+		{
+			reset();
+		}
+		
+		int32_t next(int32_t state, unsigned char byte)
+		{
+			int32_t n = transitions[((size_t)(state) << 8) | byte];
+			return n >= 0 ? n : build(state, byte);
+		}
+		
+		/* Returns true if a match begins at p and ends by end. */
+		bool match_from(const unsigned char *p, const unsigned char *end)
+		{
+			for(int32_t s = start;; s = next(s, *(p++)))
+			{
+				if(flags[s] & MATCH)
+				{
+					return true;
+				}
+				
+				if((flags[s] & DEAD) || p == end)
+				{
+					return false;
+				}
+			}
+		}
+		
+		/* Returns the end of the longest match which begins at p and ends by end, or
+		 * NULL if there isn't one.
+		*/
+		const unsigned char *longest_from(const unsigned char *p, const unsigned char *end)
+		{
+			const unsigned char *match_end = NULL;
+			
+			for(int32_t s = start;; s = next(s, *(p++)))
+			{
+				if(flags[s] & MATCH)
+				{
+					match_end = p;
+				}
+				
+				if((flags[s] & DEAD) || p == end)
+				{
+					return match_end;
+				}
+			}
+		}
+		
+		/* Returns the end of the match which ends first after p, or NULL. The DFA must
+		 * be unanchored.
+		*/
+		const unsigned char *find_end(const unsigned char *p, const unsigned char *end)
+		{
+			int32_t s = start;
+			
+			if(flags[s] & MATCH)
+			{
+				return p;
+			}
+			
+			while(p < end)
+			{
+				if(s == start && program.first_byte >= 0)
+				{
+					/* Nothing leaves the start state until the first byte of a match. */
+					p = (const unsigned char*)(memchr(p, program.first_byte, (end - p)));
+					if(p == NULL)
+					{
+						return NULL;
+					}
+				}
+				
+				s = next(s, *(p++));
+				
+				if(flags[s] & MATCH)
+				{
+					return p;
+				}
+			}
+			
+			return NULL;
+		}
+	
+	private:
+		const Program &program;
+		uint32_t nfa_start;
+		bool unanchored;
+		
+		/* The (sorted) set of NFA states making up each DFA state. */
+		std::vector< std::vector<uint32_t> > sets;
+		std::map<std::vector<uint32_t>, int32_t> ids;
+		
+		/* Scratch space for following splits. */
+		std::vector<uint32_t> mark;
+		uint32_t generation;
+		std::vector<uint32_t> stack;
+		
+		/* Empties the cache, leaving only the start state. */
+		void reset()
+		{
+			transitions.clear();
+			flags.clear();
+			sets.clear();
+			ids.clear();
+			
+			std::vector<uint32_t> set;
+			
+			new_generation();
+			closure(nfa_start, &set);
+			
+			start = add(set);
+		}
+		
+		void new_generation()
+		{
+			if(++generation == 0)
+			{
+				std::fill(mark.begin(), mark.end(), 0);
+				generation = 1;
+			}
+		}
+		
+		/* Adds the states reachable from s without consuming a byte to set. */
+		void closure(uint32_t s, std::vector<uint32_t> *set)
+		{
+			stack.push_back(s);
+			
+			while(!stack.empty())
+			{
+				uint32_t n = stack.back();
+				stack.pop_back();
+				
+				if(n == Program::NO_STATE || mark[n] == generation)
+				{
+					continue;
+				}
+				
+				mark[n] = generation;
+				
+				const Program::State &state = program.states[n];
+				
+				if(state.type == Program::State::SPLIT)
+				{
+					stack.push_back(state.out1);
+					stack.push_back(state.out);
+				}
+				else{
+					set->push_back(n);
+				}
+			}
+		}
+		
+		int32_t add(std::vector<uint32_t> &set)
+		{
+			std::sort(set.begin(), set.end());
+			
+			auto i = ids.find(set);
+			if(i != ids.end())
+			{
+				return i->second;
+			}
+			
+			int32_t id = sets.size();
+			
+			sets.push_back(set);
+			ids.insert(std::make_pair(set, id));
+			
+			transitions.resize((transitions.size() + 256), -1);
+			
+			/* State 0 is the MATCH state, so it sorts first. */
+			flags.push_back((!set.empty() && set.front() == 0 ? MATCH : 0) | (set.empty() ? DEAD : 0));
+			
+			return id;
+		}
+		
+		int32_t build(int32_t state, unsigned char byte)
+		{
+			std::vector<uint32_t> set;
+			new_generation();
+			
+			const std::vector<uint32_t> &from = sets[state];
+			
+			for(auto n = from.begin(); n != from.end(); ++n)
+			{
+				const Program::State &s = program.states[*n];
+				
+				if(s.type == Program::State::BYTES && s.bytes.test(byte))
+				{
+					closure(s.out, &set);
+				}
+			}
+			
+			if(unanchored)
+			{
+				closure(nfa_start, &set);
+			}
+			
+			if(sets.size() >= MAX_DFA_STATES)
+			{
+				/* Cache is full. Start again with only the start state and the one
+				 * we're moving to, the state we're coming from is discarded.
+				*/
+				
+				reset();
+				return add(set);
+			}
+			
+			int32_t next = add(set);
+			transitions[((size_t)(state) << 8) | byte] = next;
+			
+			return next;
+		}
+};
+
+struct REHex::RegexSearchKernel::Cache
+{
+	DFA forward;   /* Unanchored, to find where matches end. */
+	DFA anchored;  /* To check for a match at a given offset. */
+	DFA reverse;   /* Unanchored over the reversed expression, to search backwards. */
+	
+	Cache(const Program &program):
+		forward(program, program.forward_start, true),
+		anchored(program, program.forward_start, false),
+		reverse(program, program.reverse_start, true) {}
+};
+
+struct REHex::RegexSearchKernel::CachePool
+{
+	std::mutex lock;
+	std::vector< std::unique_ptr<Cache> > free;
+};
+
+/* Takes a cache from the pool (or creates one) for the duration of a search. */
+class REHex::RegexSearchKernel::CacheRef
+{
+	public:
+		CacheRef(const RegexSearchKernel &kernel):
+			pool(*(kernel.caches))
+		{
+			{
+				std::unique_lock<std::mutex> l(pool.lock);
+				
+				if(!pool.free.empty())
+				{
+					cache = std::move(pool.free.back());
+					pool.free.pop_back();
+				}
+			}
+			
+			if(!cache)
+			{
+				cache.reset(new Cache(*(kernel.program)));
+			}
+		}
+		
+		~CacheRef()
+		{
+			std::unique_lock<std::mutex> l(pool.lock);
+			pool.free.push_back(std::move(cache));
+		}
+		
+		Cache *operator->()
+		{
+			return cache.get();
+		}
+	
+	private:
+		CachePool &pool;
+		std::unique_ptr<Cache> cache;
+};
+
+REHex::RegexSearchKernel::ParseError::ParseError(const std::string &what):
+	runtime_error(what) {}
+
+REHex::RegexSearchKernel::RegexSearchKernel() {}
+
+REHex::RegexSearchKernel::RegexSearchKernel(const std::string &pattern, unsigned flags, size_t max_length):
+	caches(new CachePool())
+{
+	Node root = Parser(pattern, flags).parse();
+	program.reset(new Program(root, max_length));
+}
+
+const unsigned char *REHex::RegexSearchKernel::find(const unsigned char *begin, const unsigned char *end) const
+{
+	if(!program || begin > end)
+	{
+		return NULL;
+	}
+	
+	CacheRef cache(*this);
+	size_t max_len = program->max_length;
+	
+	for(const unsigned char *p = begin;;)
+	{
+		const unsigned char *match_end = cache->forward.find_end(p, end);
+		if(match_end == NULL)
+		{
+			return NULL;
+		}
+		
+		/* No match ends before match_end, so the leftmost match must begin no more than
+		 * max_len bytes before it.
+		*/
+		
+		const unsigned char *h = ((size_t)(match_end - p) > max_len) ? (match_end - max_len) : p;
+		
+		for(; h <= match_end; ++h)
+		{
+			if(cache->anchored.match_from(h, (((size_t)(end - h) > max_len) ? (h + max_len) : end)))
+			{
+				return h;
+			}
+		}
+		
+		/* The match(es) ending at match_end were too long. Every offset up to match_end
+		 * has been checked, so carry on from after it.
+		*/
+		
+		if(match_end == end)
+		{
+			return NULL;
+		}
+		
+		p = match_end + 1;
+	}
+}
+
+const unsigned char *REHex::RegexSearchKernel::rfind(const unsigned char *begin, const unsigned char *end, const unsigned char *limit) const
+{
+	if(!program || begin > end || (limit != NULL && limit <= begin))
+	{
+		return NULL;
+	}
+	
+	/* Offset of the last place a match may begin. */
+	size_t max_start = (limit != NULL && limit <= end) ? ((limit - begin) - 1) : (end - begin);
+	
+	CacheRef cache(*this);
+	size_t max_len = program->max_length;
+	
+	/* Run the reversed expression back from the end, each match state is the start of a
+	 * match which ends by end.
+	*/
+	
+	int32_t s = cache->reverse.start;
+	
+	for(size_t off = (end - begin);;)
+	{
+		if((cache->reverse.flags[s] & DFA::MATCH) && off <= max_start
+			&& (!program->capped || cache->anchored.match_from((begin + off), (begin + std::min((size_t)(end - begin), (off + max_len))))))
+		{
+			return begin + off;
+		}
+		
+		if(off == 0)
+		{
+			return NULL;
+		}
+		
+		s = cache->reverse.next(s, begin[--off]);
+	}
+}
+
+bool REHex::RegexSearchKernel::match_at(const unsigned char *h, const unsigned char *end) const
+{
+	if(!program || h > end)
+	{
+		return false;
+	}
+	
+	CacheRef cache(*this);
+	return cache->anchored.match_from(h, (((size_t)(end - h) > program->max_length) ? (h + program->max_length) : end));
+}
+
+size_t REHex::RegexSearchKernel::match_length(const unsigned char *h, const unsigned char *end) const
+{
+	if(!program || h > end)
+	{
+		return 0;
+	}
+	
+	CacheRef cache(*this);
+	
+	const unsigned char *match_end = cache->anchored.longest_from(h, (((size_t)(end - h) > program->max_length) ? (h + program->max_length) : end));
+	return match_end != NULL ? (match_end - h) : 0;
+}
+
+size_t REHex::RegexSearchKernel::max_length() const
+{
+	return program ? program->max_length : 0;
+}
+
+bool REHex::RegexSearchKernel::matches_empty() const
+{
+	return program && program->matches_empty;
+}
@@ -0,0 +1,122 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef REHEX_REGEXSEARCHKERNEL_HPP
+#define REHEX_REGEXSEARCHKERNEL_HPP
+
+#include <memory>
+#include <stddef.h>
+#include <stdexcept>
+#include <string>
+
+namespace REHex {
+	/* Finds matches of a regular expression within a buffer.
+	 *
+	 * The expression is compiled to an NFA, which is turned into a DFA lazily as the data is
+	 * searched, with each DFA state being built the first time it is reached and cached for
+	 * later searches. Each thread searching with the same kernel takes its own cache from a
+	 * shared pool, and a cache is flushed if it grows too large.
+	 *
+	 * The expression is matched against bytes rather than characters. Supported syntax:
+	 *
+	 *   abc       Literal characters (as UTF-8 if outside of ASCII)
+	 *   .         Any byte (any byte except a newline when the TEXT flag is set)
+	 *   [a-z\x80] Character classes, negated with [^...]
+	 *   \xHH      A byte in hex
+	 *   \d \w \s  Digits, word characters and whitespace (\D \W \S for the inverse)
+	 *   \n \r \t \f \v \0
+	 *   a|b       Alternation
+	 *   (...)     Grouping, also (?:...)
+	 *   * + ?     Repetition, also {n}, {n,} and {n,m}
+	 *
+	 * Only the start of each match is reported, so lazy quantifiers are accepted but behave
+	 * the same as greedy ones. Anchors and backreferences aren't supported.
+	 *
+	 * Matches are found using a forward DFA to find where the earliest match ends, then
+	 * looking back up to max_length() bytes for where the leftmost match begins, so matches
+	 * longer than max_length() (which can only happen when the expression has an unbounded
+	 * repetition) are never reported.
+	*/
+	
+	class RegexSearchKernel
+	{
+		public:
+			class ParseError: public std::runtime_error
+			{
+				public:
+					ParseError(const std::string &what);
+			};
+			
+			/* Letters match regardless of case (ASCII only). */
+			static const unsigned IGNORE_CASE = (1 << 0);
+			
+			/* The data is text, so '.' doesn't match a newline. */
+			static const unsigned TEXT = (1 << 1);
+			
+			/* Default limit on the length of a match. */
+			static const size_t DEFAULT_MAX_LENGTH = 4096;
+			
+			/* Number of DFA states each cache can hold before being flushed. */
+			static const size_t MAX_DFA_STATES = 1024;
+			
+			/* Construct a kernel which matches nothing. */
+			RegexSearchKernel();
+			
+			/* Throws ParseError if the expression is invalid. */
+			RegexSearchKernel(const std::string &pattern, unsigned flags = 0, size_t max_length = DEFAULT_MAX_LENGTH);
+			
+			/* Returns a pointer to the leftmost match which lies entirely between begin
+			 * and end, or NULL if there are none.
+			*/
+			const unsigned char *find(const unsigned char *begin, const unsigned char *end) const;
+			
+			/* Returns a pointer to the last match which lies entirely between begin and
+			 * end and begins before limit (or at/before end, if NULL), or NULL if there
+			 * are none.
+			*/
+			const unsigned char *rfind(const unsigned char *begin, const unsigned char *end, const unsigned char *limit = NULL) const;
+			
+			/* Returns true if a match begins at h and ends by end. */
+			bool match_at(const unsigned char *h, const unsigned char *end) const;
+			
+			/* Returns the length of the longest match which begins at h and ends by
+			 * end, or zero if there isn't one.
+			*/
+			size_t match_length(const unsigned char *h, const unsigned char *end) const;
+			
+			/* Returns the length of the longest match which can be found. */
+			size_t max_length() const;
+			
+			/* Returns true if the expression matches an empty string. */
+			bool matches_empty() const;
+		
+		private:
+			struct Program;
+			class DFA;
+			struct Cache;
+			struct CachePool;
+			class CacheRef;
+			
+			/* The compiled expression is shared between copies of the kernel, along
+			 * with the DFA caches built from it.
+			*/
+			std::shared_ptr<const Program> program;
+			std::shared_ptr<CachePool> caches;
+	};
+}
+
+#endif /* !REHEX_REGEXSEARCHKERNEL_HPP */
@@ -0,0 +1,2129 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "platform.hpp"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define REHEX_SEARCHKERNEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+/* GCC and Clang only allow SSE2/AVX2 intrinsics in functions which are marked as using them
+ * when the whole file isn't built for that instruction set.
+*/
+#ifdef __GNUC__
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+#include "SearchKernel.hpp"
+
+namespace
+{
+	struct NoFold
+	{
+		unsigned char operator()(unsigned char c) const
+		{
+			return c;
+		}
+	};
+	
+	struct AsciiFold
+	{
+		unsigned char operator()(unsigned char c) const
+		{
+			return (c >= 'A' && c <= 'Z') ? (c - 'A' + 'a') : c;
+		}
+	};
+	
+	REHex::SearchKernel::SIMDLevel best_simd()
+	{
+		static const REHex::SearchKernel::SIMDLevel level = REHex::SearchKernel::detect_simd();
+		return level;
+	}
+	
+	/* Accessors for the data being searched, so the same algorithms can read it forwards, or
+	 * backwards when searching for the reversed pattern.
+	*/
+	
+	struct ForwardText
+	{
+		const unsigned char *begin;
+		
+		ForwardText(const unsigned char *begin, const unsigned char *end):
+			begin(begin) {}
+		
+		unsigned char operator[](size_t i) const
+		{
+			return begin[i];
+		}
+		
+		/* Returns the start of a match found at the given offset in search order. */
+		const unsigned char *match(size_t i, size_t length) const
+		{
+			return begin + i;
+		}
+	};
+	
+	struct BackwardText
+	{
+		const unsigned char *last;
+		
+		BackwardText(const unsigned char *begin, const unsigned char *end):
+			last(end - 1) {}
+		
+		unsigned char operator[](size_t i) const
+		{
+			return *(last - i);
+		}
+		
+		const unsigned char *match(size_t i, size_t length) const
+		{
+			return last - i - (length - 1);
+		}
+	};
+	
+	#ifdef REHEX_SEARCHKERNEL_X86
+	inline unsigned int lowest_bit(uint32_t mask)
+	{
+		#ifdef _MSC_VER
+		unsigned long idx;
+		_BitScanForward(&idx, mask);
+		return idx;
+		#else
+		return __builtin_ctz(mask);
+		#endif
+	}
+	
+	inline unsigned int highest_bit(uint32_t mask)
+	{
+		#ifdef _MSC_VER
+		unsigned long idx;
+		_BitScanReverse(&idx, mask);
+		return idx;
+		#else
+		return 31 - __builtin_clz(mask);
+		#endif
+	}
+	
+	/* Set every lane of W bytes in a vector to a value. */
+	
+	template<size_t W> TARGET_SSE2 inline __m128i splat_sse2(uint64_t value)
+	{
+		switch(W)
+		{
+			case 1:  return _mm_set1_epi8((char)(value));
+			case 2:  return _mm_set1_epi16((short)(value));
+			case 4:  return _mm_set1_epi32((int)(value));
+			default: return _mm_set1_epi64x((long long)(value));
+		}
+	}
+	
+	template<size_t W> TARGET_AVX2 inline __m256i splat_avx2(uint64_t value)
+	{
+		switch(W)
+		{
+			case 1:  return _mm256_set1_epi8((char)(value));
+			case 2:  return _mm256_set1_epi16((short)(value));
+			case 4:  return _mm256_set1_epi32((int)(value));
+			default: return _mm256_set1_epi64x((long long)(value));
+		}
+	}
+	#endif
+}
+
+REHex::SearchKernel::SearchKernel():
+	ignore_case(false), two_way(false), forward(), backward(),
+	simd(SIMD_NONE), first_byte(0), first_mask(0), last_byte(0), last_mask(0) {}
+
+REHex::SearchKernel::SearchKernel(const void *pattern, size_t length, bool ignore_case):
+	pattern((const unsigned char*)(pattern), (const unsigned char*)(pattern) + length),
+	ignore_case(ignore_case),
+	two_way(length >= LONG_PATTERN),
+	forward(), backward(),
+	simd(SIMD_NONE), first_byte(0), first_mask(0), last_byte(0), last_mask(0)
+{
+	if(ignore_case)
+	{
+		std::transform(this->pattern.begin(), this->pattern.end(), this->pattern.begin(), AsciiFold());
+	}
+	
+	r_pattern.assign(this->pattern.rbegin(), this->pattern.rend());
+	
+	if(two_way)
+	{
+		init_two_way(this->pattern, &forward);
+		init_two_way(r_pattern, &backward);
+	}
+	else{
+		init_horspool(this->pattern, &forward);
+		init_horspool(r_pattern, &backward);
+	}
+	
+	/* Long patterns stick with Two-Way, since the prefilter could end up comparing the
+	 * whole pattern at every offset.
+	*/
+	if(!two_way && length > 0)
+	{
+		auto letter_mask = [&](unsigned char c)
+		{
+			return (ignore_case && c >= 'a' && c <= 'z') ? 0x20 : 0x00;
+		};
+		
+		simd = best_simd();
+		
+		first_byte = this->pattern.front();
+		first_mask = letter_mask(first_byte);
+		last_byte  = this->pattern.back();
+		last_mask  = letter_mask(last_byte);
+	}
+}
+
+REHex::SearchKernel::SIMDLevel REHex::SearchKernel::detect_simd()
+{
+	#if defined(REHEX_SEARCHKERNEL_X86) && defined(__GNUC__)
+	__builtin_cpu_init();
+	
+	if(__builtin_cpu_supports("avx2"))
+	{
+		return SIMD_AVX2;
+	}
+	else if(__builtin_cpu_supports("sse2"))
+	{
+		return SIMD_SSE2;
+	}
+	
+	#elif defined(REHEX_SEARCHKERNEL_X86) && defined(_MSC_VER)
+	int info[4];
+	
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+	
+	__cpuid(info, 1);
+	bool sse2    = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx     = (info[2] & (1 << 28)) != 0;
+	
+	/* AVX2 also needs the OS to save the YMM registers. */
+	if(max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6)
+	{
+		__cpuidex(info, 7, 0);
+		
+		if((info[1] & (1 << 5)) != 0)
+		{
+			return SIMD_AVX2;
+		}
+	}
+	
+	if(sse2)
+	{
+		return SIMD_SSE2;
+	}
+	#endif
+	
+	return SIMD_NONE;
+}
+
+const unsigned char *REHex::SearchKernel::find(const unsigned char *begin, const unsigned char *end) const
+{
+	if(begin > end || (size_t)(end - begin) < pattern.size())
+	{
+		return NULL;
+	}
+	
+	if(pattern.empty())
+	{
+		return begin;
+	}
+	
+	if(pattern.size() == 1 && !ignore_case)
+	{
+		return (const unsigned char*)(memchr(begin, pattern[0], (end - begin)));
+	}
+	
+	#ifdef REHEX_SEARCHKERNEL_X86
+	if(simd == SIMD_AVX2)
+	{
+		return find_prefilter_avx2(begin, end);
+	}
+	else if(simd == SIMD_SSE2)
+	{
+		return find_prefilter_sse2(begin, end);
+	}
+	#endif
+	
+	ForwardText text(begin, end);
+	
+	if(two_way)
+	{
+		return ignore_case
+			? find_two_way<AsciiFold>(text, (end - begin), pattern.data(), forward)
+			: find_two_way<NoFold>(text, (end - begin), pattern.data(), forward);
+	}
+	else{
+		return ignore_case
+			? find_horspool<AsciiFold>(text, (end - begin), pattern.data(), forward)
+			: find_horspool<NoFold>(text, (end - begin), pattern.data(), forward);
+	}
+}
+
+const unsigned char *REHex::SearchKernel::rfind(const unsigned char *begin, const unsigned char *end) const
+{
+	if(begin > end || (size_t)(end - begin) < pattern.size())
+	{
+		return NULL;
+	}
+	
+	if(pattern.empty())
+	{
+		return end;
+	}
+	
+	#ifdef REHEX_SEARCHKERNEL_X86
+	if(simd == SIMD_AVX2)
+	{
+		return rfind_prefilter_avx2(begin, end);
+	}
+	else if(simd == SIMD_SSE2)
+	{
+		return rfind_prefilter_sse2(begin, end);
+	}
+	#endif
+	
+	BackwardText text(begin, end);
+	
+	if(two_way)
+	{
+		return ignore_case
+			? find_two_way<AsciiFold>(text, (end - begin), r_pattern.data(), backward)
+			: find_two_way<NoFold>(text, (end - begin), r_pattern.data(), backward);
+	}
+	else{
+		return ignore_case
+			? find_horspool<AsciiFold>(text, (end - begin), r_pattern.data(), backward)
+			: find_horspool<NoFold>(text, (end - begin), r_pattern.data(), backward);
+	}
+}
+
+size_t REHex::SearchKernel::length() const
+{
+	return pattern.size();
+}
+
+void REHex::SearchKernel::limit_simd(SIMDLevel level)
+{
+	simd = std::min(simd, level);
+}
+
+void REHex::SearchKernel::init_horspool(const std::vector<unsigned char> &n, Factorisation *f)
+{
+	size_t len = n.size();
+	
+	std::fill(f->skip, f->skip + 256, len);
+	
+	for(size_t i = 0; (i + 1) < len; ++i)
+	{
+		f->skip[ n[i] ] = len - 1 - i;
+	}
+}
+
+/* Find the critical factorisation of the pattern for the Two-Way algorithm, as described by
+ * Crochemore and Perrin ("Two-way string-matching", 1991).
+ *
+ * The split is found by computing the maximal suffix of the pattern under both orderings of
+ * the alphabet and taking the longer of the two. Indices start at -1 (i.e. SIZE_MAX) and rely
+ * on unsigned wraparound, so "split + 1" is zero when the left half is empty.
+*/
+void REHex::SearchKernel::init_two_way(const std::vector<unsigned char> &pattern, Factorisation *f)
+{
+	const unsigned char *n = pattern.data();
+	size_t len = pattern.size();
+	
+	std::fill(f->skip, f->skip + 256, len);
+	
+	for(size_t i = 0; i < len; ++i)
+	{
+		f->skip[ n[i] ] = len - 1 - i;
+	}
+	
+	auto maximal_suffix = [&](bool reverse, size_t *period)
+	{
+		size_t ip = -1, jp = 0, k = 1, p = 1;
+		
+		while((jp + k) < len)
+		{
+			unsigned char a = n[ip + k], b = n[jp + k];
+			
+			if(a == b)
+			{
+				if(k == p)
+				{
+					jp += p;
+					k = 1;
+				}
+				else{
+					++k;
+				}
+			}
+			else if(reverse ? (a < b) : (a > b))
+			{
+				jp += k;
+				k = 1;
+				p = jp - ip;
+			}
+			else{
+				ip = jp++;
+				k = p = 1;
+			}
+		}
+		
+		*period = p;
+		return ip;
+	};
+	
+	size_t period, r_period;
+	size_t split   = maximal_suffix(false, &period);
+	size_t r_split = maximal_suffix(true,  &r_period);
+	
+	if((r_split + 1) > (split + 1))
+	{
+		split  = r_split;
+		period = r_period;
+	}
+	
+	if(memcmp(n, (n + period), (split + 1)) != 0)
+	{
+		/* Pattern isn't periodic, so nothing is remembered after a shift and the shift
+		 * can be larger than the period.
+		*/
+		period       = std::max(split, (len - split - 1)) + 1;
+		f->tw_memory = 0;
+	}
+	else{
+		f->tw_memory = len - period;
+	}
+	
+	f->tw_split  = split;
+	f->tw_period = period;
+}
+
+template<typename Fold, typename Text> const unsigned char *REHex::SearchKernel::find_horspool(const Text &h, size_t h_len, const unsigned char *n, const Factorisation &f) const
+{
+	Fold fold;
+	
+	size_t len = pattern.size();
+	unsigned char last = n[len - 1];
+	
+	for(size_t at = 0; (h_len - at) >= len;)
+	{
+		unsigned char c = fold(h[at + len - 1]);
+		
+		if(c == last)
+		{
+			size_t i = 0;
+			while(i < (len - 1) && fold(h[at + i]) == n[i])
+			{
+				++i;
+			}
+			
+			if(i == (len - 1))
+			{
+				return h.match(at, len);
+			}
+		}
+		
+		at += f.skip[c];
+	}
+	
+	return NULL;
+}
+
+template<typename Fold, typename Text> const unsigned char *REHex::SearchKernel::find_two_way(const Text &h, size_t h_len, const unsigned char *n, const Factorisation &f) const
+{
+	Fold fold;
+	
+	size_t len = pattern.size();
+	
+	/* Number of bytes at the start of the pattern already known to match. */
+	size_t mem = 0;
+	
+	for(size_t at = 0; (h_len - at) >= len;)
+	{
+		/* Check the last byte first and skip ahead if it isn't at the end of the pattern. */
+		
+		size_t k = f.skip[ fold(h[at + len - 1]) ];
+		if(k != 0)
+		{
+			at += std::max(k, mem);
+			mem = 0;
+			
+			continue;
+		}
+		
+		/* Compare the right half of the pattern. */
+		
+		for(k = std::max((f.tw_split + 1), mem); k < len && n[k] == fold(h[at + k]); ++k) {}
+		
+		if(k < len)
+		{
+			at += k - f.tw_split;
+			mem = 0;
+			
+			continue;
+		}
+		
+		/* Compare the left half of the pattern. */
+		
+		for(k = f.tw_split + 1; k > mem && n[k - 1] == fold(h[at + k - 1]); --k) {}
+		
+		if(k <= mem)
+		{
+			return h.match(at, len);
+		}
+		
+		at += f.tw_period;
+		mem = f.tw_memory;
+	}
+	
+	return NULL;
+}
+
+bool REHex::SearchKernel::match_at(const unsigned char *h) const
+{
+	if(!ignore_case)
+	{
+		return memcmp(h, pattern.data(), pattern.size()) == 0;
+	}
+	
+	AsciiFold fold;
+	
+	for(size_t i = 0; i < pattern.size(); ++i)
+	{
+		if(fold(h[i]) != pattern[i])
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+#ifdef REHEX_SEARCHKERNEL_X86
+
+TARGET_SSE2 const unsigned char *REHex::SearchKernel::find_prefilter_sse2(const unsigned char *begin, const unsigned char *end) const
+{
+	size_t len = pattern.size();
+	const unsigned char *last_start = end - len;
+	
+	const __m128i first_v = _mm_set1_epi8((char)(first_byte));
+	const __m128i first_m = _mm_set1_epi8((char)(first_mask));
+	const __m128i last_v  = _mm_set1_epi8((char)(last_byte));
+	const __m128i last_m  = _mm_set1_epi8((char)(last_mask));
+	
+	const unsigned char *h = begin;
+	
+	for(; (last_start - h) >= 15; h += 16)
+	{
+		__m128i first_in = _mm_loadu_si128((const __m128i*)(h));
+		__m128i last_in  = _mm_loadu_si128((const __m128i*)(h + len - 1));
+		
+		__m128i eq = _mm_and_si128(
+			_mm_cmpeq_epi8(_mm_or_si128(first_in, first_m), first_v),
+			_mm_cmpeq_epi8(_mm_or_si128(last_in,  last_m),  last_v));
+		
+		for(uint32_t mask = _mm_movemask_epi8(eq); mask != 0; mask &= (mask - 1))
+		{
+			const unsigned char *candidate = h + lowest_bit(mask);
+			
+			if(match_at(candidate))
+			{
+				return candidate;
+			}
+		}
+	}
+	
+	/* Check any offsets left over at the end one at a time. */
+	
+	for(; h <= last_start; ++h)
+	{
+		if((h[0] | first_mask) == first_byte && (h[len - 1] | last_mask) == last_byte && match_at(h))
+		{
+			return h;
+		}
+	}
+	
+	return NULL;
+}
+
+TARGET_AVX2 const unsigned char *REHex::SearchKernel::find_prefilter_avx2(const unsigned char *begin, const unsigned char *end) const
+{
+	size_t len = pattern.size();
+	const unsigned char *last_start = end - len;
+	
+	const __m256i first_v = _mm256_set1_epi8((char)(first_byte));
+	const __m256i first_m = _mm256_set1_epi8((char)(first_mask));
+	const __m256i last_v  = _mm256_set1_epi8((char)(last_byte));
+	const __m256i last_m  = _mm256_set1_epi8((char)(last_mask));
+	
+	const unsigned char *h = begin;
+	
+	for(; (last_start - h) >= 31; h += 32)
+	{
+		__m256i first_in = _mm256_loadu_si256((const __m256i*)(h));
+		__m256i last_in  = _mm256_loadu_si256((const __m256i*)(h + len - 1));
+		
+		__m256i eq = _mm256_and_si256(
+			_mm256_cmpeq_epi8(_mm256_or_si256(first_in, first_m), first_v),
+			_mm256_cmpeq_epi8(_mm256_or_si256(last_in,  last_m),  last_v));
+		
+		for(uint32_t mask = _mm256_movemask_epi8(eq); mask != 0; mask &= (mask - 1))
+		{
+			const unsigned char *candidate = h + lowest_bit(mask);
+			
+			if(match_at(candidate))
+			{
+				return candidate;
+			}
+		}
+	}
+	
+	/* Finish off with SSE2 (or one at a time) for anything less than 32 offsets. */
+	
+	return find_prefilter_sse2(h, end);
+}
+
+TARGET_SSE2 const unsigned char *REHex::SearchKernel::rfind_prefilter_sse2(const unsigned char *begin, const unsigned char *end) const
+{
+	size_t len = pattern.size();
+	
+	/* Number of offsets from begin which haven't been checked yet. */
+	size_t n_starts = (end - begin) - len + 1;
+	
+	const __m128i first_v = _mm_set1_epi8((char)(first_byte));
+	const __m128i first_m = _mm_set1_epi8((char)(first_mask));
+	const __m128i last_v  = _mm_set1_epi8((char)(last_byte));
+	const __m128i last_m  = _mm_set1_epi8((char)(last_mask));
+	
+	for(; n_starts >= 16; n_starts -= 16)
+	{
+		const unsigned char *h = begin + n_starts - 16;
+		
+		__m128i first_in = _mm_loadu_si128((const __m128i*)(h));
+		__m128i last_in  = _mm_loadu_si128((const __m128i*)(h + len - 1));
+		
+		__m128i eq = _mm_and_si128(
+			_mm_cmpeq_epi8(_mm_or_si128(first_in, first_m), first_v),
+			_mm_cmpeq_epi8(_mm_or_si128(last_in,  last_m),  last_v));
+		
+		for(uint32_t mask = _mm_movemask_epi8(eq); mask != 0;)
+		{
+			unsigned int bit = highest_bit(mask);
+			const unsigned char *candidate = h + bit;
+			
+			if(match_at(candidate))
+			{
+				return candidate;
+			}
+			
+			mask ^= (1U << bit);
+		}
+	}
+	
+	/* Check any offsets left over at the start one at a time. */
+	
+	while(n_starts > 0)
+	{
+		const unsigned char *h = begin + (--n_starts);
+		
+		if((h[0] | first_mask) == first_byte && (h[len - 1] | last_mask) == last_byte && match_at(h))
+		{
+			return h;
+		}
+	}
+	
+	return NULL;
+}
+
+TARGET_AVX2 const unsigned char *REHex::SearchKernel::rfind_prefilter_avx2(const unsigned char *begin, const unsigned char *end) const
+{
+	size_t len = pattern.size();
+	
+	/* Number of offsets from begin which haven't been checked yet. */
+	size_t n_starts = (end - begin) - len + 1;
+	
+	const __m256i first_v = _mm256_set1_epi8((char)(first_byte));
+	const __m256i first_m = _mm256_set1_epi8((char)(first_mask));
+	const __m256i last_v  = _mm256_set1_epi8((char)(last_byte));
+	const __m256i last_m  = _mm256_set1_epi8((char)(last_mask));
+	
+	for(; n_starts >= 32; n_starts -= 32)
+	{
+		const unsigned char *h = begin + n_starts - 32;
+		
+		__m256i first_in = _mm256_loadu_si256((const __m256i*)(h));
+		__m256i last_in  = _mm256_loadu_si256((const __m256i*)(h + len - 1));
+		
+		__m256i eq = _mm256_and_si256(
+			_mm256_cmpeq_epi8(_mm256_or_si256(first_in, first_m), first_v),
+			_mm256_cmpeq_epi8(_mm256_or_si256(last_in,  last_m),  last_v));
+		
+		for(uint32_t mask = _mm256_movemask_epi8(eq); mask != 0;)
+		{
+			unsigned int bit = highest_bit(mask);
+			const unsigned char *candidate = h + bit;
+			
+			if(match_at(candidate))
+			{
+				return candidate;
+			}
+			
+			mask ^= (1U << bit);
+		}
+	}
+	
+	/* Finish off with SSE2 (or one at a time) for anything less than 32 offsets. */
+	
+	return rfind_prefilter_sse2(begin, (begin + n_starts + len - 1));
+}
+
+#endif
+
+REHex::MultiSearchKernel::MultiSearchKernel():
+	ignore_case(false), max_len(0), match_empty(false) {}
+
+REHex::MultiSearchKernel::MultiSearchKernel(const std::vector< std::vector<unsigned char> > &patterns, bool ignore_case, size_t small_set):
+	patterns(patterns), ignore_case(ignore_case), max_len(0), match_empty(false)
+{
+	for(auto p = this->patterns.begin(); p != this->patterns.end(); ++p)
+	{
+		if(ignore_case)
+		{
+			std::transform(p->begin(), p->end(), p->begin(), AsciiFold());
+		}
+		
+		max_len = std::max(max_len, p->size());
+		
+		if(p->empty())
+		{
+			match_empty = true;
+		}
+	}
+	
+	if(patterns.size() <= small_set)
+	{
+		kernels.reserve(patterns.size());
+		
+		for(auto p = patterns.begin(); p != patterns.end(); ++p)
+		{
+			kernels.emplace_back(p->data(), p->size(), ignore_case);
+		}
+	}
+	else{
+		build_automaton(this->patterns, ignore_case, &forward);
+		
+		std::vector< std::vector<unsigned char> > r_patterns;
+		r_patterns.reserve(patterns.size());
+		
+		for(auto p = this->patterns.begin(); p != this->patterns.end(); ++p)
+		{
+			r_patterns.push_back(std::vector<unsigned char>(p->rbegin(), p->rend()));
+		}
+		
+		build_automaton(r_patterns, ignore_case, &backward);
+	}
+}
+
+const unsigned char *REHex::MultiSearchKernel::find(const unsigned char *begin, const unsigned char *end, size_t *pattern_idx) const
+{
+	if(begin > end || patterns.empty())
+	{
+		return NULL;
+	}
+	
+	if(match_empty)
+	{
+		/* An empty pattern matches anywhere, but prefer any longer one which also
+		 * matches at the start.
+		*/
+		
+		if(pattern_idx != NULL)
+		{
+			*pattern_idx = longest_at(begin, end);
+		}
+		
+		return begin;
+	}
+	
+	return kernels.empty()
+		? find_automaton(begin, end, pattern_idx)
+		: find_kernels(begin, end, pattern_idx);
+}
+
+const unsigned char *REHex::MultiSearchKernel::rfind(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t *pattern_idx) const
+{
+	if(limit == NULL || limit > end)
+	{
+		limit = end;
+	}
+	
+	if(begin >= limit || patterns.empty())
+	{
+		return NULL;
+	}
+	
+	if(match_empty)
+	{
+		/* An empty pattern matches anywhere, but prefer any longer one which also
+		 * matches at the last offset.
+		*/
+		
+		if(pattern_idx != NULL)
+		{
+			*pattern_idx = longest_at((limit - 1), end);
+		}
+		
+		return limit - 1;
+	}
+	
+	return kernels.empty()
+		? rfind_automaton(begin, end, limit, pattern_idx)
+		: rfind_kernels(begin, end, limit, pattern_idx);
+}
+
+size_t REHex::MultiSearchKernel::size() const
+{
+	return patterns.size();
+}
+
+size_t REHex::MultiSearchKernel::max_length() const
+{
+	return max_len;
+}
+
+void REHex::MultiSearchKernel::build_automaton(const std::vector< std::vector<unsigned char> > &patterns, bool ignore_case, Automaton *a)
+{
+	/* Build a trie of the patterns. Missing transitions are left as zero (the root) for
+	 * now, the root is never the target of a transition in the trie itself.
+	*/
+	
+	a->transitions.assign(256, 0);
+	a->state_match.assign(1, 0);
+	
+	for(size_t i = 0; i < patterns.size(); ++i)
+	{
+		uint32_t state = 0;
+		
+		for(auto c = patterns[i].begin(); c != patterns[i].end(); ++c)
+		{
+			uint32_t &next = a->transitions[(state * 256) + *c];
+			
+			if(next == 0)
+			{
+				next = a->state_match.size() * 256;
+				
+				a->state_match.push_back(0);
+				a->transitions.resize((a->state_match.size() * 256), 0);
+			}
+			
+			state = a->transitions[(state * 256) + *c] / 256;
+		}
+		
+		if(a->state_match[state] == 0)
+		{
+			a->state_match[state] = i + 1;
+		}
+	}
+	
+	/* Walk the trie breadth first, finding the failure link of each state (the longest
+	 * proper suffix of the state which is also in the trie) and filling in the missing
+	 * transitions from it. The failure link is always shallower than the state, so has
+	 * already been completed by the time it is needed.
+	*/
+	
+	std::vector<uint32_t> fail(a->state_match.size(), 0);
+	std::deque<uint32_t> queue;
+	
+	for(unsigned c = 0; c < 256; ++c)
+	{
+		uint32_t child = a->transitions[c] / 256;
+		
+		if(child != 0)
+		{
+			queue.push_back(child);
+		}
+	}
+	
+	while(!queue.empty())
+	{
+		uint32_t state = queue.front();
+		queue.pop_front();
+		
+		/* Any pattern ending at the failure link also ends here, but is shorter than one
+		 * which ends here directly.
+		*/
+		if(a->state_match[state] == 0)
+		{
+			a->state_match[state] = a->state_match[ fail[state] ];
+		}
+		
+		for(unsigned c = 0; c < 256; ++c)
+		{
+			uint32_t &next = a->transitions[(state * 256) + c];
+			uint32_t fail_next = a->transitions[(fail[state] * 256) + c];
+			
+			if(next != 0)
+			{
+				fail[next / 256] = fail_next / 256;
+				queue.push_back(next / 256);
+			}
+			else{
+				next = fail_next;
+			}
+		}
+	}
+	
+	/* The patterns have been folded to lower case, so upper case letters can just take
+	 * the same transitions.
+	*/
+	if(ignore_case)
+	{
+		for(size_t state = 0; state < a->state_match.size(); ++state)
+		{
+			uint32_t *st = a->transitions.data() + (state * 256);
+			std::copy((st + 'a'), (st + 'z' + 1), (st + 'A'));
+		}
+	}
+}
+
+const unsigned char *REHex::MultiSearchKernel::find_kernels(const unsigned char *begin, const unsigned char *end, size_t *pattern_idx) const
+{
+	const unsigned char *first_match = NULL;
+	size_t first_idx = 0;
+	
+	for(size_t i = 0; i < kernels.size(); ++i)
+	{
+		/* Only search as far as a match which would begin at or before the earliest match
+		 * found so far.
+		*/
+		
+		const unsigned char *k_end = (first_match != NULL)
+			? std::min(end, (first_match + kernels[i].length()))
+			: end;
+		
+		const unsigned char *match = kernels[i].find(begin, k_end);
+		
+		if(match != NULL && (first_match == NULL || match < first_match
+			|| (match == first_match && kernels[i].length() > kernels[first_idx].length())))
+		{
+			first_match = match;
+			first_idx   = i;
+		}
+	}
+	
+	if(first_match != NULL && pattern_idx != NULL)
+	{
+		*pattern_idx = first_idx;
+	}
+	
+	return first_match;
+}
+
+const unsigned char *REHex::MultiSearchKernel::find_automaton(const unsigned char *begin, const unsigned char *end, size_t *pattern_idx) const
+{
+	const uint32_t *t = forward.transitions.data();
+	uint32_t state = 0;
+	
+	const unsigned char *first_match = NULL;
+	size_t first_idx = 0;
+	
+	for(const unsigned char *p = begin; p < end; ++p)
+	{
+		state = t[state + *p];
+		
+		uint32_t match = forward.state_match[state / 256];
+		if(match != 0)
+		{
+			/* Patterns are matched by where they end, so a longer pattern ending later
+			 * could still begin before (or at) this one.
+			*/
+			
+			const unsigned char *match_begin = p + 1 - patterns[match - 1].size();
+			
+			if(first_match == NULL || match_begin < first_match
+				|| (match_begin == first_match && patterns[match - 1].size() > patterns[first_idx].size()))
+			{
+				first_match = match_begin;
+				first_idx   = match - 1;
+			}
+		}
+		
+		/* Stop once any further match would have to begin after the earliest one. */
+		if(first_match != NULL && (size_t)((p + 2) - first_match) > max_len)
+		{
+			break;
+		}
+	}
+	
+	if(first_match != NULL && pattern_idx != NULL)
+	{
+		*pattern_idx = first_idx;
+	}
+	
+	return first_match;
+}
+
+const unsigned char *REHex::MultiSearchKernel::rfind_kernels(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t *pattern_idx) const
+{
+	const unsigned char *last_match = NULL;
+	size_t last_idx = 0;
+	
+	for(size_t i = 0; i < kernels.size(); ++i)
+	{
+		/* Only search for matches which would begin before the limit and at or after the
+		 * last match found so far.
+		*/
+		
+		const unsigned char *k_begin = (last_match != NULL) ? last_match : begin;
+		const unsigned char *k_end   = ((size_t)(end - limit) >= kernels[i].length()) ? (limit + kernels[i].length() - 1) : end;
+		
+		const unsigned char *match = kernels[i].rfind(k_begin, k_end);
+		
+		if(match != NULL && (last_match == NULL || match > last_match
+			|| (match == last_match && kernels[i].length() > kernels[last_idx].length())))
+		{
+			last_match = match;
+			last_idx   = i;
+		}
+	}
+	
+	if(last_match != NULL && pattern_idx != NULL)
+	{
+		*pattern_idx = last_idx;
+	}
+	
+	return last_match;
+}
+
+const unsigned char *REHex::MultiSearchKernel::rfind_automaton(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t *pattern_idx) const
+{
+	const uint32_t *t = backward.transitions.data();
+	uint32_t state = 0;
+	
+	/* The reversed patterns are matched by where they end, i.e. where the pattern begins, so
+	 * reading backwards the first match found before the limit is the last one.
+	*/
+	
+	const unsigned char *r_begin = ((size_t)(end - limit) >= max_len) ? (limit + max_len - 1) : end;
+	
+	for(const unsigned char *p = r_begin; p > begin;)
+	{
+		--p;
+		state = t[state + *p];
+		
+		uint32_t match = backward.state_match[state / 256];
+		if(match != 0 && p < limit)
+		{
+			if(pattern_idx != NULL)
+			{
+				*pattern_idx = match - 1;
+			}
+			
+			return p;
+		}
+	}
+	
+	return NULL;
+}
+
+/* Returns the index of the longest pattern which matches at the given offset, for use when
+ * there is an empty pattern to fall back to.
+*/
+size_t REHex::MultiSearchKernel::longest_at(const unsigned char *at, const unsigned char *end) const
+{
+	size_t longest = 0;
+	while(!patterns[longest].empty())
+	{
+		++longest;
+	}
+	
+	for(size_t i = 0; i < patterns.size(); ++i)
+	{
+		const std::vector<unsigned char> &p = patterns[i];
+		
+		if(p.size() > patterns[longest].size()
+			&& p.size() <= (size_t)(end - at)
+			&& (ignore_case
+				? std::equal(p.begin(), p.end(), at, [](unsigned char n, unsigned char h) { return n == AsciiFold()(h); })
+				: memcmp(at, p.data(), p.size()) == 0))
+		{
+			longest = i;
+		}
+	}
+	
+	return longest;
+}
+
+REHex::MaskedSearchKernel::MaskedSearchKernel():
+	anchored(false), anchor_at(0), simd(SearchKernel::SIMD_NONE), probe1(0), probe2(0) {}
+
+REHex::MaskedSearchKernel::MaskedSearchKernel(const unsigned char *pattern, const unsigned char *mask, size_t length):
+	value(length),
+	mask(mask, mask + length),
+	anchored(false),
+	anchor_at(0),
+	simd(SearchKernel::SIMD_NONE),
+	probe1(0),
+	probe2(0)
+{
+	size_t anchor_length = 0;
+	
+	for(size_t i = 0, run = 0; i < length; ++i)
+	{
+		value[i] = pattern[i] & mask[i];
+		
+		run = (mask[i] == 0xFF) ? (run + 1) : 0;
+		
+		if(run > anchor_length)
+		{
+			anchor_length = run;
+			anchor_at     = i + 1 - run;
+		}
+	}
+	
+	if(anchor_length >= 2)
+	{
+		anchored = true;
+		anchor   = SearchKernel((value.data() + anchor_at), anchor_length);
+	}
+	else if(length > 0)
+	{
+		/* Probe the bytes with the most fixed bits, since they are the least likely to
+		 * match by chance.
+		*/
+		
+		auto fixed_bits = [&](size_t i)
+		{
+			unsigned int bits = 0;
+			for(unsigned char m = mask[i]; m != 0; m &= (m - 1)) { ++bits; }
+			
+			return bits;
+		};
+		
+		for(size_t i = 1; i < length; ++i)
+		{
+			if(fixed_bits(i) > fixed_bits(probe1))
+			{
+				probe1 = i;
+			}
+		}
+		
+		probe2 = (probe1 == 0 && length > 1) ? 1 : 0;
+		
+		for(size_t i = 0; i < length; ++i)
+		{
+			if(i != probe1 && fixed_bits(i) > fixed_bits(probe2))
+			{
+				probe2 = i;
+			}
+		}
+		
+		simd = best_simd();
+	}
+}
+
+const unsigned char *REHex::MaskedSearchKernel::find(const unsigned char *begin, const unsigned char *end) const
+{
+	if(begin > end || (size_t)(end - begin) < value.size())
+	{
+		return NULL;
+	}
+	
+	if(value.empty())
+	{
+		return begin;
+	}
+	
+	if(anchored)
+	{
+		return find_anchor(begin, end);
+	}
+	
+	#ifdef REHEX_SEARCHKERNEL_X86
+	if(simd == SearchKernel::SIMD_AVX2)
+	{
+		return find_probe_avx2(begin, end);
+	}
+	else if(simd == SearchKernel::SIMD_SSE2)
+	{
+		return find_probe_sse2(begin, end);
+	}
+	#endif
+	
+	return find_probe(begin, end);
+}
+
+const unsigned char *REHex::MaskedSearchKernel::rfind(const unsigned char *begin, const unsigned char *end) const
+{
+	if(begin > end || (size_t)(end - begin) < value.size())
+	{
+		return NULL;
+	}
+	
+	if(value.empty())
+	{
+		return end;
+	}
+	
+	if(anchored)
+	{
+		return rfind_anchor(begin, end);
+	}
+	
+	#ifdef REHEX_SEARCHKERNEL_X86
+	if(simd == SearchKernel::SIMD_AVX2)
+	{
+		return rfind_probe_avx2(begin, end);
+	}
+	else if(simd == SearchKernel::SIMD_SSE2)
+	{
+		return rfind_probe_sse2(begin, end);
+	}
+	#endif
+	
+	return rfind_probe(begin, end);
+}
+
+bool REHex::MaskedSearchKernel::match_at(const unsigned char *h) const
+{
+	for(size_t i = 0; i < value.size(); ++i)
+	{
+		if((h[i] & mask[i]) != value[i])
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+size_t REHex::MaskedSearchKernel::length() const
+{
+	return value.size();
+}
+
+void REHex::MaskedSearchKernel::limit_simd(SearchKernel::SIMDLevel level)
+{
+	simd = std::min(simd, level);
+	anchor.limit_simd(level);
+}
+
+const unsigned char *REHex::MaskedSearchKernel::find_anchor(const unsigned char *begin, const unsigned char *end) const
+{
+	/* The anchor must leave room for the rest of the pattern on either side. */
+	const unsigned char *a_begin = begin + anchor_at;
+	const unsigned char *a_end   = end - (value.size() - anchor_at - anchor.length());
+	
+	for(const unsigned char *a = a_begin; (a = anchor.find(a, a_end)) != NULL; ++a)
+	{
+		if(match_at(a - anchor_at))
+		{
+			return a - anchor_at;
+		}
+	}
+	
+	return NULL;
+}
+
+const unsigned char *REHex::MaskedSearchKernel::rfind_anchor(const unsigned char *begin, const unsigned char *end) const
+{
+	const unsigned char *a_begin = begin + anchor_at;
+	const unsigned char *a_end   = end - (value.size() - anchor_at - anchor.length());
+	
+	for(const unsigned char *a; (a = anchor.rfind(a_begin, a_end)) != NULL;)
+	{
+		if(match_at(a - anchor_at))
+		{
+			return a - anchor_at;
+		}
+		
+		/* Look for the anchor beginning before this one next. */
+		a_end = a + anchor.length() - 1;
+	}
+	
+	return NULL;
+}
+
+bool REHex::MaskedSearchKernel::probe_at(const unsigned char *h) const
+{
+	return (h[probe1] & mask[probe1]) == value[probe1]
+		&& (h[probe2] & mask[probe2]) == value[probe2];
+}
+
+const unsigned char *REHex::MaskedSearchKernel::find_probe(const unsigned char *begin, const unsigned char *end) const
+{
+	const unsigned char *last_start = end - value.size();
+	
+	for(const unsigned char *h = begin; h <= last_start; ++h)
+	{
+		if(probe_at(h) && match_at(h))
+		{
+			return h;
+		}
+	}
+	
+	return NULL;
+}
+
+const unsigned char *REHex::MaskedSearchKernel::rfind_probe(const unsigned char *begin, const unsigned char *end) const
+{
+	for(size_t n_starts = (end - begin) - value.size() + 1; n_starts > 0;)
+	{
+		const unsigned char *h = begin + (--n_starts);
+		
+		if(probe_at(h) && match_at(h))
+		{
+			return h;
+		}
+	}
+	
+	return NULL;
+}
+
+#ifdef REHEX_SEARCHKERNEL_X86
+
+TARGET_SSE2 const unsigned char *REHex::MaskedSearchKernel::find_probe_sse2(const unsigned char *begin, const unsigned char *end) const
+{
+	const unsigned char *last_start = end - value.size();
+	
+	const __m128i v1 = _mm_set1_epi8((char)(value[probe1]));
+	const __m128i m1 = _mm_set1_epi8((char)(mask[probe1]));
+	const __m128i v2 = _mm_set1_epi8((char)(value[probe2]));
+	const __m128i m2 = _mm_set1_epi8((char)(mask[probe2]));
+	
+	const unsigned char *h = begin;
+	
+	for(; (last_start - h) >= 15; h += 16)
+	{
+		__m128i in1 = _mm_loadu_si128((const __m128i*)(h + probe1));
+		__m128i in2 = _mm_loadu_si128((const __m128i*)(h + probe2));
+		
+		__m128i eq = _mm_and_si128(
+			_mm_cmpeq_epi8(_mm_and_si128(in1, m1), v1),
+			_mm_cmpeq_epi8(_mm_and_si128(in2, m2), v2));
+		
+		for(uint32_t bits = _mm_movemask_epi8(eq); bits != 0; bits &= (bits - 1))
+		{
+			const unsigned char *candidate = h + lowest_bit(bits);
+			
+			if(match_at(candidate))
+			{
+				return candidate;
+			}
+		}
+	}
+	
+	/* Check any offsets left over at the end one at a time. */
+	return find_probe(h, end);
+}
+
+TARGET_AVX2 const unsigned char *REHex::MaskedSearchKernel::find_probe_avx2(const unsigned char *begin, const unsigned char *end) const
+{
+	const unsigned char *last_start = end - value.size();
+	
+	const __m256i v1 = _mm256_set1_epi8((char)(value[probe1]));
+	const __m256i m1 = _mm256_set1_epi8((char)(mask[probe1]));
+	const __m256i v2 = _mm256_set1_epi8((char)(value[probe2]));
+	const __m256i m2 = _mm256_set1_epi8((char)(mask[probe2]));
+	
+	const unsigned char *h = begin;
+	
+	for(; (last_start - h) >= 31; h += 32)
+	{
+		__m256i in1 = _mm256_loadu_si256((const __m256i*)(h + probe1));
+		__m256i in2 = _mm256_loadu_si256((const __m256i*)(h + probe2));
+		
+		__m256i eq = _mm256_and_si256(
+			_mm256_cmpeq_epi8(_mm256_and_si256(in1, m1), v1),
+			_mm256_cmpeq_epi8(_mm256_and_si256(in2, m2), v2));
+		
+		for(uint32_t bits = _mm256_movemask_epi8(eq); bits != 0; bits &= (bits - 1))
+		{
+			const unsigned char *candidate = h + lowest_bit(bits);
+			
+			if(match_at(candidate))
+			{
+				return candidate;
+			}
+		}
+	}
+	
+	/* Finish off with SSE2 (or one at a time) for anything less than 32 offsets. */
+	return find_probe_sse2(h, end);
+}
+
+TARGET_SSE2 const unsigned char *REHex::MaskedSearchKernel::rfind_probe_sse2(const unsigned char *begin, const unsigned char *end) const
+{
+	size_t len = value.size();
+	
+	/* Number of offsets from begin which haven't been checked yet. */
+	size_t n_starts = (end - begin) - len + 1;
+	
+	const __m128i v1 = _mm_set1_epi8((char)(value[probe1]));
+	const __m128i m1 = _mm_set1_epi8((char)(mask[probe1]));
+	const __m128i v2 = _mm_set1_epi8((char)(value[probe2]));
+	const __m128i m2 = _mm_set1_epi8((char)(mask[probe2]));
+	
+	for(; n_starts >= 16; n_starts -= 16)
+	{
+		const unsigned char *h = begin + n_starts - 16;
+		
+		__m128i in1 = _mm_loadu_si128((const __m128i*)(h + probe1));
+		__m128i in2 = _mm_loadu_si128((const __m128i*)(h + probe2));
+		
+		__m128i eq = _mm_and_si128(
+			_mm_cmpeq_epi8(_mm_and_si128(in1, m1), v1),
+			_mm_cmpeq_epi8(_mm_and_si128(in2, m2), v2));
+		
+		for(uint32_t bits = _mm_movemask_epi8(eq); bits != 0;)
+		{
+			unsigned int bit = highest_bit(bits);
+			const unsigned char *candidate = h + bit;
+			
+			if(match_at(candidate))
+			{
+				return candidate;
+			}
+			
+			bits ^= (1U << bit);
+		}
+	}
+	
+	/* Check any offsets left over at the start one at a time. */
+	return rfind_probe(begin, (begin + n_starts + len - 1));
+}
+
+TARGET_AVX2 const unsigned char *REHex::MaskedSearchKernel::rfind_probe_avx2(const unsigned char *begin, const unsigned char *end) const
+{
+	size_t len = value.size();
+	
+	/* Number of offsets from begin which haven't been checked yet. */
+	size_t n_starts = (end - begin) - len + 1;
+	
+	const __m256i v1 = _mm256_set1_epi8((char)(value[probe1]));
+	const __m256i m1 = _mm256_set1_epi8((char)(mask[probe1]));
+	const __m256i v2 = _mm256_set1_epi8((char)(value[probe2]));
+	const __m256i m2 = _mm256_set1_epi8((char)(mask[probe2]));
+	
+	for(; n_starts >= 32; n_starts -= 32)
+	{
+		const unsigned char *h = begin + n_starts - 32;
+		
+		__m256i in1 = _mm256_loadu_si256((const __m256i*)(h + probe1));
+		__m256i in2 = _mm256_loadu_si256((const __m256i*)(h + probe2));
+		
+		__m256i eq = _mm256_and_si256(
+			_mm256_cmpeq_epi8(_mm256_and_si256(in1, m1), v1),
+			_mm256_cmpeq_epi8(_mm256_and_si256(in2, m2), v2));
+		
+		for(uint32_t bits = _mm256_movemask_epi8(eq); bits != 0;)
+		{
+			unsigned int bit = highest_bit(bits);
+			const unsigned char *candidate = h + bit;
+			
+			if(match_at(candidate))
+			{
+				return candidate;
+			}
+			
+			bits ^= (1U << bit);
+		}
+	}
+	
+	/* Finish off with SSE2 (or one at a time) for anything less than 32 offsets. */
+	return rfind_probe_sse2(begin, (begin + n_starts + len - 1));
+}
+
+#endif
+
+REHex::RangeSearchKernel::RangeSearchKernel():
+	w(1), big_endian(false), empty(true), is_float(false), flip(0), min_key(0), span(0), simd(SearchKernel::SIMD_NONE) {}
+
+REHex::RangeSearchKernel::RangeSearchKernel(size_t width, bool big_endian, Type type, uint64_t min_key, uint64_t max_key):
+	w(width),
+	big_endian(big_endian),
+	empty(min_key > max_key),
+	is_float(type == FLOAT),
+	flip(type == UNSIGNED ? 0 : (1ULL << ((width * 8) - 1))),
+	min_key(min_key),
+	span(max_key - min_key),
+	simd(best_simd()) {}
+
+REHex::RangeSearchKernel REHex::RangeSearchKernel::unsigned_range(size_t width, bool big_endian, uint64_t min, uint64_t max)
+{
+	uint64_t type_max = (width < 8) ? ((1ULL << (width * 8)) - 1) : UINT64_MAX;
+	
+	if(min > type_max)
+	{
+		return RangeSearchKernel(width, big_endian, UNSIGNED, 1, 0);
+	}
+	
+	return RangeSearchKernel(width, big_endian, UNSIGNED, min, std::min(max, type_max));
+}
+
+REHex::RangeSearchKernel REHex::RangeSearchKernel::signed_range(size_t width, bool big_endian, int64_t min, int64_t max)
+{
+	int64_t type_max = (width < 8) ? ((1LL << ((width * 8) - 1)) - 1) : INT64_MAX;
+	int64_t type_min = -type_max - 1;
+	
+	if(min > type_max || max < type_min || min > max)
+	{
+		return RangeSearchKernel(width, big_endian, SIGNED, 1, 0);
+	}
+	
+	min = std::max(min, type_min);
+	max = std::min(max, type_max);
+	
+	/* Flipping the sign bit puts the most negative value first. */
+	
+	uint64_t sign = 1ULL << ((width * 8) - 1);
+	uint64_t mask = sign | (sign - 1);
+	
+	return RangeSearchKernel(width, big_endian, SIGNED, (((uint64_t)(min) & mask) ^ sign), (((uint64_t)(max) & mask) ^ sign));
+}
+
+REHex::RangeSearchKernel REHex::RangeSearchKernel::float_range(size_t width, bool big_endian, double min, double max)
+{
+	if(std::isnan(min) || std::isnan(max) || min > max)
+	{
+		return RangeSearchKernel(width, big_endian, FLOAT, 1, 0);
+	}
+	
+	/* -0.0 sorts just before 0.0, so include both if the range begins or ends at zero. */
+	
+	if(min == 0.0)
+	{
+		min = -0.0;
+	}
+	
+	if(max == 0.0)
+	{
+		max = 0.0;
+	}
+	
+	/* Keys of positive floats have the sign bit set, negative ones have every bit flipped
+	 * so that larger magnitudes come first.
+	*/
+	
+	auto key = [](uint64_t bits, uint64_t sign)
+	{
+		return (bits & sign) ? (bits ^ (sign | (sign - 1))) : (bits | sign);
+	};
+	
+	if(width == 4)
+	{
+		/* Round the bounds to the nearest floats inside the range. */
+		
+		float f_min = (float)(min);
+		if(f_min < min)
+		{
+			f_min = std::nextafter(f_min, INFINITY);
+		}
+		
+		float f_max = (float)(max);
+		if(f_max > max)
+		{
+			f_max = std::nextafter(f_max, -INFINITY);
+		}
+		
+		if(f_min > f_max)
+		{
+			return RangeSearchKernel(width, big_endian, FLOAT, 1, 0);
+		}
+		
+		uint32_t b_min, b_max;
+		memcpy(&b_min, &f_min, sizeof(b_min));
+		memcpy(&b_max, &f_max, sizeof(b_max));
+		
+		return RangeSearchKernel(width, big_endian, FLOAT, key(b_min, 0x80000000ULL), key(b_max, 0x80000000ULL));
+	}
+	else{
+		uint64_t b_min, b_max;
+		memcpy(&b_min, &min, sizeof(b_min));
+		memcpy(&b_max, &max, sizeof(b_max));
+		
+		return RangeSearchKernel(width, big_endian, FLOAT, key(b_min, 0x8000000000000000ULL), key(b_max, 0x8000000000000000ULL));
+	}
+}
+
+const unsigned char *REHex::RangeSearchKernel::find(const unsigned char *begin, const unsigned char *end, size_t stride) const
+{
+	if(empty || begin > end || (size_t)(end - begin) < w)
+	{
+		return NULL;
+	}
+	
+	stride = std::max<size_t>(stride, 1);
+	
+	switch(w)
+	{
+		case 1:  return find_width<1>(begin, end, stride);
+		case 2:  return find_width<2>(begin, end, stride);
+		case 4:  return find_width<4>(begin, end, stride);
+		case 8:  return find_width<8>(begin, end, stride);
+		default: return NULL;
+	}
+}
+
+const unsigned char *REHex::RangeSearchKernel::rfind(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride) const
+{
+	if(limit == NULL)
+	{
+		limit = end;
+	}
+	
+	stride = std::max<size_t>(stride, 1);
+	
+	if(empty || begin > end || limit <= begin || (size_t)(end - begin) < w)
+	{
+		return NULL;
+	}
+	
+	/* Find the offset of the last value which begins a multiple of stride below (limit - 1)
+	 * and fits before end.
+	*/
+	
+	size_t top = (limit - begin) - 1;
+	size_t last_start = (end - begin) - w;
+	
+	if(top > last_start)
+	{
+		size_t over = top - last_start;
+		size_t back = ((over + stride - 1) / stride) * stride;
+		
+		if(back > top)
+		{
+			return NULL;
+		}
+		
+		top -= back;
+	}
+	
+	switch(w)
+	{
+		case 1:  return rfind_width<1>(begin, end, top, stride);
+		case 2:  return rfind_width<2>(begin, end, top, stride);
+		case 4:  return rfind_width<4>(begin, end, top, stride);
+		case 8:  return rfind_width<8>(begin, end, top, stride);
+		default: return NULL;
+	}
+}
+
+bool REHex::RangeSearchKernel::match_at(const unsigned char *h) const
+{
+	if(empty)
+	{
+		return false;
+	}
+	
+	switch(w)
+	{
+		case 1:  return match_at<1>(h);
+		case 2:  return match_at<2>(h);
+		case 4:  return match_at<4>(h);
+		case 8:  return match_at<8>(h);
+		default: return false;
+	}
+}
+
+size_t REHex::RangeSearchKernel::width() const
+{
+	return w;
+}
+
+void REHex::RangeSearchKernel::limit_simd(SearchKernel::SIMDLevel level)
+{
+	simd = std::min(simd, level);
+}
+
+/* Work out which offsets in a block of block_size bytes can be checked at once for a given
+ * stride. Each block is loaded once for each "phase", with lanes of the value's width in the
+ * vector holding the values at (phase + (n * width)) bytes into the block.
+ *
+ * If the stride divides the width, the phases are each multiple of the stride within the
+ * width. If the width divides the stride (and the stride divides the block size), only the
+ * first phase is needed and lanes between strides are filtered out. Any other stride can't
+ * be searched a block at a time.
+ *
+ * The bits of lane_filter are the offsets in the block to check, and reach is how much data
+ * must be readable from the start of the block.
+*/
+bool REHex::RangeSearchKernel::block_layout(size_t width, size_t block_size, size_t stride, BlockLayout *layout)
+{
+	if(width > block_size)
+	{
+		return false;
+	}
+	
+	layout->lane_filter = 0;
+	
+	if((width % stride) == 0)
+	{
+		layout->phase_step = stride;
+		layout->phase_end  = width;
+		layout->reach      = block_size + width - stride;
+		
+		for(size_t i = 0; i < block_size; ++i)
+		{
+			layout->lane_filter |= (1U << i);
+		}
+	}
+	else if((stride % width) == 0 && (block_size % stride) == 0)
+	{
+		layout->phase_step = 1;
+		layout->phase_end  = 1;
+		layout->reach      = block_size;
+		
+		for(size_t i = 0; i < block_size; i += stride)
+		{
+			layout->lane_filter |= (1U << i);
+		}
+	}
+	else{
+		return false;
+	}
+	
+	return true;
+}
+
+template<size_t W> bool REHex::RangeSearchKernel::match_at(const unsigned char *h) const
+{
+	/* Loops over a fixed width compile down to a single load (and byte swap). */
+	
+	uint64_t value = 0;
+	
+	for(size_t i = 0; i < W; ++i)
+	{
+		value |= (uint64_t)(h[i]) << (8 * (big_endian ? (W - 1 - i) : i));
+	}
+	
+	const uint64_t sign = 1ULL << ((W * 8) - 1);
+	const uint64_t mask = sign | (sign - 1);
+	
+	uint64_t key = value ^ ((is_float && (value & sign)) ? mask : flip);
+	
+	return ((key - min_key) & mask) <= span;
+}
+
+template<size_t W> const unsigned char *REHex::RangeSearchKernel::find_width(const unsigned char *begin, const unsigned char *end, size_t stride) const
+{
+	#ifdef REHEX_SEARCHKERNEL_X86
+	if(simd == SearchKernel::SIMD_AVX2)
+	{
+		return find_avx2<W>(begin, end, stride);
+	}
+	else if(simd == SearchKernel::SIMD_SSE2)
+	{
+		return find_sse2<W>(begin, end, stride);
+	}
+	#endif
+	
+	return find_scalar<W>(begin, end, stride);
+}
+
+template<size_t W> const unsigned char *REHex::RangeSearchKernel::rfind_width(const unsigned char *begin, const unsigned char *end, size_t top, size_t stride) const
+{
+	#ifdef REHEX_SEARCHKERNEL_X86
+	if(simd == SearchKernel::SIMD_AVX2)
+	{
+		return rfind_avx2<W>(begin, end, top, stride);
+	}
+	else if(simd == SearchKernel::SIMD_SSE2)
+	{
+		return rfind_sse2<W>(begin, end, top, stride);
+	}
+	#endif
+	
+	return rfind_scalar<W>(begin, top, stride);
+}
+
+template<size_t W> const unsigned char *REHex::RangeSearchKernel::find_scalar(const unsigned char *begin, const unsigned char *end, size_t stride) const
+{
+	if((size_t)(end - begin) < W)
+	{
+		return NULL;
+	}
+	
+	size_t last_start = (end - begin) - W;
+	
+	for(size_t off = 0; off <= last_start; off += stride)
+	{
+		if(match_at<W>(begin + off))
+		{
+			return begin + off;
+		}
+	}
+	
+	return NULL;
+}
+
+/* Checks each offset from top down to begin in steps of stride. */
+template<size_t W> const unsigned char *REHex::RangeSearchKernel::rfind_scalar(const unsigned char *begin, size_t top, size_t stride) const
+{
+	for(size_t off = top;; off -= stride)
+	{
+		if(match_at<W>(begin + off))
+		{
+			return begin + off;
+		}
+		
+		if(off < stride)
+		{
+			return NULL;
+		}
+	}
+}
+
+#ifdef REHEX_SEARCHKERNEL_X86
+
+/* Returns a bit for each offset in the 16 bytes from h where a value in the range begins,
+ * as given by the layout.
+*/
+template<size_t W> TARGET_SSE2 uint32_t REHex::RangeSearchKernel::block_sse2(const unsigned char *h, const BlockLayout &layout) const
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi8((char)(0xFF));
+	
+	const __m128i v_flip  = splat_sse2<W>(flip);
+	const __m128i v_float = is_float ? ones : zero;
+	const __m128i v_min   = splat_sse2<W>(min_key);
+	const __m128i v_span  = splat_sse2<W>(span);
+	
+	/* Bits of _mm_movemask_epi8() for the first byte of each lane. */
+	const uint32_t lane_starts = (W == 1) ? 0xFFFF : (W == 2) ? 0x5555 : (W == 4) ? 0x1111 : 0x0101;
+	
+	uint32_t bits = 0;
+	
+	for(size_t phase = 0; phase < layout.phase_end; phase += layout.phase_step)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)(h + phase));
+		
+		if(big_endian && W > 1)
+		{
+			/* Swap the bytes of each 16-bit word, then the words within each lane. */
+			x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+			
+			if(W == 4)
+			{
+				x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+			}
+			else if(W == 8)
+			{
+				x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3)), _MM_SHUFFLE(0, 1, 2, 3));
+			}
+		}
+		
+		/* Lanes set to all ones where the value is negative. */
+		__m128i negative;
+		
+		if(W == 1)
+		{
+			negative = _mm_cmpgt_epi8(zero, x);
+		}
+		else if(W == 2)
+		{
+			negative = _mm_srai_epi16(x, 15);
+		}
+		else if(W == 4)
+		{
+			negative = _mm_srai_epi32(x, 31);
+		}
+		else{
+			negative = _mm_shuffle_epi32(_mm_srai_epi32(x, 31), _MM_SHUFFLE(3, 3, 1, 1));
+		}
+		
+		__m128i key = _mm_xor_si128(x, _mm_or_si128(_mm_and_si128(negative, v_float), v_flip));
+		
+		__m128i match;
+		
+		if(W == 1)
+		{
+			match = _mm_cmpeq_epi8(_mm_subs_epu8(_mm_sub_epi8(key, v_min), v_span), zero);
+		}
+		else if(W == 2)
+		{
+			match = _mm_cmpeq_epi16(_mm_subs_epu16(_mm_sub_epi16(key, v_min), v_span), zero);
+		}
+		else if(W == 4)
+		{
+			/* There's no unsigned compare, so flip the sign bits and compare signed. */
+			
+			const __m128i sign = _mm_set1_epi32((int)(0x80000000));
+			
+			__m128i d = _mm_sub_epi32(key, v_min);
+			match = _mm_xor_si128(_mm_cmpgt_epi32(_mm_xor_si128(d, sign), _mm_xor_si128(v_span, sign)), ones);
+		}
+		else{
+			/* Nor a 64-bit compare, so compare the high halves, and the low halves where
+			 * the high halves are equal.
+			*/
+			
+			const __m128i sign = _mm_set1_epi32((int)(0x80000000));
+			
+			__m128i d  = _mm_sub_epi64(key, v_min);
+			__m128i gt = _mm_cmpgt_epi32(_mm_xor_si128(d, sign), _mm_xor_si128(v_span, sign));
+			__m128i eq = _mm_cmpeq_epi32(d, v_span);
+			
+			__m128i gt64 = _mm_or_si128(gt, _mm_and_si128(eq, _mm_slli_epi64(gt, 32)));
+			match = _mm_xor_si128(_mm_shuffle_epi32(gt64, _MM_SHUFFLE(3, 3, 1, 1)), ones);
+		}
+		
+		bits |= ((uint32_t)(_mm_movemask_epi8(match)) & lane_starts) << phase;
+	}
+	
+	return bits & layout.lane_filter;
+}
+
+template<size_t W> TARGET_AVX2 uint32_t REHex::RangeSearchKernel::block_avx2(const unsigned char *h, const BlockLayout &layout) const
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_set1_epi8((char)(0xFF));
+	
+	const __m256i v_flip  = splat_avx2<W>(flip);
+	const __m256i v_float = is_float ? ones : zero;
+	const __m256i v_min   = splat_avx2<W>(min_key);
+	const __m256i v_span  = splat_avx2<W>(span);
+	
+	/* Reverses the bytes of each lane (within each 128-bit half). */
+	const __m256i bswap = (W == 2)
+		? _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14)
+		: (W == 4)
+		? _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12)
+		: _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	
+	const uint32_t lane_starts = (W == 1) ? 0xFFFFFFFF : (W == 2) ? 0x55555555 : (W == 4) ? 0x11111111 : 0x01010101;
+	
+	uint32_t bits = 0;
+	
+	for(size_t phase = 0; phase < layout.phase_end; phase += layout.phase_step)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*)(h + phase));
+		
+		if(big_endian && W > 1)
+		{
+			x = _mm256_shuffle_epi8(x, bswap);
+		}
+		
+		__m256i negative;
+		
+		if(W == 1)
+		{
+			negative = _mm256_cmpgt_epi8(zero, x);
+		}
+		else if(W == 2)
+		{
+			negative = _mm256_srai_epi16(x, 15);
+		}
+		else if(W == 4)
+		{
+			negative = _mm256_srai_epi32(x, 31);
+		}
+		else{
+			negative = _mm256_cmpgt_epi64(zero, x);
+		}
+		
+		__m256i key = _mm256_xor_si256(x, _mm256_or_si256(_mm256_and_si256(negative, v_float), v_flip));
+		
+		__m256i match;
+		
+		if(W == 1)
+		{
+			match = _mm256_cmpeq_epi8(_mm256_subs_epu8(_mm256_sub_epi8(key, v_min), v_span), zero);
+		}
+		else if(W == 2)
+		{
+			match = _mm256_cmpeq_epi16(_mm256_subs_epu16(_mm256_sub_epi16(key, v_min), v_span), zero);
+		}
+		else if(W == 4)
+		{
+			__m256i d = _mm256_sub_epi32(key, v_min);
+			match = _mm256_cmpeq_epi32(_mm256_min_epu32(d, v_span), d);
+		}
+		else{
+			const __m256i sign = _mm256_set1_epi64x(0x8000000000000000LL);
+			
+			__m256i d = _mm256_sub_epi64(key, v_min);
+			match = _mm256_xor_si256(_mm256_cmpgt_epi64(_mm256_xor_si256(d, sign), _mm256_xor_si256(v_span, sign)), ones);
+		}
+		
+		bits |= ((uint32_t)(_mm256_movemask_epi8(match)) & lane_starts) << phase;
+	}
+	
+	return bits & layout.lane_filter;
+}
+
+template<size_t W> TARGET_SSE2 const unsigned char *REHex::RangeSearchKernel::find_sse2(const unsigned char *begin, const unsigned char *end, size_t stride) const
+{
+	BlockLayout layout;
+	if(!block_layout(W, 16, stride, &layout))
+	{
+		return find_scalar<W>(begin, end, stride);
+	}
+	
+	const unsigned char *h = begin;
+	
+	for(; (size_t)(end - h) >= layout.reach; h += 16)
+	{
+		uint32_t bits = block_sse2<W>(h, layout);
+		if(bits != 0)
+		{
+			return h + lowest_bit(bits);
+		}
+	}
+	
+	/* Check any offsets left over at the end one at a time. */
+	return find_scalar<W>(h, end, stride);
+}
+
+template<size_t W> TARGET_AVX2 const unsigned char *REHex::RangeSearchKernel::find_avx2(const unsigned char *begin, const unsigned char *end, size_t stride) const
+{
+	BlockLayout layout;
+	if(!block_layout(W, 32, stride, &layout))
+	{
+		return find_sse2<W>(begin, end, stride);
+	}
+	
+	const unsigned char *h = begin;
+	
+	for(; (size_t)(end - h) >= layout.reach; h += 32)
+	{
+		uint32_t bits = block_avx2<W>(h, layout);
+		if(bits != 0)
+		{
+			return h + lowest_bit(bits);
+		}
+	}
+	
+	/* Finish off with SSE2 (or one at a time) for anything less than 32 offsets. */
+	return find_sse2<W>(h, end, stride);
+}
+
+template<size_t W> TARGET_SSE2 const unsigned char *REHex::RangeSearchKernel::rfind_sse2(const unsigned char *begin, const unsigned char *end, size_t top, size_t stride) const
+{
+	BlockLayout layout;
+	if(!block_layout(W, 16, stride, &layout))
+	{
+		return rfind_scalar<W>(begin, top, stride);
+	}
+	
+	/* The block whose last offset is top begins at (top + stride - 16), check any offsets
+	 * one at a time until that block can be read without going past end.
+	*/
+	
+	size_t data_len = end - begin;
+	
+	while((data_len - top) < (layout.reach - 16 + stride))
+	{
+		if(match_at<W>(begin + top))
+		{
+			return begin + top;
+		}
+		
+		if(top < stride)
+		{
+			return NULL;
+		}
+		
+		top -= stride;
+	}
+	
+	for(; (top + stride) >= 16; top -= 16)
+	{
+		const unsigned char *h = begin + top + stride - 16;
+		
+		uint32_t bits = block_sse2<W>(h, layout);
+		if(bits != 0)
+		{
+			return h + highest_bit(bits);
+		}
+		
+		if(top < 16)
+		{
+			return NULL;
+		}
+	}
+	
+	/* Check any offsets left over at the start one at a time. */
+	return rfind_scalar<W>(begin, top, stride);
+}
+
+template<size_t W> TARGET_AVX2 const unsigned char *REHex::RangeSearchKernel::rfind_avx2(const unsigned char *begin, const unsigned char *end, size_t top, size_t stride) const
+{
+	BlockLayout layout;
+	if(!block_layout(W, 32, stride, &layout))
+	{
+		return rfind_sse2<W>(begin, end, top, stride);
+	}
+	
+	size_t data_len = end - begin;
+	
+	while((data_len - top) < (layout.reach - 32 + stride))
+	{
+		if(match_at<W>(begin + top))
+		{
+			return begin + top;
+		}
+		
+		if(top < stride)
+		{
+			return NULL;
+		}
+		
+		top -= stride;
+	}
+	
+	for(; (top + stride) >= 32; top -= 32)
+	{
+		const unsigned char *h = begin + top + stride - 32;
+		
+		uint32_t bits = block_avx2<W>(h, layout);
+		if(bits != 0)
+		{
+			return h + highest_bit(bits);
+		}
+		
+		if(top < 32)
+		{
+			return NULL;
+		}
+	}
+	
+	/* Finish off with SSE2 (or one at a time) for anything less than 32 offsets. */
+	return rfind_sse2<W>(begin, end, top, stride);
+}
+
+#endif
@@ -0,0 +1,378 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef REHEX_SEARCHKERNEL_HPP
+#define REHEX_SEARCHKERNEL_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace REHex {
+	/* Finds a fixed string of bytes within a buffer.
+	 *
+	 * Short patterns are found using Boyer-Moore-Horspool, which skips ahead by up to the
+	 * length of the pattern after comparing a single byte. Long patterns use the Two-Way
+	 * algorithm instead, which also skips ahead but never compares a byte of the buffer more
+	 * than twice, where Horspool can take O(n * m) time on repetitive data (e.g. searching a
+	 * zero-filled disk image for a run of zeros).
+	 *
+	 * Letters can optionally be matched case-insensitively (ASCII only).
+	 *
+	 * When the CPU supports SSE2 or AVX2 (checked at runtime), short patterns are instead
+	 * found by comparing the first and last byte of the pattern against 16 or 32 offsets at
+	 * once and only comparing the whole pattern where both match, in the style of memchr().
+	 *
+	 * Searching backwards uses the same algorithms, with Horspool and Two-Way finding the
+	 * reversed pattern while reading the buffer from the end.
+	*/
+	
+	class SearchKernel
+	{
+		public:
+			/* Patterns at least this long use the Two-Way algorithm. */
+			static const size_t LONG_PATTERN = 32;
+			
+			enum SIMDLevel
+			{
+				SIMD_NONE = 0,
+				SIMD_SSE2,
+				SIMD_AVX2,
+			};
+			
+			/* Returns the best instruction set supported by the CPU. */
+			static SIMDLevel detect_simd();
+			
+			/* Construct a kernel which matches an empty pattern. */
+			SearchKernel();
+			
+			SearchKernel(const void *pattern, size_t length, bool ignore_case = false);
+			
+			/* Returns a pointer to the first match which lies entirely between begin and
+			 * end, or NULL if there are none.
+			*/
+			const unsigned char *find(const unsigned char *begin, const unsigned char *end) const;
+			
+			/* Returns a pointer to the last match which lies entirely between begin and
+			 * end, or NULL if there are none.
+			*/
+			const unsigned char *rfind(const unsigned char *begin, const unsigned char *end) const;
+			
+			size_t length() const;
+			
+			/* Don't use any instruction set better than the one given. Used to test and
+			 * benchmark the fallbacks.
+			*/
+			void limit_simd(SIMDLevel level);
+			
+		private:
+			/* Skip table and Two-Way critical factorisation of the pattern (or of the
+			 * reversed pattern, for searching backwards).
+			*/
+			struct Factorisation
+			{
+				/* Distance to skip when the last byte under the pattern is the given
+				 * value and the pattern doesn't match. For Horspool this is the
+				 * distance from the last occurrence of the byte in the pattern
+				 * (excluding its final byte) to the end of the pattern, for Two-Way
+				 * the final byte is included.
+				*/
+				size_t skip[256];
+				
+				size_t tw_split;   /* Index of the last byte in the left half of the pattern. */
+				size_t tw_period;
+				size_t tw_memory;  /* Bytes known to match after shifting by the period. */
+			};
+			
+			std::vector<unsigned char> pattern;    /* Folded to lower case if ignore_case is set. */
+			std::vector<unsigned char> r_pattern;  /* The pattern reversed. */
+			bool ignore_case;
+			bool two_way;
+			
+			Factorisation forward, backward;
+			
+			/* Prefilter for the first and last bytes of the pattern. Letters are matched
+			 * case-insensitively by setting bit 5 (0x20) before comparing, which may
+			 * let through some other bytes, but the whole pattern is compared anyway.
+			*/
+			SIMDLevel simd;
+			unsigned char first_byte, first_mask;
+			unsigned char last_byte, last_mask;
+			
+			static void init_horspool(const std::vector<unsigned char> &n, Factorisation *f);
+			static void init_two_way(const std::vector<unsigned char> &n, Factorisation *f);
+			
+			template<typename Fold, typename Text> const unsigned char *find_horspool(const Text &h, size_t h_len, const unsigned char *n, const Factorisation &f) const;
+			template<typename Fold, typename Text> const unsigned char *find_two_way(const Text &h, size_t h_len, const unsigned char *n, const Factorisation &f) const;
+			
+			bool match_at(const unsigned char *h) const;
+			const unsigned char *find_prefilter_sse2(const unsigned char *begin, const unsigned char *end) const;
+			const unsigned char *find_prefilter_avx2(const unsigned char *begin, const unsigned char *end) const;
+			const unsigned char *rfind_prefilter_sse2(const unsigned char *begin, const unsigned char *end) const;
+			const unsigned char *rfind_prefilter_avx2(const unsigned char *begin, const unsigned char *end) const;
+	};
+	
+	/* Finds the first occurrence of any of a set of byte strings within a buffer.
+	 *
+	 * A few patterns are each found using a SearchKernel, searching only as far as the
+	 * earliest match found so far, which is fastest while each search can use the SIMD
+	 * prefilter. Larger sets are compiled into an Aho-Corasick automaton, which finds every
+	 * pattern in a single pass over the data.
+	 *
+	 * Letters can optionally be matched case-insensitively (ASCII only), in which case the
+	 * automaton is built from the patterns folded to lower case and each upper case letter
+	 * takes the same transitions as its lower case one.
+	*/
+	
+	class MultiSearchKernel
+	{
+		public:
+			/* Sets of up to this many patterns are searched for one at a time. */
+			static const size_t SMALL_SET = 8;
+			
+			/* Construct a kernel which matches no patterns. */
+			MultiSearchKernel();
+			
+			MultiSearchKernel(const std::vector< std::vector<unsigned char> > &patterns, bool ignore_case = false, size_t small_set = SMALL_SET);
+			
+			/* Returns a pointer to the first match of any pattern which lies entirely
+			 * between begin and end, or NULL if there are none.
+			 *
+			 * If pattern_idx is provided, it is set to the index of the pattern which
+			 * matched. Where more than one matches at the same offset, the longest wins.
+			*/
+			const unsigned char *find(const unsigned char *begin, const unsigned char *end, size_t *pattern_idx = NULL) const;
+			
+			/* Returns a pointer to the last match of any pattern which lies entirely
+			 * between begin and end and begins before limit (or end, if NULL), or NULL if
+			 * there are none.
+			 *
+			 * The limit allows for finding the match before a previous one, where a
+			 * shorter pattern could begin after it but a longer one before it.
+			*/
+			const unsigned char *rfind(const unsigned char *begin, const unsigned char *end, const unsigned char *limit = NULL, size_t *pattern_idx = NULL) const;
+			
+			/* Returns the number of patterns. */
+			size_t size() const;
+			
+			/* Returns the length of the longest pattern. */
+			size_t max_length() const;
+			
+		private:
+			std::vector< std::vector<unsigned char> > patterns;  /* Folded to lower case if ignore_case is set. */
+			bool ignore_case;
+			size_t max_len;
+			bool match_empty;
+			
+			/* One kernel per pattern, if there are few enough patterns. */
+			std::vector<SearchKernel> kernels;
+			
+			/* Aho-Corasick automaton as a DFA, with 256 transitions for each state. */
+			struct Automaton
+			{
+				/* State 0 is the root, and transitions hold the index of the first
+				 * transition of the next state (i.e. state * 256) to save a multiply.
+				*/
+				std::vector<uint32_t> transitions;
+				
+				/* Index + 1 of the longest pattern which ends at each state, or zero. */
+				std::vector<uint32_t> state_match;
+			};
+			
+			/* Automatons for the patterns, and for the reversed patterns to search
+			 * backwards.
+			*/
+			Automaton forward, backward;
+			
+			static void build_automaton(const std::vector< std::vector<unsigned char> > &patterns, bool ignore_case, Automaton *a);
+			
+			size_t longest_at(const unsigned char *at, const unsigned char *end) const;
+			
+			const unsigned char *find_kernels(const unsigned char *begin, const unsigned char *end, size_t *pattern_idx) const;
+			const unsigned char *find_automaton(const unsigned char *begin, const unsigned char *end, size_t *pattern_idx) const;
+			const unsigned char *rfind_kernels(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t *pattern_idx) const;
+			const unsigned char *rfind_automaton(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t *pattern_idx) const;
+	};
+	
+	/* Finds a string of bytes in which some bits can be anything, such as the pattern
+	 * "4D 5A ?? ?? 50 45", or "A?" for any byte whose high nibble is 0xA.
+	 *
+	 * If the pattern has a run of at least two fully fixed bytes, the longest such run is
+	 * found using a SearchKernel and the rest of the pattern is compared around it.
+	 * Otherwise, the two bytes with the most fixed bits are masked and compared against 16 or
+	 * 32 offsets at once using SSE2/AVX2 (or one at a time), comparing the whole pattern
+	 * where both match.
+	*/
+	
+	class MaskedSearchKernel
+	{
+		public:
+			/* Construct a kernel which matches an empty pattern. */
+			MaskedSearchKernel();
+			
+			/* Bits set in mask must match the pattern, clear bits match anything. */
+			MaskedSearchKernel(const unsigned char *pattern, const unsigned char *mask, size_t length);
+			
+			/* Returns a pointer to the first match which lies entirely between begin and
+			 * end, or NULL if there are none.
+			*/
+			const unsigned char *find(const unsigned char *begin, const unsigned char *end) const;
+			
+			/* Returns a pointer to the last match which lies entirely between begin and
+			 * end, or NULL if there are none.
+			*/
+			const unsigned char *rfind(const unsigned char *begin, const unsigned char *end) const;
+			
+			/* Returns true if the pattern matches the length() bytes at h. */
+			bool match_at(const unsigned char *h) const;
+			
+			size_t length() const;
+			
+			/* Don't use any instruction set better than the one given. Used to test and
+			 * benchmark the fallbacks.
+			*/
+			void limit_simd(SearchKernel::SIMDLevel level);
+			
+		private:
+			std::vector<unsigned char> value;  /* Pattern with the wildcard bits cleared. */
+			std::vector<unsigned char> mask;
+			
+			/* Longest run of fixed bytes, if there is one long enough to search for. */
+			bool anchored;
+			size_t anchor_at;
+			SearchKernel anchor;
+			
+			/* Offsets of the bytes compared first when there isn't. */
+			SearchKernel::SIMDLevel simd;
+			size_t probe1, probe2;
+			
+			const unsigned char *find_anchor(const unsigned char *begin, const unsigned char *end) const;
+			const unsigned char *rfind_anchor(const unsigned char *begin, const unsigned char *end) const;
+			
+			bool probe_at(const unsigned char *h) const;
+			const unsigned char *find_probe(const unsigned char *begin, const unsigned char *end) const;
+			const unsigned char *rfind_probe(const unsigned char *begin, const unsigned char *end) const;
+			const unsigned char *find_probe_sse2(const unsigned char *begin, const unsigned char *end) const;
+			const unsigned char *find_probe_avx2(const unsigned char *begin, const unsigned char *end) const;
+			const unsigned char *rfind_probe_sse2(const unsigned char *begin, const unsigned char *end) const;
+			const unsigned char *rfind_probe_avx2(const unsigned char *begin, const unsigned char *end) const;
+	};
+	
+	/* Finds a number of a given type, size and byte order whose value lies within a range,
+	 * such as any 32-bit little endian integer from 1000 to 2000, or a double within some
+	 * tolerance of a value.
+	 *
+	 * Each value is converted to a key which sorts in the same order as the values do (by
+	 * flipping the sign bit of signed integers, and every bit of negative floats), so every
+	 * type is checked with a single unsigned subtract and compare. When the CPU supports SSE2
+	 * or AVX2, 16 or 32 offsets are checked at once.
+	 *
+	 * Searches can be limited to every stride bytes from where they begin, for aligned values.
+	*/
+	class RangeSearchKernel
+	{
+		public:
+			enum Type
+			{
+				UNSIGNED = 0,
+				SIGNED,
+				FLOAT,
+			};
+			
+			/* Construct a kernel which matches nothing. */
+			RangeSearchKernel();
+			
+			/* Integers can be 1, 2, 4 or 8 bytes wide. Any part of the range which the
+			 * type can't hold is ignored.
+			*/
+			static RangeSearchKernel unsigned_range(size_t width, bool big_endian, uint64_t min, uint64_t max);
+			static RangeSearchKernel signed_range(size_t width, bool big_endian, int64_t min, int64_t max);
+			
+			/* Floats can be 4 or 8 bytes wide. The range includes any float which lies
+			 * within it after rounding the bounds inwards, -0.0 and 0.0 are the same, and
+			 * NaN never matches.
+			*/
+			static RangeSearchKernel float_range(size_t width, bool big_endian, double min, double max);
+			
+			/* Returns a pointer to the first value which lies entirely between begin and
+			 * end and begins a multiple of stride bytes after begin, or NULL if there are
+			 * none.
+			*/
+			const unsigned char *find(const unsigned char *begin, const unsigned char *end, size_t stride = 1) const;
+			
+			/* Returns a pointer to the last value which lies entirely between begin and
+			 * end and begins at (limit - 1) or a multiple of stride bytes below it (limit
+			 * is end if NULL), or NULL if there are none.
+			*/
+			const unsigned char *rfind(const unsigned char *begin, const unsigned char *end, const unsigned char *limit = NULL, size_t stride = 1) const;
+			
+			/* Returns true if the width() bytes at h are a value in the range. */
+			bool match_at(const unsigned char *h) const;
+			
+			size_t width() const;
+			
+			/* Don't use any instruction set better than the one given. Used to test and
+			 * benchmark the fallbacks.
+			*/
+			void limit_simd(SearchKernel::SIMDLevel level);
+			
+		private:
+			size_t w;
+			bool big_endian;
+			bool empty;
+			
+			/* Each value is XORed with flip to get its key, or with every bit if it's a
+			 * negative float. The key matches if (key - min_key) <= span, wrapping around
+			 * at the width of the value.
+			*/
+			bool is_float;
+			uint64_t flip;
+			uint64_t min_key;
+			uint64_t span;
+			
+			SearchKernel::SIMDLevel simd;
+			
+			RangeSearchKernel(size_t width, bool big_endian, Type type, uint64_t min_key, uint64_t max_key);
+			
+			/* Which offsets in a block of 16 or 32 are checked when searching with a given
+			 * stride, see block_layout().
+			*/
+			struct BlockLayout
+			{
+				size_t phase_step, phase_end;
+				uint32_t lane_filter;
+				size_t reach;
+			};
+			
+			static bool block_layout(size_t width, size_t block_size, size_t stride, BlockLayout *layout);
+			
+			template<size_t W> bool match_at(const unsigned char *h) const;
+			template<size_t W> const unsigned char *find_width(const unsigned char *begin, const unsigned char *end, size_t stride) const;
+			template<size_t W> const unsigned char *rfind_width(const unsigned char *begin, const unsigned char *end, size_t top, size_t stride) const;
+			template<size_t W> const unsigned char *find_scalar(const unsigned char *begin, const unsigned char *end, size_t stride) const;
+			template<size_t W> const unsigned char *rfind_scalar(const unsigned char *begin, size_t top, size_t stride) const;
+			
+			template<size_t W> uint32_t block_sse2(const unsigned char *h, const BlockLayout &layout) const;
+			template<size_t W> uint32_t block_avx2(const unsigned char *h, const BlockLayout &layout) const;
+			template<size_t W> const unsigned char *find_sse2(const unsigned char *begin, const unsigned char *end, size_t stride) const;
+			template<size_t W> const unsigned char *find_avx2(const unsigned char *begin, const unsigned char *end, size_t stride) const;
+			template<size_t W> const unsigned char *rfind_sse2(const unsigned char *begin, const unsigned char *end, size_t top, size_t stride) const;
+			template<size_t W> const unsigned char *rfind_avx2(const unsigned char *begin, const unsigned char *end, size_t top, size_t stride) const;
+	};
+}
+
+#endif /* !REHEX_SEARCHKERNEL_HPP */
@@ -0,0 +1,299 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "platform.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <wx/numformatter.h>
+
+#include "SearchResultsPanel.hpp"
+#include "util.hpp"
+
+/* Maximum number of bytes from each match shown in the list. */
+static const off_t MAX_PREVIEW_BYTES = 16;
+
+BEGIN_EVENT_TABLE(REHex::SearchResultsPanel, wxPanel)
+	EVT_LIST_ITEM_ACTIVATED(wxID_ANY, REHex::SearchResultsPanel::OnItemActivate)
+END_EVENT_TABLE()
+
+REHex::SearchResultsPanel::SearchResultsPanel(wxWindow *parent, SharedDocumentPointer &document, DocumentCtrl *document_ctrl):
+	ToolPanel(parent),
+	document(document),
+	document_ctrl(document_ctrl),
+	max_match_length(0),
+	searching(true),
+	complete(false),
+	update_needed(true)
+{
+	list_ctrl = new SearchResultsListCtrl(this);
+	
+	list_ctrl->AppendColumn("Offset");
+	list_ctrl->AppendColumn("Data");
+	
+	status_text = new wxStaticText(this, wxID_ANY, "");
+	
+	wxBoxSizer *sizer = new wxBoxSizer(wxVERTICAL);
+	sizer->Add(status_text, 0);
+	sizer->Add(list_ctrl, 1, wxEXPAND);
+	SetSizerAndFit(sizer);
+	
+	this->document.auto_cleanup_bind(DATA_ERASE,     &REHex::SearchResultsPanel::OnDataErase,     this);
+	this->document.auto_cleanup_bind(DATA_INSERT,    &REHex::SearchResultsPanel::OnDataInsert,    this);
+	this->document.auto_cleanup_bind(DATA_OVERWRITE, &REHex::SearchResultsPanel::OnDataOverwrite, this);
+}
+
+std::string REHex::SearchResultsPanel::name() const
+{
+	return "SearchResultsPanel";
+}
+
+void REHex::SearchResultsPanel::save_state(wxConfig *config) const
+{
+	/* Results aren't kept between sessions. */
+}
+
+void REHex::SearchResultsPanel::load_state(wxConfig *config)
+{
+	/* Results aren't kept between sessions. */
+}
+
+wxSize REHex::SearchResultsPanel::DoGetBestClientSize() const
+{
+	return wxSize(-1, 160);
+}
+
+void REHex::SearchResultsPanel::update()
+{
+	if(!is_visible)
+	{
+		/* There is no sense in updating this if we are not visible */
+		return;
+	}
+	
+	if(update_needed)
+	{
+		list_ctrl->SetItemCount(matches.size());
+		list_ctrl->Refresh();
+		
+		status_text->SetLabelText(
+			wxString("Found ")
+			+ wxNumberFormatter::ToString((long)(matches.size()))
+			+ (matches.size() == 1 ? " match" : " matches")
+			+ (searching ? "..." : (complete ? "" : " (search incomplete)")));
+		
+		update_needed = false;
+	}
+}
+
+void REHex::SearchResultsPanel::add_matches(std::vector<SearchMatch> &batch)
+{
+	if(batch.empty())
+	{
+		return;
+	}
+	
+	for(auto m = batch.begin(); m != batch.end(); ++m)
+	{
+		max_match_length = std::max(max_match_length, m->length);
+	}
+	
+	/* The search threads take windows in order, so each batch usually falls after (or just
+	 * before the end of) the matches already in the list, making the merge cheap.
+	*/
+	
+	std::sort(batch.begin(), batch.end());
+	
+	size_t old_size = matches.size();
+	matches.insert(matches.end(), batch.begin(), batch.end());
+	
+	if(old_size > 0 && batch.front() < matches[old_size - 1])
+	{
+		auto merge_from = std::upper_bound(matches.begin(), (matches.begin() + old_size), batch.front());
+		std::inplace_merge(merge_from, (matches.begin() + old_size), matches.end());
+	}
+	
+	batch.clear();
+	
+	update_needed = true;
+	update();
+}
+
+void REHex::SearchResultsPanel::finish(bool complete)
+{
+	searching = false;
+	this->complete = complete;
+	
+	update_needed = true;
+	update();
+}
+
+const std::vector<REHex::SearchMatch> &REHex::SearchResultsPanel::get_matches() const
+{
+	return matches;
+}
+
+void REHex::SearchResultsPanel::OnDataErase(OffsetLengthEvent &event)
+{
+	/* Drop any matches which overlap the erased data and move the ones after it back. Only
+	 * matches beginning within the longest match's length before the erased data can reach
+	 * into it.
+	*/
+	
+	auto check_begin = std::lower_bound(matches.begin(), matches.end(), SearchMatch((event.offset - std::max<off_t>(max_match_length, 1) + 1), 0));
+	auto erase_begin = std::lower_bound(check_begin, matches.end(), SearchMatch(event.offset, 0));
+	auto erase_end   = std::lower_bound(erase_begin, matches.end(), SearchMatch((event.offset + event.length), 0));
+	
+	for(auto m = erase_end; m != matches.end(); ++m)
+	{
+		m->offset -= event.length;
+	}
+	
+	erase_begin = std::remove_if(check_begin, erase_begin,
+		[&](const SearchMatch &m) { return (m.offset + std::max<off_t>(m.length, 1)) > event.offset; });
+	
+	matches.erase(erase_begin, erase_end);
+	
+	update_needed = true;
+	update();
+	
+	/* Continue propogation. */
+	event.Skip();
+}
+
+void REHex::SearchResultsPanel::OnDataInsert(OffsetLengthEvent &event)
+{
+	/* Drop any matches which the data was inserted into the middle of and move the ones after
+	 * it forward.
+	*/
+	
+	auto check_begin = std::upper_bound(matches.begin(), matches.end(), SearchMatch((event.offset - std::max<off_t>(max_match_length, 1)), 0));
+	auto check_end   = std::lower_bound(check_begin, matches.end(), SearchMatch(event.offset, 0));
+	
+	for(auto m = check_end; m != matches.end(); ++m)
+	{
+		m->offset += event.length;
+	}
+	
+	auto erase_begin = std::remove_if(check_begin, check_end,
+		[&](const SearchMatch &m) { return (m.offset + std::max<off_t>(m.length, 1)) > event.offset; });
+	
+	matches.erase(erase_begin, check_end);
+	
+	update_needed = true;
+	update();
+	
+	/* Continue propogation. */
+	event.Skip();
+}
+
+void REHex::SearchResultsPanel::OnDataOverwrite(OffsetLengthEvent &event)
+{
+	/* The data at any matches which overlap the overwritten data may no longer match, just
+	 * redraw them rather than searching again.
+	*/
+	
+	list_ctrl->Refresh();
+	
+	/* Continue propogation. */
+	event.Skip();
+}
+
+void REHex::SearchResultsPanel::OnItemActivate(wxListEvent &event)
+{
+	long item_idx = event.GetIndex();
+	assert(item_idx >= 0);
+	
+	if((size_t)(item_idx) >= matches.size())
+	{
+		return;
+	}
+	
+	const SearchMatch &match = matches[item_idx];
+	
+	document->set_cursor_position(match.offset);
+	
+	if(match.length > 0)
+	{
+		document_ctrl->set_selection(match.offset, match.length);
+	}
+}
+
+REHex::SearchResultsPanel::SearchResultsListCtrl::SearchResultsListCtrl(SearchResultsPanel *parent):
+	wxListCtrl(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, (wxLC_REPORT | wxLC_VIRTUAL)) {}
+
+wxString REHex::SearchResultsPanel::SearchResultsListCtrl::OnGetItemText(long item, long column) const
+{
+	SearchResultsPanel *parent = dynamic_cast<SearchResultsPanel*>(GetParent());
+	assert(parent != NULL);
+	
+	if((size_t)(item) >= parent->matches.size())
+	{
+		/* wxWidgets has asked for an item beyond the end of the list, the list probably
+		 * shrank since the last SetItemCount() call.
+		*/
+		
+		return "???";
+	}
+	
+	const SearchMatch &match = parent->matches[item];
+	
+	switch(column)
+	{
+		case 0:
+		{
+			/* Offset column */
+			return format_offset(match.offset, parent->document_ctrl->get_offset_display_base(), parent->document->buffer_length());
+		}
+		
+		case 1:
+		{
+			/* Data column */
+			
+			try {
+				std::vector<unsigned char> data = parent->document->read_data(match.offset, std::min(match.length, MAX_PREVIEW_BYTES));
+				
+				std::string hex;
+				for(auto c = data.begin(); c != data.end(); ++c)
+				{
+					char byte_hex[4];
+					snprintf(byte_hex, sizeof(byte_hex), "%02X ", (unsigned)(*c));
+					
+					hex += byte_hex;
+				}
+				
+				if(match.length > MAX_PREVIEW_BYTES)
+				{
+					hex += "...";
+				}
+				
+				return hex;
+			}
+			catch(const std::exception &e)
+			{
+				/* Probably a file I/O error. */
+				return "???";
+			}
+		}
+		
+		default:
+			/* Unknown column */
+			abort();
+	}
+}
@@ -0,0 +1,124 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef REHEX_SEARCHRESULTSPANEL_HPP
+#define REHEX_SEARCHRESULTSPANEL_HPP
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <vector>
+#include <wx/listctrl.h>
+#include <wx/panel.h>
+#include <wx/stattext.h>
+#include <wx/wx.h>
+
+#include "document.hpp"
+#include "Events.hpp"
+#include "SafeWindowPointer.hpp"
+#include "SharedDocumentPointer.hpp"
+#include "ToolPanel.hpp"
+
+namespace REHex {
+	/* A match found by a search. Searches such as regular expressions find matches of
+	 * different lengths, so each match has its own.
+	*/
+	struct SearchMatch
+	{
+		off_t offset;
+		off_t length;
+		
+		SearchMatch(off_t offset, off_t length):
+			offset(offset), length(length) {}
+		
+		/* Matches are ordered by offset alone, since no two begin at the same offset. */
+		bool operator<(const SearchMatch &rhs) const
+		{
+			return offset < rhs.offset;
+		}
+		
+		bool operator==(const SearchMatch &rhs) const
+		{
+			return offset == rhs.offset && length == rhs.length;
+		}
+	};
+	
+	/* Lists the matches found by a search's "Find all" mode.
+	 *
+	 * Matches are passed in by the search as it runs and kept sorted. Only the offset and
+	 * length of each match is stored, the data shown in the list is read from the document
+	 * when each row is drawn, so tens of millions of matches can be listed.
+	*/
+	class SearchResultsPanel: public ToolPanel
+	{
+		public:
+			SearchResultsPanel(wxWindow *parent, SharedDocumentPointer &document, DocumentCtrl *document_ctrl);
+			
+			virtual std::string name() const override;
+			
+			virtual void save_state(wxConfig *config) const override;
+			virtual void load_state(wxConfig *config) override;
+			virtual void update() override;
+			
+			virtual wxSize DoGetBestClientSize() const override;
+			
+			/* Add a batch of matches to the list. The batch may be in any order, but must
+			 * not contain any offsets already in the list. The batch is left empty.
+			*/
+			void add_matches(std::vector<SearchMatch> &batch);
+			
+			/* Mark the search as finished. complete is false if it was cancelled or
+			 * failed before searching the whole range.
+			*/
+			void finish(bool complete);
+			
+			const std::vector<SearchMatch> &get_matches() const;
+		
+		private:
+			class SearchResultsListCtrl: public wxListCtrl
+			{
+				public:
+					SearchResultsListCtrl(SearchResultsPanel *parent);
+				
+				protected:
+					virtual wxString OnGetItemText(long item, long column) const override;
+			};
+			
+			SharedDocumentPointer document;
+			SafeWindowPointer<DocumentCtrl> document_ctrl;
+			
+			std::vector<SearchMatch> matches;
+			off_t max_match_length; /* Length of the longest match ever added. */
+			
+			bool searching;
+			bool complete;
+			bool update_needed;
+			
+			SearchResultsListCtrl *list_ctrl;
+			wxStaticText *status_text;
+			
+			void OnDataErase(OffsetLengthEvent &event);
+			void OnDataInsert(OffsetLengthEvent &event);
+			void OnDataOverwrite(OffsetLengthEvent &event);
+			void OnItemActivate(wxListEvent &event);
+		
+		DECLARE_EVENT_TABLE()
+		
+		friend SearchResultsListCtrl;
+	};
+}
+
+#endif /* !REHEX_SEARCHRESULTSPANEL_HPP */
@@ -138,15 +138,16 @@ void REHex::StringPanel::update()
 
 void REHex::StringPanel::mark_dirty(off_t offset, off_t length)
 {
-	ByteRangeSet to_pending;
-	to_pending.set_range(offset, length);
+	ByteRangeSet marked;
+	marked.set_range(offset, length);
 	
-	ByteRangeSet to_dirty = ByteRangeSet::intersection(to_pending, working);
+	/* Ranges currently being processed need processing again once the worker is done. */
 	
-	to_pending.clear_ranges(to_dirty.begin(), to_dirty.end());
+	ByteRangeSet to_dirty   = ByteRangeSet::intersection(marked, working);
+	ByteRangeSet to_pending = ByteRangeSet::difference(marked, working);
 	
-	dirty  .set_ranges(  to_dirty.begin(),   to_dirty.end());
-	pending.set_ranges(to_pending.begin(), to_pending.end());
+	dirty  .union_with(to_dirty);
+	pending.union_with(to_pending);
 	
 	if(!pending.empty())
 	{
@@ -164,8 +165,8 @@ void REHex::StringPanel::mark_work_done(off_t offset, off_t length)
 	
 	working.clear_range(offset, length);
 	
-	dirty.clear_ranges(to_pending.begin(), to_pending.end());
-	pending.set_ranges(to_pending.begin(), to_pending.end());
+	dirty.subtract(to_pending);
+	pending.union_with(to_pending);
 	
 	if(!pending.empty())
 	{
@@ -178,10 +179,7 @@ off_t REHex::StringPanel::sum_dirty_bytes()
 {
 	/* Merge the all the ranges in dirty, pending and working. */
 	
-	ByteRangeSet merged;
-	merged.set_ranges(dirty.begin(), dirty.end());
-	merged.set_ranges(pending.begin(), pending.end());
-	merged.set_ranges(working.begin(), working.end());
+	ByteRangeSet merged = ByteRangeSet::set_union(ByteRangeSet::set_union(dirty, pending), working);
 	
 	/* Sum the length of the merged ranges. */
 	
@@ -381,7 +379,7 @@ void REHex::StringPanel::thread_flush(ByteRangeSet *set_ranges, ByteRangeSet *cl
 	{
 		std::lock_guard<std::mutex> sl(strings_lock);
 		
-		strings.clear_ranges(clear_ranges->begin(), clear_ranges->end());
+		strings.subtract(*clear_ranges);
 		clear_ranges->clear_all();
 		
 		update_needed = true;
@@ -669,7 +667,7 @@ wxString REHex::StringPanel::StringPanelListCtrl::OnGetItemText(long item, long
 		return "???";
 	}
 	
-	const ByteRangeSet::Range &si = parent->strings.get_ranges()[item];
+	const ByteRangeSet::Range &si = parent->strings[item];
 	
 	switch(column)
 	{
@@ -17,6 +17,7 @@
 
 #include "platform.hpp"
 #include <exception>
+#include <functional>
 #include <inttypes.h>
 #include <stack>
 #include <tuple>
@@ -28,6 +29,8 @@
 #include "app.hpp"
 #include "DiffWindow.hpp"
 #include "EditCommentDialog.hpp"
+#include "search.hpp"
+#include "SearchResultsPanel.hpp"
 #include "Tab.hpp"
 
 /* Is the given byte a printable 7-bit ASCII character? */
@@ -85,12 +88,11 @@ REHex::Tab::Tab(wxWindow *parent):
 	
 	doc.auto_cleanup_bind(DATA_ERASE,     &REHex::Tab::OnDocumentDataErase,     this);
 	doc.auto_cleanup_bind(DATA_INSERT,    &REHex::Tab::OnDocumentDataInsert,    this);
-	doc.auto_cleanup_bind(DATA_OVERWRITE, &REHex::Tab::OnDocumentDataOverwrite, this);
+	
+	doc.auto_cleanup_bind(DOCUMENT_CHANGESET, &REHex::Tab::OnDocumentChangeSet, this);
 	
 	doc.auto_cleanup_bind(CURSOR_UPDATE,          &REHex::Tab::OnDocumentCursorUpdate,      this);
 	doc_ctrl->Bind(       CURSOR_UPDATE,          &REHex::Tab::OnDocumentCtrlCursorUpdate,  this);
-	doc.auto_cleanup_bind(EV_COMMENT_MODIFIED,    &REHex::Tab::OnDocumentCommentModified,   this);
-	doc.auto_cleanup_bind(EV_HIGHLIGHTS_CHANGED,  &REHex::Tab::OnDocumenHighlightsChanged,  this);
 	
 	doc_ctrl->Bind(wxEVT_CHAR, &REHex::Tab::OnDocumentCtrlChar, this);
 	
@@ -146,12 +148,11 @@ REHex::Tab::Tab(wxWindow *parent, const std::string &filename):
 	
 	doc.auto_cleanup_bind(DATA_ERASE,     &REHex::Tab::OnDocumentDataErase,     this);
 	doc.auto_cleanup_bind(DATA_INSERT,    &REHex::Tab::OnDocumentDataInsert,    this);
-	doc.auto_cleanup_bind(DATA_OVERWRITE, &REHex::Tab::OnDocumentDataOverwrite, this);
+	
+	doc.auto_cleanup_bind(DOCUMENT_CHANGESET, &REHex::Tab::OnDocumentChangeSet, this);
 	
 	doc.auto_cleanup_bind(CURSOR_UPDATE,          &REHex::Tab::OnDocumentCursorUpdate,      this);
 	doc_ctrl->Bind(       CURSOR_UPDATE,          &REHex::Tab::OnDocumentCtrlCursorUpdate,  this);
-	doc.auto_cleanup_bind(EV_COMMENT_MODIFIED,    &REHex::Tab::OnDocumentCommentModified,   this);
-	doc.auto_cleanup_bind(EV_HIGHLIGHTS_CHANGED,  &REHex::Tab::OnDocumenHighlightsChanged,  this);
 	
 	doc_ctrl->Bind(wxEVT_CHAR, &REHex::Tab::OnDocumentCtrlChar, this);
 	
@@ -301,6 +302,50 @@ void REHex::Tab::search_dialog_register(wxDialog *search_dialog)
 {
 	search_dialogs.insert(search_dialog);
 	search_dialog->Bind(wxEVT_DESTROY, &REHex::Tab::OnSearchDialogDestroy, this);
+	
+	Search *search = dynamic_cast<Search*>(search_dialog);
+	if(search != NULL)
+	{
+		/* Results from "Find all" are listed in a panel below the document. */
+		search->set_results_panel_factory(std::bind(&REHex::Tab::search_results_create, this));
+		
+		/* Matches found as the user types are selected in the document. */
+		search->set_match_highlighter([this](off_t offset, off_t length)
+		{
+			if(offset >= 0)
+			{
+				doc->set_cursor_position(offset);
+				doc_ctrl->set_selection(offset, length);
+			}
+			else{
+				doc_ctrl->clear_selection();
+			}
+		});
+	}
+}
+
+/* Creates a panel below the document to list search results in, replacing any earlier one. */
+REHex::SearchResultsPanel *REHex::Tab::search_results_create()
+{
+	SearchResultsPanel *results = new SearchResultsPanel(h_tools, doc, doc_ctrl);
+	htool_insert(results, "Search results", true);
+	
+	return results;
+}
+
+/* Adds a panel which was created as a child of h_tools rather than from the ToolPanelRegistry,
+ * replacing any existing tool with the same name.
+*/
+void REHex::Tab::htool_insert(ToolPanel *tool_window, const std::string &label, bool switch_to)
+{
+	tool_destroy(tool_window->name());
+	
+	h_tools->AddPage(tool_window, label, switch_to);
+	
+	tools.insert(std::make_pair(tool_window->name(), tool_window));
+	
+	xtools_fix_visibility(h_tools);
+	htools_adjust_on_idle();
 }
 
 void REHex::Tab::hide_child_windows()
@@ -951,9 +996,22 @@ void REHex::Tab::OnDocumentDataInsert(OffsetLengthEvent &event)
 	event.Skip();
 }
 
-void REHex::Tab::OnDocumentDataOverwrite(OffsetLengthEvent &event)
+void REHex::Tab::OnDocumentChangeSet(ChangeSetEvent &event)
 {
-	doc_ctrl->Refresh();
+	/* Region layout only needs rebuilding when comments change, the layout is kept in
+	 * step with the length of the document by the synchronous DATA_ERASE/DATA_INSERT
+	 * handlers above.
+	*/
+	
+	if(event.comments_modified)
+	{
+		repopulate_regions();
+	}
+	else if(!event.data_modified.empty() || event.highlights_modified)
+	{
+		doc_ctrl->Refresh();
+	}
+	
 	event.Skip();
 }
 
@@ -969,18 +1027,6 @@ void REHex::Tab::OnDocumentCtrlCursorUpdate(CursorUpdateEvent &event)
 	event.Skip();
 }
 
-void REHex::Tab::OnDocumentCommentModified(wxCommandEvent &event)
-{
-	repopulate_regions();
-	event.Skip();
-}
-
-void REHex::Tab::OnDocumenHighlightsChanged(wxCommandEvent &event)
-{
-	doc_ctrl->Refresh();
-	event.Skip();
-}
-
 int REHex::Tab::hsplit_clamp_sash(int sash_position)
 {
 	/* Prevent the user resizing a tool panel beyond its min/max size.
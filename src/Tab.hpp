@@ -31,6 +31,7 @@
 #include "document.hpp"
 #include "DocumentCtrl.hpp"
 #include "Events.hpp"
+#include "SearchResultsPanel.hpp"
 #include "SharedDocumentPointer.hpp"
 #include "ToolPanel.hpp"
 
@@ -64,6 +65,7 @@ namespace REHex
 			void tool_destroy(const std::string &name);
 			
 			void search_dialog_register(wxDialog *search_dialog);
+			SearchResultsPanel *search_results_create();
 			
 			void hide_child_windows();
 			void unhide_child_windows();
@@ -107,12 +109,10 @@ namespace REHex
 			
 			void OnDocumentDataErase(OffsetLengthEvent &event);
 			void OnDocumentDataInsert(OffsetLengthEvent &event);
-			void OnDocumentDataOverwrite(OffsetLengthEvent &event);
+			void OnDocumentChangeSet(ChangeSetEvent &event);
 			
 			void OnDocumentCursorUpdate(CursorUpdateEvent &event);
 			void OnDocumentCtrlCursorUpdate(CursorUpdateEvent &event);
-			void OnDocumentCommentModified(wxCommandEvent &event);
-			void OnDocumenHighlightsChanged(wxCommandEvent &event);
 			
 			template<typename T> void OnEventToForward(T &event)
 			{
@@ -122,6 +122,8 @@ namespace REHex
 				ProcessWindowEvent(event_copy);
 			}
 			
+			void htool_insert(ToolPanel *tool_window, const std::string &label, bool switch_to);
+			
 			void vtools_adjust();
 			void htools_adjust();
 			void vtools_adjust_on_idle();
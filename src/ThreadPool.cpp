@@ -0,0 +1,165 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "platform.hpp"
+#include <algorithm>
+#include <assert.h>
+
+#include "ThreadPool.hpp"
+
+REHex::ThreadPool::Job::Job(ThreadPool *pool, const std::function<void()> &func, unsigned int max_workers):
+	pool(pool),
+	func(func),
+	starts_left(max_workers),
+	running(0) {}
+
+void REHex::ThreadPool::Job::wait()
+{
+	std::unique_lock<std::mutex> l(pool->lock);
+	pool->done_cv.wait(l, [this]() { return starts_left == 0 && running == 0; });
+}
+
+bool REHex::ThreadPool::Job::finished()
+{
+	std::unique_lock<std::mutex> l(pool->lock);
+	return starts_left == 0 && running == 0;
+}
+
+void REHex::ThreadPool::Job::cancel()
+{
+	std::unique_lock<std::mutex> l(pool->lock);
+	
+	/* A job which hasn't started yet is dropped from the queue and finishes straight away,
+	 * rather than making anything waiting on it wait for the jobs ahead of it too.
+	*/
+	
+	starts_left = 0;
+	
+	pool->queue.remove_if([this](const std::shared_ptr<Job> &job) { return job.get() == this; });
+	pool->done_cv.notify_all();
+}
+
+REHex::ThreadPool::ThreadPool(unsigned int n_workers):
+	stop(false)
+{
+	if(n_workers == 0)
+	{
+		n_workers = std::max(std::thread::hardware_concurrency(), 1U);
+	}
+	
+	workers.reserve(n_workers);
+	
+	while(workers.size() < n_workers)
+	{
+		workers.emplace_back(&REHex::ThreadPool::worker_main, this);
+	}
+}
+
+REHex::ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> l(lock);
+		stop = true;
+	}
+	
+	cv.notify_all();
+	
+	for(auto w = workers.begin(); w != workers.end(); ++w)
+	{
+		w->join();
+	}
+}
+
+unsigned int REHex::ThreadPool::size() const
+{
+	return workers.size();
+}
+
+std::shared_ptr<REHex::ThreadPool::Job> REHex::ThreadPool::submit(const std::function<void()> &func, unsigned int max_workers)
+{
+	if(max_workers == 0 || max_workers > workers.size())
+	{
+		max_workers = workers.size();
+	}
+	
+	std::shared_ptr<Job> job(new Job(this, func, max_workers));
+	
+	{
+		std::unique_lock<std::mutex> l(lock);
+		queue.push_back(job);
+	}
+	
+	cv.notify_all();
+	
+	return job;
+}
+
+REHex::ThreadPool &REHex::ThreadPool::get_shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void REHex::ThreadPool::worker_main()
+{
+	std::unique_lock<std::mutex> l(lock);
+	
+	while(true)
+	{
+		cv.wait(l, [this]() { return stop || !queue.empty(); });
+		
+		if(stop)
+		{
+			break;
+		}
+		
+		/* Take a start from the oldest job, dropping it from the queue once every worker
+		 * it may run on has started it.
+		*/
+		
+		std::shared_ptr<Job> job = queue.front();
+		
+		assert(job->starts_left > 0);
+		
+		if(--(job->starts_left) == 0)
+		{
+			queue.pop_front();
+		}
+		
+		++(job->running);
+		
+		l.unlock();
+		job->func();
+		l.lock();
+		
+		--(job->running);
+		
+		if(job->starts_left > 0)
+		{
+			/* The call only returns once there's no work left, so don't start the
+			 * job on any more workers.
+			*/
+			job->starts_left = 0;
+			queue.remove(job);
+		}
+		
+		if(job->running == 0)
+		{
+			done_cv.notify_all();
+		}
+	}
+}
@@ -0,0 +1,108 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef REHEX_THREADPOOL_HPP
+#define REHEX_THREADPOOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace REHex {
+	/* Fixed set of worker threads which live for as long as the pool, so work can be spread
+	 * over every core without creating and joining threads each time.
+	 *
+	 * A job is a function which is run by several workers at once. Each call is expected to
+	 * claim pieces of work from some shared state (e.g. an atomic counter) until there are
+	 * none left and then return, so once any call has returned the job isn't started on any
+	 * more workers, and it is finished when every call which started has returned. Jobs are
+	 * started in the order they were submitted.
+	*/
+	
+	class ThreadPool
+	{
+		public:
+			class Job
+			{
+				public:
+					/* Wait for every call to the job's function which has started (or
+					 * will start) to return.
+					*/
+					void wait();
+					
+					/* Returns true if wait() wouldn't block. */
+					bool finished();
+					
+					/* Stop any more workers starting the job. Calls which have already
+					 * started carry on, use wait() to wait for them. If no calls have
+					 * started the job never runs and is finished immediately.
+					*/
+					void cancel();
+				
+				private:
+					ThreadPool *pool;
+					std::function<void()> func;
+					
+					unsigned int starts_left; /* Workers which may still start the job. */
+					unsigned int running;     /* Calls which have started and not returned. */
+					
+					Job(ThreadPool *pool, const std::function<void()> &func, unsigned int max_workers);
+				
+				friend ThreadPool;
+			};
+			
+			/* Create a pool with the given number of workers, or one per CPU core if
+			 * zero.
+			*/
+			ThreadPool(unsigned int n_workers = 0);
+			~ThreadPool();
+			
+			unsigned int size() const;
+			
+			/* Run func on up to max_workers workers at once (or every worker if zero).
+			 * func must not throw.
+			*/
+			std::shared_ptr<Job> submit(const std::function<void()> &func, unsigned int max_workers = 0);
+			
+			/* Pool shared by everything in the application, created the first time it
+			 * is used.
+			*/
+			static ThreadPool &get_shared();
+		
+		private:
+			std::mutex lock;
+			std::condition_variable cv;       /* Signalled when a job is queued or the pool is stopping. */
+			std::condition_variable done_cv;  /* Signalled when a call to a job returns. */
+			
+			std::list< std::shared_ptr<Job> > queue;
+			bool stop;
+			
+			std::vector<std::thread> workers;
+			
+			void worker_main();
+			
+			/* Prevent copying. */
+			ThreadPool(const ThreadPool&) = delete;
+			ThreadPool &operator=(const ThreadPool&) = delete;
+	};
+}
+
+#endif /* !REHEX_THREADPOOL_HPP */
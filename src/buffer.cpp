@@ -699,6 +699,135 @@ bool REHex::Buffer::erase_data(off_t offset, off_t length)
 	return true;
 }
 
+bool REHex::Buffer::replace_data(const std::vector<off_t> &offsets, off_t old_length, const unsigned char *new_data, off_t new_length, off_t new_data_stride)
+{
+	assert(old_length >= 0);
+	assert(new_length >= 0);
+	
+	std::unique_lock<std::mutex> l(lock);
+	
+	if(offsets.empty())
+	{
+		return true;
+	}
+	
+	for(size_t i = 0; i < offsets.size(); ++i)
+	{
+		if(offsets[i] < 0 || (i > 0 && (offsets[i] <= offsets[i - 1] || offsets[i] < (offsets[i - 1] + old_length))))
+		{
+			/* Ranges out of order or overlapping. */
+			return false;
+		}
+	}
+	
+	if((offsets.back() + old_length) > _length())
+	{
+		/* Runs past the end of the buffer. */
+		return false;
+	}
+	
+	/* Walk the blocks once, rebuilding the data of any block which has a replacement
+	 * starting in it or a replaced range passing through it. Offsets in the blocks are
+	 * adjusted as we go, so the block virt_offset values are only compared against the
+	 * offsets list BEFORE being updated.
+	*/
+	
+	off_t delta = 0;
+	size_t r = 0;
+	
+	for(auto block = blocks.begin(); block != blocks.end(); ++block)
+	{
+		off_t block_begin = block->virt_offset;
+		off_t block_end   = block->virt_offset + block->virt_length;
+		
+		bool is_last = (block + 1) == blocks.end();
+		
+		block->virt_offset += delta;
+		
+		if(r == offsets.size() || !(offsets[r] < block_end || (is_last && offsets[r] == block_end)))
+		{
+			/* No replacements touch this block. */
+			continue;
+		}
+		
+		if(offsets[r] < block_begin && (offsets[r] + old_length) >= block_end && block_begin < block_end)
+		{
+			/* This block is wholly within a range which started in a previous block,
+			 * don't bother loading it.
+			*/
+			
+			delta -= block->virt_length;
+			
+			block->virt_length = 0;
+			block->data.clear();
+			block->data.shrink_to_fit();
+			
+			block->state = Block::DIRTY;
+			_last_access_remove(&(*block));
+			
+			if((offsets[r] + old_length) == block_end)
+			{
+				++r;
+			}
+			
+			continue;
+		}
+		
+		_load_block(&(*block));
+		
+		const unsigned char *src = block->data.data();
+		
+		std::vector<unsigned char> new_block_data;
+		new_block_data.reserve(block->virt_length + new_length);
+		
+		off_t pos = block_begin;
+		
+		while(r < offsets.size() && (offsets[r] < block_end || (is_last && offsets[r] == block_end)))
+		{
+			off_t r_begin = offsets[r];
+			off_t r_end   = offsets[r] + old_length;
+			
+			if(r_begin >= block_begin)
+			{
+				/* Replacement starts in this block, copy any data before it and then
+				 * insert the new data.
+				*/
+				
+				new_block_data.insert(new_block_data.end(), (src + (pos - block_begin)), (src + (r_begin - block_begin)));
+				
+				const unsigned char *r_data = new_data + (r * new_data_stride);
+				new_block_data.insert(new_block_data.end(), r_data, (r_data + new_length));
+				
+				pos = r_begin;
+			}
+			
+			pos = std::max(pos, std::min(r_end, block_end));
+			
+			if(r_end > block_end)
+			{
+				/* Replaced range continues into the next block. */
+				break;
+			}
+			
+			++r;
+		}
+		
+		new_block_data.insert(new_block_data.end(), (src + (pos - block_begin)), (src + (block_end - block_begin)));
+		
+		delta += (off_t)(new_block_data.size()) - block->virt_length;
+		
+		block->virt_length = new_block_data.size();
+		block->data.swap(new_block_data);
+		
+		block->state = Block::DIRTY;
+		_last_access_remove(&(*block));
+	}
+	
+	assert(r == offsets.size());
+	
+	return true;
+}
+
 REHex::Buffer::Block::Block(off_t offset, off_t length):
 	real_offset(offset),
 	virt_offset(offset),
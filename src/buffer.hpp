@@ -113,6 +113,16 @@ namespace REHex {
 			bool overwrite_data(off_t offset, unsigned const char *data, off_t length);
 			bool insert_data(off_t offset, unsigned const char *data, off_t length);
 			bool erase_data(off_t offset, off_t length);
+			
+			/* Replace old_length bytes at each of the given offsets with new_length
+			 * bytes from new_data, resizing the buffer as necessary in a single pass.
+			 *
+			 * The offsets are relative to the buffer BEFORE any replacements and must
+			 * be in ascending order with no overlapping ranges. The replacement data
+			 * for the n-th range is read from new_data + (n * new_data_stride), so a
+			 * stride of zero replaces every range with the same data.
+			*/
+			bool replace_data(const std::vector<off_t> &offsets, off_t old_length, const unsigned char *new_data, off_t new_length, off_t new_data_stride);
 	};
 }
 
@@ -76,7 +76,7 @@ namespace REHex {
 			std::vector<unsigned char> last_data;
 			
 			void OnCursorUpdate(CursorUpdateEvent &event);
-			void OnDataModified(OffsetLengthEvent &event);
+			void OnDataModified(ChangeSetEvent &event);
 			void OnPropertyGridChanged(wxPropertyGridEvent& event);
 			void OnPropertyGridSelected(wxPropertyGridEvent &event);
 			void OnEndian(wxCommandEvent &event);
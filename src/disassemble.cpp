@@ -147,9 +147,7 @@ REHex::Disassemble::Disassemble(wxWindow *parent, SharedDocumentPointer &documen
 	
 	this->document.auto_cleanup_bind(CURSOR_UPDATE, &REHex::Disassemble::OnCursorUpdate,    this);
 	
-	this->document.auto_cleanup_bind(DATA_ERASE,     &REHex::Disassemble::OnDataModified, this);
-	this->document.auto_cleanup_bind(DATA_INSERT,    &REHex::Disassemble::OnDataModified, this);
-	this->document.auto_cleanup_bind(DATA_OVERWRITE, &REHex::Disassemble::OnDataModified, this);
+	this->document.auto_cleanup_bind(DOCUMENT_CHANGESET, &REHex::Disassemble::OnDataModified, this);
 	
 	this->document_ctrl.auto_cleanup_bind(EV_DISP_SETTING_CHANGED, &REHex::Disassemble::OnBaseChanged, this);
 	
@@ -357,9 +355,12 @@ void REHex::Disassemble::OnArch(wxCommandEvent &event)
 	update();
 }
 
-void REHex::Disassemble::OnDataModified(OffsetLengthEvent &event)
+void REHex::Disassemble::OnDataModified(ChangeSetEvent &event)
 {
-	update();
+	if(event.data_changed())
+	{
+		update();
+	}
 	
 	/* Continue propogation. */
 	event.Skip();
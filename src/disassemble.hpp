@@ -67,7 +67,7 @@ namespace REHex {
 			
 			void OnCursorUpdate(CursorUpdateEvent &event);
 			void OnArch(wxCommandEvent &event);
-			void OnDataModified(OffsetLengthEvent &event);
+			void OnDataModified(ChangeSetEvent &event);
 			void OnBaseChanged(wxCommandEvent &event);
 			
 			/* Stays at the bottom because it changes the protection... */
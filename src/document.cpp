@@ -25,13 +25,16 @@
 #include <limits>
 #include <map>
 #include <stack>
+#include <stdio.h>
 #include <string>
 #include <wx/clipbrd.h>
 #include <wx/dcbuffer.h>
 
 #include "app.hpp"
+#include "BinaryMetadata.hpp"
 #include "document.hpp"
 #include "Events.hpp"
+#include "FileStat.hpp"
 #include "Palette.hpp"
 #include "textentrydialog.hpp"
 #include "util.hpp"
@@ -50,7 +53,11 @@ wxDEFINE_EVENT(REHex::EV_HIGHLIGHTS_CHANGED,  wxCommandEvent);
 
 REHex::Document::Document():
 	dirty(false),
-	cursor_state(CSTATE_HEX)
+	cursor_state(CSTATE_HEX),
+	changeset_resized_from(-1),
+	changeset_comments(false),
+	changeset_highlights(false),
+	changeset_pending(false)
 {
 	buffer = new REHex::Buffer();
 	title  = "Untitled";
@@ -59,7 +66,11 @@ REHex::Document::Document():
 REHex::Document::Document(const std::string &filename):
 	filename(filename),
 	dirty(false),
-	cursor_state(CSTATE_HEX)
+	cursor_state(CSTATE_HEX),
+	changeset_resized_from(-1),
+	changeset_comments(false),
+	changeset_highlights(false),
+	changeset_pending(false)
 {
 	buffer = new REHex::Buffer(filename);
 	
@@ -75,6 +86,9 @@ REHex::Document::Document(const std::string &filename):
 
 REHex::Document::~Document()
 {
+	/* Document is being closed - any unsaved changes have been discarded. */
+	_journal_close();
+	
 	delete buffer;
 }
 
@@ -83,6 +97,8 @@ void REHex::Document::save()
 	buffer->write_inplace();
 	_save_metadata(filename + ".rehex-meta");
 	
+	_journal_close();
+	
 	dirty_bytes.clear_all();
 	set_dirty(false);
 }
@@ -90,6 +106,8 @@ void REHex::Document::save()
 void REHex::Document::save(const std::string &filename)
 {
 	buffer->write_inplace(filename);
+	
+	_journal_close();
 	this->filename = filename;
 	
 	size_t last_slash = filename.find_last_of("/\\");
@@ -124,6 +142,11 @@ bool REHex::Document::is_byte_dirty(off_t offset) const
 	return dirty_bytes.isset(offset);
 }
 
+const REHex::ByteRangeSet &REHex::Document::get_dirty_bytes() const
+{
+	return dirty_bytes;
+}
+
 off_t REHex::Document::get_cursor_position() const
 {
 	return this->cpos_off;
@@ -203,6 +226,14 @@ void REHex::Document::replace_data(off_t offset, off_t old_data_length, const un
 	_tracked_replace_data(change_desc, offset, old_data_length, new_data, new_data_length, new_cursor_pos, new_cursor_state);
 }
 
+void REHex::Document::replace_data(const std::vector<off_t> &offsets, off_t old_data_length, const unsigned char *new_data, off_t new_data_length, off_t new_cursor_pos, CursorState new_cursor_state, const char *change_desc)
+{
+	if(new_cursor_pos < 0)                 { new_cursor_pos = cpos_off; }
+	if(new_cursor_state == CSTATE_CURRENT) { new_cursor_state = cursor_state; }
+	
+	_tracked_replace_data(change_desc, offsets, old_data_length, new_data, new_data_length, new_cursor_pos, new_cursor_state);
+}
+
 off_t REHex::Document::buffer_length()
 {
 	return buffer->length();
@@ -228,6 +259,7 @@ bool REHex::Document::set_comment(off_t offset, off_t length, const Comment &com
 		{
 			NestedOffsetLengthMap_set(comments, offset, length, comment);
 			set_dirty(true);
+			_journal_set_comment(offset, length, comment);
 			
 			_raise_comment_modified();
 		},
@@ -252,6 +284,7 @@ bool REHex::Document::erase_comment(off_t offset, off_t length)
 		{
 			comments.erase(NestedOffsetLengthMapKey(offset, length));
 			set_dirty(true);
+			_journal_erase_key(RecoveryJournal::REC_ERASE_COMMENT, offset, length);
 			
 			_raise_comment_modified();
 		},
@@ -269,6 +302,22 @@ const REHex::NestedOffsetLengthMap<int> &REHex::Document::get_highlights() const
 	return highlights;
 }
 
+bool REHex::Document::get_binary_metadata() const
+{
+	return metadata_binary;
+}
+
+void REHex::Document::set_binary_metadata(bool binary_metadata)
+{
+	if(metadata_binary == binary_metadata)
+	{
+		return;
+	}
+	
+	metadata_binary = binary_metadata;
+	set_dirty(true);
+}
+
 bool REHex::Document::set_highlight(off_t off, off_t length, int highlight_colour_idx)
 {
 	assert(highlight_colour_idx >= 0);
@@ -289,6 +338,7 @@ bool REHex::Document::set_highlight(off_t off, off_t length, int highlight_colou
 		{
 			NestedOffsetLengthMap_set(highlights, off, length, highlight_colour_idx);
 			set_dirty(true);
+			_journal_set_highlight(off, length, highlight_colour_idx);
 
 			_raise_highlights_changed();
 		},
@@ -314,6 +364,7 @@ bool REHex::Document::erase_highlight(off_t off, off_t length)
 		{
 			highlights.erase(NestedOffsetLengthMapKey(off, length));
 			set_dirty(true);
+			_journal_erase_key(RecoveryJournal::REC_ERASE_HIGHLIGHT, off, length);
 
 			_raise_highlights_changed();
 		},
@@ -354,6 +405,7 @@ void REHex::Document::handle_paste(wxWindow *modal_dialog_parent, const NestedOf
 			for(auto cc = clipboard_comments.begin(); cc != clipboard_comments.end(); ++cc)
 			{
 				NestedOffsetLengthMap_set(comments, cursor_pos + cc->first.offset, cc->first.length, cc->second);
+				_journal_set_comment(cursor_pos + cc->first.offset, cc->first.length, cc->second);
 			}
 			
 			set_dirty(true);
@@ -380,10 +432,17 @@ void REHex::Document::undo()
 		cursor_state = act.old_cursor_state;
 		comments     = act.old_comments;
 		highlights   = act.old_highlights;
-		dirty_bytes  = act.old_dirty_bytes;
+		dirty_bytes  = act.old_dirty_bytes.to_byte_range_set();
 		
 		set_dirty(act.old_dirty);
 		
+		/* Comments and highlights are restored wholesale rather than by replaying
+		 * anything, so the journal needs a fresh copy of them.
+		*/
+		journal_comments_pending   = true;
+		journal_highlights_pending = true;
+		_changeset_queue();
+		
 		if(cursor_updated)
 		{
 			CursorUpdateEvent cursor_update_event(this, cpos_off, cursor_state);
@@ -446,6 +505,11 @@ void REHex::Document::_UNTRACKED_overwrite_data(off_t offset, const unsigned cha
 		dirty_bytes.set_range(offset, length);
 		set_dirty(true);
 		
+		_journal_data(RecoveryJournal::REC_OVERWRITE, offset, data, length);
+		
+		changeset_data.set_range(offset, length);
+		_changeset_queue();
+		
 		OffsetLengthEvent data_overwrite_event(this, DATA_OVERWRITE, offset, length);
 		ProcessEvent(data_overwrite_event);
 	}
@@ -470,6 +534,13 @@ void REHex::Document::_UNTRACKED_insert_data(off_t offset, const unsigned char *
 		dirty_bytes.set_range(offset, length);
 		set_dirty(true);
 		
+		_journal_data(RecoveryJournal::REC_INSERT, offset, data, length);
+		
+		changeset_data.data_inserted(offset, length);
+		changeset_data.set_range(offset, length);
+		changeset_resized_from = (changeset_resized_from >= 0 ? std::min(changeset_resized_from, offset) : offset);
+		_changeset_queue();
+		
 		OffsetLengthEvent data_insert_event(this, DATA_INSERT, offset, length);
 		ProcessEvent(data_insert_event);
 		
@@ -503,6 +574,12 @@ void REHex::Document::_UNTRACKED_erase_data(off_t offset, off_t length)
 		dirty_bytes.data_erased(offset, length);
 		set_dirty(true);
 		
+		_journal_data(RecoveryJournal::REC_ERASE, offset, NULL, length);
+		
+		changeset_data.data_erased(offset, length);
+		changeset_resized_from = (changeset_resized_from >= 0 ? std::min(changeset_resized_from, offset) : offset);
+		_changeset_queue();
+		
 		OffsetLengthEvent data_erase_event(this, DATA_ERASE, offset, length);
 		ProcessEvent(data_erase_event);
 		
@@ -522,6 +599,122 @@ void REHex::Document::_UNTRACKED_erase_data(off_t offset, off_t length)
 	}
 }
 
+/* Replace many ranges of data in the Buffer in a single pass and update our own data structures.
+ *
+ * Other objects see the span from the start of the first replacement to the end of the last one
+ * as having been overwritten, with any change in length inserted or erased at the end of it.
+*/
+void REHex::Document::_UNTRACKED_replace_data(const std::vector<off_t> &offsets, off_t old_length, const unsigned char *data, off_t new_length, off_t data_stride)
+{
+	assert(!offsets.empty());
+	
+	off_t delta    = (new_length - old_length) * (off_t)(offsets.size());
+	off_t span_off = offsets.front();
+	off_t old_span = (offsets.back() + old_length) - span_off;
+	off_t common   = std::min(old_span, (old_span + delta));
+	
+	if(common > 0)
+	{
+		OffsetLengthEvent data_overwriting_event(this, DATA_OVERWRITING, span_off, common);
+		ProcessEvent(data_overwriting_event);
+	}
+	
+	if(delta > 0)
+	{
+		OffsetLengthEvent data_inserting_event(this, DATA_INSERTING, (span_off + common), delta);
+		ProcessEvent(data_inserting_event);
+	}
+	else if(delta < 0)
+	{
+		OffsetLengthEvent data_erasing_event(this, DATA_ERASING, (span_off + common), -delta);
+		ProcessEvent(data_erasing_event);
+	}
+	
+	bool ok = buffer->replace_data(offsets, old_length, data, new_length, data_stride);
+	assert(ok);
+	
+	if(ok)
+	{
+		/* Build the (merged) list of ranges occupied by the new data. */
+		
+		std::vector<ByteRangeSet::Range> replaced;
+		
+		for(size_t i = 0; i < offsets.size() && new_length > 0; ++i)
+		{
+			off_t r_off = offsets[i] + ((off_t)(i) * (new_length - old_length));
+			
+			if(!replaced.empty() && (replaced.back().offset + replaced.back().length) == r_off)
+			{
+				replaced.back().length += new_length;
+			}
+			else{
+				replaced.push_back(ByteRangeSet::Range(r_off, new_length));
+			}
+		}
+		
+		dirty_bytes.data_replaced(offsets, old_length, new_length);
+		dirty_bytes.set_ranges(replaced.begin(), replaced.end());
+		set_dirty(true);
+		
+		_journal_replace(offsets, old_length, data, new_length, data_stride);
+		
+		changeset_data.data_replaced(offsets, old_length, new_length);
+		changeset_data.set_ranges(replaced.begin(), replaced.end());
+		
+		if(delta != 0)
+		{
+			changeset_resized_from = (changeset_resized_from >= 0 ? std::min(changeset_resized_from, span_off) : span_off);
+		}
+		
+		_changeset_queue();
+		
+		if(delta > 0)
+		{
+			OffsetLengthEvent data_insert_event(this, DATA_INSERT, (span_off + common), delta);
+			ProcessEvent(data_insert_event);
+		}
+		else if(delta < 0)
+		{
+			OffsetLengthEvent data_erase_event(this, DATA_ERASE, (span_off + common), -delta);
+			ProcessEvent(data_erase_event);
+		}
+		
+		if(common > 0)
+		{
+			OffsetLengthEvent data_overwrite_event(this, DATA_OVERWRITE, span_off, common);
+			ProcessEvent(data_overwrite_event);
+		}
+		
+		if(NestedOffsetLengthMap_data_replaced(comments, offsets, old_length, new_length) > 0)
+		{
+			_raise_comment_modified();
+		}
+		
+		if(NestedOffsetLengthMap_data_replaced(highlights, offsets, old_length, new_length) > 0)
+		{
+			_raise_highlights_changed();
+		}
+	}
+	else{
+		if(delta > 0)
+		{
+			OffsetLengthEvent data_insert_aborted_event(this, DATA_INSERT_ABORTED, (span_off + common), delta);
+			ProcessEvent(data_insert_aborted_event);
+		}
+		else if(delta < 0)
+		{
+			OffsetLengthEvent data_erase_aborted_event(this, DATA_ERASE_ABORTED, (span_off + common), -delta);
+			ProcessEvent(data_erase_aborted_event);
+		}
+		
+		if(common > 0)
+		{
+			OffsetLengthEvent data_overwrite_aborted_event(this, DATA_OVERWRITE_ABORTED, span_off, common);
+			ProcessEvent(data_overwrite_aborted_event);
+		}
+	}
+}
+
 void REHex::Document::_tracked_overwrite_data(const char *change_desc, off_t offset, const unsigned char *data, off_t length, off_t new_cursor_pos, CursorState new_cursor_state)
 {
 	/* Move data into a std::vector managed by a shared_ptr so that it can be "copied" into
@@ -621,6 +814,65 @@ void REHex::Document::_tracked_replace_data(const char *change_desc, off_t offse
 		});
 }
 
+void REHex::Document::_tracked_replace_data(const char *change_desc, const std::vector<off_t> &offsets, off_t old_data_length, const unsigned char *new_data, off_t new_data_length, off_t new_cursor_pos, CursorState new_cursor_state)
+{
+	if(offsets.empty())
+	{
+		return;
+	}
+	
+	/* Save the data being replaced in one contiguous buffer, so the change can be undone
+	 * using another multi-range replace. The file is read in large windows to avoid going
+	 * back to the Buffer for every match.
+	*/
+	
+	static const off_t READ_WINDOW_SIZE = 4194304; /* 4MiB */
+	
+	std::shared_ptr< std::vector<unsigned char> > old_data(new std::vector<unsigned char>());
+	old_data->reserve(offsets.size() * old_data_length);
+	
+	std::vector<unsigned char> window;
+	off_t window_base = 0;
+	
+	for(auto o = offsets.begin(); o != offsets.end(); ++o)
+	{
+		if((*o + old_data_length) > (window_base + (off_t)(window.size())))
+		{
+			window_base = *o;
+			window = read_data(window_base, std::max(READ_WINDOW_SIZE, old_data_length));
+		}
+		
+		const unsigned char *base = window.data() + (*o - window_base);
+		old_data->insert(old_data->end(), base, base + old_data_length);
+	}
+	
+	assert(old_data->size() == (offsets.size() * old_data_length));
+	
+	std::shared_ptr< std::vector<off_t> > old_offsets(new std::vector<off_t>(offsets));
+	
+	std::shared_ptr< std::vector<off_t> > new_offsets(new std::vector<off_t>());
+	new_offsets->reserve(offsets.size());
+	
+	for(size_t i = 0; i < offsets.size(); ++i)
+	{
+		new_offsets->push_back(offsets[i] + ((off_t)(i) * (new_data_length - old_data_length)));
+	}
+	
+	std::shared_ptr< std::vector<unsigned char> > new_data_copy(new std::vector<unsigned char>(new_data, new_data + new_data_length));
+	
+	_tracked_change(change_desc,
+		[this, old_offsets, old_data_length, new_data_copy, new_cursor_pos, new_cursor_state]()
+		{
+			_UNTRACKED_replace_data(*old_offsets, old_data_length, new_data_copy->data(), new_data_copy->size(), 0);
+			_set_cursor_position(new_cursor_pos, new_cursor_state);
+		},
+		
+		[this, new_offsets, new_data_length, old_data, old_data_length]()
+		{
+			_UNTRACKED_replace_data(*new_offsets, new_data_length, old_data->data(), old_data_length, old_data_length);
+		});
+}
+
 void REHex::Document::_tracked_change(const char *desc, std::function< void() > do_func, std::function< void() > undo_func)
 {
 	struct TrackedChange change;
@@ -634,7 +886,7 @@ void REHex::Document::_tracked_change(const char *desc, std::function< void() >
 	change.old_comments     = comments;
 	change.old_highlights   = highlights;
 	change.old_dirty        = dirty;
-	change.old_dirty_bytes  = dirty_bytes;
+	change.old_dirty_bytes  = CompactByteRangeSet(dirty_bytes);
 	
 	do_func();
 	
@@ -709,6 +961,12 @@ void REHex::Document::_save_metadata(const std::string &filename)
 {
 	/* TODO: Atomically replace file. */
 	
+	if(metadata_binary && !(comments.empty() && highlights.empty()))
+	{
+		_save_binary_metadata(filename);
+		return;
+	}
+	
 	bool has_data = false;
 	json_t *meta = _dump_metadata(has_data);
 	int res = 0;
@@ -728,12 +986,31 @@ void REHex::Document::_save_metadata(const std::string &filename)
 	}
 }
 
-REHex::NestedOffsetLengthMap<REHex::Document::Comment> REHex::Document::_load_comments(const json_t *meta, off_t buffer_length)
+void REHex::Document::_save_binary_metadata(const std::string &filename)
 {
-	NestedOffsetLengthMap<Comment> comments;
+	BinaryMetadataWriter writer(filename);
+	
+	for(auto c = comments.begin(); c != comments.end(); ++c)
+	{
+		const wxScopedCharBuffer utf8_text = c->second.text->utf8_str();
+		writer.add_comment(c->first.offset, c->first.length, utf8_text.data(), utf8_text.length());
+	}
+	
+	for(auto h = highlights.begin(); h != highlights.end(); ++h)
+	{
+		writer.add_highlight(h->first.offset, h->first.length, h->second);
+	}
 	
+	writer.finish();
+}
+
+REHex::NestedOffsetLengthMap<REHex::Document::Comment> REHex::Document::_load_comments(const json_t *meta, off_t buffer_length)
+{
 	json_t *j_comments = json_object_get(meta, "comments");
 	
+	std::vector< std::pair<NestedOffsetLengthMapKey, Comment> > comments;
+	comments.reserve(json_array_size(j_comments));
+	
 	size_t index;
 	json_t *value;
 	
@@ -746,19 +1023,20 @@ REHex::NestedOffsetLengthMap<REHex::Document::Comment> REHex::Document::_load_co
 		if(offset >= 0 && offset < buffer_length
 			&& length >= 0 && (offset + length) <= buffer_length)
 		{
-			NestedOffsetLengthMap_set(comments, offset, length, Comment(text));
+			comments.push_back(std::make_pair(NestedOffsetLengthMapKey(offset, length), Comment(text)));
 		}
 	}
 	
-	return comments;
+	return NestedOffsetLengthMap_bulk_load(std::move(comments));
 }
 
 REHex::NestedOffsetLengthMap<int> REHex::Document::_load_highlights(const json_t *meta, off_t buffer_length)
 {
-	NestedOffsetLengthMap<int> highlights;
-	
 	json_t *j_highlights = json_object_get(meta, "highlights");
 	
+	std::vector< std::pair<NestedOffsetLengthMapKey, int> > highlights;
+	highlights.reserve(json_array_size(j_highlights));
+	
 	size_t index;
 	json_t *value;
 	
@@ -772,17 +1050,23 @@ REHex::NestedOffsetLengthMap<int> REHex::Document::_load_highlights(const json_t
 			&& length > 0 && (offset + length) <= buffer_length
 			&& colour >= 0 && colour < Palette::NUM_HIGHLIGHT_COLOURS)
 		{
-			NestedOffsetLengthMap_set(highlights, offset, length, colour);
+			highlights.push_back(std::make_pair(NestedOffsetLengthMapKey(offset, length), colour));
 		}
 	}
 	
-	return highlights;
+	return NestedOffsetLengthMap_bulk_load(std::move(highlights));
 }
 
 void REHex::Document::_load_metadata(const std::string &filename)
 {
 	/* TODO: Report errors */
 	
+	if(BinaryMetadataReader::is_binary_metadata(filename))
+	{
+		_load_binary_metadata(filename);
+		return;
+	}
+	
 	json_error_t json_err;
 	json_t *meta = json_load_file(filename.c_str(), 0, &json_err);
 	
@@ -792,8 +1076,716 @@ void REHex::Document::_load_metadata(const std::string &filename)
 	json_decref(meta);
 }
 
+void REHex::Document::_load_binary_metadata(const std::string &filename)
+{
+	off_t buffer_length = this->buffer_length();
+	
+	std::vector< std::pair<NestedOffsetLengthMapKey, Comment> > comments;
+	std::vector< std::pair<NestedOffsetLengthMapKey, int> > highlights;
+	
+	try {
+		BinaryMetadataReader reader(filename);
+		
+		comments.reserve(reader.comment_count());
+		highlights.reserve(reader.highlight_count());
+		
+		off_t offset, length;
+		std::string utf8_text;
+		int colour;
+		
+		while(reader.next_comment(&offset, &length, &utf8_text))
+		{
+			if(offset >= 0 && offset < buffer_length
+				&& length >= 0 && (offset + length) <= buffer_length)
+			{
+				comments.push_back(std::make_pair(NestedOffsetLengthMapKey(offset, length), Comment(wxString::FromUTF8(utf8_text.data(), utf8_text.size()))));
+			}
+		}
+		
+		while(reader.next_highlight(&offset, &length, &colour))
+		{
+			if(offset >= 0 && offset < buffer_length
+				&& length > 0 && (offset + length) <= buffer_length
+				&& colour >= 0 && colour < Palette::NUM_HIGHLIGHT_COLOURS)
+			{
+				highlights.push_back(std::make_pair(NestedOffsetLengthMapKey(offset, length), colour));
+			}
+		}
+	}
+	catch(const std::exception &e)
+	{
+		fprintf(stderr, "Unable to load metadata from %s: %s\n", filename.c_str(), e.what());
+		return;
+	}
+	
+	this->comments   = NestedOffsetLengthMap_bulk_load(std::move(comments));
+	this->highlights = NestedOffsetLengthMap_bulk_load(std::move(highlights));
+	
+	metadata_binary = true;
+}
+
+bool REHex::Document::has_recovery_journal() const
+{
+	if(filename.empty() || journal || !wxFileExists(_journal_filename()))
+	{
+		return false;
+	}
+	
+	if(journal_lock)
+	{
+		return true;
+	}
+	
+	/* Another session may be editing the file - its journal isn't ours to recover. */
+	
+	try {
+		return RecoveryJournal::Lock::acquire(_journal_filename()) != NULL;
+	}
+	catch(const std::exception &e)
+	{
+		fprintf(stderr, "Unable to lock recovery journal: %s\n", e.what());
+		return false;
+	}
+}
+
+/* Replay the changes from a recovery journal left behind by a previous session.
+ *
+ * Throws a std::runtime_error if the journal can't be read, was made against a different
+ * version of the file or is owned by another session. The journal is kept and appended to as
+ * further changes are made.
+ *
+ * If replaying fails partway through, the document is left part-recovered and journalling is
+ * disabled so the journal isn't overwritten - the caller should close and reopen the file.
+*/
+void REHex::Document::recover_from_journal()
+{
+	assert(!journal);
+	
+	if(!_journal_lock())
+	{
+		throw std::runtime_error("The unsaved changes are being edited in another window");
+	}
+	
+	off_t valid_length;
+	
+	{
+		RecoveryJournal::Reader reader(_journal_filename());
+		
+		off_t file_size;
+		int64_t file_mtime;
+		
+		if(!stat_file(filename, &file_size, &file_mtime)
+			|| file_size != reader.get_file_size()
+			|| file_mtime != reader.get_file_mtime())
+		{
+			throw std::runtime_error("The file has been modified since the unsaved changes were made");
+		}
+		
+		journal_replaying = true;
+		
+		try {
+			RecoveryJournal::RecordType type;
+			std::vector<unsigned char> payload;
+			
+			while(reader.next(&type, &payload))
+			{
+				_journal_replay_record(type, payload);
+			}
+		}
+		catch(...)
+		{
+			journal_replaying = false;
+			journal_failed    = true;
+			throw;
+		}
+		
+		journal_replaying          = false;
+		journal_comments_pending   = false;
+		journal_highlights_pending = false;
+		
+		valid_length = reader.get_valid_length();
+	}
+	
+	try {
+		journal.reset(new RecoveryJournal(_journal_filename(), valid_length));
+	}
+	catch(const std::exception &e)
+	{
+		fprintf(stderr, "Unable to open recovery journal: %s\n", e.what());
+		journal_failed = true;
+	}
+}
+
+void REHex::Document::discard_recovery_journal()
+{
+	if(!journal && !filename.empty() && wxFileExists(_journal_filename()) && _journal_lock())
+	{
+		wxRemoveFile(_journal_filename());
+	}
+}
+
+void REHex::Document::sync_recovery_journal()
+{
+	_journal_metadata();
+	
+	if(journal)
+	{
+		journal->sync();
+	}
+}
+
+std::string REHex::Document::_journal_filename() const
+{
+	return filename + ".rehex-journal";
+}
+
+/* Returns the journal to record changes in, starting a new one if necessary, or NULL if changes
+ * aren't being journalled.
+*/
+REHex::RecoveryJournal *REHex::Document::_journal()
+{
+	if(journal_replaying || journal_failed || filename.empty())
+	{
+		return NULL;
+	}
+	
+	if(!journal)
+	{
+		if(!_journal_lock())
+		{
+			fprintf(stderr, "Not journalling changes to %s - already open in another session\n", filename.c_str());
+			journal_failed = true;
+			
+			return NULL;
+		}
+		
+		try {
+			off_t file_size;
+			int64_t file_mtime;
+			
+			if(!stat_file(filename, &file_size, &file_mtime))
+			{
+				throw std::runtime_error("Unable to stat " + filename);
+			}
+			
+			journal.reset(new RecoveryJournal(_journal_filename(), file_size, file_mtime));
+			
+			/* Changes to comments and highlights are journalled relative to the
+			 * ones already in the document, so the journal starts with a copy.
+			*/
+			journal_comments_pending   = true;
+			journal_highlights_pending = true;
+			journal_metadata_bytes     = 0;
+			journal_snapshot_bytes     = 0;
+		}
+		catch(const std::exception &e)
+		{
+			fprintf(stderr, "Unable to create recovery journal: %s\n", e.what());
+			journal_failed = true;
+			
+			return NULL;
+		}
+	}
+	
+	if(!journal->ok())
+	{
+		return NULL;
+	}
+	
+	return journal.get();
+}
+
+/* Takes the lock on the journal, if we don't already hold it. Returns false if another session
+ * holds it or it can't be taken.
+*/
+bool REHex::Document::_journal_lock()
+{
+	if(!journal_lock)
+	{
+		try {
+			journal_lock = RecoveryJournal::Lock::acquire(_journal_filename());
+		}
+		catch(const std::exception &e)
+		{
+			fprintf(stderr, "Unable to lock recovery journal: %s\n", e.what());
+		}
+	}
+	
+	return journal_lock != NULL;
+}
+
+void REHex::Document::_journal_data(RecoveryJournal::RecordType type, off_t offset, const unsigned char *data, off_t length)
+{
+	RecoveryJournal *journal = _journal();
+	if(journal == NULL)
+	{
+		return;
+	}
+	
+	/* Write out any changes to comments/highlights first, so they are replayed before the
+	 * change to the data moves them around.
+	*/
+	_journal_metadata();
+	
+	std::vector<unsigned char> payload;
+	payload.reserve(16 + (data != NULL ? length : 0));
+	
+	RecoveryJournal::put_u64(payload, offset);
+	
+	if(data != NULL)
+	{
+		RecoveryJournal::put_data(payload, data, length);
+	}
+	else{
+		RecoveryJournal::put_u64(payload, length);
+	}
+	
+	journal->append(type, std::move(payload));
+}
+
+void REHex::Document::_journal_replace(const std::vector<off_t> &offsets, off_t old_length, const unsigned char *data, off_t new_length, off_t data_stride)
+{
+	RecoveryJournal *journal = _journal();
+	if(journal == NULL)
+	{
+		return;
+	}
+	
+	_journal_metadata();
+	
+	off_t data_length = data_stride > 0 ? (data_stride * (off_t)(offsets.size())) : new_length;
+	
+	std::vector<unsigned char> payload;
+	payload.reserve(32 + (offsets.size() * 8) + data_length);
+	
+	RecoveryJournal::put_u64(payload, old_length);
+	RecoveryJournal::put_u64(payload, new_length);
+	RecoveryJournal::put_u64(payload, data_stride);
+	RecoveryJournal::put_u64(payload, offsets.size());
+	
+	for(auto o = offsets.begin(); o != offsets.end(); ++o)
+	{
+		RecoveryJournal::put_u64(payload, *o);
+	}
+	
+	RecoveryJournal::put_data(payload, data, data_length);
+	
+	journal->append(RecoveryJournal::REC_REPLACE, std::move(payload));
+}
+
+/* Write a copy of the comments and/or highlights to the journal if they have been replaced
+ * wholesale (by an undo, or when the journal is started) since they were last written.
+*/
+void REHex::Document::_journal_metadata()
+{
+	if(!journal_comments_pending && !journal_highlights_pending)
+	{
+		return;
+	}
+	
+	RecoveryJournal *journal = _journal();
+	if(journal == NULL)
+	{
+		return;
+	}
+	
+	if(journal_comments_pending)
+	{
+		journal_comments_pending = false;
+		_journal_metadata_record(RecoveryJournal::REC_COMMENTS, _journal_comments_payload());
+	}
+	
+	if(journal_highlights_pending)
+	{
+		journal_highlights_pending = false;
+		_journal_metadata_record(RecoveryJournal::REC_HIGHLIGHTS, _journal_highlights_payload());
+	}
+}
+
+std::vector<unsigned char> REHex::Document::_journal_comments_payload() const
+{
+	std::vector<unsigned char> payload;
+	RecoveryJournal::put_u64(payload, comments.size());
+	
+	for(auto c = comments.begin(); c != comments.end(); ++c)
+	{
+		const wxScopedCharBuffer utf8_text = c->second.text->utf8_str();
+		
+		RecoveryJournal::put_u64(payload, c->first.offset);
+		RecoveryJournal::put_u64(payload, c->first.length);
+		RecoveryJournal::put_u32(payload, utf8_text.length());
+		RecoveryJournal::put_data(payload, utf8_text.data(), utf8_text.length());
+	}
+	
+	return payload;
+}
+
+std::vector<unsigned char> REHex::Document::_journal_highlights_payload() const
+{
+	std::vector<unsigned char> payload;
+	payload.reserve(8 + (highlights.size() * 20));
+	
+	RecoveryJournal::put_u64(payload, highlights.size());
+	
+	for(auto h = highlights.begin(); h != highlights.end(); ++h)
+	{
+		RecoveryJournal::put_u64(payload, h->first.offset);
+		RecoveryJournal::put_u64(payload, h->first.length);
+		RecoveryJournal::put_u32(payload, h->second);
+	}
+	
+	return payload;
+}
+
+void REHex::Document::_journal_set_comment(off_t offset, off_t length, const Comment &comment)
+{
+	if(_journal() == NULL)
+	{
+		return;
+	}
+	
+	const wxScopedCharBuffer utf8_text = comment.text->utf8_str();
+	
+	std::vector<unsigned char> payload;
+	RecoveryJournal::put_u64(payload, offset);
+	RecoveryJournal::put_u64(payload, length);
+	RecoveryJournal::put_u32(payload, utf8_text.length());
+	RecoveryJournal::put_data(payload, utf8_text.data(), utf8_text.length());
+	
+	_journal_metadata_record(RecoveryJournal::REC_SET_COMMENT, std::move(payload));
+}
+
+void REHex::Document::_journal_set_highlight(off_t offset, off_t length, int colour)
+{
+	if(_journal() == NULL)
+	{
+		return;
+	}
+	
+	std::vector<unsigned char> payload;
+	RecoveryJournal::put_u64(payload, offset);
+	RecoveryJournal::put_u64(payload, length);
+	RecoveryJournal::put_u32(payload, colour);
+	
+	_journal_metadata_record(RecoveryJournal::REC_SET_HIGHLIGHT, std::move(payload));
+}
+
+void REHex::Document::_journal_erase_key(RecoveryJournal::RecordType type, off_t offset, off_t length)
+{
+	if(_journal() == NULL)
+	{
+		return;
+	}
+	
+	std::vector<unsigned char> payload;
+	RecoveryJournal::put_u64(payload, offset);
+	RecoveryJournal::put_u64(payload, length);
+	
+	_journal_metadata_record(type, std::move(payload));
+}
+
+/* Append a change to the comments or highlights to the journal.
+ *
+ * Changes to single comments and highlights are journalled as they are made, so the journal only
+ * grows by the size of each change. Once the changes in the journal outweigh a copy of all the
+ * comments and highlights (and JOURNAL_COMPACT_MIN), the journal is compacted to replace them all
+ * with a copy.
+*/
+void REHex::Document::_journal_metadata_record(RecoveryJournal::RecordType type, std::vector<unsigned char> &&payload)
+{
+	/* Copies of the whole set must go in before any changes to it. */
+	_journal_metadata();
+	
+	journal_metadata_bytes += payload.size();
+	journal->append(type, std::move(payload));
+	
+	if(journal_metadata_bytes > std::max((off_t)(JOURNAL_COMPACT_MIN), (journal_snapshot_bytes * 2)))
+	{
+		std::vector<RecoveryJournal::Record> records(2);
+		
+		records[0].type    = RecoveryJournal::REC_COMMENTS;
+		records[0].payload = _journal_comments_payload();
+		
+		records[1].type    = RecoveryJournal::REC_HIGHLIGHTS;
+		records[1].payload = _journal_highlights_payload();
+		
+		journal_snapshot_bytes = records[0].payload.size() + records[1].payload.size();
+		journal_metadata_bytes = journal_snapshot_bytes;
+		
+		journal->compact({
+			RecoveryJournal::REC_COMMENTS, RecoveryJournal::REC_HIGHLIGHTS,
+			RecoveryJournal::REC_SET_COMMENT, RecoveryJournal::REC_ERASE_COMMENT,
+			RecoveryJournal::REC_SET_HIGHLIGHT, RecoveryJournal::REC_ERASE_HIGHLIGHT }, std::move(records));
+	}
+}
+
+/* Stop journalling and delete the journal - called once the changes in it have been saved or
+ * discarded.
+*/
+void REHex::Document::_journal_close()
+{
+	if(journal)
+	{
+		journal.reset();
+		wxRemoveFile(_journal_filename());
+	}
+	
+	journal_lock.reset();
+	
+	journal_failed             = false;
+	journal_comments_pending   = false;
+	journal_highlights_pending = false;
+}
+
+void REHex::Document::_journal_replay_record(RecoveryJournal::RecordType type, const std::vector<unsigned char> &payload)
+{
+	RecoveryJournal::PayloadReader pr(payload);
+	off_t buffer_length = this->buffer_length();
+	
+	auto bad_record = []()
+	{
+		throw std::runtime_error("Invalid record in recovery journal");
+	};
+	
+	switch(type)
+	{
+		case RecoveryJournal::REC_OVERWRITE:
+		{
+			off_t offset = pr.get_u64();
+			off_t length = pr.remain();
+			
+			if(offset < 0 || offset > buffer_length || length > (buffer_length - offset))
+			{
+				bad_record();
+			}
+			
+			_UNTRACKED_overwrite_data(offset, pr.get_data(length), length);
+			break;
+		}
+		
+		case RecoveryJournal::REC_INSERT:
+		{
+			off_t offset = pr.get_u64();
+			off_t length = pr.remain();
+			
+			if(offset < 0 || offset > buffer_length)
+			{
+				bad_record();
+			}
+			
+			_UNTRACKED_insert_data(offset, pr.get_data(length), length);
+			break;
+		}
+		
+		case RecoveryJournal::REC_ERASE:
+		{
+			off_t offset = pr.get_u64();
+			off_t length = pr.get_u64();
+			
+			if(offset < 0 || offset > buffer_length || length < 0 || length > (buffer_length - offset))
+			{
+				bad_record();
+			}
+			
+			_UNTRACKED_erase_data(offset, length);
+			break;
+		}
+		
+		case RecoveryJournal::REC_REPLACE:
+		{
+			off_t old_length  = pr.get_u64();
+			off_t new_length  = pr.get_u64();
+			off_t data_stride = pr.get_u64();
+			uint64_t count    = pr.get_u64();
+			
+			if(old_length < 0 || new_length < 0 || data_stride < 0 || count == 0 || count > (pr.remain() / 8))
+			{
+				bad_record();
+			}
+			
+			std::vector<off_t> offsets;
+			offsets.reserve(count);
+			
+			for(uint64_t i = 0; i < count; ++i)
+			{
+				off_t offset = pr.get_u64();
+				
+				if(offset < 0 || (!offsets.empty() && offset < (offsets.back() + old_length)))
+				{
+					bad_record();
+				}
+				
+				offsets.push_back(offset);
+			}
+			
+			if(old_length > buffer_length || offsets.back() > (buffer_length - old_length)
+				|| pr.remain() != (size_t)(data_stride > 0 ? (data_stride * (off_t)(count)) : new_length)
+				|| (data_stride > 0 && data_stride < new_length))
+			{
+				bad_record();
+			}
+			
+			_UNTRACKED_replace_data(offsets, old_length, pr.get_data(pr.remain()), new_length, data_stride);
+			break;
+		}
+		
+		case RecoveryJournal::REC_COMMENTS:
+		{
+			uint64_t count = pr.get_u64();
+			
+			std::vector< std::pair<NestedOffsetLengthMapKey, Comment> > new_comments;
+			new_comments.reserve(std::min<uint64_t>(count, pr.remain() / 20));
+			
+			for(uint64_t i = 0; i < count; ++i)
+			{
+				off_t offset       = pr.get_u64();
+				off_t length       = pr.get_u64();
+				uint32_t text_len  = pr.get_u32();
+				const char *text   = (const char*)(pr.get_data(text_len));
+				
+				if(offset >= 0 && length >= 0 && offset <= buffer_length && length <= (buffer_length - offset))
+				{
+					new_comments.push_back(std::make_pair(NestedOffsetLengthMapKey(offset, length), Comment(wxString::FromUTF8(text, text_len))));
+				}
+			}
+			
+			comments = NestedOffsetLengthMap_bulk_load(std::move(new_comments));
+			set_dirty(true);
+			
+			_raise_comment_modified();
+			break;
+		}
+		
+		case RecoveryJournal::REC_HIGHLIGHTS:
+		{
+			uint64_t count = pr.get_u64();
+			
+			std::vector< std::pair<NestedOffsetLengthMapKey, int> > new_highlights;
+			new_highlights.reserve(std::min<uint64_t>(count, pr.remain() / 20));
+			
+			for(uint64_t i = 0; i < count; ++i)
+			{
+				off_t offset = pr.get_u64();
+				off_t length = pr.get_u64();
+				int colour   = pr.get_u32();
+				
+				if(offset >= 0 && length > 0 && offset < buffer_length && length <= (buffer_length - offset)
+					&& colour >= 0 && colour < Palette::NUM_HIGHLIGHT_COLOURS)
+				{
+					new_highlights.push_back(std::make_pair(NestedOffsetLengthMapKey(offset, length), colour));
+				}
+			}
+			
+			highlights = NestedOffsetLengthMap_bulk_load(std::move(new_highlights));
+			set_dirty(true);
+			
+			_raise_highlights_changed();
+			break;
+		}
+		
+		case RecoveryJournal::REC_SET_COMMENT:
+		{
+			off_t offset      = pr.get_u64();
+			off_t length      = pr.get_u64();
+			uint32_t text_len = pr.get_u32();
+			const char *text  = (const char*)(pr.get_data(text_len));
+			
+			if(offset >= 0 && length >= 0 && offset <= buffer_length && length <= (buffer_length - offset))
+			{
+				NestedOffsetLengthMap_set(comments, offset, length, Comment(wxString::FromUTF8(text, text_len)));
+			}
+			
+			set_dirty(true);
+			
+			_raise_comment_modified();
+			break;
+		}
+		
+		case RecoveryJournal::REC_ERASE_COMMENT:
+		{
+			off_t offset = pr.get_u64();
+			off_t length = pr.get_u64();
+			
+			comments.erase(NestedOffsetLengthMapKey(offset, length));
+			set_dirty(true);
+			
+			_raise_comment_modified();
+			break;
+		}
+		
+		case RecoveryJournal::REC_SET_HIGHLIGHT:
+		{
+			off_t offset = pr.get_u64();
+			off_t length = pr.get_u64();
+			int colour   = pr.get_u32();
+			
+			if(offset >= 0 && length > 0 && offset < buffer_length && length <= (buffer_length - offset)
+				&& colour >= 0 && colour < Palette::NUM_HIGHLIGHT_COLOURS)
+			{
+				NestedOffsetLengthMap_set(highlights, offset, length, colour);
+			}
+			
+			set_dirty(true);
+			
+			_raise_highlights_changed();
+			break;
+		}
+		
+		case RecoveryJournal::REC_ERASE_HIGHLIGHT:
+		{
+			off_t offset = pr.get_u64();
+			off_t length = pr.get_u64();
+			
+			highlights.erase(NestedOffsetLengthMapKey(offset, length));
+			set_dirty(true);
+			
+			_raise_highlights_changed();
+			break;
+		}
+		
+		default:
+			/* Unknown record type, probably from a newer version. Skipping it would
+			 * leave the document in an inconsistent state.
+			*/
+			bad_record();
+	}
+}
+
+void REHex::Document::_changeset_queue()
+{
+	if(!changeset_pending)
+	{
+		changeset_pending = true;
+		CallAfter(&REHex::Document::flush_changeset);
+	}
+}
+
+void REHex::Document::flush_changeset()
+{
+	if(!changeset_pending)
+	{
+		return;
+	}
+	
+	_journal_metadata();
+	
+	ChangeSetEvent event(this, changeset_data, changeset_resized_from, changeset_comments, changeset_highlights);
+	
+	/* Reset before dispatching so any changes made by handlers go into a new change set. */
+	changeset_data.clear_all();
+	changeset_resized_from = -1;
+	changeset_comments     = false;
+	changeset_highlights   = false;
+	changeset_pending      = false;
+	
+	ProcessEvent(event);
+}
+
 void REHex::Document::_raise_comment_modified()
 {
+	changeset_comments = true;
+	_changeset_queue();
+	
 	wxCommandEvent event(REHex::EV_COMMENT_MODIFIED);
 	event.SetEventObject(this);
 	
@@ -826,6 +1818,9 @@ void REHex::Document::_raise_clean()
 
 void REHex::Document::_raise_highlights_changed()
 {
+	changeset_highlights = true;
+	_changeset_queue();
+	
 	wxCommandEvent event(REHex::EV_HIGHLIGHTS_CHANGED);
 	event.SetEventObject(this);
 	
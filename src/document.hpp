@@ -29,7 +29,9 @@
 
 #include "buffer.hpp"
 #include "ByteRangeSet.hpp"
+#include "CompactByteRangeSet.hpp"
 #include "NestedOffsetLengthMap.hpp"
+#include "RecoveryJournal.hpp"
 #include "util.hpp"
 
 namespace REHex {
@@ -94,6 +96,7 @@ namespace REHex {
 			std::string get_filename();
 			bool is_dirty();
 			bool is_byte_dirty(off_t offset) const;
+			const ByteRangeSet &get_dirty_bytes() const;
 			
 			off_t get_cursor_position() const;
 			CursorState get_cursor_state() const;
@@ -107,6 +110,14 @@ namespace REHex {
 			bool set_highlight(off_t off, off_t length, int highlight_colour_idx);
 			bool erase_highlight(off_t off, off_t length);
 			
+			/* Whether comments and highlights are saved in the binary .rehex-meta
+			 * format rather than JSON. Off unless chosen by the user or the metadata
+			 * was loaded from a binary file. Changing it marks the document dirty so
+			 * it can be saved in the new format.
+			*/
+			bool get_binary_metadata() const;
+			void set_binary_metadata(bool binary_metadata);
+			
 			void handle_paste(wxWindow *modal_dialog_parent, const NestedOffsetLengthMap<Document::Comment> &clipboard_comments);
 			
 			void undo();
@@ -114,6 +125,30 @@ namespace REHex {
 			void redo();
 			const char *redo_desc();
 			
+			/**
+			 * @brief Deliver any pending DOCUMENT_CHANGESET event immediately.
+			 *
+			 * Changes are normally coalesced and delivered once control returns
+			 * to the event loop, this may be used to force delivery where a
+			 * caller needs subscribers to be up to date before continuing.
+			*/
+			void flush_changeset();
+			
+			/* Unsaved changes to a file are journalled alongside it (in a
+			 * .rehex-journal file) until they are saved or the document is closed,
+			 * so they can be recovered if we crash.
+			 *
+			 * A journal belongs to the session writing it until that session exits,
+			 * has_recovery_journal() only reports journals left behind by sessions
+			 * which have gone away.
+			*/
+			bool has_recovery_journal() const;
+			void recover_from_journal();
+			void discard_recovery_journal();
+			
+			/* Wait for any journalled changes to be written out. */
+			void sync_recovery_journal();
+			
 		#ifndef UNIT_TEST
 		private:
 		#endif
@@ -130,7 +165,7 @@ namespace REHex {
 				NestedOffsetLengthMap<int> old_highlights;
 				
 				bool old_dirty;
-				ByteRangeSet old_dirty_bytes;
+				CompactByteRangeSet old_dirty_bytes;
 			};
 			
 			Buffer *buffer;
@@ -146,6 +181,12 @@ namespace REHex {
 			
 			std::string title;
 			
+			/* Set when binary metadata was chosen with set_binary_metadata() or
+			 * successfully loaded from a binary .rehex-meta file, so it is saved back in
+			 * the same format.
+			*/
+			bool metadata_binary{false};
+			
 			off_t cpos_off{0};
 			bool insert_mode{false};
 			
@@ -155,24 +196,66 @@ namespace REHex {
 			std::list<REHex::Document::TrackedChange> undo_stack;
 			std::list<REHex::Document::TrackedChange> redo_stack;
 			
+			/* Changes accumulated for the next DOCUMENT_CHANGESET event. */
+			ByteRangeSet changeset_data;
+			off_t changeset_resized_from;
+			bool changeset_comments;
+			bool changeset_highlights;
+			bool changeset_pending;
+			
+			void _changeset_queue();
+			
+			std::unique_ptr<RecoveryJournal> journal;
+			std::unique_ptr<RecoveryJournal::Lock> journal_lock;
+			bool journal_failed{false};
+			bool journal_replaying{false};
+			bool journal_comments_pending{false};
+			bool journal_highlights_pending{false};
+			
+			/* Size of the records of changes to comments and highlights in the journal,
+			 * and of the copy of them all written by the last compaction.
+			*/
+			static const off_t JOURNAL_COMPACT_MIN = 1024 * 1024; /* 1MiB */
+			off_t journal_metadata_bytes{0};
+			off_t journal_snapshot_bytes{0};
+			
+			std::string _journal_filename() const;
+			RecoveryJournal *_journal();
+			bool _journal_lock();
+			void _journal_data(RecoveryJournal::RecordType type, off_t offset, const unsigned char *data, off_t length);
+			void _journal_replace(const std::vector<off_t> &offsets, off_t old_length, const unsigned char *data, off_t new_length, off_t data_stride);
+			void _journal_metadata();
+			std::vector<unsigned char> _journal_comments_payload() const;
+			std::vector<unsigned char> _journal_highlights_payload() const;
+			void _journal_set_comment(off_t offset, off_t length, const Comment &comment);
+			void _journal_set_highlight(off_t offset, off_t length, int colour);
+			void _journal_erase_key(RecoveryJournal::RecordType type, off_t offset, off_t length);
+			void _journal_metadata_record(RecoveryJournal::RecordType type, std::vector<unsigned char> &&payload);
+			void _journal_close();
+			void _journal_replay_record(RecoveryJournal::RecordType type, const std::vector<unsigned char> &payload);
+			
 			void _set_cursor_position(off_t position, enum CursorState cursor_state);
 			
 			void _UNTRACKED_overwrite_data(off_t offset, const unsigned char *data, off_t length);
 			void _UNTRACKED_insert_data(off_t offset, const unsigned char *data, off_t length);
 			void _UNTRACKED_erase_data(off_t offset, off_t length);
+			void _UNTRACKED_replace_data(const std::vector<off_t> &offsets, off_t old_length, const unsigned char *data, off_t new_length, off_t data_stride);
 			
 			void _tracked_overwrite_data(const char *change_desc, off_t offset, const unsigned char *data, off_t length, off_t new_cursor_pos, CursorState new_cursor_state);
 			void _tracked_insert_data(const char *change_desc, off_t offset, const unsigned char *data, off_t length, off_t new_cursor_pos, CursorState new_cursor_state);
 			void _tracked_erase_data(const char *change_desc, off_t offset, off_t length, off_t new_cursor_pos, CursorState new_cursor_state);
 			void _tracked_replace_data(const char *change_desc, off_t offset, off_t old_data_length, const unsigned char *new_data, off_t new_data_length, off_t new_cursor_pos, CursorState new_cursor_state);
+			void _tracked_replace_data(const char *change_desc, const std::vector<off_t> &offsets, off_t old_data_length, const unsigned char *new_data, off_t new_data_length, off_t new_cursor_pos, CursorState new_cursor_state);
 			void _tracked_change(const char *desc, std::function< void() > do_func, std::function< void() > undo_func);
 			
 			json_t *_dump_metadata(bool& has_data);
 			void _save_metadata(const std::string &filename);
+			void _save_binary_metadata(const std::string &filename);
 			
 			static NestedOffsetLengthMap<Comment> _load_comments(const json_t *meta, off_t buffer_length);
 			static NestedOffsetLengthMap<int> _load_highlights(const json_t *meta, off_t buffer_length);
 			void _load_metadata(const std::string &filename);
+			void _load_binary_metadata(const std::string &filename);
 			
 			void _raise_comment_modified();
 			void _raise_undo_update();
@@ -188,6 +271,11 @@ namespace REHex {
 			void insert_data(off_t offset, const unsigned char *data, off_t length,                                      off_t new_cursor_pos = -1, CursorState new_cursor_state = CSTATE_CURRENT, const char *change_desc = "change data");
 			void erase_data(off_t offset, off_t length,                                                                  off_t new_cursor_pos = -1, CursorState new_cursor_state = CSTATE_CURRENT, const char *change_desc = "change data");
 			void replace_data(off_t offset, off_t old_data_length, const unsigned char *new_data, off_t new_data_length, off_t new_cursor_pos = -1, CursorState new_cursor_state = CSTATE_CURRENT, const char *change_desc = "change data");
+			
+			/* Replace old_data_length bytes at each of the given offsets with new_data as a
+			 * single undoable change. Offsets must be in ascending order and not overlap.
+			*/
+			void replace_data(const std::vector<off_t> &offsets, off_t old_data_length, const unsigned char *new_data, off_t new_data_length, off_t new_cursor_pos = -1, CursorState new_cursor_state = CSTATE_CURRENT, const char *change_desc = "replace data");
 	};
 	
 	class CommentsDataObject: public wxCustomDataObject
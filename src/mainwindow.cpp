@@ -17,6 +17,7 @@
 
 #include "platform.hpp"
 #include <exception>
+#include <functional>
 #include <limits>
 #include <new>
 #include <wx/artprov.h>
@@ -61,7 +62,13 @@ enum {
 	ID_SHOW_ASCII,
 	ID_SEARCH_TEXT,
 	ID_SEARCH_BSEQ,
+	ID_SEARCH_MASKED,
+	ID_SEARCH_REGEX,
 	ID_SEARCH_VALUE,
+	ID_SEARCH_RANGE,
+	ID_SEARCH_PATTERNS,
+	ID_BUILD_SEARCH_INDEX,
+	ID_INDEX_BUILD_TIMER,
 	ID_GOTO_OFFSET,
 	ID_OVERWRITE_MODE,
 	ID_SAVE_VIEW,
@@ -79,6 +86,7 @@ enum {
 	ID_DARK_PALETTE,
 	ID_CLOSE_ALL,
 	ID_CLOSE_OTHERS,
+	ID_BINARY_METADATA,
 	ID_GITHUB,
 	ID_DONATE,
 
@@ -96,6 +104,7 @@ BEGIN_EVENT_TABLE(REHex::MainWindow, wxFrame)
 	EVT_MENU(wxID_CLOSE,      REHex::MainWindow::OnClose)
 	EVT_MENU(ID_CLOSE_ALL,    REHex::MainWindow::OnCloseAll)
 	EVT_MENU(ID_CLOSE_OTHERS, REHex::MainWindow::OnCloseOthers)
+	EVT_MENU(ID_BINARY_METADATA, REHex::MainWindow::OnBinaryMetadata)
 	EVT_MENU(wxID_EXIT,       REHex::MainWindow::OnExit)
 	
 	EVT_MENU(wxID_FILE1, REHex::MainWindow::OnRecentOpen)
@@ -119,7 +128,14 @@ BEGIN_EVENT_TABLE(REHex::MainWindow, wxFrame)
 	
 	EVT_MENU(ID_SEARCH_TEXT, REHex::MainWindow::OnSearchText)
 	EVT_MENU(ID_SEARCH_BSEQ,  REHex::MainWindow::OnSearchBSeq)
+	EVT_MENU(ID_SEARCH_MASKED, REHex::MainWindow::OnSearchMasked)
+	EVT_MENU(ID_SEARCH_REGEX,  REHex::MainWindow::OnSearchRegex)
 	EVT_MENU(ID_SEARCH_VALUE,  REHex::MainWindow::OnSearchValue)
+	EVT_MENU(ID_SEARCH_RANGE,  REHex::MainWindow::OnSearchRange)
+	EVT_MENU(ID_SEARCH_PATTERNS, REHex::MainWindow::OnSearchPatterns)
+	EVT_MENU(ID_BUILD_SEARCH_INDEX, REHex::MainWindow::OnBuildSearchIndex)
+	
+	EVT_TIMER(ID_INDEX_BUILD_TIMER, REHex::MainWindow::OnIndexBuildTimer)
 	
 	EVT_MENU(ID_GOTO_OFFSET, REHex::MainWindow::OnGotoOffset)
 	
@@ -169,7 +185,8 @@ BEGIN_EVENT_TABLE(REHex::MainWindow, wxFrame)
 END_EVENT_TABLE()
 
 REHex::MainWindow::MainWindow():
-	wxFrame(NULL, wxID_ANY, "Reverse Engineers' Hex Editor", wxDefaultPosition, wxSize(900, 700))
+	wxFrame(NULL, wxID_ANY, "Reverse Engineers' Hex Editor", wxDefaultPosition, wxSize(900, 700)),
+	index_build_timer(this, ID_INDEX_BUILD_TIMER)
 {
 	file_menu = new wxMenu;
 	recent_files_menu = new wxMenu;
@@ -179,6 +196,7 @@ REHex::MainWindow::MainWindow():
 	file_menu->AppendSubMenu(recent_files_menu, "Open &Recent");
 	file_menu->Append(wxID_SAVE,   "&Save\tCtrl-S");
 	file_menu->Append(wxID_SAVEAS, "&Save As");
+	file_menu->AppendCheckItem(ID_BINARY_METADATA, "Save metadata in binary format");
 	file_menu->AppendSeparator();
 	file_menu->Append(wxID_CLOSE,  "&Close\tCtrl-W");
 	file_menu->Append(ID_CLOSE_ALL, "Close All");
@@ -210,7 +228,14 @@ REHex::MainWindow::MainWindow():
 	
 	edit_menu->Append(ID_SEARCH_TEXT,  "Search for text...");
 	edit_menu->Append(ID_SEARCH_BSEQ,  "Search for byte sequence...");
+	edit_menu->Append(ID_SEARCH_MASKED, "Search for masked byte sequence...");
+	edit_menu->Append(ID_SEARCH_REGEX, "Search for regular expression...");
 	edit_menu->Append(ID_SEARCH_VALUE, "Search for value...");
+	edit_menu->Append(ID_SEARCH_RANGE, "Search for value range...");
+	edit_menu->Append(ID_SEARCH_PATTERNS, "Search for pattern list...");
+	edit_menu->Append(ID_BUILD_SEARCH_INDEX, "Build search index",
+		("Index the file to speed up searches for byte sequences and text of at least "
+			+ std::to_string(NGramIndex::NGRAM_LENGTH + NGramIndex::DEFAULT_SAMPLE_STRIDE - 1) + " bytes"));
 	
 	edit_menu->AppendSeparator();
 	
@@ -345,7 +370,7 @@ REHex::MainWindow::MainWindow():
 	notebook_dirty_bitmap = artp.GetBitmap(wxART_FILE_SAVE, wxART_MENU);
 	assert(!notebook_dirty_bitmap.IsSameAs(wxNullBitmap));
 	
-	CreateStatusBar(3);
+	CreateStatusBar(4);
 	
 	SetDropTarget(new DropTarget(this));
 	
@@ -424,6 +449,52 @@ void REHex::MainWindow::open_file(const std::string &filename)
 	wxGetApp().recent_files->AddFileToHistory(wxfn.GetFullPath());
 	
 	notebook->AddPage(tab, tab->doc->get_title(), true);
+	
+	if(tab->doc->has_recovery_journal())
+	{
+		/* rehex exited without saving changes to this file last time. */
+		
+		int answer = wxMessageBox(
+			std::string("Unsaved changes to ") + filename + " from a previous session were found.\n"
+				+ "Do you want to recover them?",
+			"Recover unsaved changes", (wxYES_NO | wxICON_QUESTION), this);
+		
+		if(answer == wxYES)
+		{
+			try {
+				tab->doc->recover_from_journal();
+			}
+			catch(const std::exception &e)
+			{
+				wxMessageBox(
+					std::string("Unable to recover changes to ") + filename + ":\n" + e.what(),
+					"Error", wxICON_ERROR, this);
+				
+				/* Some of the changes may have been replayed before the error, so
+				 * reopen the file rather than leave it half-recovered.
+				*/
+				
+				notebook->DeletePage(notebook->GetPageIndex(tab));
+				
+				try {
+					tab = new Tab(notebook, filename);
+				}
+				catch(const std::exception &e)
+				{
+					wxMessageBox(
+						std::string("Error opening ") + filename + ":\n" + e.what(),
+						"Error", wxICON_ERROR, this);
+					return;
+				}
+				
+				notebook->AddPage(tab, tab->doc->get_title(), true);
+			}
+		}
+		else{
+			tab->doc->discard_recovery_journal();
+		}
+	}
+	
 	tab->doc_ctrl->SetFocus();
 }
 
@@ -587,6 +658,12 @@ void REHex::MainWindow::OnCloseOthers(wxCommandEvent &event)
 	close_other_tabs(tab);
 }
 
+void REHex::MainWindow::OnBinaryMetadata(wxCommandEvent &event)
+{
+	Tab *tab = active_tab();
+	tab->doc->set_binary_metadata(event.IsChecked());
+}
+
 void REHex::MainWindow::OnExit(wxCommandEvent &event)
 {
 	Close();
@@ -604,6 +681,7 @@ void REHex::MainWindow::OnSearchText(wxCommandEvent &event)
 	sd->Show(true);
 	
 	tab->search_dialog_register(sd);
+	sd->set_open_documents_provider(std::bind(&REHex::MainWindow::open_documents, this));
 }
 
 void REHex::MainWindow::OnSearchBSeq(wxCommandEvent &event)
@@ -618,6 +696,37 @@ void REHex::MainWindow::OnSearchBSeq(wxCommandEvent &event)
 	sd->Show(true);
 	
 	tab->search_dialog_register(sd);
+	sd->set_open_documents_provider(std::bind(&REHex::MainWindow::open_documents, this));
+}
+
+void REHex::MainWindow::OnSearchMasked(wxCommandEvent &event)
+{
+	wxWindow *cpage = notebook->GetCurrentPage();
+	assert(cpage != NULL);
+	
+	auto tab = dynamic_cast<Tab*>(cpage);
+	assert(tab != NULL);
+	
+	REHex::Search::Masked *sd = new REHex::Search::Masked(tab, tab->doc);
+	sd->Show(true);
+	
+	tab->search_dialog_register(sd);
+	sd->set_open_documents_provider(std::bind(&REHex::MainWindow::open_documents, this));
+}
+
+void REHex::MainWindow::OnSearchRegex(wxCommandEvent &event)
+{
+	wxWindow *cpage = notebook->GetCurrentPage();
+	assert(cpage != NULL);
+	
+	auto tab = dynamic_cast<Tab*>(cpage);
+	assert(tab != NULL);
+	
+	REHex::Search::Regex *sd = new REHex::Search::Regex(tab, tab->doc);
+	sd->Show(true);
+	
+	tab->search_dialog_register(sd);
+	sd->set_open_documents_provider(std::bind(&REHex::MainWindow::open_documents, this));
 }
 
 void REHex::MainWindow::OnSearchValue(wxCommandEvent &event)
@@ -632,6 +741,104 @@ void REHex::MainWindow::OnSearchValue(wxCommandEvent &event)
 	sd->Show(true);
 	
 	tab->search_dialog_register(sd);
+	sd->set_open_documents_provider(std::bind(&REHex::MainWindow::open_documents, this));
+}
+
+void REHex::MainWindow::OnSearchRange(wxCommandEvent &event)
+{
+	wxWindow *cpage = notebook->GetCurrentPage();
+	assert(cpage != NULL);
+	
+	auto tab = dynamic_cast<Tab*>(cpage);
+	assert(tab != NULL);
+	
+	REHex::Search::ValueRange *sd = new REHex::Search::ValueRange(tab, tab->doc);
+	sd->Show(true);
+	
+	tab->search_dialog_register(sd);
+	sd->set_open_documents_provider(std::bind(&REHex::MainWindow::open_documents, this));
+}
+
+void REHex::MainWindow::OnSearchPatterns(wxCommandEvent &event)
+{
+	wxWindow *cpage = notebook->GetCurrentPage();
+	assert(cpage != NULL);
+	
+	auto tab = dynamic_cast<Tab*>(cpage);
+	assert(tab != NULL);
+	
+	REHex::Search::PatternList *sd = new REHex::Search::PatternList(tab, tab->doc);
+	sd->Show(true);
+	
+	tab->search_dialog_register(sd);
+	sd->set_open_documents_provider(std::bind(&REHex::MainWindow::open_documents, this));
+}
+
+/* Build a search index for the current file in the background, so searches for byte sequences
+ * and text in it only need to check the places the index says they might be. Only one index is
+ * built at a time, choosing this again while one is being built offers to cancel it.
+*/
+void REHex::MainWindow::OnBuildSearchIndex(wxCommandEvent &event)
+{
+	if(index_builder)
+	{
+		if(wxMessageBox(("A search index is already being built for " + index_build_title + ".\nCancel it?"), "Build search index", (wxYES_NO | wxCENTRE), this) == wxYES)
+		{
+			index_builder->cancel();
+		}
+		
+		return;
+	}
+	
+	Tab *tab = active_tab();
+	
+	std::string filename = tab->doc->get_filename();
+	if(filename == "" || tab->doc->is_dirty())
+	{
+		wxMessageBox("The file must be saved before a search index can be built", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return;
+	}
+	
+	try {
+		index_builder.reset(new NGramIndex::Builder(filename));
+	}
+	catch(const std::exception &e)
+	{
+		wxMessageBox((std::string("Error building search index for ") + tab->doc->get_title() + ":\n" + e.what()), "Error", (wxOK | wxICON_ERROR | wxCENTRE), this);
+		return;
+	}
+	
+	index_build_title = tab->doc->get_title();
+	
+	SetStatusText(("Indexing " + index_build_title + "..."), 3);
+	index_build_timer.Start(500, wxTIMER_CONTINUOUS);
+}
+
+void REHex::MainWindow::OnIndexBuildTimer(wxTimerEvent &event)
+{
+	if(!index_builder->finished())
+	{
+		int percent = index_builder->progress() * 100;
+		SetStatusText(("Indexing " + index_build_title + "... " + std::to_string(percent) + "%"), 3);
+		
+		return;
+	}
+	
+	index_build_timer.Stop();
+	SetStatusText("", 3);
+	
+	try {
+		if(index_builder->finish())
+		{
+			SetStatusText(("Search index built for " + index_build_title), 3);
+		}
+	}
+	catch(const std::exception &e)
+	{
+		wxMessageBox((std::string("Error building search index for ") + index_build_title + ":\n" + e.what()), "Error", (wxOK | wxICON_ERROR | wxCENTRE), this);
+	}
+	
+	index_builder.reset();
 }
 
 void REHex::MainWindow::OnGotoOffset(wxCommandEvent &event)
@@ -956,6 +1163,7 @@ void REHex::MainWindow::OnDocumentChange(wxAuiNotebookEvent& event)
 	
 	Tab *tab = active_tab();
 	
+	file_menu->Check(ID_BINARY_METADATA, tab->doc->get_binary_metadata());
 	edit_menu->Check(ID_OVERWRITE_MODE, !tab->doc_ctrl->get_insert_mode());
 	view_menu->Check(ID_SHOW_OFFSETS, tab->doc_ctrl->get_show_offsets());
 	view_menu->Check(ID_SHOW_ASCII,   tab->doc_ctrl->get_show_ascii());
@@ -1232,6 +1440,22 @@ REHex::Document *REHex::MainWindow::active_document()
 	return active_tab()->doc;
 }
 
+/* Every open document, and how to list search results in its tab. */
+std::vector<REHex::Search::OpenDocument> REHex::MainWindow::open_documents()
+{
+	std::vector<Search::OpenDocument> documents;
+	
+	for(size_t i = 0; i < notebook->GetPageCount(); ++i)
+	{
+		auto tab = dynamic_cast<Tab*>(notebook->GetPage(i));
+		assert(tab != NULL);
+		
+		documents.push_back(Search::OpenDocument{ tab->doc, std::bind(&REHex::Tab::search_results_create, tab) });
+	}
+	
+	return documents;
+}
+
 void REHex::MainWindow::_update_status_offset(REHex::DocumentCtrl *doc_ctrl)
 {
 	off_t off = doc_ctrl->get_cursor_position();
@@ -19,12 +19,16 @@
 #define REHEX_MAINWINDOW_HPP
 
 #include <map>
+#include <memory>
+#include <string>
 #include <vector>
 #include <wx/aui/auibook.h>
 #include <wx/dnd.h>
 #include <wx/wx.h>
 
 #include "Events.hpp"
+#include "NGramIndex.hpp"
+#include "search.hpp"
 #include "Tab.hpp"
 #include "ToolPanel.hpp"
 
@@ -48,11 +52,18 @@ namespace REHex {
 			void OnClose(wxCommandEvent &event);
 			void OnCloseAll(wxCommandEvent &event);
 			void OnCloseOthers(wxCommandEvent &event);
+			void OnBinaryMetadata(wxCommandEvent &event);
 			void OnExit(wxCommandEvent &event);
 			
 			void OnSearchText(wxCommandEvent &event);
 			void OnSearchBSeq(wxCommandEvent &event);
+			void OnSearchMasked(wxCommandEvent &event);
+			void OnSearchRegex(wxCommandEvent &event);
 			void OnSearchValue(wxCommandEvent &event);
+			void OnSearchRange(wxCommandEvent &event);
+			void OnSearchPatterns(wxCommandEvent &event);
+			void OnBuildSearchIndex(wxCommandEvent &event);
+			void OnIndexBuildTimer(wxTimerEvent &event);
 			void OnGotoOffset(wxCommandEvent &event);
 			void OnCut(wxCommandEvent &event);
 			void OnCopy(wxCommandEvent &event);
@@ -121,8 +132,14 @@ namespace REHex {
 			
 			wxMenu *inline_comments_menu;
 			
+			/* Search index being built in the background, if any. */
+			std::unique_ptr<NGramIndex::Builder> index_builder;
+			std::string index_build_title;
+			wxTimer index_build_timer;
+			
 			Tab *active_tab();
 			Document *active_document();
+			std::vector<Search::OpenDocument> open_documents();
 			
 			void _update_status_offset(REHex::DocumentCtrl *doc_ctrl);
 			void _update_status_selection(REHex::DocumentCtrl *doc_ctrl);
@@ -16,11 +16,16 @@
 */
 
 #include "platform.hpp"
+#include <algorithm>
 #include <assert.h>
+#include <chrono>
+#include <cmath>
 #include <functional>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
 #include <sys/types.h>
+#include <thread>
 #include <utility>
 #include <wx/msgdlg.h>
 #include <wx/sizer.h>
@@ -36,8 +41,17 @@
 */
 #include <portable_endian.h>
 
+/* Workers scan each window this many bytes at a time, so a worker searching beyond a match found
+ * by another worker, or whose search has been cancelled, gives up on its window quickly.
+*/
+static const off_t SCAN_SLICE = 65536;
+
 enum {
 	ID_FIND_NEXT = 1,
+	ID_FIND_PREV,
+	ID_FIND_ALL,
+	ID_FIND_ALL_DOCUMENTS,
+	ID_REPLACE_ALL,
 	ID_TIMER,
 	
 	ID_RANGE_CB,
@@ -65,15 +79,25 @@ BEGIN_EVENT_TABLE(REHex::Search, wxDialog)
 	EVT_CHECKBOX(ID_RALIGN_CB, REHex::Search::OnCheckBox)
 	
 	EVT_BUTTON(ID_FIND_NEXT, REHex::Search::OnFindNext)
+	EVT_BUTTON(ID_FIND_PREV, REHex::Search::OnFindPrev)
+	EVT_BUTTON(ID_FIND_ALL, REHex::Search::OnFindAll)
+	EVT_BUTTON(ID_FIND_ALL_DOCUMENTS, REHex::Search::OnFindAllDocuments)
+	EVT_BUTTON(ID_REPLACE_ALL, REHex::Search::OnReplaceAll)
 	EVT_BUTTON(wxID_CANCEL, REHex::Search::OnCancel)
 	EVT_TIMER(ID_TIMER, REHex::Search::OnTimer)
 END_EVENT_TABLE()
 
 REHex::Search::Search(wxWindow *parent, SharedDocumentPointer &doc, const char *title):
 	wxDialog(parent, wxID_ANY, title),
-	doc(doc), range_begin(0), range_end(-1), align_to(1), align_from(0), match_found_at(-1), running(false),
-	timer(this, ID_TIMER)
-{}
+	doc(doc), range_begin(0), range_end(-1), align_to(1), align_from(0), match_found_at(-1), match_found_length(0), running(false),
+	backwards(false), progress(NULL), timer(this, ID_TIMER), finding_all(false), find_all_failed(false), replacing_all(false), replace_data_modified(false), incremental(false),
+	incremental_wrapped(false), incremental_from(0), incremental_window_size(DEFAULT_WINDOW_SIZE), incremental_done(false),
+	incremental_found(-1), incremental_highlighted(-1), incremental_cursor(-1), find_all_documents_btn(NULL)
+{
+	this->doc.auto_cleanup_bind(DATA_ERASE,     &REHex::Search::OnDataModified, this);
+	this->doc.auto_cleanup_bind(DATA_INSERT,    &REHex::Search::OnDataModified, this);
+	this->doc.auto_cleanup_bind(DATA_OVERWRITE, &REHex::Search::OnDataModified, this);
+}
 
 void REHex::Search::setup_window()
 {
@@ -134,7 +158,19 @@ void REHex::Search::setup_window()
 		wxBoxSizer *button_sz = new wxBoxSizer(wxHORIZONTAL);
 		main_sizer->Add(button_sz, 0, wxALIGN_RIGHT | wxALL, 10);
 		
-		button_sz->Add(new wxButton(this, ID_FIND_NEXT, "Find next"));
+		button_sz->Add(new wxButton(this, ID_FIND_PREV, "Find previous"));
+		button_sz->Add(new wxButton(this, ID_FIND_NEXT, "Find next"), 0, wxLEFT, 10);
+		button_sz->Add(new wxButton(this, ID_FIND_ALL, "Find all"), 0, wxLEFT, 10);
+		
+		find_all_documents_btn = new wxButton(this, ID_FIND_ALL_DOCUMENTS, "Find in all documents");
+		find_all_documents_btn->Enable((bool)(open_documents_provider));
+		button_sz->Add(find_all_documents_btn, 0, wxLEFT, 10);
+		
+		if(replace_supported())
+		{
+			button_sz->Add(new wxButton(this, ID_REPLACE_ALL, "Replace all"), 0, wxLEFT, 10);
+		}
+		
 		button_sz->Add(new wxButton(this, wxID_CANCEL,  "Cancel"), 0, wxLEFT, 10);
 	}
 	
@@ -149,6 +185,8 @@ void REHex::Search::limit_range(off_t range_begin, off_t range_end)
 	
 	this->range_begin = range_begin;
 	this->range_end   = range_end;
+	
+	incremental_done = false;
 }
 
 void REHex::Search::require_alignment(off_t alignment, off_t relative_to_offset)
@@ -158,6 +196,8 @@ void REHex::Search::require_alignment(off_t alignment, off_t relative_to_offset)
 	
 	align_to   = alignment;
 	align_from = relative_to_offset;
+	
+	incremental_done = false;
 }
 
 /* This method is only used by the unit tests. */
@@ -166,11 +206,7 @@ off_t REHex::Search::find_next(off_t from_offset, size_t window_size)
 	begin_search(from_offset, range_end, window_size);
 	
 	/* Wait for the workers to finish searching. */
-	while(!threads.empty())
-	{
-		threads.back().join();
-		threads.pop_back();
-	}
+	job->wait();
 	
 	end_search();
 	
@@ -189,14 +225,63 @@ void REHex::Search::begin_search(off_t from_offset, off_t range_end, size_t wind
 	
 	search_base = next_window_start;
 	search_end  = (range_end >= 0 ? range_end : doc->buffer_length());
+	backwards   = false;
+	
+	window_size = prepare_index(window_size);
 	
-	/* Number of threads to spawn */
-	unsigned int thread_count = std::thread::hardware_concurrency();
+	job = ThreadPool::get_shared().submit(std::bind(&REHex::Search::thread_main, this, window_size, compare_size));
 	
-	while(threads.size() < thread_count)
+	if(incremental)
 	{
-		threads.emplace_back(&REHex::Search::thread_main, this, window_size, compare_size);
+		/* Incremental searches run without a progress dialog, and are checked on more
+		 * often so the match is shown as soon as it is found.
+		*/
+		progress = NULL;
+		timer.Start(50, wxTIMER_CONTINUOUS);
+	}
+	else{
+		progress = new wxProgressDialog("Searching", "Search in progress...", 100, this, wxPD_CAN_ABORT | wxPD_REMAINING_TIME);
+		timer.Start(200, wxTIMER_CONTINUOUS);
 	}
+}
+
+/* This method is only used by the unit tests. */
+off_t REHex::Search::find_prev(off_t from_offset, size_t window_size)
+{
+	begin_search_backwards(from_offset, range_begin, window_size);
+	
+	/* Wait for the workers to finish searching. */
+	job->wait();
+	
+	end_search();
+	
+	return match_found_at;
+}
+
+/* Begin searching backwards for the last match which starts before from_offset.
+ *
+ * The worker threads claim windows in descending order from from_offset down to range_begin,
+ * so any window not yet claimed is below every match found so far and the highest match
+ * wins once the windows in progress have been searched.
+*/
+void REHex::Search::begin_search_backwards(off_t from_offset, off_t range_begin, size_t window_size)
+{
+	assert(!running);
+	
+	size_t compare_size = test_max_window();
+	
+	search_base = std::max(range_begin, this->range_begin);
+	search_end  = (range_end >= 0 ? range_end : doc->buffer_length());
+	search_from = std::min(from_offset, search_end);
+	backwards   = true;
+	
+	next_window_start = search_from;
+	match_found_at    = -1;
+	running           = true;
+	
+	window_size = prepare_index(window_size);
+	
+	job = ThreadPool::get_shared().submit(std::bind(&REHex::Search::thread_main_backwards, this, window_size, compare_size));
 	
 	progress = new wxProgressDialog("Searching", "Search in progress...", 100, this, wxPD_CAN_ABORT | wxPD_REMAINING_TIME);
 	timer.Start(200, wxTIMER_CONTINUOUS);
@@ -206,431 +291,2377 @@ void REHex::Search::end_search()
 {
 	assert(running);
 	
+	/* Workers stop part way through their windows once running is cleared, so the search is
+	 * only complete if they had all finished before it was.
+	*/
+	bool job_finished = job->finished();
+	
 	running = false;
 	
-	while(!threads.empty())
-	{
-		threads.back().join();
-		threads.pop_back();
-	}
+	job->cancel();
+	job->wait();
+	job.reset();
 	
 	timer.Stop();
+	
 	delete progress;
+	progress = NULL;
+	
+	if(finding_all)
+	{
+		/* Pass on any matches found since the last timer tick. */
+		flush_results();
+		
+		if(results && *results != NULL)
+		{
+			(*results)->finish(!find_all_failed && job_finished);
+		}
+		
+		results.reset();
+		finding_all = false;
+	}
+	
+	if(replacing_all)
+	{
+		/* finish_replace_all() takes the matches if the search completed. */
+		if(!job_finished || find_all_failed)
+		{
+			found.clear();
+		}
+		
+		replacing_all = false;
+	}
 }
 
-void REHex::Search::OnCheckBox(wxCommandEvent &event)
+/* Find every (non-overlapping) match within the search range.
+ *
+ * This method is only used by the unit tests.
+ *
+ * Returns false if the search failed.
+*/
+bool REHex::Search::find_all(std::vector<off_t> &matches, size_t window_size)
 {
-	enable_controls();
+	start_find_all(window_size);
+	
+	/* Wait for the workers to finish searching. */
+	job->wait();
+	
+	bool failed = find_all_failed;
+	
+	end_search();
+	take_found(matches);
+	
+	return !failed;
 }
 
-void REHex::Search::OnFindNext(wxCommandEvent &event)
+/* Start the workers searching for every match within the search range, collecting them in found.
+ * Used by the "Find all" and "Replace all" modes.
+*/
+void REHex::Search::start_find_all(size_t window_size)
 {
-	if(read_base_window_controls() && read_window_controls())
+	assert(!running);
+	
+	size_t compare_size = test_max_window();
+	
+	next_window_start = range_begin;
+	match_found_at    = -1;
+	running           = true;
+	
+	search_base = range_begin;
+	search_end  = (range_end >= 0 ? range_end : doc->buffer_length());
+	
+	find_all_failed = false;
+	found.clear();
+	
+	window_size = prepare_index(window_size);
+	
+	job = ThreadPool::get_shared().submit(std::bind(&REHex::Search::thread_find_all, this, window_size, compare_size, &found, &find_all_failed));
+}
+
+/* Take the matches collected by a search started by start_find_all() which has ended. Windows are
+ * searched in whatever order the threads get to them, so the matches are put back in order and
+ * any which overlap an earlier one are dropped.
+*/
+void REHex::Search::take_found(std::vector<off_t> &matches)
+{
+	size_t compare_size = test_max_window();
+	
+	std::sort(found.begin(), found.end());
+	
+	matches.clear();
+	matches.reserve(found.size());
+	
+	for(auto m = found.begin(); m != found.end(); ++m)
 	{
-		begin_search((doc->get_cursor_position() + 1), range_end);
+		if(compare_size == 0 || matches.empty() || m->offset >= (matches.back() + (off_t)(compare_size)))
+		{
+			matches.push_back(m->offset);
+		}
 	}
+	
+	found.clear();
 }
 
-void REHex::Search::OnCancel(wxCommandEvent &event)
+/* Begin searching for every match within the search range, listing them in a results panel.
+ *
+ * The whole range is searched in parallel, with matches being added to the panel by the timer
+ * as they are found until the search finishes or is cancelled via the progress dialog. Unlike
+ * find_all(), overlapping matches are all listed.
+*/
+void REHex::Search::begin_find_all(SearchResultsPanel *results, size_t window_size)
 {
-	Close();
+	start_find_all(window_size);
+	
+	finding_all = true;
+	this->results.reset(new SafeWindowPointer<SearchResultsPanel>(results));
+	
+	progress = new wxProgressDialog("Searching", "Search in progress...", 100, this, wxPD_CAN_ABORT | wxPD_REMAINING_TIME);
+	timer.Start(200, wxTIMER_CONTINUOUS);
 }
 
-void REHex::Search::OnTimer(wxTimerEvent &event)
+/* This method is only used by the unit tests. */
+void REHex::Search::find_all(SearchResultsPanel *results, size_t window_size)
 {
-	if(progress->WasCancelled())
+	begin_find_all(results, window_size);
+	
+	/* Wait for the workers to finish searching. */
+	job->wait();
+	
+	end_search();
+}
+
+void REHex::Search::set_results_panel_factory(const std::function<SearchResultsPanel*()> &factory)
+{
+	results_panel_factory = factory;
+}
+
+void REHex::Search::set_match_highlighter(const std::function<void(off_t, off_t)> &highlighter)
+{
+	match_highlighter = highlighter;
+}
+
+bool REHex::Search::find_all_documents(const std::vector<SharedDocumentPointer> &documents, std::vector< std::vector<SearchMatch> > &matches, wxProgressDialog *progress, size_t window_size)
+{
+	assert(!running);
+	
+	size_t compare_size = test_max_window();
+	
+	/* The range and alignment are offsets in the document the dialog was opened for, which
+	 * mean nothing in the others, so every document is searched whole and unaligned.
+	*/
+	off_t saved_align_to   = align_to;
+	off_t saved_align_from = align_from;
+	
+	align_to   = 1;
+	align_from = 0;
+	
+	std::vector< std::unique_ptr<DocumentSearch> > searches;
+	off_t total_size = 0;
+	
+	for(auto d = documents.begin(); d != documents.end(); ++d)
 	{
-		end_search();
-		return;
+		DocumentSearch *ds = new DocumentSearch();
+		searches.emplace_back(ds);
+		
+		ds->doc        = *d;
+		ds->search_end = (*d)->buffer_length();
+		
+		/* Each document may have its own search index. */
+		ds->index       = open_index(*d);
+		ds->window_size = ds->index ? std::max(window_size, (size_t)(NGramIndex::SEGMENT_SIZE)) : window_size;
+		
+		ds->next_window_start = 0;
+		
+		total_size += ds->search_end;
 	}
 	
-	if(match_found_at >= 0 || next_window_start > search_end)
+	running = true;
+	std::atomic<bool> failed(false);
+	
+	job = ThreadPool::get_shared().submit(std::bind(&REHex::Search::thread_find_all_documents, this, &searches, compare_size, &failed));
+	
+	bool cancelled = false;
+	
+	if(progress != NULL)
 	{
-		end_search();
-		
-		if(match_found_at >= 0)
+		while(!failed && !job->finished())
 		{
-			doc->set_cursor_position(match_found_at);
-		}
-		else{
-			if(search_base > range_begin)
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			
+			off_t searched = 0;
+			
+			for(auto s = searches.begin(); s != searches.end(); ++s)
 			{
-				/* Search was not from beginning of file/range, ask if we should go back to the start. */
-				
-				const char *message = range_begin > 0
-					? "Not found. Continue search from start of range?"
-					: "Not found. Continue search from start of file?";
-				
-				if(wxMessageBox(message, wxMessageBoxCaptionStr, (wxYES_NO | wxCENTRE), this) == wxYES)
-				{
-					begin_search(range_begin, search_base);
-				}
+				searched += std::min((off_t)((*s)->next_window_start), (*s)->search_end);
 			}
-			else{
-				wxMessageBox("Not found", wxMessageBoxCaptionStr, (wxOK | wxICON_INFORMATION | wxCENTRE), this);
+			
+			if(!progress->Update(((double)(100) / (total_size + 1)) * searched))
+			{
+				cancelled = true;
+				break;
 			}
 		}
 	}
-	else{
-		progress->Update(((double)(100) / ((search_end - search_base) + 1)) * (next_window_start - search_base));
+	
+	if(cancelled || failed)
+	{
+		/* Tell the workers to stop after their current window. */
+		running = false;
+		job->cancel();
+	}
+	
+	job->wait();
+	job.reset();
+	
+	running = false;
+	
+	align_to   = saved_align_to;
+	align_from = saved_align_from;
+	
+	matches.clear();
+	
+	if(cancelled || failed)
+	{
+		return false;
+	}
+	
+	/* Windows are searched in whatever order the threads get to them. */
+	
+	matches.resize(searches.size());
+	
+	for(size_t i = 0; i < searches.size(); ++i)
+	{
+		matches[i].swap(searches[i]->matches);
+		std::sort(matches[i].begin(), matches[i].end());
 	}
+	
+	return true;
 }
 
-void REHex::Search::OnClose(wxCloseEvent &event)
+void REHex::Search::set_open_documents_provider(const std::function<std::vector<OpenDocument>()> &provider)
 {
-	Destroy();
+	open_documents_provider = provider;
+	
+	if(find_all_documents_btn != NULL)
+	{
+		find_all_documents_btn->Enable((bool)(open_documents_provider));
+	}
 }
 
-void REHex::Search::enable_controls()
+void REHex::Search::begin_incremental_search(bool extends_last, size_t window_size)
 {
-	range_begin_tc->Enable(range_cb->GetValue());
-	range_end_tc  ->Enable(range_cb->GetValue());
+	cancel_incremental_search();
+	assert(!running);
 	
-	align_tc->Enable(align_cb->GetValue());
+	off_t cursor = doc->get_cursor_position();
 	
-	ralign_cb->Enable(align_cb->GetValue());
-	ralign_tc->Enable(align_cb->GetValue() && ralign_cb->GetValue());
-}
-
-bool REHex::Search::read_base_window_controls()
-{
-	bool ok = true;
+	/* Keep searching from the same place while the cursor is where we left it. */
+	off_t from_offset = (cursor == incremental_cursor)
+		? incremental_from
+		: cursor;
 	
-	auto read_off_value = [this, &ok](off_t *dest, wxTextCtrl *tc, bool cannot_be_zero, const char *desc)
+	if(!extends_last || from_offset != incremental_from)
 	{
-		if(!ok)
-		{
-			/* Already raised an error, don't spam them. */
-			return;
-		}
-		
-		std::string tc_val = tc->GetValue().ToStdString();
+		incremental_done = false;
+	}
+	
+	incremental_from        = from_offset;
+	incremental_window_size = window_size;
+	
+	if(incremental_done && incremental_found < 0)
+	{
+		/* The last search found nothing, so neither will this one. */
 		
-		char *endptr;
-		long long ll_val = strtoll(tc_val.c_str(), &endptr, 0);
+		incremental_highlighted = -1;
 		
-		if(tc_val.empty() || *endptr != '\0' || ll_val < 0)
+		if(match_highlighter)
 		{
-			wxMessageBox((std::string("Invalid ") + desc), "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
-			
-			ok = false;
-			return;
+			match_highlighter(-1, test_max_window());
 		}
 		
-		if(cannot_be_zero && ll_val == 0)
-		{
-			wxMessageBox((std::string(desc) + " cannot be zero"), "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
-			
-			ok = false;
-			return;
-		}
+		incremental_cursor = doc->get_cursor_position();
 		
-		*dest = ll_val;
-	};
-	
-	if(range_cb->GetValue())
-	{
-		read_off_value(&range_begin, range_begin_tc, false, "start of range");
-		read_off_value(&range_begin, range_begin_tc, false, "end of range");
-	}
-	else{
-		range_begin = 0;
-		range_end   = -1;
+		return;
 	}
 	
-	if(align_cb->GetValue())
+	/* Any match of the pattern is also a match of the last one, so there are none before
+	 * the first match the last search found.
+	*/
+	
+	incremental = true;
+	
+	if(incremental_done && incremental_found < from_offset)
 	{
-		read_off_value(&align_to, align_tc, true, "alignment");
-		
-		if(ralign_cb->GetValue())
-		{
-			read_off_value(&align_from, ralign_tc, false, "alignment offset");
-		}
-		else{
-			align_from = 0;
-		}
+		incremental_wrapped = true;
+		begin_search(incremental_found, std::min((off_t)(from_offset + test_max_window() - 1), (range_end >= 0 ? range_end : doc->buffer_length())), window_size);
 	}
 	else{
-		align_to   = 1;
-		align_from = 0;
+		incremental_wrapped = false;
+		begin_search((incremental_done ? incremental_found : from_offset), range_end, window_size);
 	}
-	
-	return ok;
 }
 
-void REHex::Search::thread_main(size_t window_size, size_t compare_size)
+void REHex::Search::cancel_incremental_search()
 {
-	while(running && match_found_at < 0)
+	if(incremental)
 	{
-		off_t window_base = next_window_start.fetch_add(window_size);
-		off_t next_window = std::min((off_t)(window_base + window_size), (search_end + 1));
-		
-		if(window_base > search_end)
-		{
-			break;
-		}
-		
-		try {
-			std::vector<unsigned char> window = doc->read_data(window_base, window_size + compare_size);
-			
-			off_t search_base = window_base;
-			if(((search_base - align_from) % align_to) != 0)
-			{
-				search_base += (align_to - ((search_base - align_from) % align_to));
-			}
-			
-			for(off_t at = search_base; at < next_window; at += align_to)
-			{
-				off_t  window_off   = at - window_base;
-				size_t window_avail = std::min((size_t)(window.size() - window_off), (size_t)(search_end - at));
-				
-				if(test((window.data() + window_off), window_avail))
-				{
-					std::unique_lock<std::mutex> l(lock);
-					
-					if(match_found_at < 0 || match_found_at > at)
-					{
-						match_found_at = at;
-						return;
-					}
-				}
-			}
-		}
-		catch(const std::exception &e)
-		{
-			fprintf(stderr, "Exception in REHex::Search::thread_main: %s\n", e.what());
-		}
+		end_search();
+		incremental = false;
 	}
 }
 
-REHex::Search::Text::Text(wxWindow *parent, SharedDocumentPointer &doc, const std::string &search_for, bool case_sensitive):
-	Search(parent, doc, "Search for text"),
-	search_for(search_for),
-	case_sensitive(case_sensitive)
+bool REHex::Search::is_searching() const
 {
-	setup_window();
+	return running;
 }
 
-REHex::Search::Text::~Text()
+/* Called once the workers have finished a pass of an incremental search. Wraps around to search
+ * from the start of the range if nothing was found after incremental_from, otherwise passes the
+ * result on to the match highlighter.
+*/
+void REHex::Search::finish_incremental_pass()
 {
-	if(running)
+	end_search();
+	
+	if(match_found_at < 0 && !incremental_wrapped && incremental_from > range_begin)
 	{
-		end_search();
+		incremental_wrapped = true;
+		
+		/* Matches which begin before incremental_from may end after it. */
+		off_t search_end = std::min((off_t)(incremental_from + test_max_window() - 1), (range_end >= 0 ? range_end : doc->buffer_length()));
+		
+		begin_search(range_begin, search_end, incremental_window_size);
+		return;
+	}
+	
+	incremental       = false;
+	incremental_done  = true;
+	incremental_found = match_found_at;
+	
+	incremental_highlighted = match_found_at;
+	
+	if(match_highlighter)
+	{
+		match_highlighter(match_found_at, match_found_length);
 	}
+	
+	incremental_cursor = doc->get_cursor_position();
 }
 
-bool REHex::Search::Text::test(const void *data, size_t data_size)
+/* This method is only used by the unit tests. */
+off_t REHex::Search::wait_for_incremental_search()
 {
-	if(case_sensitive)
+	while(incremental)
 	{
-		return (data_size >= search_for.size()
-			&& strncmp((const char*)(data), search_for.c_str(), search_for.size()) == 0);
-	}
-	else{
-		return (data_size >= search_for.size()
-			&& strncasecmp((const char*)(data), search_for.c_str(), search_for.size()) == 0);
+		job->wait();
+		finish_incremental_pass();
 	}
+	
+	return incremental_highlighted;
 }
 
-size_t REHex::Search::Text::test_max_window()
+/* Begin searching for every match within the search range, to be replaced with the given data
+ * by finish_replace_all() once the search finishes.
+ *
+ * The search runs in the background like begin_find_all(), with the timer updating the progress
+ * dialog. The document may be modified while it runs, in which case the offsets found are stale
+ * and nothing is replaced.
+*/
+void REHex::Search::begin_replace_all(const std::vector<unsigned char> &replace_with, size_t window_size)
 {
-	return search_for.size();
+	start_find_all(window_size);
+	
+	replacing_all         = true;
+	replace_data_modified = false;
+	this->replace_with    = replace_with;
+	
+	progress = new wxProgressDialog("Replacing", "Search in progress...", 100, this, wxPD_CAN_ABORT | wxPD_REMAINING_TIME);
+	timer.Start(200, wxTIMER_CONTINUOUS);
 }
 
-void REHex::Search::Text::setup_window_controls(wxWindow *parent, wxSizer *sizer)
+/* Replace the matches found by a "Replace all" whose search has completed.
+ *
+ * All replacements are applied to the document in a single pass and form a single undo step.
+ * Each match is assumed to be test_max_window() bytes long. Nothing is replaced if the document
+ * was modified during the search.
+ *
+ * Returns the number of replacements made.
+*/
+size_t REHex::Search::finish_replace_all()
 {
-	{
-		wxBoxSizer *text_sizer = new wxBoxSizer(wxHORIZONTAL);
-		
-		text_sizer->Add(new wxStaticText(parent, wxID_ANY, "Text: "), 0, wxALIGN_CENTER_VERTICAL);
-		
-		search_for_tc = new wxTextCtrl(parent, wxID_ANY, "");
-		text_sizer->Add(search_for_tc, 1);
-		
-		sizer->Add(text_sizer, 0, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
-	}
+	std::vector<off_t> matches;
+	take_found(matches);
 	
+	if(replace_data_modified || matches.empty())
 	{
-		case_sensitive_cb = new wxCheckBox(parent, wxID_ANY, "Case sensitive");
-		sizer->Add(case_sensitive_cb, 0, wxTOP | wxLEFT | wxRIGHT, 10);
+		return 0;
 	}
+	
+	off_t match_length = test_max_window();
+	
+	/* Leave the cursor at the start of the last replacement. */
+	off_t new_cursor_pos = matches.back() + ((off_t)(matches.size() - 1) * ((off_t)(replace_with.size()) - match_length));
+	
+	doc->replace_data(matches, match_length, replace_with.data(), replace_with.size(), new_cursor_pos, Document::CSTATE_CURRENT, "replace all");
+	
+	return matches.size();
 }
 
-bool REHex::Search::Text::read_window_controls()
+/* This method is only used by the unit tests. */
+size_t REHex::Search::replace_all(const std::vector<unsigned char> &replace_with, size_t window_size)
 {
-	search_for     = search_for_tc->GetValue();
-	case_sensitive = case_sensitive_cb->GetValue();
+	begin_replace_all(replace_with, window_size);
+	return wait_for_replace_all();
+}
+
+/* This method is only used by the unit tests. */
+size_t REHex::Search::wait_for_replace_all()
+{
+	/* Wait for the workers to finish searching. */
+	job->wait();
 	
-	if(search_for.empty())
-	{
-		wxMessageBox("Please enter a string to search for", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
-		return false;
-	}
+	bool failed = find_all_failed;
 	
-	return true;
+	end_search();
+	
+	return failed ? 0 : finish_replace_all();
 }
 
-REHex::Search::ByteSequence::ByteSequence(wxWindow *parent, SharedDocumentPointer &doc, const std::vector<unsigned char> &search_for):
-	Search(parent, doc, "Search for byte sequence"),
-	search_for(search_for)
+bool REHex::Search::replace_supported()
 {
-	setup_window();
+	return false;
 }
 
-REHex::Search::ByteSequence::~ByteSequence()
+bool REHex::Search::read_replace_controls(std::vector<unsigned char> &replace_with)
 {
-	if(running)
-	{
-		end_search();
-	}
+	return false;
 }
 
-bool REHex::Search::ByteSequence::test(const void *data, size_t data_size)
+bool REHex::Search::fixed_patterns(std::vector< std::vector<unsigned char> > &patterns)
 {
-	return (data_size >= search_for.size()
-		&& memcmp(data, search_for.data(), search_for.size()) == 0);
+	return false;
 }
 
-size_t REHex::Search::ByteSequence::test_max_window()
+void REHex::Search::OnCheckBox(wxCommandEvent &event)
 {
-	return search_for.size();
+	enable_controls();
 }
 
-void REHex::Search::ByteSequence::setup_window_controls(wxWindow *parent, wxSizer *sizer)
+void REHex::Search::OnFindNext(wxCommandEvent &event)
 {
+	cancel_incremental_search();
+	
+	if(read_base_window_controls() && read_window_controls())
 	{
-		wxBoxSizer *text_sizer = new wxBoxSizer(wxHORIZONTAL);
-		
-		text_sizer->Add(new wxStaticText(parent, wxID_ANY, "Data: "), 0, wxALIGN_CENTER_VERTICAL);
-		
-		search_for_tc = new wxTextCtrl(parent, wxID_ANY, "");
-		text_sizer->Add(search_for_tc, 1);
-		
-		sizer->Add(text_sizer, 0, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
+		begin_search((doc->get_cursor_position() + 1), range_end);
 	}
 }
 
-bool REHex::Search::ByteSequence::read_window_controls()
+void REHex::Search::OnFindPrev(wxCommandEvent &event)
 {
-	std::string search_for_text = search_for_tc->GetValue().ToStdString();
+	cancel_incremental_search();
 	
-	if(search_for_text.empty())
+	if(read_base_window_controls() && read_window_controls())
 	{
-		wxMessageBox("Please enter a hex string to search for", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
-		return false;
-	}
-	
-	try {
-		search_for = REHex::parse_hex_string(search_for_text);
-	}
-	catch(const REHex::ParseError &e) {
-		wxMessageBox(e.what(), "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
-		return false;
+		begin_search_backwards(doc->get_cursor_position(), range_begin);
 	}
-	
-	return true;
-}
-
-REHex::Search::Value::Value(wxWindow *parent, SharedDocumentPointer &doc):
-	Search(parent, doc, "Search for value")
-{
-	setup_window();
 }
 
-REHex::Search::Value::~Value()
+void REHex::Search::OnFindAll(wxCommandEvent &event)
 {
-	if(running)
+	cancel_incremental_search();
+	
+	if(running || !results_panel_factory || !read_base_window_controls() || !read_window_controls())
 	{
-		end_search();
+		return;
 	}
+	
+	SearchResultsPanel *results = results_panel_factory();
+	begin_find_all(results);
 }
 
-void REHex::Search::Value::configure(const std::string &value, unsigned formats)
+/* Search every open document, listing the matches in a results panel in the tab of each one with
+ * any and summarising which documents they were found in.
+*/
+void REHex::Search::OnFindAllDocuments(wxCommandEvent &event)
 {
-	search_for_tc->SetValue(value);
+	cancel_incremental_search();
 	
-	if((formats & FMT_LE) && (formats & FMT_BE))
+	if(running || !open_documents_provider || !read_base_window_controls() || !read_window_controls())
 	{
-		e_either->SetValue(true);
+		return;
 	}
-	else if((formats & FMT_LE))
+	
+	if(range_begin > 0 || range_end >= 0 || align_to > 1)
 	{
-		e_little->SetValue(true);
+		/* find_all_documents() would search each document whole, don't let the range or
+		 * alignment be silently ignored.
+		*/
+		wxMessageBox("The search range and alignment only apply to this document, clear them to search all open documents",
+			"Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		
+		return;
 	}
-	else if((formats & FMT_BE))
+	
+	std::vector<OpenDocument> open_documents = open_documents_provider();
+	
+	std::vector<SharedDocumentPointer> documents;
+	for(auto od = open_documents.begin(); od != open_documents.end(); ++od)
 	{
-		e_big->SetValue(true);
+		documents.push_back(od->doc);
 	}
 	
-	i8_cb->SetValue(!!(formats & FMT_I8));
-	i16_cb->SetValue(!!(formats & FMT_I16));
-	i32_cb->SetValue(!!(formats & FMT_I32));
-	i64_cb->SetValue(!!(formats & FMT_I64));
+	std::vector< std::vector<SearchMatch> > matches;
 	
-	read_window_controls();
-}
-
-bool REHex::Search::Value::test(const void *data, size_t data_size)
-{
-	for(auto i = search_for.begin(); i != search_for.end(); ++i)
 	{
-		if(data_size >= i->size() && memcmp(data, i->data(), i->size()) == 0)
+		/* Modal, so no documents can be closed while they're being searched. */
+		wxProgressDialog progress("Searching", "Searching all documents...", 100, this, wxPD_CAN_ABORT | wxPD_REMAINING_TIME | wxPD_APP_MODAL);
+		
+		if(!find_all_documents(documents, matches, &progress))
 		{
-			return true;
+			return;
 		}
 	}
 	
-	return false;
+	size_t n_documents = 0;
+	std::string found_in;
+	
+	for(size_t i = 0; i < open_documents.size(); ++i)
+	{
+		if(matches[i].empty())
+		{
+			continue;
+		}
+		
+		++n_documents;
+		found_in += "\n" + open_documents[i].doc->get_title() + ": " + std::to_string(matches[i].size())
+			+ (matches[i].size() == 1 ? " match" : " matches");
+		
+		if(open_documents[i].results_panel_factory)
+		{
+			SearchResultsPanel *results = open_documents[i].results_panel_factory();
+			
+			results->add_matches(matches[i]);
+			results->finish(true);
+		}
+	}
+	
+	if(n_documents > 0)
+	{
+		std::string message = "Found in " + std::to_string(n_documents) + " of " + std::to_string(open_documents.size())
+			+ (open_documents.size() == 1 ? " document:" : " documents:") + found_in;
+		
+		wxMessageBox(message, wxMessageBoxCaptionStr, (wxOK | wxICON_INFORMATION | wxCENTRE), this);
+	}
+	else{
+		wxMessageBox("Not found in any open document", wxMessageBoxCaptionStr, (wxOK | wxICON_INFORMATION | wxCENTRE), this);
+	}
 }
 
-size_t REHex::Search::Value::test_max_window()
+void REHex::Search::OnReplaceAll(wxCommandEvent &event)
 {
-	size_t search_for_max = 0;
+	cancel_incremental_search();
 	
-	for(auto i = search_for.begin(); i != search_for.end(); ++i)
+	std::vector<unsigned char> replace_with;
+	
+	if(running || !read_base_window_controls() || !read_window_controls() || !read_replace_controls(replace_with))
 	{
-		search_for_max = std::max(search_for_max, i->size());
+		return;
 	}
 	
-	return search_for_max;
+	begin_replace_all(replace_with);
 }
 
-void REHex::Search::Value::setup_window_controls(wxWindow *parent, wxSizer *sizer)
+void REHex::Search::OnCancel(wxCommandEvent &event)
+{
+	Close();
+}
+
+void REHex::Search::OnTimer(wxTimerEvent &event)
 {
+	/* end_search() stops the workers part way through their windows, so wait for the job to
+	 * finish. Workers searching beyond a match which has been found stop by themselves, but
+	 * ones searching before it may still find a closer match.
+	*/
+	
+	if(incremental)
 	{
-		wxBoxSizer *text_sizer = new wxBoxSizer(wxHORIZONTAL);
-		
-		text_sizer->Add(new wxStaticText(parent, wxID_ANY, "Value: "), 0, wxALIGN_CENTER_VERTICAL);
-		
-		search_for_tc = new NumericTextCtrl(parent, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, 0);
-		text_sizer->Add(search_for_tc, 1);
+		if(job->finished())
+		{
+			finish_incremental_pass();
+		}
 		
-		search_for_tc->Bind(wxEVT_TEXT, &REHex::Search::Value::OnText, this);
+		return;
+	}
+	
+	if(progress->WasCancelled())
+	{
+		end_search();
+		return;
+	}
+	
+	if(replacing_all)
+	{
+		if(find_all_failed || job->finished())
+		{
+			bool failed = find_all_failed;
+			
+			end_search();
+			
+			size_t replaced = failed ? 0 : finish_replace_all();
+			
+			if(failed)
+			{
+				wxMessageBox("Error while searching, nothing was replaced", "Error", (wxOK | wxICON_ERROR | wxCENTRE), this);
+			}
+			else if(replace_data_modified)
+			{
+				wxMessageBox("The document was modified during the search, nothing was replaced", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+			}
+			else if(replaced > 0)
+			{
+				std::string message = "Replaced " + std::to_string(replaced) + (replaced == 1 ? " occurrence" : " occurrences");
+				wxMessageBox(message, wxMessageBoxCaptionStr, (wxOK | wxICON_INFORMATION | wxCENTRE), this);
+			}
+			else{
+				wxMessageBox("Not found", wxMessageBoxCaptionStr, (wxOK | wxICON_INFORMATION | wxCENTRE), this);
+			}
+		}
+		else{
+			progress->Update(((double)(100) / ((search_end - search_base) + 1)) * (std::min((off_t)(next_window_start), search_end) - search_base));
+		}
 		
-		sizer->Add(text_sizer, 0, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
+		return;
 	}
 	
+	if(finding_all)
 	{
-		wxStaticBoxSizer *sz = new wxStaticBoxSizer(wxVERTICAL, parent, "Value formats");
+		if(find_all_failed || job->finished())
+		{
+			end_search();
+		}
+		else{
+			flush_results();
+			
+			size_t n_found = (results && *results != NULL) ? (*results)->get_matches().size() : 0;
+			
+			progress->Update(((double)(100) / ((search_end - search_base) + 1)) * (next_window_start - search_base),
+				("Found " + std::to_string(n_found) + (n_found == 1 ? " match" : " matches") + " so far..."));
+		}
 		
-		wxBoxSizer *sz1 = new wxBoxSizer(wxHORIZONTAL);
-		sz->Add(sz1, 0, wxTOP | wxBOTTOM, 5);
+		return;
+	}
+	
+	if(backwards)
+	{
+		if(job->finished())
+		{
+			end_search();
+			
+			if(match_found_at >= 0)
+			{
+				doc->set_cursor_position(match_found_at);
+			}
+			else{
+				if(search_from < search_end)
+				{
+					/* Search was not from end of file/range, ask if we should go back to the end. */
+					
+					const char *message = range_end >= 0
+						? "Not found. Continue search from end of range?"
+						: "Not found. Continue search from end of file?";
+					
+					if(wxMessageBox(message, wxMessageBoxCaptionStr, (wxYES_NO | wxCENTRE), this) == wxYES)
+					{
+						begin_search_backwards(search_end, search_from);
+					}
+				}
+				else{
+					wxMessageBox("Not found", wxMessageBoxCaptionStr, (wxOK | wxICON_INFORMATION | wxCENTRE), this);
+				}
+			}
+		}
+		else{
+			progress->Update(((double)(100) / ((search_from - search_base) + 1)) * (search_from - next_window_start));
+		}
+		
+		return;
+	}
+	
+	if(job->finished())
+	{
+		end_search();
+		
+		if(match_found_at >= 0)
+		{
+			doc->set_cursor_position(match_found_at);
+		}
+		else{
+			if(search_base > range_begin)
+			{
+				/* Search was not from beginning of file/range, ask if we should go back to the start. */
+				
+				const char *message = range_begin > 0
+					? "Not found. Continue search from start of range?"
+					: "Not found. Continue search from start of file?";
+				
+				if(wxMessageBox(message, wxMessageBoxCaptionStr, (wxYES_NO | wxCENTRE), this) == wxYES)
+				{
+					begin_search(range_begin, search_base);
+				}
+			}
+			else{
+				wxMessageBox("Not found", wxMessageBoxCaptionStr, (wxOK | wxICON_INFORMATION | wxCENTRE), this);
+			}
+		}
+	}
+	else{
+		progress->Update(((double)(100) / ((search_end - search_base) + 1)) * (next_window_start - search_base));
+	}
+}
+
+void REHex::Search::OnDataModified(OffsetLengthEvent &event)
+{
+	/* The outcome of the last incremental search, and of any pass which has already read
+	 * some of the document, may no longer be true of the data.
+	*/
+	cancel_incremental_search();
+	incremental_done = false;
+	
+	/* The offsets found by a "Replace all" which is running no longer point at the matches. */
+	replace_data_modified = true;
+	
+	/* Continue propogation. */
+	event.Skip();
+}
+
+void REHex::Search::OnClose(wxCloseEvent &event)
+{
+	Destroy();
+}
+
+void REHex::Search::enable_controls()
+{
+	range_begin_tc->Enable(range_cb->GetValue());
+	range_end_tc  ->Enable(range_cb->GetValue());
+	
+	align_tc->Enable(align_cb->GetValue());
+	
+	ralign_cb->Enable(align_cb->GetValue());
+	ralign_tc->Enable(align_cb->GetValue() && ralign_cb->GetValue());
+}
+
+bool REHex::Search::read_base_window_controls()
+{
+	bool ok = true;
+	
+	/* The range or alignment may be about to change. */
+	incremental_done = false;
+	
+	auto read_off_value = [this, &ok](off_t *dest, wxTextCtrl *tc, bool cannot_be_zero, const char *desc)
+	{
+		if(!ok)
+		{
+			/* Already raised an error, don't spam them. */
+			return;
+		}
+		
+		std::string tc_val = tc->GetValue().ToStdString();
+		
+		char *endptr;
+		long long ll_val = strtoll(tc_val.c_str(), &endptr, 0);
+		
+		if(tc_val.empty() || *endptr != '\0' || ll_val < 0)
+		{
+			wxMessageBox((std::string("Invalid ") + desc), "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+			
+			ok = false;
+			return;
+		}
+		
+		if(cannot_be_zero && ll_val == 0)
+		{
+			wxMessageBox((std::string(desc) + " cannot be zero"), "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+			
+			ok = false;
+			return;
+		}
+		
+		*dest = ll_val;
+	};
+	
+	if(range_cb->GetValue())
+	{
+		read_off_value(&range_begin, range_begin_tc, false, "start of range");
+		read_off_value(&range_begin, range_begin_tc, false, "end of range");
+	}
+	else{
+		range_begin = 0;
+		range_end   = -1;
+	}
+	
+	if(align_cb->GetValue())
+	{
+		read_off_value(&align_to, align_tc, true, "alignment");
+		
+		if(ralign_cb->GetValue())
+		{
+			read_off_value(&align_from, ralign_tc, false, "alignment offset");
+		}
+		else{
+			align_from = 0;
+		}
+	}
+	else{
+		align_to   = 1;
+		align_from = 0;
+	}
+	
+	return ok;
+}
+
+const unsigned char *REHex::Search::scan(const unsigned char *begin, const unsigned char *end, size_t stride)
+{
+	for(size_t off = 0; off < (size_t)(end - begin); off += stride)
+	{
+		if(test((begin + off), ((end - begin) - off)))
+		{
+			return begin + off;
+		}
+	}
+	
+	return NULL;
+}
+
+const unsigned char *REHex::Search::rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride)
+{
+	for(size_t off = (limit - begin); off > 0;)
+	{
+		--off;
+		
+		if(test((begin + off), ((end - begin) - off)))
+		{
+			return begin + off;
+		}
+		
+		off -= std::min(off, (stride - 1));
+	}
+	
+	return NULL;
+}
+
+size_t REHex::Search::match_length(const unsigned char *at, const unsigned char *end)
+{
+	return test_max_window();
+}
+
+/* Round an offset up to the next one which satisfies the alignment requirements. */
+off_t REHex::Search::align_up(off_t offset) const
+{
+	off_t misalignment = (offset - align_from) % align_to;
+	if(misalignment < 0)
+	{
+		misalignment += align_to;
+	}
+	
+	if(misalignment != 0)
+	{
+		offset += (align_to - misalignment);
+	}
+	
+	return offset;
+}
+
+/* Round an offset down to the previous one which satisfies the alignment requirements. */
+off_t REHex::Search::align_down(off_t offset) const
+{
+	off_t misalignment = (offset - align_from) % align_to;
+	if(misalignment < 0)
+	{
+		misalignment += align_to;
+	}
+	
+	return offset - misalignment;
+}
+
+/* Pass any matches found by the worker threads since the last call on to the results panel. */
+void REHex::Search::flush_results()
+{
+	std::vector<SearchMatch> batch;
+	
+	{
+		std::unique_lock<std::mutex> l(lock);
+		batch.swap(found);
+	}
+	
+	if(results && *results != NULL)
+	{
+		(*results)->add_matches(batch);
+	}
+}
+
+/* Open the search index for the document if it can be used by a search which is beginning.
+ *
+ * The index can only be used while the document is the same as the file it was built from, and
+ * only searches for fixed patterns no shorter than the index's minimum can be looked up in it.
+ * Each window is narrowed down using the index, so windows are made as large as a segment of
+ * the index to avoid looking up the same posting lists over and over.
+ *
+ * Returns the window size to search with.
+*/
+size_t REHex::Search::prepare_index(size_t window_size)
+{
+	index = open_index(doc);
+	
+	return index ? std::max(window_size, (size_t)(NGramIndex::SEGMENT_SIZE)) : window_size;
+}
+
+/* Open the search index for a document, returns NULL if it can't be used by the search. Sets
+ * index_patterns to the patterns to look up in it.
+*/
+std::shared_ptr<NGramIndex> REHex::Search::open_index(Document *document)
+{
+	/* The patterns are set even if this document can't use an index, since the same ones are
+	 * used for every document searched by find_all_documents().
+	*/
+	index_patterns.clear();
+	if(!fixed_patterns(index_patterns))
+	{
+		return NULL;
+	}
+	
+	std::string filename = document->get_filename();
+	
+	if(filename.empty() || document->is_dirty())
+	{
+		return NULL;
+	}
+	
+	std::shared_ptr<NGramIndex> new_index = NGramIndex::open(filename);
+	if(new_index == NULL)
+	{
+		return NULL;
+	}
+	
+	for(auto p = index_patterns.begin(); p != index_patterns.end(); ++p)
+	{
+		if(p->size() < new_index->min_pattern_length())
+		{
+			return NULL;
+		}
+	}
+	
+	return new_index;
+}
+
+/* Narrow a window from begin up to (but not including) end down to the first and last offsets
+ * where the search index says a match may begin.
+ *
+ * Returns false if there are none.
+*/
+bool REHex::Search::narrow_window(NGramIndex *index, off_t *begin, off_t *end)
+{
+	std::vector<off_t> candidates;
+	
+	if(!index || !index->find(index_patterns, *begin, *end, candidates))
+	{
+		/* Search the whole window. */
+		return true;
+	}
+	
+	if(candidates.empty())
+	{
+		return false;
+	}
+	
+	*begin = candidates.front();
+	*end   = candidates.back() + 1;
+	
+	return true;
+}
+
+void REHex::Search::thread_main(size_t window_size, size_t compare_size)
+{
+	while(running && match_found_at < 0)
+	{
+		off_t window_base = next_window_start.fetch_add(window_size);
+		off_t next_window = std::min((off_t)(window_base + window_size), (search_end + 1));
+		
+		if(window_base > search_end)
+		{
+			break;
+		}
+		
+		try {
+			if(!narrow_window(index.get(), &window_base, &next_window))
+			{
+				continue;
+			}
+			
+			std::vector<unsigned char> window = doc->read_data(window_base, (next_window - window_base) + compare_size);
+			
+			/* Matches must end within the search range. */
+			const unsigned char *data     = window.data();
+			const unsigned char *data_end = data + std::min((off_t)(window.size()), (search_end - window_base));
+			
+			for(off_t at = align_up(window_base); at < next_window;)
+			{
+				/* Stop part way through the window if the search has been cancelled. */
+				if(!running)
+				{
+					return;
+				}
+				
+				/* Give up on this window once another worker has found an earlier match. */
+				off_t found_at = match_found_at;
+				if(found_at >= 0 && found_at < at)
+				{
+					return;
+				}
+				
+				/* Scan the next slice, plus enough to complete a match beginning in it. */
+				off_t slice_end = std::min((off_t)(at + SCAN_SLICE), next_window);
+				const unsigned char *scan_end = std::min((data + (slice_end - window_base) + compare_size), data_end);
+				
+				const unsigned char *match = scan(std::min((data + (at - window_base)), data_end), scan_end, align_to);
+				if(match == NULL)
+				{
+					at = align_up(slice_end);
+					continue;
+				}
+				
+				off_t match_at = window_base + (match - data);
+				if(match_at >= next_window)
+				{
+					break;
+				}
+				
+				if(align_up(match_at) == match_at)
+				{
+					off_t length = match_length(match, data_end);
+					
+					std::unique_lock<std::mutex> l(lock);
+					
+					if(match_found_at < 0 || match_found_at > match_at)
+					{
+						match_found_at     = match_at;
+						match_found_length = length;
+						return;
+					}
+				}
+				
+				at = align_up(match_at + 1);
+			}
+		}
+		catch(const std::exception &e)
+		{
+			fprintf(stderr, "Exception in REHex::Search::thread_main: %s\n", e.what());
+		}
+	}
+}
+
+void REHex::Search::thread_main_backwards(size_t window_size, size_t compare_size)
+{
+	while(running && match_found_at < 0)
+	{
+		off_t window_end  = next_window_start.fetch_sub(window_size);
+		off_t window_base = std::max((off_t)(window_end - window_size), search_base);
+		
+		if(window_end <= search_base)
+		{
+			break;
+		}
+		
+		try {
+			if(!narrow_window(index.get(), &window_base, &window_end))
+			{
+				continue;
+			}
+			
+			std::vector<unsigned char> window = doc->read_data(window_base, (window_end - window_base) + compare_size);
+			
+			/* Matches must end within the search range. */
+			const unsigned char *data     = window.data();
+			const unsigned char *data_end = data + std::min((off_t)(window.size()), (search_end - window_base));
+			
+			for(off_t top = std::min(window_end, (off_t)(window_base + (data_end - data))); top > window_base;)
+			{
+				/* Stop part way through the window if the search has been cancelled. */
+				if(!running)
+				{
+					return;
+				}
+				
+				/* Give up on this window once another worker has found a later match. */
+				if(match_found_at >= top)
+				{
+					return;
+				}
+				
+				/* Highest aligned offset a match may begin at. */
+				off_t last = align_down(top - 1);
+				if(last < window_base)
+				{
+					break;
+				}
+				
+				/* Scan the slice below top. */
+				off_t slice_base = std::max((off_t)(top - SCAN_SLICE), window_base);
+				
+				const unsigned char *match = rscan((data + (slice_base - window_base)), data_end, (data + (last - window_base) + 1), align_to);
+				if(match == NULL)
+				{
+					top = slice_base;
+					continue;
+				}
+				
+				off_t match_at = window_base + (match - data);
+				
+				if(align_up(match_at) == match_at)
+				{
+					off_t length = match_length(match, data_end);
+					
+					std::unique_lock<std::mutex> l(lock);
+					
+					if(match_found_at < match_at)
+					{
+						match_found_at     = match_at;
+						match_found_length = length;
+					}
+					
+					return;
+				}
+				
+				top = match_at;
+			}
+		}
+		catch(const std::exception &e)
+		{
+			fprintf(stderr, "Exception in REHex::Search::thread_main_backwards: %s\n", e.what());
+		}
+	}
+}
+
+/* Find every aligned match beginning from window_base up to (but not including) next_window
+ * and ending by search_end in a document, appending them to matches.
+ *
+ * The window is scanned in slices, returning early with only some of the matches if the search
+ * is cancelled.
+*/
+void REHex::Search::find_in_window(Document *document, off_t window_base, off_t next_window, off_t search_end, size_t compare_size, std::vector<SearchMatch> &matches)
+{
+	std::vector<unsigned char> window = document->read_data(window_base, (next_window - window_base) + compare_size);
+	
+	/* Matches must end within the search range. */
+	const unsigned char *data     = window.data();
+	const unsigned char *data_end = data + std::min((off_t)(window.size()), (search_end - window_base));
+	
+	for(off_t at = align_up(window_base); at < next_window && running;)
+	{
+		/* Scan the next slice, plus enough to complete a match beginning in it. */
+		off_t slice_end = std::min((off_t)(at + SCAN_SLICE), next_window);
+		const unsigned char *scan_end = std::min((data + (slice_end - window_base) + compare_size), data_end);
+		
+		const unsigned char *match = scan(std::min((data + (at - window_base)), data_end), scan_end, align_to);
+		if(match == NULL)
+		{
+			at = align_up(slice_end);
+			continue;
+		}
+		
+		off_t match_at = window_base + (match - data);
+		if(match_at >= next_window)
+		{
+			break;
+		}
+		
+		if(align_up(match_at) == match_at)
+		{
+			matches.push_back(SearchMatch(match_at, match_length(match, data_end)));
+		}
+		
+		at = align_up(match_at + 1);
+	}
+}
+
+void REHex::Search::thread_find_all(size_t window_size, size_t compare_size, std::vector<SearchMatch> *matches, std::atomic<bool> *failed)
+{
+	while(running)
+	{
+		off_t window_base = next_window_start.fetch_add(window_size);
+		off_t next_window = std::min((off_t)(window_base + window_size), (search_end + 1));
+		
+		if(window_base > search_end)
+		{
+			break;
+		}
+		
+		try {
+			if(!narrow_window(index.get(), &window_base, &next_window))
+			{
+				continue;
+			}
+			
+			std::vector<SearchMatch> window_matches;
+			find_in_window(doc, window_base, next_window, search_end, compare_size, window_matches);
+			
+			if(!window_matches.empty())
+			{
+				std::unique_lock<std::mutex> l(lock);
+				matches->insert(matches->end(), window_matches.begin(), window_matches.end());
+			}
+		}
+		catch(const std::exception &e)
+		{
+			fprintf(stderr, "Exception in REHex::Search::thread_find_all: %s\n", e.what());
+			
+			*failed = true;
+			return;
+		}
+	}
+}
+
+void REHex::Search::thread_find_all_documents(std::vector< std::unique_ptr<DocumentSearch> > *documents, size_t compare_size, std::atomic<bool> *failed)
+{
+	for(auto d = documents->begin(); d != documents->end(); ++d)
+	{
+		DocumentSearch &ds = **d;
+		
+		while(running)
+		{
+			off_t window_base = ds.next_window_start.fetch_add(ds.window_size);
+			off_t next_window = std::min((off_t)(window_base + ds.window_size), (ds.search_end + 1));
+			
+			if(window_base > ds.search_end)
+			{
+				break;
+			}
+			
+			try {
+				if(!narrow_window(ds.index.get(), &window_base, &next_window))
+				{
+					continue;
+				}
+				
+				std::vector<SearchMatch> window_matches;
+				find_in_window(ds.doc, window_base, next_window, ds.search_end, compare_size, window_matches);
+				
+				if(!window_matches.empty())
+				{
+					std::unique_lock<std::mutex> l(lock);
+					ds.matches.insert(ds.matches.end(), window_matches.begin(), window_matches.end());
+				}
+			}
+			catch(const std::exception &e)
+			{
+				fprintf(stderr, "Exception in REHex::Search::thread_find_all_documents: %s\n", e.what());
+				
+				*failed = true;
+				return;
+			}
+		}
+	}
+}
+
+REHex::Search::Text::Text(wxWindow *parent, SharedDocumentPointer &doc, const std::string &search_for, bool case_sensitive, unsigned encodings):
+	Search(parent, doc, "Search for text"),
+	search_for(search_for),
+	case_sensitive(case_sensitive),
+	encodings(encodings),
+	verify(false),
+	incremental_case_sensitive(false),
+	incremental_encodings(0)
+{
+	if(!search_for.empty())
+	{
+		compile();
+	}
+	
+	setup_window();
+}
+
+REHex::Search::Text::~Text()
+{
+	if(running)
+	{
+		end_search();
+	}
+}
+
+/* Encode the text in each of the selected encodings and build a kernel which searches for all
+ * of them at once. Throws ParseError if the text can't be represented in any of them.
+*/
+void REHex::Search::Text::compile()
+{
+	static const struct { unsigned flag; TextEncoding encoding; } ENCODINGS[] = {
+		{ ENC_UTF8,    ENCODING_UTF8    },
+		{ ENC_UTF16LE, ENCODING_UTF16LE },
+		{ ENC_UTF16BE, ENCODING_UTF16BE },
+		{ ENC_LATIN1,  ENCODING_LATIN1  },
+	};
+	
+	std::vector<TextEncoding> new_encoded_as;
+	std::vector<MaskedSearchKernel> new_encoded;
+	std::vector< std::vector<unsigned char> > patterns;
+	bool new_verify = false;
+	
+	std::string error;
+	
+	for(size_t i = 0; i < (sizeof(ENCODINGS) / sizeof(*ENCODINGS)); ++i)
+	{
+		if(!(encodings & ENCODINGS[i].flag))
+		{
+			continue;
+		}
+		
+		std::vector<unsigned char> pattern;
+		
+		try {
+			pattern = encode_text(search_for, ENCODINGS[i].encoding);
+		}
+		catch(const REHex::ParseError &e) {
+			/* Skip any encoding which can't represent the text (i.e. Latin-1) as long as
+			 * there is another one to search for.
+			*/
+			error = e.what();
+			continue;
+		}
+		
+		/* ASCII text is the same in UTF-8 and Latin-1. */
+		if(std::find(patterns.begin(), patterns.end(), pattern) != patterns.end())
+		{
+			continue;
+		}
+		
+		/* Only the case bit (0x20) of ASCII letters may differ. In UTF-16, a byte is only an
+		 * ASCII letter if the other byte of its code unit is zero.
+		*/
+		
+		std::vector<unsigned char> mask(pattern.size(), 0xFF);
+		
+		if(!case_sensitive)
+		{
+			size_t unit = (ENCODINGS[i].encoding == ENCODING_UTF16LE || ENCODINGS[i].encoding == ENCODING_UTF16BE) ? 2 : 1;
+			size_t low  = (ENCODINGS[i].encoding == ENCODING_UTF16BE) ? 1 : 0;
+			
+			for(size_t j = 0; j < pattern.size(); j += unit)
+			{
+				bool ascii = (unit == 1 || pattern[j + (1 - low)] == 0x00);
+				
+				for(size_t k = j; k < (j + unit); ++k)
+				{
+					if((pattern[k] >= 'A' && pattern[k] <= 'Z') || (pattern[k] >= 'a' && pattern[k] <= 'z'))
+					{
+						if(ascii && k == (j + low))
+						{
+							mask[k] = 0xDF;
+						}
+						else{
+							/* The kernel will match this byte case-insensitively
+							 * anyway, so check the matches it finds.
+							*/
+							new_verify = true;
+						}
+					}
+				}
+			}
+		}
+		
+		new_encoded_as.push_back(ENCODINGS[i].encoding);
+		new_encoded.emplace_back(pattern.data(), mask.data(), pattern.size());
+		patterns.push_back(pattern);
+	}
+	
+	if(patterns.empty())
+	{
+		throw ParseError(error.empty() ? "No encodings selected" : error.c_str());
+	}
+	
+	encoded_as       = new_encoded_as;
+	encoded          = new_encoded;
+	encoded_patterns = patterns;
+	verify           = new_verify;
+	kernel           = MultiSearchKernel(patterns, !case_sensitive);
+}
+
+bool REHex::Search::Text::test(const void *data, size_t data_size)
+{
+	for(auto e = encoded.begin(); e != encoded.end(); ++e)
+	{
+		if(data_size >= e->length() && e->match_at((const unsigned char*)(data)))
+		{
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+size_t REHex::Search::Text::test_max_window()
+{
+	return kernel.max_length();
+}
+
+/* The text may be a different length in each encoding, the longest one which matches wins. */
+size_t REHex::Search::Text::match_length(const unsigned char *at, const unsigned char *end)
+{
+	size_t length = 0;
+	
+	for(auto e = encoded.begin(); e != encoded.end(); ++e)
+	{
+		if((size_t)(end - at) >= e->length() && e->length() > length && e->match_at(at))
+		{
+			length = e->length();
+		}
+	}
+	
+	return length;
+}
+
+const unsigned char *REHex::Search::Text::scan(const unsigned char *begin, const unsigned char *end, size_t stride)
+{
+	for(const unsigned char *p = begin; (p = kernel.find(p, end)) != NULL; ++p)
+	{
+		if(!verify || test(p, (end - p)))
+		{
+			return p;
+		}
+	}
+	
+	return NULL;
+}
+
+const unsigned char *REHex::Search::Text::rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride)
+{
+	/* Only search as far as the end of a match beginning just before limit. */
+	if((size_t)(end - limit) >= kernel.max_length())
+	{
+		end = limit + kernel.max_length() - 1;
+	}
+	
+	for(const unsigned char *p; (p = kernel.rfind(begin, end, limit)) != NULL; limit = p)
+	{
+		if(!verify || test(p, (end - p)))
+		{
+			return p;
+		}
+	}
+	
+	return NULL;
+}
+
+void REHex::Search::Text::setup_window_controls(wxWindow *parent, wxSizer *sizer)
+{
+	{
+		wxBoxSizer *text_sizer = new wxBoxSizer(wxHORIZONTAL);
+		
+		text_sizer->Add(new wxStaticText(parent, wxID_ANY, "Text: "), 0, wxALIGN_CENTER_VERTICAL);
+		
+		search_for_tc = new wxTextCtrl(parent, wxID_ANY, "");
+		text_sizer->Add(search_for_tc, 1);
+		
+		search_for_tc->Bind(wxEVT_TEXT, &REHex::Search::Text::OnText, this);
+		
+		sizer->Add(text_sizer, 0, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
+	}
+	
+	{
+		wxBoxSizer *text_sizer = new wxBoxSizer(wxHORIZONTAL);
+		
+		text_sizer->Add(new wxStaticText(parent, wxID_ANY, "Replace with: "), 0, wxALIGN_CENTER_VERTICAL);
+		
+		replace_with_tc = new wxTextCtrl(parent, wxID_ANY, "");
+		text_sizer->Add(replace_with_tc, 1);
+		
+		sizer->Add(text_sizer, 0, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
+	}
+	
+	{
+		case_sensitive_cb = new wxCheckBox(parent, wxID_ANY, "Case sensitive");
+		sizer->Add(case_sensitive_cb, 0, wxTOP | wxLEFT | wxRIGHT, 10);
+	}
+	
+	{
+		incremental_cb = new wxCheckBox(parent, wxID_ANY, "Search as you type");
+		incremental_cb->SetValue(true);
+		sizer->Add(incremental_cb, 0, wxTOP | wxLEFT | wxRIGHT, 10);
+	}
+	
+	{
+		wxStaticBoxSizer *sz = new wxStaticBoxSizer(wxHORIZONTAL, parent, "Encodings");
+		
+		utf8_cb = new wxCheckBox(sz->GetStaticBox(), wxID_ANY, "UTF-8");
+		utf8_cb->SetValue(!!(encodings & ENC_UTF8));
+		sz->Add(utf8_cb, 0, wxTOP | wxBOTTOM | wxLEFT, 5);
+		
+		utf16le_cb = new wxCheckBox(sz->GetStaticBox(), wxID_ANY, "UTF-16LE");
+		utf16le_cb->SetValue(!!(encodings & ENC_UTF16LE));
+		sz->Add(utf16le_cb, 0, wxTOP | wxBOTTOM | wxLEFT, 5);
+		
+		utf16be_cb = new wxCheckBox(sz->GetStaticBox(), wxID_ANY, "UTF-16BE");
+		utf16be_cb->SetValue(!!(encodings & ENC_UTF16BE));
+		sz->Add(utf16be_cb, 0, wxTOP | wxBOTTOM | wxLEFT, 5);
+		
+		latin1_cb = new wxCheckBox(sz->GetStaticBox(), wxID_ANY, "Latin-1");
+		latin1_cb->SetValue(!!(encodings & ENC_LATIN1));
+		sz->Add(latin1_cb, 0, wxTOP | wxBOTTOM | wxLEFT | wxRIGHT, 5);
+		
+		sizer->Add(sz, 0, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
+	}
+}
+
+bool REHex::Search::Text::read_window_controls()
+{
+	search_for     = search_for_tc->GetValue().utf8_str();
+	case_sensitive = case_sensitive_cb->GetValue();
+	
+	encodings = (utf8_cb->GetValue()    ? ENC_UTF8    : 0)
+		| (utf16le_cb->GetValue() ? ENC_UTF16LE : 0)
+		| (utf16be_cb->GetValue() ? ENC_UTF16BE : 0)
+		| (latin1_cb->GetValue()  ? ENC_LATIN1  : 0);
+	
+	if(search_for.empty())
+	{
+		wxMessageBox("Please enter a string to search for", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
+	
+	if(encodings == 0)
+	{
+		wxMessageBox("Please select at least one encoding", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
+	
+	try {
+		compile();
+	}
+	catch(const REHex::ParseError &e) {
+		wxMessageBox(e.what(), "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
+	
+	return true;
+}
+
+void REHex::Search::Text::search_as_you_type(const std::string &text, bool case_sensitive, unsigned encodings)
+{
+	cancel_incremental_search();
+	
+	if(is_searching())
+	{
+		/* Leave a search started from the buttons alone. */
+		return;
+	}
+	
+	/* Any match of text which begins with what the last search was for is also a match of
+	 * that, so the new search can carry on from where the last one got to.
+	*/
+	bool extends_last = !incremental_text.empty()
+		&& text.compare(0, incremental_text.length(), incremental_text) == 0
+		&& case_sensitive == incremental_case_sensitive
+		&& encodings == incremental_encodings;
+	
+	incremental_text.clear();
+	
+	this->search_for     = text;
+	this->case_sensitive = case_sensitive;
+	this->encodings      = encodings;
+	
+	if(text.empty() || encodings == 0)
+	{
+		return;
+	}
+	
+	try {
+		compile();
+	}
+	catch(const REHex::ParseError &e) {
+		return;
+	}
+	
+	incremental_text           = text;
+	incremental_case_sensitive = case_sensitive;
+	incremental_encodings      = encodings;
+	
+	begin_incremental_search(extends_last);
+}
+
+bool REHex::Search::Text::replace_supported()
+{
+	return true;
+}
+
+bool REHex::Search::Text::read_replace_controls(std::vector<unsigned char> &replace_with)
+{
+	/* Matches are replaced with the same data, so the replacement can only be encoded to
+	 * match them when searching for one encoding.
+	*/
+	if(encoded_as.size() != 1)
+	{
+		wxMessageBox("Replacing text is only supported when searching in a single encoding", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
+	
+	try {
+		replace_with = encode_text(std::string(replace_with_tc->GetValue().utf8_str()), encoded_as.front());
+	}
+	catch(const REHex::ParseError &e) {
+		wxMessageBox(e.what(), "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
+	
+	return true;
+}
+
+bool REHex::Search::Text::fixed_patterns(std::vector< std::vector<unsigned char> > &patterns)
+{
+	/* Case-insensitive matches can't be looked up by their bytes. */
+	if(!case_sensitive)
+	{
+		return false;
+	}
+	
+	patterns = encoded_patterns;
+	return !patterns.empty();
+}
+
+void REHex::Search::Text::OnText(wxCommandEvent &event)
+{
+	if(incremental_cb->GetValue())
+	{
+		unsigned encodings = (utf8_cb->GetValue()    ? ENC_UTF8    : 0)
+			| (utf16le_cb->GetValue() ? ENC_UTF16LE : 0)
+			| (utf16be_cb->GetValue() ? ENC_UTF16BE : 0)
+			| (latin1_cb->GetValue()  ? ENC_LATIN1  : 0);
+		
+		search_as_you_type(std::string(search_for_tc->GetValue().utf8_str()), case_sensitive_cb->GetValue(), encodings);
+	}
+}
+
+REHex::Search::ByteSequence::ByteSequence(wxWindow *parent, SharedDocumentPointer &doc, const std::vector<unsigned char> &search_for):
+	Search(parent, doc, "Search for byte sequence"),
+	search_for(search_for),
+	kernel(search_for.data(), search_for.size())
+{
+	setup_window();
+}
+
+REHex::Search::ByteSequence::~ByteSequence()
+{
+	if(running)
+	{
+		end_search();
+	}
+}
+
+bool REHex::Search::ByteSequence::test(const void *data, size_t data_size)
+{
+	return (data_size >= search_for.size()
+		&& memcmp(data, search_for.data(), search_for.size()) == 0);
+}
+
+size_t REHex::Search::ByteSequence::test_max_window()
+{
+	return search_for.size();
+}
+
+const unsigned char *REHex::Search::ByteSequence::scan(const unsigned char *begin, const unsigned char *end, size_t stride)
+{
+	return kernel.find(begin, end);
+}
+
+const unsigned char *REHex::Search::ByteSequence::rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride)
+{
+	/* Only search as far as the end of a match beginning just before limit. */
+	if((size_t)(end - limit) >= search_for.size())
+	{
+		end = limit + search_for.size() - 1;
+	}
+	
+	return kernel.rfind(begin, end);
+}
+
+void REHex::Search::ByteSequence::setup_window_controls(wxWindow *parent, wxSizer *sizer)
+{
+	{
+		wxBoxSizer *text_sizer = new wxBoxSizer(wxHORIZONTAL);
+		
+		text_sizer->Add(new wxStaticText(parent, wxID_ANY, "Data: "), 0, wxALIGN_CENTER_VERTICAL);
+		
+		search_for_tc = new wxTextCtrl(parent, wxID_ANY, "");
+		text_sizer->Add(search_for_tc, 1);
+		
+		sizer->Add(text_sizer, 0, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
+	}
+	
+	{
+		wxBoxSizer *text_sizer = new wxBoxSizer(wxHORIZONTAL);
+		
+		text_sizer->Add(new wxStaticText(parent, wxID_ANY, "Replace with: "), 0, wxALIGN_CENTER_VERTICAL);
+		
+		replace_with_tc = new wxTextCtrl(parent, wxID_ANY, "");
+		text_sizer->Add(replace_with_tc, 1);
+		
+		sizer->Add(text_sizer, 0, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
+	}
+}
+
+bool REHex::Search::ByteSequence::read_window_controls()
+{
+	std::string search_for_text = search_for_tc->GetValue().ToStdString();
+	
+	if(search_for_text.empty())
+	{
+		wxMessageBox("Please enter a hex string to search for", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
+	
+	try {
+		search_for = REHex::parse_hex_string(search_for_text);
+	}
+	catch(const REHex::ParseError &e) {
+		wxMessageBox(e.what(), "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
+	
+	kernel = SearchKernel(search_for.data(), search_for.size());
+	
+	return true;
+}
+
+bool REHex::Search::ByteSequence::replace_supported()
+{
+	return true;
+}
+
+bool REHex::Search::ByteSequence::read_replace_controls(std::vector<unsigned char> &replace_with)
+{
+	/* An empty string is valid here - it means delete every match. */
+	
+	try {
+		replace_with = REHex::parse_hex_string(replace_with_tc->GetValue().ToStdString());
+	}
+	catch(const REHex::ParseError &e) {
+		wxMessageBox(e.what(), "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
+	
+	return true;
+}
+
+bool REHex::Search::ByteSequence::fixed_patterns(std::vector< std::vector<unsigned char> > &patterns)
+{
+	patterns.assign(1, search_for);
+	return !search_for.empty();
+}
+
+REHex::Search::Masked::Masked(wxWindow *parent, SharedDocumentPointer &doc, const std::vector<unsigned char> &search_for, const std::vector<unsigned char> &mask):
+	Search(parent, doc, "Search for masked byte sequence"),
+	search_for(search_for),
+	mask(mask),
+	kernel(search_for.data(), mask.data(), std::min(search_for.size(), mask.size()))
+{
+	setup_window();
+}
+
+REHex::Search::Masked::~Masked()
+{
+	if(running)
+	{
+		end_search();
+	}
+}
+
+bool REHex::Search::Masked::test(const void *data, size_t data_size)
+{
+	return data_size >= kernel.length() && kernel.match_at((const unsigned char*)(data));
+}
+
+size_t REHex::Search::Masked::test_max_window()
+{
+	return kernel.length();
+}
+
+const unsigned char *REHex::Search::Masked::scan(const unsigned char *begin, const unsigned char *end, size_t stride)
+{
+	return kernel.find(begin, end);
+}
+
+const unsigned char *REHex::Search::Masked::rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride)
+{
+	/* Only search as far as the end of a match beginning just before limit. */
+	if((size_t)(end - limit) >= kernel.length())
+	{
+		end = limit + kernel.length() - 1;
+	}
+	
+	return kernel.rfind(begin, end);
+}
+
+void REHex::Search::Masked::setup_window_controls(wxWindow *parent, wxSizer *sizer)
+{
+	wxBoxSizer *text_sizer = new wxBoxSizer(wxHORIZONTAL);
+	
+	text_sizer->Add(new wxStaticText(parent, wxID_ANY, "Data: "), 0, wxALIGN_CENTER_VERTICAL);
+	
+	search_for_tc = new wxTextCtrl(parent, wxID_ANY, "");
+	search_for_tc->SetHint("e.g. 4D 5A ?? ?? 50 45");
+	text_sizer->Add(search_for_tc, 1);
+	
+	sizer->Add(text_sizer, 0, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
+	
+	sizer->Add(new wxStaticText(parent, wxID_ANY, "Use ? in place of any hex digit to match any value."), 0, wxTOP | wxLEFT | wxRIGHT, 10);
+}
+
+bool REHex::Search::Masked::read_window_controls()
+{
+	std::string search_for_text = search_for_tc->GetValue().ToStdString();
+	
+	if(search_for_text.empty())
+	{
+		wxMessageBox("Please enter a hex string to search for", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
+	
+	try {
+		search_for = REHex::parse_masked_hex_string(search_for_text, &mask);
+	}
+	catch(const REHex::ParseError &e) {
+		wxMessageBox(e.what(), "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
+	
+	kernel = MaskedSearchKernel(search_for.data(), mask.data(), search_for.size());
+	
+	return true;
+}
+
+REHex::Search::Regex::Regex(wxWindow *parent, SharedDocumentPointer &doc, const std::string &search_for, unsigned flags):
+	Search(parent, doc, "Search for regular expression"),
+	search_for(search_for),
+	flags(flags)
+{
+	if(!search_for.empty())
+	{
+		kernel = RegexSearchKernel(search_for, flags);
+	}
+	
+	setup_window();
+}
+
+REHex::Search::Regex::~Regex()
+{
+	if(running)
+	{
+		end_search();
+	}
+}
+
+bool REHex::Search::Regex::test(const void *data, size_t data_size)
+{
+	return kernel.match_at((const unsigned char*)(data), (const unsigned char*)(data) + data_size);
+}
+
+size_t REHex::Search::Regex::test_max_window()
+{
+	return kernel.max_length();
+}
+
+size_t REHex::Search::Regex::match_length(const unsigned char *at, const unsigned char *end)
+{
+	return kernel.match_length(at, end);
+}
+
+const unsigned char *REHex::Search::Regex::scan(const unsigned char *begin, const unsigned char *end, size_t stride)
+{
+	return kernel.find(begin, end);
+}
+
+const unsigned char *REHex::Search::Regex::rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride)
+{
+	/* Only search as far as the end of the longest match beginning just before limit. */
+	if((size_t)(end - limit) >= kernel.max_length())
+	{
+		end = limit + kernel.max_length() - 1;
+	}
+	
+	return kernel.rfind(begin, end, limit);
+}
+
+void REHex::Search::Regex::setup_window_controls(wxWindow *parent, wxSizer *sizer)
+{
+	wxBoxSizer *text_sizer = new wxBoxSizer(wxHORIZONTAL);
+	
+	text_sizer->Add(new wxStaticText(parent, wxID_ANY, "Expression: "), 0, wxALIGN_CENTER_VERTICAL);
+	
+	search_for_tc = new wxTextCtrl(parent, wxID_ANY, search_for);
+	search_for_tc->SetHint("e.g. PK\\x03\\x04|MZ");
+	text_sizer->Add(search_for_tc, 1);
+	
+	sizer->Add(text_sizer, 0, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
+	
+	case_insensitive_cb = new wxCheckBox(parent, wxID_ANY, "Case insensitive");
+	case_insensitive_cb->SetValue(!!(flags & RegexSearchKernel::IGNORE_CASE));
+	sizer->Add(case_insensitive_cb, 0, wxTOP | wxLEFT | wxRIGHT, 10);
+	
+	text_cb = new wxCheckBox(parent, wxID_ANY, "Don't match newlines with '.'");
+	text_cb->SetValue(!!(flags & RegexSearchKernel::TEXT));
+	sizer->Add(text_cb, 0, wxTOP | wxLEFT | wxRIGHT, 10);
+}
+
+bool REHex::Search::Regex::read_window_controls()
+{
+	std::string search_for_text = search_for_tc->GetValue().ToStdString();
+	
+	if(search_for_text.empty())
+	{
+		wxMessageBox("Please enter an expression to search for", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
+	
+	unsigned new_flags = 0;
+	
+	if(case_insensitive_cb->GetValue())
+	{
+		new_flags |= RegexSearchKernel::IGNORE_CASE;
+	}
+	
+	if(text_cb->GetValue())
+	{
+		new_flags |= RegexSearchKernel::TEXT;
+	}
+	
+	RegexSearchKernel new_kernel;
+	
+	try {
+		new_kernel = RegexSearchKernel(search_for_text, new_flags);
+	}
+	catch(const RegexSearchKernel::ParseError &e) {
+		wxMessageBox(e.what(), "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
+	
+	if(new_kernel.matches_empty())
+	{
+		wxMessageBox("The expression matches an empty string", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
+	
+	search_for = search_for_text;
+	flags = new_flags;
+	kernel = new_kernel;
+	
+	return true;
+}
+
+REHex::Search::Value::Value(wxWindow *parent, SharedDocumentPointer &doc):
+	Search(parent, doc, "Search for value")
+{
+	setup_window();
+}
+
+REHex::Search::Value::~Value()
+{
+	if(running)
+	{
+		end_search();
+	}
+}
+
+void REHex::Search::Value::configure(const std::string &value, unsigned formats)
+{
+	search_for_tc->SetValue(value);
+	
+	if((formats & FMT_LE) && (formats & FMT_BE))
+	{
+		e_either->SetValue(true);
+	}
+	else if((formats & FMT_LE))
+	{
+		e_little->SetValue(true);
+	}
+	else if((formats & FMT_BE))
+	{
+		e_big->SetValue(true);
+	}
+	
+	i8_cb->SetValue(!!(formats & FMT_I8));
+	i16_cb->SetValue(!!(formats & FMT_I16));
+	i32_cb->SetValue(!!(formats & FMT_I32));
+	i64_cb->SetValue(!!(formats & FMT_I64));
+	
+	read_window_controls();
+}
+
+bool REHex::Search::Value::test(const void *data, size_t data_size)
+{
+	for(auto i = search_for.begin(); i != search_for.end(); ++i)
+	{
+		if(data_size >= i->size() && memcmp(data, i->data(), i->size()) == 0)
+		{
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+size_t REHex::Search::Value::test_max_window()
+{
+	size_t search_for_max = 0;
+	
+	for(auto i = search_for.begin(); i != search_for.end(); ++i)
+	{
+		search_for_max = std::max(search_for_max, i->size());
+	}
+	
+	return search_for_max;
+}
+
+/* Each size being searched for is a different length, the longest one which matches wins. */
+size_t REHex::Search::Value::match_length(const unsigned char *at, const unsigned char *end)
+{
+	size_t length = 0;
+	
+	for(auto i = search_for.begin(); i != search_for.end(); ++i)
+	{
+		if((size_t)(end - at) >= i->size() && i->size() > length && memcmp(at, i->data(), i->size()) == 0)
+		{
+			length = i->size();
+		}
+	}
+	
+	return length;
+}
+
+const unsigned char *REHex::Search::Value::scan(const unsigned char *begin, const unsigned char *end, size_t stride)
+{
+	return kernel.find(begin, end);
+}
+
+const unsigned char *REHex::Search::Value::rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride)
+{
+	return kernel.rfind(begin, end, limit);
+}
+
+void REHex::Search::Value::setup_window_controls(wxWindow *parent, wxSizer *sizer)
+{
+	{
+		wxBoxSizer *text_sizer = new wxBoxSizer(wxHORIZONTAL);
+		
+		text_sizer->Add(new wxStaticText(parent, wxID_ANY, "Value: "), 0, wxALIGN_CENTER_VERTICAL);
+		
+		search_for_tc = new NumericTextCtrl(parent, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, 0);
+		text_sizer->Add(search_for_tc, 1);
+		
+		search_for_tc->Bind(wxEVT_TEXT, &REHex::Search::Value::OnText, this);
+		
+		sizer->Add(text_sizer, 0, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
+	}
+	
+	{
+		wxStaticBoxSizer *sz = new wxStaticBoxSizer(wxVERTICAL, parent, "Value formats");
+		
+		wxBoxSizer *sz1 = new wxBoxSizer(wxHORIZONTAL);
+		sz->Add(sz1, 0, wxTOP | wxBOTTOM, 5);
+		
+		i8_cb = new wxCheckBox(sz->GetStaticBox(), wxID_ANY, "8-bit integer");
+		i8_cb->SetValue(true);
+		sz1->Add(i8_cb, 0, wxLEFT, 5);
+		
+		i16_cb = new wxCheckBox(sz->GetStaticBox(), wxID_ANY, "16-bit integer");
+		i16_cb->SetValue(true);
+		sz1->Add(i16_cb, 0, wxLEFT, 5);
+		
+		i32_cb = new wxCheckBox(sz->GetStaticBox(), wxID_ANY, "32-bit integer");
+		i32_cb->SetValue(true);
+		sz1->Add(i32_cb, 0, wxLEFT, 5);
+		
+		i64_cb = new wxCheckBox(sz->GetStaticBox(), wxID_ANY, "64-bit integer");
+		i64_cb->SetValue(true);
+		sz1->Add(i64_cb, 0, wxLEFT | wxRIGHT, 5);
+		
+		wxStaticLine *sl1 = new wxStaticLine(sz->GetStaticBox(), wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLI_HORIZONTAL);
+		sz->Add(sl1, 0, wxEXPAND | wxLEFT | wxRIGHT, 5);
+		
+		wxBoxSizer *sz2 = new wxBoxSizer(wxHORIZONTAL);
+		sz->Add(sz2, 0, wxTOP | wxBOTTOM, 5);
+		
+		e_little = new wxRadioButton(sz->GetStaticBox(), wxID_ANY, "Little endian", wxDefaultPosition, wxDefaultSize, wxRB_GROUP);
+		sz2->Add(e_little, 0, wxLEFT, 5);
+		
+		e_big = new wxRadioButton(sz->GetStaticBox(), wxID_ANY, "Big endian");
+		sz2->Add(e_big, 0, wxLEFT, 5);
+		
+		e_either = new wxRadioButton(sz->GetStaticBox(), wxID_ANY, "Either");
+		e_either->SetValue(true);
+		sz2->Add(e_either, 0, wxLEFT | wxRIGHT, 5);
+		
+		sizer->Add(sz, 0, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
+	}
+}
+
+#define INTEGER_TYPE_SIZE(x) \
+{ \
+	if(i ## x ## _cb->GetValue()) \
+	{ \
+		try { \
+			uint ## x ## _t v = search_for_tc->GetValue<uint ## x ## _t>(); \
+			\
+			if(e_little->GetValue() || e_either->GetValue()) \
+			{ \
+				uint ## x ## _t lv = htole ## x(v); \
+				search_for.push_back(std::vector<unsigned char>((unsigned char*)(&(lv)), (unsigned char*)(&(lv) + 1))); \
+			} \
+			\
+			if(e_big->GetValue() || e_either->GetValue()) \
+			{ \
+				uint ## x ## _t bv = htobe ## x(v); \
+				search_for.push_back(std::vector<unsigned char>((unsigned char*)(&(bv)), (unsigned char*)(&(bv) + 1))); \
+			} \
+		} \
+		catch(const REHex::NumericTextCtrl::RangeError &) \
+		{ \
+			try { \
+				int ## x ## _t v = search_for_tc->GetValue<int ## x ## _t>(); \
+				\
+				if(e_little->GetValue() || e_either->GetValue()) \
+				{ \
+					int ## x ## _t lv = htole ## x(v); \
+					search_for.push_back(std::vector<unsigned char>((unsigned char*)(&(lv)), (unsigned char*)(&(lv) + 1))); \
+				} \
+				\
+				if(e_big->GetValue() || e_either->GetValue()) \
+				{ \
+					int ## x ## _t bv = htobe ## x(v); \
+					search_for.push_back(std::vector<unsigned char>((unsigned char*)(&(bv)), (unsigned char*)(&(bv) + 1))); \
+				} \
+			} \
+			catch(REHex::NumericTextCtrl::InputError &) {} \
+		} \
+		catch(REHex::NumericTextCtrl::InputError &) {} \
+	} \
+}
+
+bool REHex::Search::Value::read_window_controls()
+{
+	search_for.clear();
+	
+	if(i8_cb->GetValue())
+	{
+		try {
+			uint8_t v = search_for_tc->GetValue<uint8_t>();
+			search_for.push_back(std::vector<unsigned char>((unsigned char*)(&(v)), (unsigned char*)(&(v) + 1)));
+		}
+		catch(const REHex::NumericTextCtrl::RangeError &)
+		{
+			try {
+				int8_t v = search_for_tc->GetValue<int8_t>();
+				search_for.push_back(std::vector<unsigned char>((unsigned char*)(&(v)), (unsigned char*)(&(v) + 1)));
+			}
+			catch(REHex::NumericTextCtrl::InputError &) {}
+		}
+		catch(REHex::NumericTextCtrl::InputError &) {}
+	}
+	
+	INTEGER_TYPE_SIZE(16);
+	INTEGER_TYPE_SIZE(32);
+	INTEGER_TYPE_SIZE(64);
+	
+	if(search_for.empty())
+	{
+		wxMessageBox("Please enter a valid value to search for", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
+	
+	kernel = MultiSearchKernel(std::vector< std::vector<unsigned char> >(search_for.begin(), search_for.end()));
+	
+	return true;
+}
+
+void REHex::Search::Value::OnText(wxCommandEvent &event)
+{
+	i8_cb->Disable();
+	
+	try { search_for_tc->GetValue<int8_t>(); i8_cb->Enable(); }
+	catch(const REHex::NumericTextCtrl::InputError &) {}
+	
+	try { search_for_tc->GetValue<uint8_t>(); i8_cb->Enable(); }
+	catch(const REHex::NumericTextCtrl::InputError &) {}
+	
+	i16_cb->Disable();
+	
+	try { search_for_tc->GetValue<int16_t>(); i16_cb->Enable(); }
+	catch(const REHex::NumericTextCtrl::InputError &) {}
+	
+	try { search_for_tc->GetValue<uint16_t>(); i16_cb->Enable(); }
+	catch(const REHex::NumericTextCtrl::InputError &) {}
+	
+	i32_cb->Disable();
+	
+	try { search_for_tc->GetValue<int32_t>(); i32_cb->Enable(); }
+	catch(const REHex::NumericTextCtrl::InputError &) {}
+	
+	try { search_for_tc->GetValue<uint32_t>(); i32_cb->Enable(); }
+	catch(const REHex::NumericTextCtrl::InputError &) {}
+	
+	i64_cb->Disable();
+	
+	try { search_for_tc->GetValue<int64_t>(); i64_cb->Enable(); }
+	catch(const REHex::NumericTextCtrl::InputError &) {}
+	
+	try { search_for_tc->GetValue<uint64_t>(); i64_cb->Enable(); }
+	catch(const REHex::NumericTextCtrl::InputError &) {}
+}
+
+REHex::Search::ValueRange::ValueRange(wxWindow *parent, SharedDocumentPointer &doc):
+	Search(parent, doc, "Search for value range")
+{
+	setup_window();
+}
+
+REHex::Search::ValueRange::~ValueRange()
+{
+	if(running)
+	{
+		end_search();
+	}
+}
+
+void REHex::Search::ValueRange::configure(const std::string &from, const std::string &to, RangeSearchKernel::Type type, size_t width, unsigned formats, const std::string &tolerance)
+{
+	from_tc->SetValue(from);
+	to_tc->SetValue(to);
+	tolerance_tc->SetValue(tolerance);
+	
+	switch(type)
+	{
+		case RangeSearchKernel::UNSIGNED: t_unsigned->SetValue(true); break;
+		case RangeSearchKernel::SIGNED:   t_signed->SetValue(true);   break;
+		case RangeSearchKernel::FLOAT:    t_float->SetValue(true);    break;
+	}
+	
+	switch(width)
+	{
+		case 1: w8->SetValue(true);  break;
+		case 2: w16->SetValue(true); break;
+		case 4: w32->SetValue(true); break;
+		case 8: w64->SetValue(true); break;
+	}
+	
+	if((formats & FMT_LE) && (formats & FMT_BE))
+	{
+		e_either->SetValue(true);
+	}
+	else if((formats & FMT_LE))
+	{
+		e_little->SetValue(true);
+	}
+	else if((formats & FMT_BE))
+	{
+		e_big->SetValue(true);
+	}
+	
+	update_controls();
+	read_window_controls();
+}
+
+bool REHex::Search::ValueRange::test(const void *data, size_t data_size)
+{
+	for(auto k = kernels.begin(); k != kernels.end(); ++k)
+	{
+		if(data_size >= k->width() && k->match_at((const unsigned char*)(data)))
+		{
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+size_t REHex::Search::ValueRange::test_max_window()
+{
+	return kernels.empty() ? 1 : kernels.front().width();
+}
+
+const unsigned char *REHex::Search::ValueRange::scan(const unsigned char *begin, const unsigned char *end, size_t stride)
+{
+	const unsigned char *first = NULL;
+	
+	for(auto k = kernels.begin(); k != kernels.end(); ++k)
+	{
+		/* Nothing after a match we already have needs to be searched. */
+		const unsigned char *k_end = first != NULL ? std::min(end, (first + k->width() - 1)) : end;
+		
+		const unsigned char *match = k->find(begin, k_end, stride);
+		if(match != NULL && (first == NULL || match < first))
+		{
+			first = match;
+		}
+	}
+	
+	return first;
+}
+
+const unsigned char *REHex::Search::ValueRange::rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride)
+{
+	const unsigned char *last = NULL;
+	
+	for(auto k = kernels.begin(); k != kernels.end(); ++k)
+	{
+		const unsigned char *match = k->rfind(begin, end, limit, stride);
 		
-		i8_cb = new wxCheckBox(sz->GetStaticBox(), wxID_ANY, "8-bit integer");
-		i8_cb->SetValue(true);
-		sz1->Add(i8_cb, 0, wxLEFT, 5);
+		if(match != NULL && (last == NULL || match > last))
+		{
+			last = match;
+		}
+	}
+	
+	return last;
+}
+
+void REHex::Search::ValueRange::setup_window_controls(wxWindow *parent, wxSizer *sizer)
+{
+	{
+		wxBoxSizer *text_sizer = new wxBoxSizer(wxHORIZONTAL);
 		
-		i16_cb = new wxCheckBox(sz->GetStaticBox(), wxID_ANY, "16-bit integer");
-		i16_cb->SetValue(true);
-		sz1->Add(i16_cb, 0, wxLEFT, 5);
+		text_sizer->Add(new wxStaticText(parent, wxID_ANY, "From: "), 0, wxALIGN_CENTER_VERTICAL);
 		
-		i32_cb = new wxCheckBox(sz->GetStaticBox(), wxID_ANY, "32-bit integer");
-		i32_cb->SetValue(true);
-		sz1->Add(i32_cb, 0, wxLEFT, 5);
+		from_tc = new NumericTextCtrl(parent, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, 0);
+		text_sizer->Add(from_tc, 1);
 		
-		i64_cb = new wxCheckBox(sz->GetStaticBox(), wxID_ANY, "64-bit integer");
-		i64_cb->SetValue(true);
-		sz1->Add(i64_cb, 0, wxLEFT | wxRIGHT, 5);
+		text_sizer->Add(new wxStaticText(parent, wxID_ANY, " To: "), 0, wxALIGN_CENTER_VERTICAL);
+		
+		to_tc = new NumericTextCtrl(parent, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, 0);
+		text_sizer->Add(to_tc, 1);
+		
+		text_sizer->Add(new wxStaticText(parent, wxID_ANY, " +/- "), 0, wxALIGN_CENTER_VERTICAL);
+		
+		tolerance_tc = new wxTextCtrl(parent, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, 0);
+		text_sizer->Add(tolerance_tc, 1);
+		
+		sizer->Add(text_sizer, 0, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
+	}
+	
+	{
+		wxStaticBoxSizer *sz = new wxStaticBoxSizer(wxVERTICAL, parent, "Value format");
+		
+		wxBoxSizer *sz1 = new wxBoxSizer(wxHORIZONTAL);
+		sz->Add(sz1, 0, wxTOP | wxBOTTOM, 5);
+		
+		t_unsigned = new wxRadioButton(sz->GetStaticBox(), wxID_ANY, "Unsigned integer", wxDefaultPosition, wxDefaultSize, wxRB_GROUP);
+		sz1->Add(t_unsigned, 0, wxLEFT, 5);
+		
+		t_signed = new wxRadioButton(sz->GetStaticBox(), wxID_ANY, "Signed integer");
+		t_signed->SetValue(true);
+		sz1->Add(t_signed, 0, wxLEFT, 5);
+		
+		t_float = new wxRadioButton(sz->GetStaticBox(), wxID_ANY, "Floating point");
+		sz1->Add(t_float, 0, wxLEFT | wxRIGHT, 5);
+		
+		t_unsigned->Bind(wxEVT_RADIOBUTTON, &REHex::Search::ValueRange::OnType, this);
+		t_signed->Bind(wxEVT_RADIOBUTTON, &REHex::Search::ValueRange::OnType, this);
+		t_float->Bind(wxEVT_RADIOBUTTON, &REHex::Search::ValueRange::OnType, this);
 		
 		wxStaticLine *sl1 = new wxStaticLine(sz->GetStaticBox(), wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLI_HORIZONTAL);
 		sz->Add(sl1, 0, wxEXPAND | wxLEFT | wxRIGHT, 5);
@@ -638,127 +2669,301 @@ void REHex::Search::Value::setup_window_controls(wxWindow *parent, wxSizer *size
 		wxBoxSizer *sz2 = new wxBoxSizer(wxHORIZONTAL);
 		sz->Add(sz2, 0, wxTOP | wxBOTTOM, 5);
 		
+		w8 = new wxRadioButton(sz->GetStaticBox(), wxID_ANY, "8-bit", wxDefaultPosition, wxDefaultSize, wxRB_GROUP);
+		sz2->Add(w8, 0, wxLEFT, 5);
+		
+		w16 = new wxRadioButton(sz->GetStaticBox(), wxID_ANY, "16-bit");
+		sz2->Add(w16, 0, wxLEFT, 5);
+		
+		w32 = new wxRadioButton(sz->GetStaticBox(), wxID_ANY, "32-bit");
+		w32->SetValue(true);
+		sz2->Add(w32, 0, wxLEFT, 5);
+		
+		w64 = new wxRadioButton(sz->GetStaticBox(), wxID_ANY, "64-bit");
+		sz2->Add(w64, 0, wxLEFT | wxRIGHT, 5);
+		
+		wxStaticLine *sl2 = new wxStaticLine(sz->GetStaticBox(), wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLI_HORIZONTAL);
+		sz->Add(sl2, 0, wxEXPAND | wxLEFT | wxRIGHT, 5);
+		
+		wxBoxSizer *sz3 = new wxBoxSizer(wxHORIZONTAL);
+		sz->Add(sz3, 0, wxTOP | wxBOTTOM, 5);
+		
 		e_little = new wxRadioButton(sz->GetStaticBox(), wxID_ANY, "Little endian", wxDefaultPosition, wxDefaultSize, wxRB_GROUP);
-		sz2->Add(e_little, 0, wxLEFT, 5);
+		sz3->Add(e_little, 0, wxLEFT, 5);
 		
 		e_big = new wxRadioButton(sz->GetStaticBox(), wxID_ANY, "Big endian");
-		sz2->Add(e_big, 0, wxLEFT, 5);
+		sz3->Add(e_big, 0, wxLEFT, 5);
 		
 		e_either = new wxRadioButton(sz->GetStaticBox(), wxID_ANY, "Either");
 		e_either->SetValue(true);
-		sz2->Add(e_either, 0, wxLEFT | wxRIGHT, 5);
+		sz3->Add(e_either, 0, wxLEFT | wxRIGHT, 5);
 		
 		sizer->Add(sz, 0, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
 	}
+	
+	update_controls();
 }
 
-#define INTEGER_TYPE_SIZE(x) \
-{ \
-	if(i ## x ## _cb->GetValue()) \
-	{ \
-		try { \
-			uint ## x ## _t v = search_for_tc->GetValue<uint ## x ## _t>(); \
-			\
-			if(e_little->GetValue() || e_either->GetValue()) \
-			{ \
-				uint ## x ## _t lv = htole ## x(v); \
-				search_for.push_back(std::vector<unsigned char>((unsigned char*)(&(lv)), (unsigned char*)(&(lv) + 1))); \
-			} \
-			\
-			if(e_big->GetValue() || e_either->GetValue()) \
-			{ \
-				uint ## x ## _t bv = htobe ## x(v); \
-				search_for.push_back(std::vector<unsigned char>((unsigned char*)(&(bv)), (unsigned char*)(&(bv) + 1))); \
-			} \
-		} \
-		catch(const REHex::NumericTextCtrl::RangeError &) \
-		{ \
-			try { \
-				int ## x ## _t v = search_for_tc->GetValue<int ## x ## _t>(); \
-				\
-				if(e_little->GetValue() || e_either->GetValue()) \
-				{ \
-					int ## x ## _t lv = htole ## x(v); \
-					search_for.push_back(std::vector<unsigned char>((unsigned char*)(&(lv)), (unsigned char*)(&(lv) + 1))); \
-				} \
-				\
-				if(e_big->GetValue() || e_either->GetValue()) \
-				{ \
-					int ## x ## _t bv = htobe ## x(v); \
-					search_for.push_back(std::vector<unsigned char>((unsigned char*)(&(bv)), (unsigned char*)(&(bv) + 1))); \
-				} \
-			} \
-			catch(REHex::NumericTextCtrl::InputError &) {} \
-		} \
-		catch(REHex::NumericTextCtrl::InputError &) {} \
-	} \
+/* Reads a floating point value from a text control, an empty control reads as empty_value. */
+static bool read_double(const wxTextCtrl *tc, double empty_value, double *value)
+{
+	wxString s = tc->GetValue().Trim().Trim(false);
+	
+	if(s.empty())
+	{
+		*value = empty_value;
+		return true;
+	}
+	
+	return s.ToCDouble(value) && !std::isnan(*value);
 }
 
-bool REHex::Search::Value::read_window_controls()
+bool REHex::Search::ValueRange::read_window_controls()
 {
-	search_for.clear();
+	size_t width = w8->GetValue() ? 1 : (w16->GetValue() ? 2 : (w32->GetValue() ? 4 : 8));
 	
-	if(i8_cb->GetValue())
+	std::vector<bool> orders;
+	
+	if(e_little->GetValue() || e_either->GetValue())
+	{
+		orders.push_back(false);
+	}
+	
+	if((e_big->GetValue() || e_either->GetValue()) && width > 1)
 	{
+		orders.push_back(true);
+	}
+	
+	std::vector<RangeSearchKernel> new_kernels;
+	
+	if(t_float->GetValue())
+	{
+		double from, to, tolerance;
+		
+		if(!read_double(from_tc, NAN, &from) || std::isnan(from))
+		{
+			wxMessageBox("Please enter a valid value to search from", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+			return false;
+		}
+		
+		if(!read_double(to_tc, from, &to))
+		{
+			wxMessageBox("Please enter a valid value to search to", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+			return false;
+		}
+		
+		if(!read_double(tolerance_tc, 0.0, &tolerance) || tolerance < 0.0)
+		{
+			wxMessageBox("Please enter a valid tolerance", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+			return false;
+		}
+		
+		if(to < from)
+		{
+			wxMessageBox("The end of the range must not be less than the start", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+			return false;
+		}
+		
+		for(auto o = orders.begin(); o != orders.end(); ++o)
+		{
+			new_kernels.push_back(RangeSearchKernel::float_range(width, *o, (from - tolerance), (to + tolerance)));
+		}
+	}
+	else{
+		bool is_signed = t_signed->GetValue();
+		
+		/* Largest and smallest values of the chosen width, as signed or unsigned. */
+		uint64_t type_max = width < 8 ? ((1ULL << (width * 8)) - 1) : UINT64_MAX;
+		int64_t stype_min = width < 8 ? -(int64_t)(1ULL << (width * 8 - 1)) : INT64_MIN;
+		int64_t stype_max = width < 8 ? (int64_t)((1ULL << (width * 8 - 1)) - 1) : INT64_MAX;
+		
+		int64_t s_from = 0, s_to = 0;
+		uint64_t u_from = 0, u_to = 0;
+		
 		try {
-			uint8_t v = search_for_tc->GetValue<uint8_t>();
-			search_for.push_back(std::vector<unsigned char>((unsigned char*)(&(v)), (unsigned char*)(&(v) + 1)));
+			if(is_signed)
+			{
+				s_from = from_tc->GetValue<int64_t>(stype_min, stype_max);
+			}
+			else{
+				u_from = from_tc->GetValue<uint64_t>(0, type_max);
+			}
 		}
-		catch(const REHex::NumericTextCtrl::RangeError &)
+		catch(const REHex::NumericTextCtrl::InputError &e)
 		{
-			try {
-				int8_t v = search_for_tc->GetValue<int8_t>();
-				search_for.push_back(std::vector<unsigned char>((unsigned char*)(&(v)), (unsigned char*)(&(v) + 1)));
+			wxMessageBox(std::string("Invalid value to search from: ") + e.what(), "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+			return false;
+		}
+		
+		try {
+			if(is_signed)
+			{
+				s_to = to_tc->GetValue<int64_t>(stype_min, stype_max);
+			}
+			else{
+				u_to = to_tc->GetValue<uint64_t>(0, type_max);
 			}
-			catch(REHex::NumericTextCtrl::InputError &) {}
 		}
-		catch(REHex::NumericTextCtrl::InputError &) {}
+		catch(const REHex::NumericTextCtrl::EmptyError &)
+		{
+			s_to = s_from;
+			u_to = u_from;
+		}
+		catch(const REHex::NumericTextCtrl::InputError &e)
+		{
+			wxMessageBox(std::string("Invalid value to search to: ") + e.what(), "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+			return false;
+		}
+		
+		if(is_signed ? (s_to < s_from) : (u_to < u_from))
+		{
+			wxMessageBox("The end of the range must not be less than the start", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+			return false;
+		}
+		
+		for(auto o = orders.begin(); o != orders.end(); ++o)
+		{
+			new_kernels.push_back(is_signed
+				? RangeSearchKernel::signed_range(width, *o, s_from, s_to)
+				: RangeSearchKernel::unsigned_range(width, *o, u_from, u_to));
+		}
 	}
 	
-	INTEGER_TYPE_SIZE(16);
-	INTEGER_TYPE_SIZE(32);
-	INTEGER_TYPE_SIZE(64);
-	
-	if(search_for.empty())
-	{
-		wxMessageBox("Please enter a valid value to search for", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
-		return false;
-	}
+	kernels = new_kernels;
 	
 	return true;
 }
 
-void REHex::Search::Value::OnText(wxCommandEvent &event)
+void REHex::Search::ValueRange::OnType(wxCommandEvent &event)
 {
-	i8_cb->Disable();
+	update_controls();
+}
+
+void REHex::Search::ValueRange::update_controls()
+{
+	bool is_float = t_float->GetValue();
 	
-	try { search_for_tc->GetValue<int8_t>(); i8_cb->Enable(); }
-	catch(const REHex::NumericTextCtrl::InputError &) {}
+	/* Floating point values are either 32-bit or 64-bit. */
 	
-	try { search_for_tc->GetValue<uint8_t>(); i8_cb->Enable(); }
-	catch(const REHex::NumericTextCtrl::InputError &) {}
+	if(is_float && (w8->GetValue() || w16->GetValue()))
+	{
+		w32->SetValue(true);
+	}
 	
-	i16_cb->Disable();
+	w8->Enable(!is_float);
+	w16->Enable(!is_float);
+	tolerance_tc->Enable(is_float);
+}
+
+REHex::Search::PatternList::PatternList(wxWindow *parent, SharedDocumentPointer &doc, const std::vector< std::vector<unsigned char> > &search_for):
+	Search(parent, doc, "Search for pattern list"),
+	search_for(search_for),
+	kernel(search_for)
+{
+	setup_window();
+}
+
+REHex::Search::PatternList::~PatternList()
+{
+	if(running)
+	{
+		end_search();
+	}
+}
+
+bool REHex::Search::PatternList::test(const void *data, size_t data_size)
+{
+	for(auto i = search_for.begin(); i != search_for.end(); ++i)
+	{
+		if(data_size >= i->size() && memcmp(data, i->data(), i->size()) == 0)
+		{
+			return true;
+		}
+	}
 	
-	try { search_for_tc->GetValue<int16_t>(); i16_cb->Enable(); }
-	catch(const REHex::NumericTextCtrl::InputError &) {}
+	return false;
+}
+
+size_t REHex::Search::PatternList::test_max_window()
+{
+	return kernel.max_length();
+}
+
+/* Where more than one pattern matches, the longest wins (as in MultiSearchKernel::find()). */
+size_t REHex::Search::PatternList::match_length(const unsigned char *at, const unsigned char *end)
+{
+	size_t length = 0;
 	
-	try { search_for_tc->GetValue<uint16_t>(); i16_cb->Enable(); }
-	catch(const REHex::NumericTextCtrl::InputError &) {}
+	for(auto i = search_for.begin(); i != search_for.end(); ++i)
+	{
+		if((size_t)(end - at) >= i->size() && i->size() > length && memcmp(at, i->data(), i->size()) == 0)
+		{
+			length = i->size();
+		}
+	}
 	
-	i32_cb->Disable();
+	return length;
+}
+
+const unsigned char *REHex::Search::PatternList::scan(const unsigned char *begin, const unsigned char *end, size_t stride)
+{
+	return kernel.find(begin, end);
+}
+
+const unsigned char *REHex::Search::PatternList::rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride)
+{
+	return kernel.rfind(begin, end, limit);
+}
+
+void REHex::Search::PatternList::setup_window_controls(wxWindow *parent, wxSizer *sizer)
+{
+	sizer->Add(new wxStaticText(parent, wxID_ANY, "Hex strings to search for (one per line):"), 0, wxTOP | wxLEFT | wxRIGHT, 10);
 	
-	try { search_for_tc->GetValue<int32_t>(); i32_cb->Enable(); }
-	catch(const REHex::NumericTextCtrl::InputError &) {}
+	search_for_tc = new wxTextCtrl(parent, wxID_ANY, "", wxDefaultPosition, wxSize(400, 120), wxTE_MULTILINE);
+	sizer->Add(search_for_tc, 1, wxTOP | wxLEFT | wxRIGHT | wxEXPAND, 10);
+}
+
+bool REHex::Search::PatternList::read_window_controls()
+{
+	std::string search_for_text = search_for_tc->GetValue().ToStdString();
 	
-	try { search_for_tc->GetValue<uint32_t>(); i32_cb->Enable(); }
-	catch(const REHex::NumericTextCtrl::InputError &) {}
+	std::vector< std::vector<unsigned char> > patterns;
 	
-	i64_cb->Disable();
+	for(size_t line_begin = 0, line_no = 1; line_begin < search_for_text.length(); ++line_no)
+	{
+		size_t line_end = search_for_text.find('\n', line_begin);
+		if(line_end == std::string::npos)
+		{
+			line_end = search_for_text.length();
+		}
+		
+		std::vector<unsigned char> pattern;
+		
+		try {
+			pattern = REHex::parse_hex_string(search_for_text.substr(line_begin, (line_end - line_begin)));
+		}
+		catch(const REHex::ParseError &e) {
+			wxMessageBox(("Line " + std::to_string(line_no) + ": " + e.what()), "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+			return false;
+		}
+		
+		/* Blank lines are skipped. */
+		if(!pattern.empty())
+		{
+			patterns.push_back(pattern);
+		}
+		
+		line_begin = line_end + 1;
+	}
 	
-	try { search_for_tc->GetValue<int64_t>(); i64_cb->Enable(); }
-	catch(const REHex::NumericTextCtrl::InputError &) {}
+	if(patterns.empty())
+	{
+		wxMessageBox("Please enter at least one hex string to search for", "Error", (wxOK | wxICON_EXCLAMATION | wxCENTRE), this);
+		return false;
+	}
 	
-	try { search_for_tc->GetValue<uint64_t>(); i64_cb->Enable(); }
-	catch(const REHex::NumericTextCtrl::InputError &) {}
+	search_for = patterns;
+	kernel = MultiSearchKernel(search_for);
+	
+	return true;
 }
@@ -19,10 +19,13 @@
 #define REHEX_SEARCH_HPP
 
 #include <atomic>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <sys/types.h>
-#include <thread>
+#include <vector>
+#include <wx/button.h>
 #include <wx/checkbox.h>
 #include <wx/progdlg.h>
 #include <wx/radiobut.h>
@@ -30,18 +33,39 @@
 #include <wx/timer.h>
 
 #include "document.hpp"
+#include "Events.hpp"
+#include "NGramIndex.hpp"
 #include "NumericTextCtrl.hpp"
+#include "RegexSearchKernel.hpp"
+#include "SafeWindowPointer.hpp"
+#include "SearchKernel.hpp"
+#include "SearchResultsPanel.hpp"
 #include "SharedDocumentPointer.hpp"
+#include "ThreadPool.hpp"
+#include "util.hpp"
 
 namespace REHex {
 	class Search: public wxDialog {
 		public:
 			class Text;
 			class ByteSequence;
+			class Masked;
+			class Regex;
 			class Value;
+			class ValueRange;
+			class PatternList;
 			
 			static const size_t DEFAULT_WINDOW_SIZE = 2134016; /* 2MiB */
 			
+			/* An open document searched by "Find in all documents", and the function
+			 * which creates the panel its results are listed in.
+			*/
+			struct OpenDocument
+			{
+				SharedDocumentPointer doc;
+				std::function<SearchResultsPanel*()> results_panel_factory;
+			};
+			
 		protected:
 			SharedDocumentPointer doc;
 			
@@ -59,18 +83,95 @@ namespace REHex {
 			wxTextCtrl *ralign_tc;
 			
 			std::mutex lock;
-			std::list<std::thread> threads;
+			std::shared_ptr<ThreadPool::Job> job; /* Workers searching the document. */
 			std::atomic<off_t> next_window_start;
 			std::atomic<off_t> match_found_at;
+			off_t match_found_length;
 			std::atomic<bool> running;
 			
 			/* Start and end (inclusive) of current search. */
 			off_t search_base;
 			off_t search_end;
 			
+			/* Set when searching backwards from search_from (exclusive) towards
+			 * search_base. Matches must still end by search_end.
+			*/
+			bool backwards;
+			off_t search_from;
+			
 			wxProgressDialog *progress;
 			wxTimer timer;
 			
+			/* State of a "Find all" search started by begin_find_all(). Matches are
+			 * collected in found by the worker threads and passed on to the results
+			 * panel from the UI thread by OnTimer().
+			*/
+			bool finding_all;
+			std::vector<SearchMatch> found;
+			std::atomic<bool> find_all_failed;
+			std::unique_ptr< SafeWindowPointer<SearchResultsPanel> > results;
+			
+			/* State of a "Replace all" started by begin_replace_all(). Matches are
+			 * collected in found like a "Find all" and replaced once the search
+			 * finishes, unless replace_data_modified was set by the document being
+			 * modified in the meantime.
+			*/
+			bool replacing_all;
+			bool replace_data_modified;
+			std::vector<unsigned char> replace_with;
+			
+			std::function<SearchResultsPanel*()> results_panel_factory;
+			
+			/* State of an incremental search started by begin_incremental_search(),
+			 * which searches from incremental_from to the end of the range and then
+			 * wraps around to search from the start of the range.
+			*/
+			bool incremental;
+			bool incremental_wrapped;
+			off_t incremental_from;
+			size_t incremental_window_size;
+			
+			/* Outcome of the last incremental search to finish, kept so the next one can
+			 * skip ahead when its pattern extends the last one (searches cancelled in
+			 * between don't matter, so long as each pattern extended the one before).
+			 * incremental_found is -1 if there were no matches.
+			*/
+			bool incremental_done;
+			off_t incremental_found;
+			
+			/* Last match passed to the match highlighter, -1 if none, and where the
+			 * cursor was left afterwards.
+			*/
+			off_t incremental_highlighted;
+			off_t incremental_cursor;
+			
+			std::function<void(off_t, off_t)> match_highlighter;
+			
+			std::function<std::vector<OpenDocument>()> open_documents_provider;
+			wxButton *find_all_documents_btn;
+			
+			/* State of each document searched by find_all_documents(). Workers claim
+			 * windows of the first document which has any left, so every document is
+			 * searched by the same job.
+			*/
+			struct DocumentSearch
+			{
+				Document *doc;
+				off_t search_end;
+				
+				std::shared_ptr<NGramIndex> index;
+				size_t window_size;
+				
+				std::atomic<off_t> next_window_start;
+				std::vector<SearchMatch> matches;
+			};
+			
+			/* Search index of the document's file and the patterns to look up in it,
+			 * set up when a search begins if the index can be used for it.
+			*/
+			std::shared_ptr<NGramIndex> index;
+			std::vector< std::vector<unsigned char> > index_patterns;
+			
 		protected:
 			Search(wxWindow *parent, SharedDocumentPointer &doc, const char *title);
 			
@@ -78,27 +179,143 @@ namespace REHex {
 			virtual void setup_window_controls(wxWindow *parent, wxSizer *sizer) = 0;
 			virtual bool read_window_controls() = 0;
 			
+			/* Subclasses which can replace what they find override these to provide the
+			 * "Replace all" button and the replacement data entered by the user.
+			*/
+			virtual bool replace_supported();
+			virtual bool read_replace_controls(std::vector<unsigned char> &replace_with);
+			
+			/* Subclasses which only match fixed sequences of bytes override this to
+			 * provide them, so searches can use the document's search index (if it has
+			 * one) to skip over data which can't match.
+			*/
+			virtual bool fixed_patterns(std::vector< std::vector<unsigned char> > &patterns);
+			
+			/* Begin searching forwards from the cursor as the user types, wrapping around
+			 * to the start of the range if there are no matches after it. No progress or
+			 * prompts are shown, and the first match is passed to the match highlighter.
+			 *
+			 * While the cursor remains where the last incremental search left it, the
+			 * search begins from where that one did instead. If the caller
+			 * knows that any match of the pattern being searched for is also a match of
+			 * the pattern the last incremental search was for (e.g. the user has typed
+			 * another character), it can pass extends_last, and the search skips over
+			 * the positions which the last search showed can't match.
+			*/
+			void begin_incremental_search(bool extends_last, size_t window_size = DEFAULT_WINDOW_SIZE);
+			
+			/* Stop any incremental search which is running. Subclasses must call this
+			 * before changing what they are searching for.
+			*/
+			void cancel_incremental_search();
+			
+			bool is_searching() const;
+			
 		public:
 			void limit_range(off_t range_begin, off_t range_end);
 			void require_alignment(off_t alignment, off_t relative_to_offset = 0);
 			
 			off_t find_next(off_t from_offset, size_t window_size = DEFAULT_WINDOW_SIZE);
 			void begin_search(off_t from_offset, off_t range_end, size_t window_size = DEFAULT_WINDOW_SIZE);
+			
+			off_t find_prev(off_t from_offset, size_t window_size = DEFAULT_WINDOW_SIZE);
+			void begin_search_backwards(off_t from_offset, off_t range_begin, size_t window_size = DEFAULT_WINDOW_SIZE);
+			
 			void end_search();
 			
+			bool find_all(std::vector<off_t> &matches, size_t window_size = DEFAULT_WINDOW_SIZE);
+			
+			void begin_find_all(SearchResultsPanel *results, size_t window_size = DEFAULT_WINDOW_SIZE);
+			void find_all(SearchResultsPanel *results, size_t window_size = DEFAULT_WINDOW_SIZE);
+			
+			/* Sets the function used by the "Find all" button to create the panel which
+			 * the results are listed in.
+			*/
+			void set_results_panel_factory(const std::function<SearchResultsPanel*()> &factory);
+			
+			/* Sets the function which incremental searches call with the offset and
+			 * length of the match they found, or an offset of -1 if there are none.
+			*/
+			void set_match_highlighter(const std::function<void(off_t, off_t)> &highlighter);
+			
+			/* Find every match in each of the documents, searching them all at once on the
+			 * shared thread pool. matches is resized to hold the matches in each document,
+			 * in order and including overlapping matches (like begin_find_all()). Each
+			 * document is searched whole, any range or alignment set is only used when
+			 * searching this search's own document.
+			 *
+			 * Returns false if the search was cancelled or failed.
+			*/
+			bool find_all_documents(const std::vector<SharedDocumentPointer> &documents, std::vector< std::vector<SearchMatch> > &matches, wxProgressDialog *progress = NULL, size_t window_size = DEFAULT_WINDOW_SIZE);
+			
+			/* Sets the function used by the "Find in all documents" button to list the
+			 * open documents. The button is disabled until this is set.
+			*/
+			void set_open_documents_provider(const std::function<std::vector<OpenDocument>()> &provider);
+			
+			off_t wait_for_incremental_search();
+			
+			void begin_replace_all(const std::vector<unsigned char> &replace_with, size_t window_size = DEFAULT_WINDOW_SIZE);
+			size_t replace_all(const std::vector<unsigned char> &replace_with, size_t window_size = DEFAULT_WINDOW_SIZE);
+			size_t wait_for_replace_all();
+			
 			virtual bool test(const void *data, size_t data_size) = 0;
 			virtual size_t test_max_window() = 0;
 			
+			/* Returns the length of the match found at the given position, with data
+			 * available up to end. The default implementation returns test_max_window(),
+			 * subclasses whose matches can be shorter override it.
+			*/
+			virtual size_t match_length(const unsigned char *at, const unsigned char *end);
+			
+			/* Find the first match in a window of data.
+			 *
+			 * Returns the first position from begin, in steps of stride, where test()
+			 * matches the data up to end, or NULL if there isn't one. Subclasses which
+			 * can search a whole window faster than calling test() at every offset
+			 * override this, and may return matches which aren't on a stride boundary,
+			 * which the caller skips over.
+			*/
+			virtual const unsigned char *scan(const unsigned char *begin, const unsigned char *end, size_t stride);
+			
+			/* Find the last match in a window of data.
+			 *
+			 * Returns the highest position before limit, in steps of stride down from
+			 * (limit - 1), where test() matches the data up to end, or NULL if there
+			 * isn't one. Overrides may return matches which aren't on a stride boundary,
+			 * which the caller skips over.
+			*/
+			virtual const unsigned char *rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride);
+			
 			void OnCheckBox(wxCommandEvent &event);
 			void OnFindNext(wxCommandEvent &event);
+			void OnFindPrev(wxCommandEvent &event);
+			void OnFindAll(wxCommandEvent &event);
+			void OnFindAllDocuments(wxCommandEvent &event);
+			void OnReplaceAll(wxCommandEvent &event);
 			void OnCancel(wxCommandEvent &event);
 			void OnTimer(wxTimerEvent &event);
 			void OnClose(wxCloseEvent &event);
+			void OnDataModified(OffsetLengthEvent &event);
 			
 		private:
 			void enable_controls();
 			bool read_base_window_controls();
+			off_t align_up(off_t offset) const;
+			off_t align_down(off_t offset) const;
+			void flush_results();
+			void finish_incremental_pass();
+			size_t prepare_index(size_t window_size);
+			std::shared_ptr<NGramIndex> open_index(Document *document);
+			bool narrow_window(NGramIndex *index, off_t *begin, off_t *end);
+			void start_find_all(size_t window_size);
+			void take_found(std::vector<off_t> &matches);
+			size_t finish_replace_all();
+			void find_in_window(Document *document, off_t window_base, off_t next_window, off_t search_end, size_t compare_size, std::vector<SearchMatch> &matches);
 			void thread_main(size_t window_size, size_t compare_size);
+			void thread_main_backwards(size_t window_size, size_t compare_size);
+			void thread_find_all(size_t window_size, size_t compare_size, std::vector<SearchMatch> *matches, std::atomic<bool> *failed);
+			void thread_find_all_documents(std::vector< std::unique_ptr<DocumentSearch> > *documents, size_t compare_size, std::atomic<bool> *failed);
 			
 		/* Stays at the bottom because it changes the protection... */
 		DECLARE_EVENT_TABLE()
@@ -107,22 +324,68 @@ namespace REHex {
 	class Search::Text: public Search
 	{
 		private:
-			std::string search_for;
+			std::string search_for;  /* UTF-8 */
 			bool case_sensitive;
+			unsigned encodings;
+			
+			/* The text in each of the selected encodings, with the bits of each byte
+			 * which must match (only the case of ASCII letters may differ).
+			*/
+			std::vector<TextEncoding> encoded_as;
+			std::vector<MaskedSearchKernel> encoded;
+			std::vector< std::vector<unsigned char> > encoded_patterns;
+			
+			/* Set when the kernel folds the case of bytes which aren't letters in the
+			 * encoding they're part of, so its matches need checking against encoded.
+			*/
+			bool verify;
+			
+			MultiSearchKernel kernel;
 			
 			wxTextCtrl *search_for_tc;
 			wxCheckBox *case_sensitive_cb;
+			wxCheckBox *utf8_cb, *utf16le_cb, *utf16be_cb, *latin1_cb;
+			wxCheckBox *incremental_cb;
+			wxTextCtrl *replace_with_tc;
+			
+			/* What the last incremental search was for. Empty if the next one can't
+			 * carry on from it.
+			*/
+			std::string incremental_text;
+			bool incremental_case_sensitive;
+			unsigned incremental_encodings;
+			
+			void compile();
 			
 		public:
-			Text(wxWindow *parent, SharedDocumentPointer &doc, const std::string &search_for = "", bool case_sensitive = true);
+			static const unsigned ENC_UTF8    = (1 << 0);
+			static const unsigned ENC_UTF16LE = (1 << 1);
+			static const unsigned ENC_UTF16BE = (1 << 2);
+			static const unsigned ENC_LATIN1  = (1 << 3);
+			
+			Text(wxWindow *parent, SharedDocumentPointer &doc, const std::string &search_for = "", bool case_sensitive = true, unsigned encodings = ENC_UTF8);
 			virtual ~Text();
 			
+			/* Begin an incremental search for text, as if it had been typed into the
+			 * dialog.
+			*/
+			void search_as_you_type(const std::string &text, bool case_sensitive, unsigned encodings);
+			
 			virtual bool test(const void *data, size_t data_size);
 			virtual size_t test_max_window();
+			virtual size_t match_length(const unsigned char *at, const unsigned char *end);
+			virtual const unsigned char *scan(const unsigned char *begin, const unsigned char *end, size_t stride);
+			virtual const unsigned char *rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride);
 			
 		protected:
 			virtual void setup_window_controls(wxWindow *parent, wxSizer *sizer);
 			virtual bool read_window_controls();
+			virtual bool replace_supported();
+			virtual bool read_replace_controls(std::vector<unsigned char> &replace_with);
+			virtual bool fixed_patterns(std::vector< std::vector<unsigned char> > &patterns);
+			
+		private:
+			void OnText(wxCommandEvent &event);
 	};
 	
 	class Search::ByteSequence: public Search
@@ -130,7 +393,10 @@ namespace REHex {
 		private:
 			std::vector<unsigned char> search_for;
 			
+			SearchKernel kernel;
+			
 			wxTextCtrl *search_for_tc;
+			wxTextCtrl *replace_with_tc;
 			
 		public:
 			ByteSequence(wxWindow *parent, SharedDocumentPointer &doc, const std::vector<unsigned char> &search_for = std::vector<unsigned char>());
@@ -138,6 +404,62 @@ namespace REHex {
 			
 			virtual bool test(const void *data, size_t data_size);
 			virtual size_t test_max_window();
+			virtual const unsigned char *scan(const unsigned char *begin, const unsigned char *end, size_t stride);
+			virtual const unsigned char *rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride);
+			
+		protected:
+			virtual void setup_window_controls(wxWindow *parent, wxSizer *sizer);
+			virtual bool read_window_controls();
+			virtual bool replace_supported();
+			virtual bool read_replace_controls(std::vector<unsigned char> &replace_with);
+			virtual bool fixed_patterns(std::vector< std::vector<unsigned char> > &patterns);
+	};
+	
+	class Search::Masked: public Search
+	{
+		private:
+			std::vector<unsigned char> search_for;
+			std::vector<unsigned char> mask;
+			
+			MaskedSearchKernel kernel;
+			
+			wxTextCtrl *search_for_tc;
+			
+		public:
+			Masked(wxWindow *parent, SharedDocumentPointer &doc, const std::vector<unsigned char> &search_for = std::vector<unsigned char>(), const std::vector<unsigned char> &mask = std::vector<unsigned char>());
+			virtual ~Masked();
+			
+			virtual bool test(const void *data, size_t data_size);
+			virtual size_t test_max_window();
+			virtual const unsigned char *scan(const unsigned char *begin, const unsigned char *end, size_t stride);
+			virtual const unsigned char *rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride);
+			
+		protected:
+			virtual void setup_window_controls(wxWindow *parent, wxSizer *sizer);
+			virtual bool read_window_controls();
+	};
+	
+	class Search::Regex: public Search
+	{
+		private:
+			std::string search_for;
+			unsigned flags;
+			
+			RegexSearchKernel kernel;
+			
+			wxTextCtrl *search_for_tc;
+			wxCheckBox *case_insensitive_cb;
+			wxCheckBox *text_cb;
+			
+		public:
+			Regex(wxWindow *parent, SharedDocumentPointer &doc, const std::string &search_for = "", unsigned flags = 0);
+			virtual ~Regex();
+			
+			virtual bool test(const void *data, size_t data_size);
+			virtual size_t test_max_window();
+			virtual size_t match_length(const unsigned char *at, const unsigned char *end);
+			virtual const unsigned char *scan(const unsigned char *begin, const unsigned char *end, size_t stride);
+			virtual const unsigned char *rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride);
 			
 		protected:
 			virtual void setup_window_controls(wxWindow *parent, wxSizer *sizer);
@@ -148,6 +470,7 @@ namespace REHex {
 	{
 		private:
 			std::list< std::vector<unsigned char> > search_for;
+			MultiSearchKernel kernel;
 			
 			NumericTextCtrl *search_for_tc;
 			wxCheckBox *i8_cb, *i16_cb,*i32_cb, *i64_cb;
@@ -168,6 +491,9 @@ namespace REHex {
 			
 			virtual bool test(const void *data, size_t data_size);
 			virtual size_t test_max_window();
+			virtual size_t match_length(const unsigned char *at, const unsigned char *end);
+			virtual const unsigned char *scan(const unsigned char *begin, const unsigned char *end, size_t stride);
+			virtual const unsigned char *rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride);
 			
 		protected:
 			virtual void setup_window_controls(wxWindow *parent, wxSizer *sizer);
@@ -176,6 +502,67 @@ namespace REHex {
 		private:
 			void OnText(wxCommandEvent &event);
 	};
+	
+	class Search::ValueRange: public Search
+	{
+		private:
+			/* One kernel for each byte order being searched. */
+			std::vector<RangeSearchKernel> kernels;
+			
+			NumericTextCtrl *from_tc, *to_tc;
+			wxTextCtrl *tolerance_tc;
+			wxRadioButton *t_unsigned, *t_signed, *t_float;
+			wxRadioButton *w8, *w16, *w32, *w64;
+			wxRadioButton *e_little, *e_big, *e_either;
+			
+		public:
+			ValueRange(wxWindow *parent, SharedDocumentPointer &doc);
+			virtual ~ValueRange();
+			
+			static const unsigned FMT_LE = (1 << 0);
+			static const unsigned FMT_BE = (1 << 1);
+			
+			/* An empty to value searches for from alone. The tolerance is only used by
+			 * floating point searches, and widens the range by that much either side.
+			*/
+			void configure(const std::string &from, const std::string &to, RangeSearchKernel::Type type, size_t width, unsigned formats, const std::string &tolerance = "");
+			
+			virtual bool test(const void *data, size_t data_size);
+			virtual size_t test_max_window();
+			virtual const unsigned char *scan(const unsigned char *begin, const unsigned char *end, size_t stride);
+			virtual const unsigned char *rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride);
+			
+		protected:
+			virtual void setup_window_controls(wxWindow *parent, wxSizer *sizer);
+			virtual bool read_window_controls();
+			
+		private:
+			void OnType(wxCommandEvent &event);
+			void update_controls();
+	};
+	
+	class Search::PatternList: public Search
+	{
+		private:
+			std::vector< std::vector<unsigned char> > search_for;
+			MultiSearchKernel kernel;
+			
+			wxTextCtrl *search_for_tc;
+			
+		public:
+			PatternList(wxWindow *parent, SharedDocumentPointer &doc, const std::vector< std::vector<unsigned char> > &search_for = std::vector< std::vector<unsigned char> >());
+			virtual ~PatternList();
+			
+			virtual bool test(const void *data, size_t data_size);
+			virtual size_t test_max_window();
+			virtual size_t match_length(const unsigned char *at, const unsigned char *end);
+			virtual const unsigned char *scan(const unsigned char *begin, const unsigned char *end, size_t stride);
+			virtual const unsigned char *rscan(const unsigned char *begin, const unsigned char *end, const unsigned char *limit, size_t stride);
+			
+		protected:
+			virtual void setup_window_controls(wxWindow *parent, wxSizer *sizer);
+			virtual bool read_window_controls();
+	};
 }
 
 #endif /* !REHEX_SEARCH_HPP */
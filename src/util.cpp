@@ -72,6 +72,55 @@ std::vector<unsigned char> REHex::parse_hex_string(const std::string &hex_string
 	return data;
 }
 
+/* Parses a hex string like parse_hex_string(), except any digit may instead be a '?' which
+ * matches any value. The wildcard nibbles are zero in the returned data, and mask is set to
+ * the bits of each byte which must match.
+*/
+std::vector<unsigned char> REHex::parse_masked_hex_string(const std::string &hex_string, std::vector<unsigned char> *mask)
+{
+	std::vector<unsigned char> data;
+	mask->clear();
+	
+	auto is_digit = [](char c)
+	{
+		return isxdigit(c) || c == '?';
+	};
+	
+	auto parse_digit = [](char c)
+	{
+		return (c == '?') ? 0x0 : parse_ascii_nibble(c);
+	};
+	
+	for(size_t at = 0; at < hex_string.length();)
+	{
+		char this_char = hex_string.at(at++);
+		
+		if(isspace(this_char))
+		{
+			continue;
+		}
+		else if(is_digit(this_char) && at < hex_string.length())
+		{
+			char next_char;
+			do {
+				next_char = hex_string.at(at++);
+			} while(at < hex_string.length() && isspace(next_char));
+			
+			if(at <= hex_string.length() && is_digit(next_char))
+			{
+				data.push_back(parse_digit(next_char) | (parse_digit(this_char) << 4));
+				mask->push_back((next_char == '?' ? 0x00 : 0x0F) | (this_char == '?' ? 0x00 : 0xF0));
+				
+				continue;
+			}
+		}
+		
+		throw ParseError("Invalid hex string");
+	}
+	
+	return data;
+}
+
 unsigned char REHex::parse_ascii_nibble(char c)
 {
 	switch(c)
@@ -98,6 +147,92 @@ unsigned char REHex::parse_ascii_nibble(char c)
 	}
 }
 
+/* Converts UTF-8 text to the given encoding. Throws ParseError if the text isn't valid UTF-8
+ * or has characters which the encoding can't represent.
+*/
+std::vector<unsigned char> REHex::encode_text(const std::string &utf8_text, TextEncoding encoding)
+{
+	std::vector<unsigned char> data;
+	data.reserve(utf8_text.length() * (encoding == ENCODING_UTF16LE || encoding == ENCODING_UTF16BE ? 2 : 1));
+	
+	auto push_utf16 = [&](uint16_t unit)
+	{
+		if(encoding == ENCODING_UTF16LE)
+		{
+			data.push_back(unit & 0xFF);
+			data.push_back(unit >> 8);
+		}
+		else{
+			data.push_back(unit >> 8);
+			data.push_back(unit & 0xFF);
+		}
+	};
+	
+	for(size_t at = 0; at < utf8_text.length();)
+	{
+		unsigned char lead = utf8_text[at++];
+		
+		/* Decode the next character, rejecting overlong sequences and surrogates. */
+		
+		uint32_t c;
+		size_t n_cont;
+		uint32_t min;
+		
+		if(lead < 0x80)      { c = lead;        n_cont = 0; min = 0x0;     }
+		else if(lead < 0xC0) { throw ParseError("Invalid UTF-8 text"); }
+		else if(lead < 0xE0) { c = lead & 0x1F; n_cont = 1; min = 0x80;    }
+		else if(lead < 0xF0) { c = lead & 0x0F; n_cont = 2; min = 0x800;   }
+		else if(lead < 0xF8) { c = lead & 0x07; n_cont = 3; min = 0x10000; }
+		else                 { throw ParseError("Invalid UTF-8 text"); }
+		
+		for(size_t i = 0; i < n_cont; ++i)
+		{
+			if(at >= utf8_text.length() || (utf8_text[at] & 0xC0) != 0x80)
+			{
+				throw ParseError("Invalid UTF-8 text");
+			}
+			
+			c = (c << 6) | (utf8_text[at++] & 0x3F);
+		}
+		
+		if(c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+		{
+			throw ParseError("Invalid UTF-8 text");
+		}
+		
+		switch(encoding)
+		{
+			case ENCODING_UTF8:
+				data.insert(data.end(), (utf8_text.begin() + at - n_cont - 1), (utf8_text.begin() + at));
+				break;
+				
+			case ENCODING_UTF16LE:
+			case ENCODING_UTF16BE:
+				if(c >= 0x10000)
+				{
+					push_utf16(0xD800 | ((c - 0x10000) >> 10));
+					push_utf16(0xDC00 | ((c - 0x10000) & 0x3FF));
+				}
+				else{
+					push_utf16(c);
+				}
+				
+				break;
+				
+			case ENCODING_LATIN1:
+				if(c > 0xFF)
+				{
+					throw ParseError("Text can't be represented in Latin-1");
+				}
+				
+				data.push_back(c);
+				break;
+		}
+	}
+	
+	return data;
+}
+
 void REHex::file_manager_show_file(const std::string &filename)
 {
 	wxFileName wxfn(filename);
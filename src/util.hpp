@@ -49,8 +49,18 @@ namespace REHex {
 	};
 	
 	std::vector<unsigned char> parse_hex_string(const std::string &hex_string);
+	std::vector<unsigned char> parse_masked_hex_string(const std::string &hex_string, std::vector<unsigned char> *mask);
 	unsigned char parse_ascii_nibble(char c);
 	
+	enum TextEncoding {
+		ENCODING_UTF8,
+		ENCODING_UTF16LE,
+		ENCODING_UTF16BE,
+		ENCODING_LATIN1,
+	};
+	
+	std::vector<unsigned char> encode_text(const std::string &utf8_text, TextEncoding encoding);
+	
 	void file_manager_show_file(const std::string &filename);
 	
 	enum OffsetBase {
@@ -0,0 +1,287 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#undef NDEBUG
+#include "../src/platform.hpp"
+#include <assert.h>
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <string>
+#include <string.h>
+#include <vector>
+
+#include "../src/BinaryMetadata.hpp"
+
+using namespace REHex;
+
+#define TMPFILE  "tests/.tmpfile"
+
+static std::vector<unsigned char> read_file(const char *filename)
+{
+	std::vector<unsigned char> data;
+	
+	FILE *fh = fopen(filename, "rb");
+	assert(fh);
+	
+	unsigned char buf[1024];
+	size_t len;
+	while((len = fread(buf, 1, sizeof(buf), fh)) > 0)
+	{
+		data.insert(data.end(), buf, buf + len);
+	}
+	
+	fclose(fh);
+	
+	return data;
+}
+
+static void write_file(const char *filename, const std::vector<unsigned char> &data)
+{
+	FILE *fh = fopen(filename, "wb");
+	assert(fh);
+	
+	if(data.size() > 0)
+		assert(fwrite(data.data(), data.size(), 1, fh) == 1);
+	
+	fclose(fh);
+}
+
+TEST(BinaryMetadata, Empty)
+{
+	{
+		BinaryMetadataWriter w(TMPFILE);
+		w.finish();
+	}
+	
+	EXPECT_TRUE(BinaryMetadataReader::is_binary_metadata(TMPFILE));
+	
+	BinaryMetadataReader r(TMPFILE);
+	
+	EXPECT_EQ(r.comment_count(), 0U);
+	EXPECT_EQ(r.highlight_count(), 0U);
+	
+	off_t offset, length;
+	std::string text;
+	int colour;
+	
+	EXPECT_FALSE(r.next_comment(&offset, &length, &text));
+	EXPECT_FALSE(r.next_highlight(&offset, &length, &colour));
+}
+
+TEST(BinaryMetadata, RoundTrip)
+{
+	{
+		BinaryMetadataWriter w(TMPFILE);
+		
+		w.add_comment(0,  10, "first", 5);
+		w.add_comment(0,  0,  "", 0);
+		w.add_comment(4,  2,  "\xE2\x98\x83 snowman", 11);
+		w.add_comment(20, 1,  "last", 4);
+		
+		w.add_highlight(2,  4, 0);
+		w.add_highlight(10, 8, 5);
+		
+		w.finish();
+	}
+	
+	BinaryMetadataReader r(TMPFILE);
+	
+	EXPECT_EQ(r.comment_count(), 4U);
+	EXPECT_EQ(r.highlight_count(), 2U);
+	
+	off_t offset, length;
+	std::string text;
+	int colour;
+	
+	/* Read the sections interleaved to check each keeps its own position. */
+	
+	ASSERT_TRUE(r.next_comment(&offset, &length, &text));
+	EXPECT_EQ(offset, 0);
+	EXPECT_EQ(length, 10);
+	EXPECT_EQ(text, "first");
+	
+	ASSERT_TRUE(r.next_highlight(&offset, &length, &colour));
+	EXPECT_EQ(offset, 2);
+	EXPECT_EQ(length, 4);
+	EXPECT_EQ(colour, 0);
+	
+	ASSERT_TRUE(r.next_comment(&offset, &length, &text));
+	EXPECT_EQ(offset, 0);
+	EXPECT_EQ(length, 0);
+	EXPECT_EQ(text, "");
+	
+	ASSERT_TRUE(r.next_comment(&offset, &length, &text));
+	EXPECT_EQ(offset, 4);
+	EXPECT_EQ(length, 2);
+	EXPECT_EQ(text, "\xE2\x98\x83 snowman");
+	
+	ASSERT_TRUE(r.next_highlight(&offset, &length, &colour));
+	EXPECT_EQ(offset, 10);
+	EXPECT_EQ(length, 8);
+	EXPECT_EQ(colour, 5);
+	
+	EXPECT_FALSE(r.next_highlight(&offset, &length, &colour));
+	
+	ASSERT_TRUE(r.next_comment(&offset, &length, &text));
+	EXPECT_EQ(offset, 20);
+	EXPECT_EQ(length, 1);
+	EXPECT_EQ(text, "last");
+	
+	EXPECT_FALSE(r.next_comment(&offset, &length, &text));
+}
+
+TEST(BinaryMetadata, HighlightsOnly)
+{
+	{
+		BinaryMetadataWriter w(TMPFILE);
+		w.add_highlight(1, 2, 3);
+		w.finish();
+	}
+	
+	BinaryMetadataReader r(TMPFILE);
+	
+	EXPECT_EQ(r.comment_count(), 0U);
+	EXPECT_EQ(r.highlight_count(), 1U);
+	
+	off_t offset, length;
+	std::string text;
+	int colour;
+	
+	EXPECT_FALSE(r.next_comment(&offset, &length, &text));
+	
+	ASSERT_TRUE(r.next_highlight(&offset, &length, &colour));
+	EXPECT_EQ(offset, 1);
+	EXPECT_EQ(length, 2);
+	EXPECT_EQ(colour, 3);
+}
+
+TEST(BinaryMetadata, Seek)
+{
+	/* Enough records to span several index entries. */
+	
+	const off_t N_RECORDS = 2000;
+	
+	{
+		BinaryMetadataWriter w(TMPFILE);
+		
+		for(off_t i = 0; i < N_RECORDS; ++i)
+		{
+			std::string text = std::to_string(i * 10);
+			w.add_comment((i * 10), 5, text.data(), text.size());
+		}
+		
+		for(off_t i = 0; i < N_RECORDS; ++i)
+		{
+			w.add_highlight((i * 3), 2, (i % 10));
+		}
+		
+		w.finish();
+	}
+	
+	BinaryMetadataReader r(TMPFILE);
+	
+	EXPECT_EQ(r.comment_count(),   (uint64_t)(N_RECORDS));
+	EXPECT_EQ(r.highlight_count(), (uint64_t)(N_RECORDS));
+	
+	off_t offset, length;
+	std::string text;
+	int colour;
+	
+	r.seek_comments(12345);
+	
+	ASSERT_TRUE(r.next_comment(&offset, &length, &text));
+	EXPECT_EQ(offset, 12350) << "seek_comments() finds the first record after an offset between records";
+	EXPECT_EQ(text, "12350");
+	
+	r.seek_comments(2560);
+	
+	ASSERT_TRUE(r.next_comment(&offset, &length, &text));
+	EXPECT_EQ(offset, 2560) << "seek_comments() finds a record exactly on an index boundary";
+	
+	ASSERT_TRUE(r.next_comment(&offset, &length, &text));
+	EXPECT_EQ(offset, 2570) << "next_comment() continues on from a seek";
+	
+	r.seek_comments(0);
+	
+	ASSERT_TRUE(r.next_comment(&offset, &length, &text));
+	EXPECT_EQ(offset, 0) << "seek_comments() can seek backwards";
+	
+	r.seek_comments(N_RECORDS * 10);
+	
+	EXPECT_FALSE(r.next_comment(&offset, &length, &text)) << "seek_comments() past the last record reaches the end";
+	
+	r.seek_highlights(5000);
+	
+	ASSERT_TRUE(r.next_highlight(&offset, &length, &colour));
+	EXPECT_EQ(offset, 5001);
+	EXPECT_EQ(colour, (5001 / 3) % 10);
+	
+	off_t n_read = 1;
+	while(r.next_highlight(&offset, &length, &colour))
+	{
+		++n_read;
+	}
+	
+	EXPECT_EQ(n_read, N_RECORDS - (5001 / 3)) << "next_highlight() reads every record after a seek";
+}
+
+TEST(BinaryMetadata, NotBinary)
+{
+	const char *JSON = "{\"comments\": [], \"highlights\": []}";
+	write_file(TMPFILE, std::vector<unsigned char>(JSON, JSON + strlen(JSON)));
+	
+	EXPECT_FALSE(BinaryMetadataReader::is_binary_metadata(TMPFILE));
+	EXPECT_THROW(BinaryMetadataReader r(TMPFILE), std::runtime_error);
+}
+
+TEST(BinaryMetadata, Truncated)
+{
+	{
+		BinaryMetadataWriter w(TMPFILE);
+		w.add_comment(0, 1, "x", 1);
+		w.add_highlight(0, 1, 1);
+		w.finish();
+	}
+	
+	std::vector<unsigned char> data = read_file(TMPFILE);
+	
+	/* Chop off the end of the file - the header is still valid, so the file is recognised,
+	 * but the reader should refuse to load it.
+	*/
+	
+	for(size_t len = 16; len < data.size(); ++len)
+	{
+		write_file(TMPFILE, std::vector<unsigned char>(data.begin(), data.begin() + len));
+		
+		EXPECT_TRUE(BinaryMetadataReader::is_binary_metadata(TMPFILE));
+		EXPECT_THROW(BinaryMetadataReader r(TMPFILE), std::runtime_error) << "BinaryMetadataReader rejects file truncated to " << len << " bytes";
+	}
+}
+
+TEST(BinaryMetadata, Unfinished)
+{
+	{
+		BinaryMetadataWriter w(TMPFILE);
+		w.add_comment(0, 1, "x", 1);
+		
+		/* Destroyed without calling finish() */
+	}
+	
+	EXPECT_THROW(BinaryMetadataReader r(TMPFILE), std::runtime_error);
+}
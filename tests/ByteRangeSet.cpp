@@ -16,8 +16,10 @@
 */
 
 #include "../src/platform.hpp"
+#include <chrono>
 #include <gtest/gtest.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "../src/ByteRangeSet.hpp"
 
@@ -693,6 +695,32 @@ TEST(ByteRangeSet, IsSetNoRanges)
 	EXPECT_FALSE(brs.isset(10));
 }
 
+TEST(ByteRangeSet, FindFirstIn)
+{
+	ByteRangeSet brs;
+	
+	brs.set_range(10, 10);
+	brs.set_range(30, 10);
+	brs.set_range(50, 10);
+	
+	EXPECT_EQ(brs.find_first_in(0, 10), brs.end()) << "find_first_in() returns end() when range is before set ranges";
+	EXPECT_EQ(brs.find_first_in(20, 10), brs.end()) << "find_first_in() returns end() when range is between set ranges";
+	EXPECT_EQ(brs.find_first_in(60, 10), brs.end()) << "find_first_in() returns end() when range is after set ranges";
+	
+	EXPECT_EQ(brs.find_first_in(0, 11), brs.begin()) << "find_first_in() finds range overlapping end of search range";
+	EXPECT_EQ(brs.find_first_in(15, 2), brs.begin()) << "find_first_in() finds range containing search range";
+	EXPECT_EQ(brs.find_first_in(19, 40), brs.begin()) << "find_first_in() finds first of many ranges in search range";
+	EXPECT_EQ(brs.find_first_in(20, 40), std::next(brs.begin())) << "find_first_in() skips range ending at start of search range";
+	EXPECT_EQ(brs.find_first_in(59, 1), std::next(brs.begin(), 2)) << "find_first_in() finds range overlapping start of search range";
+}
+
+TEST(ByteRangeSet, FindFirstInNoRanges)
+{
+	ByteRangeSet brs;
+	
+	EXPECT_EQ(brs.find_first_in(0, 100), brs.end());
+}
+
 TEST(ByteRangeSet, DataInsertedBeforeRanges)
 {
 	ByteRangeSet brs;
@@ -797,16 +825,20 @@ TEST(ByteRangeSet, DataInsertedIntoRange)
 	);
 }
 
-/* Tests ByteRangeSet::data_inserted() on a large enough set to use threading. */
+/* Tests ByteRangeSet::data_inserted() on a large set spread over many chunks. */
 TEST(ByteRangeSet, DataInsertedParallel)
 {
 	ByteRangeSet brs;
 	
 	/* Populate a reference vector with double the ranges necessary to trigger necessary to
 	 * trigger threading, then some change to check the remainder is handled properly.
+	 *
+	 * data_inserted() no longer uses threads, but the test still uses a set of the size
+	 * which did, to cover shifting ranges across many chunks.
 	*/
 	
-	const size_t N_RANGES = ByteRangeSet::DATA_INSERTED_THREAD_MIN * 2 + 5;
+	const size_t DATA_INSERTED_THREAD_MIN = 100000;
+	const size_t N_RANGES = DATA_INSERTED_THREAD_MIN * 2 + 5;
 	size_t next_range = 0;
 	
 	std::vector<ByteRangeSet::Range> ranges;
@@ -945,6 +977,92 @@ TEST(ByteRangeSet, DataErasedOverlappingMultipleRanges)
 	);
 }
 
+TEST(ByteRangeSet, DataReplacedShrink)
+{
+	ByteRangeSet brs;
+	
+	brs.set_range(10, 20);
+	brs.set_range(40, 10);
+	brs.set_range(60, 10);
+	
+	/* Replace 4 bytes with 1 at 5, 20, 44 and 70. */
+	brs.data_replaced(std::vector<off_t>({ 5, 20, 44, 70 }), 4, 1);
+	
+	EXPECT_RANGES(
+		ByteRangeSet::Range( 7, 10),
+		ByteRangeSet::Range(18,  6),
+		ByteRangeSet::Range(34,  4),
+		ByteRangeSet::Range(39,  2),
+		ByteRangeSet::Range(51, 10),
+	);
+}
+
+TEST(ByteRangeSet, DataReplacedGrow)
+{
+	ByteRangeSet brs;
+	
+	brs.set_range(10, 20);
+	brs.set_range(40, 10);
+	
+	/* Replace 2 bytes with 5 at 0, 14 and 30. */
+	brs.data_replaced(std::vector<off_t>({ 0, 14, 30 }), 2, 5);
+	
+	EXPECT_RANGES(
+		ByteRangeSet::Range(13,  4),
+		ByteRangeSet::Range(22, 14),
+		ByteRangeSet::Range(49, 10),
+	);
+}
+
+TEST(ByteRangeSet, DataReplacedMatchesEraseInsert)
+{
+	/* Check data_replaced() gives the same result as erasing and inserting each
+	 * replacement in turn for a bunch of pseudo-random sets and replacements.
+	*/
+	
+	unsigned int seed = 1;
+	auto next_rand = [&seed](unsigned int max)
+	{
+		seed = (seed * 1103515245U) + 12345U;
+		return (seed >> 16) % max;
+	};
+	
+	for(int i = 0; i < 200; ++i)
+	{
+		ByteRangeSet brs;
+		
+		for(off_t off = next_rand(8); off < 1000; off += next_rand(20) + 1)
+		{
+			off_t len = next_rand(20) + 1;
+			brs.set_range(off, len);
+			off += len;
+		}
+		
+		off_t old_length = next_rand(6);
+		off_t new_length = next_rand(6) + 1; /* data_inserted() splits ranges on zero-length inserts */
+		
+		std::vector<off_t> offsets;
+		for(off_t off = next_rand(10); off < 1000; off += old_length + next_rand(30) + 1)
+		{
+			offsets.push_back(off);
+		}
+		
+		ByteRangeSet expect = brs;
+		
+		for(size_t j = 0; j < offsets.size(); ++j)
+		{
+			off_t at = offsets[j] + ((off_t)(j) * (new_length - old_length));
+			
+			expect.data_erased(at, old_length);
+			expect.data_inserted(at, new_length);
+		}
+		
+		brs.data_replaced(offsets, old_length, new_length);
+		
+		EXPECT_EQ(brs.get_ranges(), expect.get_ranges()) << "ByteRangeSet::data_replaced() matches data_erased()/data_inserted() (iteration " << i << ")";
+	}
+}
+
 TEST(ByteRangeSet, IntersectionNoOverlap)
 {
 	const std::vector<ByteRangeSet::Range> RANGES_A = {
@@ -1156,3 +1274,464 @@ TEST(ByteRangeSet, IntersectionEmptySet)
 	EXPECT_EQ(ByteRangeSet::intersection( EMPTY_SET,     NON_EMPTY_SET ).get_ranges(), EMPTY_RANGE);
 	EXPECT_EQ(ByteRangeSet::intersection( EMPTY_SET,     EMPTY_SET     ).get_ranges(), EMPTY_RANGE);
 }
+
+TEST(ByteRangeSet, Union)
+{
+	const std::vector<ByteRangeSet::Range> RANGES_A = {
+		ByteRangeSet::Range( 10, 10),
+		ByteRangeSet::Range( 30, 20),
+		ByteRangeSet::Range( 70, 10),
+		ByteRangeSet::Range(150, 20),
+		ByteRangeSet::Range(250, 30),
+	};
+	
+	const ByteRangeSet SET_A(RANGES_A.begin(), RANGES_A.end());
+	
+	const std::vector<ByteRangeSet::Range> RANGES_B = {
+		/* Adjacent */
+		ByteRangeSet::Range( 20, 10),
+		
+		/* No overlap */
+		ByteRangeSet::Range(100, 10),
+		
+		/* Partial overlap */
+		ByteRangeSet::Range(160, 20),
+		
+		/* Subset */
+		ByteRangeSet::Range(260, 5),
+		
+		/* After all of A */
+		ByteRangeSet::Range(300, 10),
+	};
+	
+	const ByteRangeSet SET_B(RANGES_B.begin(), RANGES_B.end());
+	
+	const std::vector<ByteRangeSet::Range> UNION = {
+		ByteRangeSet::Range( 10, 40),
+		ByteRangeSet::Range( 70, 10),
+		ByteRangeSet::Range(100, 10),
+		ByteRangeSet::Range(150, 30),
+		ByteRangeSet::Range(250, 30),
+		ByteRangeSet::Range(300, 10),
+	};
+	
+	EXPECT_EQ(ByteRangeSet::set_union(SET_A, SET_B).get_ranges(), UNION);
+	EXPECT_EQ(ByteRangeSet::set_union(SET_B, SET_A).get_ranges(), UNION);
+	
+	ByteRangeSet set = SET_A;
+	set.union_with(SET_B);
+	
+	EXPECT_EQ(set.get_ranges(), UNION);
+}
+
+TEST(ByteRangeSet, UnionEmptySet)
+{
+	const std::vector<ByteRangeSet::Range> NON_EMPTY_RANGE = {
+		ByteRangeSet::Range(10, 10),
+	};
+	
+	const ByteRangeSet NON_EMPTY_SET(NON_EMPTY_RANGE.begin(), NON_EMPTY_RANGE.end());
+	
+	const std::vector<ByteRangeSet::Range> EMPTY_RANGE = {};
+	const ByteRangeSet EMPTY_SET;
+	
+	EXPECT_EQ(ByteRangeSet::set_union( NON_EMPTY_SET, EMPTY_SET     ).get_ranges(), NON_EMPTY_RANGE);
+	EXPECT_EQ(ByteRangeSet::set_union( EMPTY_SET,     NON_EMPTY_SET ).get_ranges(), NON_EMPTY_RANGE);
+	EXPECT_EQ(ByteRangeSet::set_union( EMPTY_SET,     EMPTY_SET     ).get_ranges(), EMPTY_RANGE);
+}
+
+TEST(ByteRangeSet, Difference)
+{
+	const std::vector<ByteRangeSet::Range> RANGES_A = {
+		/* No overlap */
+		ByteRangeSet::Range( 10, 10),
+		
+		/* Partial overlap */
+		ByteRangeSet::Range( 50, 20),
+		ByteRangeSet::Range( 90, 20),
+		
+		/* Hole punched in the middle */
+		ByteRangeSet::Range(150, 30),
+		
+		/* Exact match */
+		ByteRangeSet::Range(200, 10),
+		
+		/* One range in B spanning several */
+		ByteRangeSet::Range(300, 10),
+		ByteRangeSet::Range(320, 10),
+		ByteRangeSet::Range(340, 10),
+	};
+	
+	const ByteRangeSet SET_A(RANGES_A.begin(), RANGES_A.end());
+	
+	const std::vector<ByteRangeSet::Range> RANGES_B = {
+		ByteRangeSet::Range( 30, 10),
+		ByteRangeSet::Range( 40, 15),
+		ByteRangeSet::Range(100, 20),
+		ByteRangeSet::Range(160,  5),
+		ByteRangeSet::Range(170,  2),
+		ByteRangeSet::Range(200, 10),
+		ByteRangeSet::Range(305, 40),
+	};
+	
+	const ByteRangeSet SET_B(RANGES_B.begin(), RANGES_B.end());
+	
+	const std::vector<ByteRangeSet::Range> DIFFERENCE = {
+		ByteRangeSet::Range( 10, 10),
+		ByteRangeSet::Range( 55, 15),
+		ByteRangeSet::Range( 90, 10),
+		ByteRangeSet::Range(150, 10),
+		ByteRangeSet::Range(165,  5),
+		ByteRangeSet::Range(172,  8),
+		ByteRangeSet::Range(300,  5),
+		ByteRangeSet::Range(345,  5),
+	};
+	
+	EXPECT_EQ(ByteRangeSet::difference(SET_A, SET_B).get_ranges(), DIFFERENCE);
+	
+	ByteRangeSet set = SET_A;
+	set.subtract(SET_B);
+	
+	EXPECT_EQ(set.get_ranges(), DIFFERENCE);
+}
+
+TEST(ByteRangeSet, DifferenceEmptySet)
+{
+	const std::vector<ByteRangeSet::Range> NON_EMPTY_RANGE = {
+		ByteRangeSet::Range(10, 10),
+	};
+	
+	const ByteRangeSet NON_EMPTY_SET(NON_EMPTY_RANGE.begin(), NON_EMPTY_RANGE.end());
+	
+	const std::vector<ByteRangeSet::Range> EMPTY_RANGE = {};
+	const ByteRangeSet EMPTY_SET;
+	
+	EXPECT_EQ(ByteRangeSet::difference( NON_EMPTY_SET, EMPTY_SET     ).get_ranges(), NON_EMPTY_RANGE);
+	EXPECT_EQ(ByteRangeSet::difference( EMPTY_SET,     NON_EMPTY_SET ).get_ranges(), EMPTY_RANGE);
+	EXPECT_EQ(ByteRangeSet::difference( NON_EMPTY_SET, NON_EMPTY_SET ).get_ranges(), EMPTY_RANGE);
+}
+
+TEST(ByteRangeSet, Complement)
+{
+	const std::vector<ByteRangeSet::Range> RANGES = {
+		ByteRangeSet::Range(10, 10),
+		ByteRangeSet::Range(30, 10),
+		ByteRangeSet::Range(50, 10),
+	};
+	
+	const ByteRangeSet SET(RANGES.begin(), RANGES.end());
+	
+	const std::vector<ByteRangeSet::Range> ALL = {
+		ByteRangeSet::Range( 0, 10),
+		ByteRangeSet::Range(20, 10),
+		ByteRangeSet::Range(40, 10),
+		ByteRangeSet::Range(60, 40),
+	};
+	
+	EXPECT_EQ(SET.complement(0, 100).get_ranges(), ALL);
+	
+	const std::vector<ByteRangeSet::Range> WITHIN = {
+		ByteRangeSet::Range(20, 10),
+		ByteRangeSet::Range(40, 5),
+	};
+	
+	EXPECT_EQ(SET.complement(15, 30).get_ranges(), WITHIN);
+	
+	const std::vector<ByteRangeSet::Range> EMPTY_RANGE = {};
+	
+	EXPECT_EQ(SET.complement(32, 5).get_ranges(), EMPTY_RANGE);
+	EXPECT_EQ(ByteRangeSet().complement(5, 10).get_ranges(), std::vector<ByteRangeSet::Range>({ ByteRangeSet::Range(5, 10) }));
+}
+
+TEST(ByteRangeSet, SetOperationsMatchBitmap)
+{
+	/* Check the set operations against a bitmap for random sets of various sizes, including
+	 * in-place operations with a much smaller set, which are applied one range at a time.
+	*/
+	
+	const off_t BITMAP_SIZE = 200000;
+	
+	auto random_set = [&](int n_ranges, std::vector<bool> *bitmap)
+	{
+		ByteRangeSet set;
+		bitmap->assign(BITMAP_SIZE, false);
+		
+		for(int i = 0; i < n_ranges; ++i)
+		{
+			off_t offset = rand() % (BITMAP_SIZE - 100);
+			off_t length = 1 + (rand() % 50);
+			
+			set.set_range(offset, length);
+			std::fill((bitmap->begin() + offset), (bitmap->begin() + offset + length), true);
+		}
+		
+		return set;
+	};
+	
+	auto set_bitmap = [&](const ByteRangeSet &set)
+	{
+		std::vector<bool> bitmap(BITMAP_SIZE, false);
+		
+		for(auto r = set.begin(); r != set.end(); ++r)
+		{
+			std::fill((bitmap.begin() + r->offset), (bitmap.begin() + r->offset + r->length), true);
+		}
+		
+		return bitmap;
+	};
+	
+	srand(0);
+	
+	const int SIZES[][2] = {
+		{ 5000, 5000 },
+		{ 5000,   50 },
+		{   50, 5000 },
+	};
+	
+	for(auto s = std::begin(SIZES); s != std::end(SIZES); ++s)
+	{
+		std::vector<bool> bitmap_a, bitmap_b;
+		ByteRangeSet a = random_set((*s)[0], &bitmap_a);
+		ByteRangeSet b = random_set((*s)[1], &bitmap_b);
+		
+		std::vector<bool> bm_union(BITMAP_SIZE), bm_intersection(BITMAP_SIZE), bm_difference(BITMAP_SIZE), bm_complement(BITMAP_SIZE);
+		
+		for(off_t i = 0; i < BITMAP_SIZE; ++i)
+		{
+			bm_union[i]        = bitmap_a[i] || bitmap_b[i];
+			bm_intersection[i] = bitmap_a[i] && bitmap_b[i];
+			bm_difference[i]   = bitmap_a[i] && !bitmap_b[i];
+			bm_complement[i]   = !bitmap_a[i];
+		}
+		
+		EXPECT_EQ(set_bitmap(ByteRangeSet::set_union(a, b)), bm_union);
+		EXPECT_EQ(set_bitmap(ByteRangeSet::intersection(a, b)), bm_intersection);
+		EXPECT_EQ(set_bitmap(ByteRangeSet::difference(a, b)), bm_difference);
+		EXPECT_EQ(set_bitmap(a.complement(0, BITMAP_SIZE)), bm_complement);
+		
+		ByteRangeSet u = a;
+		u.union_with(b);
+		EXPECT_EQ(set_bitmap(u), bm_union);
+		EXPECT_EQ(u.get_ranges(), ByteRangeSet::set_union(a, b).get_ranges());
+		
+		ByteRangeSet i = a;
+		i.intersect_with(b);
+		EXPECT_EQ(set_bitmap(i), bm_intersection);
+		
+		ByteRangeSet d = a;
+		d.subtract(b);
+		EXPECT_EQ(set_bitmap(d), bm_difference);
+	}
+}
+
+TEST(ByteRangeSet, ManyRangesMatchBitmap)
+{
+	/* Apply lots of random operations to a set with enough ranges to be split over many
+	 * chunks and check it always matches a simple bitmap.
+	*/
+	
+	const off_t BITMAP_SIZE = 100000;
+	
+	ByteRangeSet brs;
+	std::vector<bool> bitmap(BITMAP_SIZE, false);
+	
+	srand(0);
+	
+	for(int i = 0; i < 20000; ++i)
+	{
+		int op = rand() % 10;
+		
+		off_t offset = rand() % (BITMAP_SIZE - 1000);
+		off_t length = 1 + (rand() % ((op == 0) ? 1000 : 20));
+		
+		if(op < 6)
+		{
+			brs.set_range(offset, length);
+			std::fill((bitmap.begin() + offset), (bitmap.begin() + offset + length), true);
+		}
+		else if(op < 8)
+		{
+			brs.clear_range(offset, length);
+			std::fill((bitmap.begin() + offset), (bitmap.begin() + offset + length), false);
+		}
+		else if(op == 8)
+		{
+			brs.data_inserted(offset, length);
+			bitmap.insert((bitmap.begin() + offset), length, false);
+			bitmap.resize(BITMAP_SIZE);
+			brs.clear_range(BITMAP_SIZE, length);
+		}
+		else{
+			brs.data_erased(offset, length);
+			bitmap.erase((bitmap.begin() + offset), (bitmap.begin() + offset + length));
+			bitmap.resize(BITMAP_SIZE, false);
+		}
+		
+		if((i % 500) != 0)
+		{
+			continue;
+		}
+		
+		std::vector<ByteRangeSet::Range> ranges = brs.get_ranges();
+		std::vector<bool> got(BITMAP_SIZE, false);
+		
+		ASSERT_EQ(ranges.size(), brs.size());
+		
+		size_t idx = 0;
+		for(auto r = brs.begin(); r != brs.end(); ++r, ++idx)
+		{
+			ASSERT_EQ(*r, ranges[idx]) << "Iteration matches get_ranges() (operation " << i << ")";
+			ASSERT_EQ(brs[idx], ranges[idx]) << "operator[] matches get_ranges() (operation " << i << ")";
+			
+			ASSERT_GT(r->length, 0);
+			ASSERT_TRUE(idx == 0 || (ranges[idx - 1].offset + ranges[idx - 1].length) <= r->offset) << "Ranges are in order and don't overlap (operation " << i << ")";
+			
+			std::fill((got.begin() + r->offset), (got.begin() + r->offset + r->length), true);
+		}
+		
+		ASSERT_EQ(got, bitmap) << "Set matches bitmap (operation " << i << ")";
+		
+		for(off_t off = 0; off < BITMAP_SIZE; off += 97)
+		{
+			ASSERT_EQ(brs.isset(off), bitmap[off]) << "isset(" << off << ") matches bitmap (operation " << i << ")";
+		}
+	}
+}
+
+TEST(ByteRangeSet, DISABLED_SetRangeBenchmark)
+{
+	/* Add a million ranges in an order which puts each one in the middle of the set, as when
+	 * strings are found in blocks of a large file processed out of order.
+	*/
+	
+	const off_t N_RANGES = 1000000;
+	
+	ByteRangeSet brs;
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	for(off_t i = 0; i < N_RANGES; ++i)
+	{
+		off_t base = ((i * 7919) % N_RANGES) * 16;
+		brs.set_range(base, 8);
+	}
+	
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	printf("ByteRangeSet::set_range() added %lld ranges in %lldms\n", (long long)(N_RANGES), (long long)(elapsed.count()));
+	
+	ASSERT_EQ(brs.size(), (size_t)(N_RANGES));
+	
+	EXPECT_EQ(brs[0], ByteRangeSet::Range(0, 8));
+	EXPECT_EQ(brs[N_RANGES / 2], ByteRangeSet::Range(((N_RANGES / 2) * 16), 8));
+	EXPECT_EQ(brs[N_RANGES - 1], ByteRangeSet::Range(((N_RANGES - 1) * 16), 8));
+	
+	start = std::chrono::steady_clock::now();
+	
+	for(off_t i = 0; i < N_RANGES; i += 2)
+	{
+		off_t base = ((i * 7919) % N_RANGES) * 16;
+		brs.clear_range(base, 8);
+	}
+	
+	elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	printf("ByteRangeSet::clear_range() removed %lld ranges in %lldms\n", (long long)(N_RANGES / 2), (long long)(elapsed.count()));
+	
+	EXPECT_EQ(brs.size(), (size_t)(N_RANGES / 2));
+}
+
+TEST(ByteRangeSet, DISABLED_DataInsertedBenchmark)
+{
+	/* Type a thousand characters near the start of a file with a million strings. */
+	
+	const off_t N_RANGES = 1000000;
+	
+	std::vector<ByteRangeSet::Range> ranges;
+	ranges.reserve(N_RANGES);
+	
+	for(off_t i = 0; i < N_RANGES; ++i)
+	{
+		ranges.push_back(ByteRangeSet::Range((i * 16), 8));
+	}
+	
+	ByteRangeSet brs(ranges.begin(), ranges.end());
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	for(off_t i = 0; i < 1000; ++i)
+	{
+		brs.data_inserted((1000 + i), 1);
+	}
+	
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	printf("ByteRangeSet::data_inserted() called 1000 times in %lldms\n", (long long)(elapsed.count()));
+	
+	for(off_t i = 0; i < 1000; ++i)
+	{
+		brs.data_erased(1000, 1);
+	}
+	
+	EXPECT_EQ(brs.get_ranges(), ranges) << "ByteRangeSet::data_erased() reverses ByteRangeSet::data_inserted()";
+}
+
+TEST(ByteRangeSet, DISABLED_SetOperationsBenchmark)
+{
+	/* Combine two sets of a million ranges each, interleaved so every range in one set
+	 * overlaps ranges in the other, using the set operations and the equivalent loops over
+	 * set_range() and clear_range().
+	*/
+	
+	const off_t N_RANGES = 1000000;
+	
+	std::vector<ByteRangeSet::Range> ranges_a, ranges_b;
+	ranges_a.reserve(N_RANGES);
+	ranges_b.reserve(N_RANGES);
+	
+	for(off_t i = 0; i < N_RANGES; ++i)
+	{
+		ranges_a.push_back(ByteRangeSet::Range((i * 32), 16));
+		ranges_b.push_back(ByteRangeSet::Range((i * 32) + 8, 16));
+	}
+	
+	const ByteRangeSet a(ranges_a.begin(), ranges_a.end());
+	const ByteRangeSet b(ranges_b.begin(), ranges_b.end());
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	ByteRangeSet loop_union = a;
+	for(auto r = b.begin(); r != b.end(); ++r)
+	{
+		loop_union.set_range(r->offset, r->length);
+	}
+	
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	printf("Union of %lld ranges using ByteRangeSet::set_range() took %lldms\n", (long long)(N_RANGES), (long long)(elapsed.count()));
+	
+	start = std::chrono::steady_clock::now();
+	
+	ByteRangeSet merge_union = ByteRangeSet::set_union(a, b);
+	
+	elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	printf("Union of %lld ranges using ByteRangeSet::set_union() took %lldms\n", (long long)(N_RANGES), (long long)(elapsed.count()));
+	
+	EXPECT_EQ(merge_union.get_ranges(), loop_union.get_ranges());
+	
+	start = std::chrono::steady_clock::now();
+	
+	ByteRangeSet loop_difference = a;
+	for(auto r = b.begin(); r != b.end(); ++r)
+	{
+		loop_difference.clear_range(r->offset, r->length);
+	}
+	
+	elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	printf("Difference of %lld ranges using ByteRangeSet::clear_range() took %lldms\n", (long long)(N_RANGES), (long long)(elapsed.count()));
+	
+	start = std::chrono::steady_clock::now();
+	
+	ByteRangeSet merge_difference = ByteRangeSet::difference(a, b);
+	
+	elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	printf("Difference of %lld ranges using ByteRangeSet::difference() took %lldms\n", (long long)(N_RANGES), (long long)(elapsed.count()));
+	
+	EXPECT_EQ(merge_difference.get_ranges(), loop_difference.get_ranges());
+}
@@ -0,0 +1,196 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "../src/platform.hpp"
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "../src/CompactByteRangeSet.hpp"
+
+using namespace REHex;
+
+/* Used by Google Test to print out Range values. */
+std::ostream& operator<<(std::ostream& os, const ByteRangeSet::Range& range);
+
+static std::vector<ByteRangeSet::Range> compact_ranges(const CompactByteRangeSet &set)
+{
+	return std::vector<ByteRangeSet::Range>(set.begin(), set.end());
+}
+
+TEST(CompactByteRangeSet, Empty)
+{
+	CompactByteRangeSet set;
+	
+	EXPECT_TRUE(set.empty());
+	EXPECT_EQ(set.size(), 0U);
+	EXPECT_TRUE(set.begin() == set.end());
+	EXPECT_FALSE(set.isset(0));
+	
+	CompactByteRangeSet from_empty((ByteRangeSet()));
+	EXPECT_TRUE(from_empty == set);
+}
+
+TEST(CompactByteRangeSet, FromByteRangeSet)
+{
+	ByteRangeSet brs;
+	brs.set_range(10, 10);
+	brs.set_range(30, 5);
+	brs.set_range(1000000000000LL, 200);
+	
+	CompactByteRangeSet set(brs);
+	
+	EXPECT_FALSE(set.empty());
+	EXPECT_EQ(set.size(), 3U);
+	EXPECT_EQ(compact_ranges(set), brs.get_ranges());
+	EXPECT_EQ(set.to_byte_range_set().get_ranges(), brs.get_ranges());
+}
+
+TEST(CompactByteRangeSet, AdjacentRangesMerged)
+{
+	const std::vector<ByteRangeSet::Range> RANGES = {
+		ByteRangeSet::Range(10, 10),
+		ByteRangeSet::Range(20, 10),
+		ByteRangeSet::Range(40, 10),
+	};
+	
+	CompactByteRangeSet set(RANGES.begin(), RANGES.end());
+	
+	const std::vector<ByteRangeSet::Range> EXPECT = {
+		ByteRangeSet::Range(10, 20),
+		ByteRangeSet::Range(40, 10),
+	};
+	
+	EXPECT_EQ(compact_ranges(set), EXPECT);
+}
+
+TEST(CompactByteRangeSet, IsSet)
+{
+	const std::vector<ByteRangeSet::Range> RANGES = {
+		ByteRangeSet::Range(10, 10),
+		ByteRangeSet::Range(30, 10),
+	};
+	
+	CompactByteRangeSet set(RANGES.begin(), RANGES.end());
+	
+	EXPECT_FALSE(set.isset(0));
+	EXPECT_FALSE(set.isset(9));
+	EXPECT_TRUE(set.isset(10));
+	EXPECT_TRUE(set.isset(19));
+	EXPECT_FALSE(set.isset(20));
+	EXPECT_FALSE(set.isset(29));
+	EXPECT_TRUE(set.isset(30));
+	EXPECT_TRUE(set.isset(39));
+	EXPECT_FALSE(set.isset(40));
+}
+
+TEST(CompactByteRangeSet, ManyRanges)
+{
+	/* Enough ranges with enough variety in gaps and lengths to cover many blocks and
+	 * multi-byte varints.
+	*/
+	
+	ByteRangeSet brs;
+	
+	srand(0);
+	
+	off_t offset = 0;
+	for(int i = 0; i < 10000; ++i)
+	{
+		offset += 1 + (rand() % ((i % 7) == 0 ? 1000000 : 100));
+		off_t length = 1 + (rand() % ((i % 5) == 0 ? 100000 : 10));
+		
+		brs.set_range(offset, length);
+		offset += length;
+	}
+	
+	CompactByteRangeSet set(brs);
+	
+	EXPECT_EQ(set.size(), brs.size());
+	EXPECT_EQ(compact_ranges(set), brs.get_ranges());
+	
+	EXPECT_LT(set.encoded_size(), (brs.size() * sizeof(ByteRangeSet::Range)) / 2)
+		<< "CompactByteRangeSet takes less than half the space of the ranges";
+	
+	for(off_t i = 0; i < offset + 10; i += 997)
+	{
+		ASSERT_EQ(set.isset(i), brs.isset(i)) << "isset(" << i << ") matches ByteRangeSet";
+	}
+	
+	for(auto r = brs.begin(); r != brs.end(); ++r)
+	{
+		ASSERT_TRUE(set.isset(r->offset));
+		ASSERT_TRUE(set.isset(r->offset + r->length - 1));
+		ASSERT_FALSE(set.isset(r->offset + r->length));
+		ASSERT_FALSE(set.isset(r->offset - 1));
+	}
+}
+
+TEST(CompactByteRangeSet, Merge)
+{
+	const std::vector<ByteRangeSet::Range> RANGES_A = {
+		ByteRangeSet::Range( 0, 10),
+		ByteRangeSet::Range(20, 10),
+		ByteRangeSet::Range(60, 10),
+		ByteRangeSet::Range(90, 10),
+	};
+	
+	const std::vector<ByteRangeSet::Range> RANGES_B = {
+		ByteRangeSet::Range(10,  5),
+		ByteRangeSet::Range(25, 20),
+		ByteRangeSet::Range(62,  2),
+		ByteRangeSet::Range(80,  5),
+	};
+	
+	CompactByteRangeSet a(RANGES_A.begin(), RANGES_A.end());
+	CompactByteRangeSet b(RANGES_B.begin(), RANGES_B.end());
+	
+	const std::vector<ByteRangeSet::Range> EXPECT = {
+		ByteRangeSet::Range( 0, 15),
+		ByteRangeSet::Range(20, 25),
+		ByteRangeSet::Range(60, 10),
+		ByteRangeSet::Range(80,  5),
+		ByteRangeSet::Range(90, 10),
+	};
+	
+	EXPECT_EQ(compact_ranges(CompactByteRangeSet::merge(a, b)), EXPECT);
+	EXPECT_EQ(compact_ranges(CompactByteRangeSet::merge(b, a)), EXPECT);
+	
+	EXPECT_TRUE(CompactByteRangeSet::merge(a, CompactByteRangeSet()) == a);
+	EXPECT_TRUE(CompactByteRangeSet::merge(CompactByteRangeSet(), b) == b);
+}
+
+TEST(CompactByteRangeSet, MergeManyRanges)
+{
+	ByteRangeSet brs_a, brs_b;
+	
+	srand(1);
+	
+	for(int i = 0; i < 5000; ++i)
+	{
+		brs_a.set_range((rand() % 1000000), (1 + rand() % 100));
+		brs_b.set_range((rand() % 1000000), (1 + rand() % 100));
+	}
+	
+	ByteRangeSet brs_merged = brs_a;
+	brs_merged.set_ranges(brs_b.begin(), brs_b.end());
+	
+	CompactByteRangeSet merged = CompactByteRangeSet::merge(CompactByteRangeSet(brs_a), CompactByteRangeSet(brs_b));
+	
+	EXPECT_EQ(compact_ranges(merged), brs_merged.get_ranges());
+}
@@ -23,6 +23,7 @@
 #include <vector>
 #include <wx/frame.h>
 
+#include "../src/BinaryMetadata.hpp"
 #include "../src/document.hpp"
 #include "../src/Events.hpp"
 
@@ -1036,3 +1037,325 @@ TEST_F(DocumentTest, EraseHighlightUndo)
 	
 	EXPECT_EQ(doc->get_highlights(), expect_highlights_post);
 }
+
+TEST_F(DocumentTest, ChangeSetCoalescesChanges)
+{
+	/* Preload document with data. */
+	doc->insert_data(0, (const unsigned char*)(IPSUM), strlen(IPSUM));
+	doc->flush_changeset();
+	
+	std::vector<std::string> changesets;
+	
+	doc->Bind(DOCUMENT_CHANGESET, [&](ChangeSetEvent &event)
+	{
+		std::string changeset_s = "DOCUMENT_CHANGESET(";
+		
+		for(auto r = event.data_modified.begin(); r != event.data_modified.end(); ++r)
+		{
+			char range_s[64];
+			snprintf(range_s, sizeof(range_s), "%d+%d, ", (int)(r->offset), (int)(r->length));
+			changeset_s += range_s;
+		}
+		
+		char tail_s[64];
+		snprintf(tail_s, sizeof(tail_s), "%d, %s, %s)",
+			(int)(event.resized_from),
+			(event.comments_modified   ? "comments"   : "-"),
+			(event.highlights_modified ? "highlights" : "-"));
+		
+		changesets.push_back(changeset_s + tail_s);
+	});
+	
+	doc->overwrite_data(10, "abcd", 4);
+	doc->overwrite_data(12, "efgh", 4);
+	doc->insert_data(40, (const unsigned char*)("ijkl"), 4);
+	doc->erase_data(4, 2);
+	ASSERT_TRUE(doc->set_highlight(50, 10, 0));
+	
+	EXPECT_TRUE(changesets.empty()) << "Document doesn't deliver change set until flushed";
+	
+	doc->flush_changeset();
+	
+	const std::vector<std::string> EXPECT_CHANGESETS = {
+		"DOCUMENT_CHANGESET(8+6, 38+4, 4, -, highlights)",
+	};
+	
+	EXPECT_EQ(changesets, EXPECT_CHANGESETS) << "Document delivers all changes in a single change set";
+	
+	changesets.clear();
+	doc->flush_changeset();
+	
+	EXPECT_TRUE(changesets.empty()) << "Document doesn't deliver empty change set";
+	
+	ASSERT_TRUE(doc->set_comment(0, 10, Document::Comment("hello")));
+	doc->flush_changeset();
+	
+	const std::vector<std::string> EXPECT_CHANGESETS2 = {
+		"DOCUMENT_CHANGESET(-1, comments, -)",
+	};
+	
+	EXPECT_EQ(changesets, EXPECT_CHANGESETS2) << "Document delivers comment changes in change set";
+}
+
+TEST(Document, RecoverFromJournal)
+{
+	const char *TMPFILE = "tests/.tmpfile";
+	const std::string JOURNAL = std::string(TMPFILE) + ".rehex-journal";
+	
+	{
+		FILE *fh = fopen(TMPFILE, "wb");
+		ASSERT_NE(fh, (FILE*)(NULL));
+		ASSERT_EQ(fwrite("0123456789ABCDEFGHIJ", 20, 1, fh), 1U);
+		fclose(fh);
+	}
+	
+	std::vector<unsigned char> journal_copy;
+	
+	{
+		Document doc(TMPFILE);
+		
+		EXPECT_FALSE(doc.has_recovery_journal());
+		
+		doc.overwrite_data(2, "ab", 2);
+		ASSERT_TRUE(doc.set_comment(4, 4, Document::Comment("hello")));
+		doc.insert_data(0, (const unsigned char*)("xyz"), 3);
+		ASSERT_TRUE(doc.set_highlight(10, 2, 1));
+		doc.erase_data(20, 2);
+		
+		doc.sync_recovery_journal();
+		
+		/* Take a copy of the journal, since it gets deleted when the document is closed. */
+		
+		FILE *fh = fopen(JOURNAL.c_str(), "rb");
+		ASSERT_NE(fh, (FILE*)(NULL));
+		
+		unsigned char buf[1024];
+		size_t len;
+		while((len = fread(buf, 1, sizeof(buf), fh)) > 0)
+		{
+			journal_copy.insert(journal_copy.end(), buf, buf + len);
+		}
+		
+		fclose(fh);
+	}
+	
+	{
+		FILE *fh = fopen(JOURNAL.c_str(), "wb");
+		ASSERT_NE(fh, (FILE*)(NULL));
+		ASSERT_EQ(fwrite(journal_copy.data(), journal_copy.size(), 1, fh), 1U);
+		fclose(fh);
+	}
+	
+	Document doc(TMPFILE);
+	
+	ASSERT_TRUE(doc.has_recovery_journal());
+	doc.recover_from_journal();
+	
+	std::vector<unsigned char> data = doc.read_data(0, 1024);
+	EXPECT_EQ(std::string((const char*)(data.data()), data.size()), "xyz01ab456789ABCDEFGJ") << "Data changes are recovered";
+	
+	auto comments = doc.get_comments();
+	ASSERT_EQ(comments.size(), 1U);
+	EXPECT_EQ(comments.begin()->first, NestedOffsetLengthMapKey(7, 4)) << "Comments are recovered";
+	EXPECT_EQ(*(comments.begin()->second.text), "hello");
+	
+	auto highlights = doc.get_highlights();
+	ASSERT_EQ(highlights.size(), 1U);
+	EXPECT_EQ(highlights.begin()->first, NestedOffsetLengthMapKey(10, 2)) << "Highlights are recovered";
+	EXPECT_EQ(highlights.begin()->second, 1);
+	
+	EXPECT_TRUE(doc.is_dirty()) << "Recovered document is dirty";
+}
+
+TEST(Document, RecoverJournalledMetadataChanges)
+{
+	const char *TMPFILE = "tests/.tmpfile";
+	const std::string JOURNAL = std::string(TMPFILE) + ".rehex-journal";
+	
+	{
+		FILE *fh = fopen(TMPFILE, "wb");
+		ASSERT_NE(fh, (FILE*)(NULL));
+		ASSERT_EQ(fwrite("0123456789ABCDEFGHIJ", 20, 1, fh), 1U);
+		fclose(fh);
+	}
+	
+	const std::string LONG_TEXT(1000, 'x');
+	const int N_EDITS = 5000;
+	
+	std::vector<unsigned char> journal_copy;
+	
+	{
+		Document doc(TMPFILE);
+		
+		ASSERT_TRUE(doc.set_comment(0, 4, Document::Comment("first")));
+		ASSERT_TRUE(doc.set_comment(8, 2, Document::Comment("second")));
+		ASSERT_TRUE(doc.erase_comment(0, 4));
+		
+		ASSERT_TRUE(doc.set_highlight(2, 2, 1));
+		ASSERT_TRUE(doc.set_highlight(12, 4, 2));
+		ASSERT_TRUE(doc.erase_highlight(2, 2));
+		
+		/* Change one comment enough times that the journal must be compacted to keep it
+		 * from growing with every change.
+		*/
+		for(int i = 0; i < N_EDITS; ++i)
+		{
+			ASSERT_TRUE(doc.set_comment(16, 2, Document::Comment(LONG_TEXT + std::to_string(i))));
+		}
+		
+		doc.sync_recovery_journal();
+		
+		FILE *fh = fopen(JOURNAL.c_str(), "rb");
+		ASSERT_NE(fh, (FILE*)(NULL));
+		
+		unsigned char buf[1024];
+		size_t len;
+		while((len = fread(buf, 1, sizeof(buf), fh)) > 0)
+		{
+			journal_copy.insert(journal_copy.end(), buf, buf + len);
+		}
+		
+		fclose(fh);
+		
+		EXPECT_LT(journal_copy.size(), (size_t)(2 * 1024 * 1024)) << "Journal is compacted";
+	}
+	
+	{
+		FILE *fh = fopen(JOURNAL.c_str(), "wb");
+		ASSERT_NE(fh, (FILE*)(NULL));
+		ASSERT_EQ(fwrite(journal_copy.data(), journal_copy.size(), 1, fh), 1U);
+		fclose(fh);
+	}
+	
+	Document doc(TMPFILE);
+	
+	ASSERT_TRUE(doc.has_recovery_journal());
+	doc.recover_from_journal();
+	
+	auto comments = doc.get_comments();
+	ASSERT_EQ(comments.size(), 2U);
+	
+	auto c = comments.begin();
+	EXPECT_EQ(c->first, NestedOffsetLengthMapKey(8, 2)) << "Comment changes are recovered";
+	EXPECT_EQ(*(c->second.text), "second");
+	
+	++c;
+	EXPECT_EQ(c->first, NestedOffsetLengthMapKey(16, 2)) << "Comment changes are recovered";
+	EXPECT_EQ(*(c->second.text), (LONG_TEXT + std::to_string(N_EDITS - 1)));
+	
+	auto highlights = doc.get_highlights();
+	ASSERT_EQ(highlights.size(), 1U);
+	EXPECT_EQ(highlights.begin()->first, NestedOffsetLengthMapKey(12, 4)) << "Highlight changes are recovered";
+	EXPECT_EQ(highlights.begin()->second, 2);
+}
+
+TEST(Document, JournalOwnedByOpenDocument)
+{
+	const char *TMPFILE = "tests/.tmpfile";
+	const std::string JOURNAL = std::string(TMPFILE) + ".rehex-journal";
+	
+	auto journal_exists = [&]()
+	{
+		FILE *fh = fopen(JOURNAL.c_str(), "rb");
+		if(fh != NULL)
+		{
+			fclose(fh);
+		}
+		
+		return fh != NULL;
+	};
+	
+	{
+		FILE *fh = fopen(TMPFILE, "wb");
+		ASSERT_NE(fh, (FILE*)(NULL));
+		ASSERT_EQ(fwrite("0123456789ABCDEFGHIJ", 20, 1, fh), 1U);
+		fclose(fh);
+	}
+	
+	Document doc1(TMPFILE);
+	
+	doc1.overwrite_data(2, "ab", 2);
+	doc1.sync_recovery_journal();
+	
+	ASSERT_TRUE(journal_exists());
+	
+	{
+		Document doc2(TMPFILE);
+		
+		EXPECT_FALSE(doc2.has_recovery_journal()) << "Journal of an open document isn't offered for recovery";
+		EXPECT_THROW(doc2.recover_from_journal(), std::runtime_error) << "Journal of an open document can't be recovered";
+		
+		doc2.discard_recovery_journal();
+		EXPECT_TRUE(journal_exists()) << "Journal of an open document isn't discarded";
+		
+		doc2.overwrite_data(4, "cd", 2);
+		doc2.sync_recovery_journal();
+	}
+	
+	EXPECT_TRUE(journal_exists()) << "Journal of an open document isn't overwritten or removed by another";
+	
+	doc1.sync_recovery_journal();
+}
+
+TEST(Document, BinaryMetadataOptIn)
+{
+	const char *TMPFILE = "tests/.tmpfile";
+	const std::string META = std::string(TMPFILE) + ".rehex-meta";
+	
+	const int N_HIGHLIGHTS = 12000;
+	
+	remove(META.c_str());
+	
+	{
+		std::vector<unsigned char> data(N_HIGHLIGHTS * 8);
+		
+		FILE *fh = fopen(TMPFILE, "wb");
+		ASSERT_NE(fh, (FILE*)(NULL));
+		ASSERT_EQ(fwrite(data.data(), data.size(), 1, fh), 1U);
+		fclose(fh);
+	}
+	
+	{
+		Document doc(TMPFILE);
+		
+		for(int i = 0; i < N_HIGHLIGHTS; ++i)
+		{
+			ASSERT_TRUE(doc.set_highlight((i * 8), 4, 1));
+		}
+		
+		doc.save();
+		
+		EXPECT_FALSE(doc.get_binary_metadata());
+		EXPECT_FALSE(BinaryMetadataReader::is_binary_metadata(META)) << "Metadata is saved as JSON unless binary is chosen";
+		
+		doc.set_binary_metadata(true);
+		EXPECT_TRUE(doc.is_dirty()) << "Choosing binary metadata marks the document dirty";
+		
+		doc.save();
+		
+		EXPECT_TRUE(BinaryMetadataReader::is_binary_metadata(META)) << "Metadata is saved as binary once chosen";
+	}
+	
+	{
+		Document doc(TMPFILE);
+		
+		EXPECT_TRUE(doc.get_binary_metadata()) << "Binary metadata is saved back as binary";
+		EXPECT_EQ(doc.get_highlights().size(), (size_t)(N_HIGHLIGHTS));
+	}
+	
+	{
+		FILE *fh = fopen(META.c_str(), "wb");
+		ASSERT_NE(fh, (FILE*)(NULL));
+		ASSERT_EQ(fwrite("REHEXMD\0\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF", 16, 1, fh), 1U);
+		fclose(fh);
+	}
+	
+	{
+		Document doc(TMPFILE);
+		
+		EXPECT_FALSE(doc.get_binary_metadata()) << "Binary metadata which can't be loaded isn't saved back as binary";
+		EXPECT_EQ(doc.get_highlights().size(), 0U);
+	}
+	
+	remove(META.c_str());
+}
@@ -0,0 +1,261 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#undef NDEBUG
+#include "../src/platform.hpp"
+#include <assert.h>
+
+#include <algorithm>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "../src/NGramIndex.hpp"
+
+using namespace REHex;
+
+#define TMPFILE  "tests/.tmpfile"
+
+static void write_file(const std::vector<unsigned char> &data)
+{
+	FILE *tmp = fopen(TMPFILE, "wb");
+	assert(tmp != NULL);
+	assert(data.empty() || fwrite(data.data(), data.size(), 1, tmp) == 1);
+	fclose(tmp);
+}
+
+static void build_index(unsigned sample_stride = NGramIndex::DEFAULT_SAMPLE_STRIDE)
+{
+	NGramIndex::Builder builder(TMPFILE, sample_stride);
+	ASSERT_TRUE(builder.finish());
+	EXPECT_EQ(builder.progress(), 1.0);
+}
+
+/* Every position from begin to end where pattern occurs in data. */
+static std::vector<off_t> naive_find_all(const std::vector<unsigned char> &data, const std::vector<unsigned char> &pattern, off_t begin, off_t end)
+{
+	std::vector<off_t> matches;
+	
+	for(off_t at = begin; at < end && (at + (off_t)(pattern.size())) <= (off_t)(data.size()); ++at)
+	{
+		if(memcmp((data.data() + at), pattern.data(), pattern.size()) == 0)
+		{
+			matches.push_back(at);
+		}
+	}
+	
+	return matches;
+}
+
+/* Check the candidates are in order and include every match. */
+static void check_candidates(const std::vector<off_t> &candidates, const std::vector<off_t> &matches)
+{
+	EXPECT_TRUE(std::is_sorted(candidates.begin(), candidates.end()));
+	EXPECT_TRUE(std::includes(candidates.begin(), candidates.end(), matches.begin(), matches.end())) << "Every match is a candidate";
+}
+
+TEST(NGramIndex, FindsMatches)
+{
+	std::vector<unsigned char> data(100000);
+	srand(1);
+	std::generate(data.begin(), data.end(), []() { return rand() & 0xFF; });
+	
+	std::vector<unsigned char> pattern = { 'H', 'e', 'l', 'l', 'o', ',', ' ', 'w', 'o', 'r', 'l', 'd', ' ', 'o', 'f', ' ', 'i', 'n', 'd', 'e', 'x' };
+	std::vector<unsigned char> other = { 'S', 'o', 'm', 'e', 't', 'h', 'i', 'n', 'g', ' ', 'e', 'l', 's', 'e', ' ', 'e', 'n', 't', 'i', 'r', 'e' };
+	
+	for(off_t at : { 0, 100, 5000, 5030, 65535, 99979 })
+	{
+		std::copy(pattern.begin(), pattern.end(), (data.begin() + at));
+	}
+	
+	std::copy(other.begin(), other.end(), (data.begin() + 80000));
+	
+	write_file(data);
+	build_index();
+	
+	std::shared_ptr<NGramIndex> index = NGramIndex::open(TMPFILE);
+	ASSERT_NE(index, nullptr);
+	
+	EXPECT_EQ(index->min_pattern_length(), (NGramIndex::NGRAM_LENGTH + NGramIndex::DEFAULT_SAMPLE_STRIDE - 1));
+	
+	std::vector<off_t> candidates;
+	
+	ASSERT_TRUE(index->find({ pattern }, 0, data.size(), candidates));
+	check_candidates(candidates, std::vector<off_t>({ 0, 100, 5000, 5030, 65535, 99979 }));
+	EXPECT_LT(candidates.size(), 50U) << "Random data doesn't produce many other candidates";
+	
+	ASSERT_TRUE(index->find({ pattern }, 100, 5001, candidates));
+	check_candidates(candidates, std::vector<off_t>({ 100, 5000 }));
+	
+	for(auto c = candidates.begin(); c != candidates.end(); ++c)
+	{
+		EXPECT_GE(*c, 100) << "Candidates are limited to the range";
+		EXPECT_LT(*c, 5001) << "Candidates are limited to the range";
+	}
+	
+	ASSERT_TRUE(index->find({ pattern, other }, 0, data.size(), candidates));
+	check_candidates(candidates, std::vector<off_t>({ 0, 100, 5000, 5030, 65535, 80000, 99979 }));
+	
+	ASSERT_FALSE(index->find({ std::vector<unsigned char>(pattern.begin(), (pattern.begin() + index->min_pattern_length() - 1)) }, 0, data.size(), candidates))
+		<< "Patterns which are too short can't be found";
+	
+	remove(NGramIndex::index_filename(TMPFILE).c_str());
+}
+
+TEST(NGramIndex, MatchesNaiveSearch)
+{
+	/* Data with few distinct bytes, so most positions are candidates for some patterns. */
+	
+	std::vector<unsigned char> data(300000);
+	srand(2);
+	std::generate(data.begin(), data.end(), []() { return "ab"[rand() % 2]; });
+	
+	write_file(data);
+	
+	for(unsigned sample_stride : { 1, 4, 8 })
+	{
+		build_index(sample_stride);
+		
+		std::shared_ptr<NGramIndex> index = NGramIndex::open(TMPFILE);
+		ASSERT_NE(index, nullptr);
+		
+		for(int i = 0; i < 200; ++i)
+		{
+			size_t len = index->min_pattern_length() + (rand() % 8);
+			off_t from = rand() % (data.size() - len);
+			
+			std::vector<unsigned char> pattern((data.begin() + from), (data.begin() + from + len));
+			
+			off_t begin = rand() % data.size();
+			off_t end   = begin + (rand() % (data.size() - begin + 1));
+			
+			std::vector<off_t> candidates;
+			if(index->find({ pattern }, begin, end, candidates))
+			{
+				check_candidates(candidates, naive_find_all(data, pattern, begin, end));
+				
+				for(auto c = candidates.begin(); c != candidates.end(); ++c)
+				{
+					EXPECT_GE(*c, begin);
+					EXPECT_LT(*c, end);
+				}
+			}
+		}
+	}
+	
+	remove(NGramIndex::index_filename(TMPFILE).c_str());
+}
+
+TEST(NGramIndex, LargeFile)
+{
+	/* Spans several segments, with a match straddling the boundary between two. */
+	
+	std::vector<unsigned char> data((NGramIndex::SEGMENT_SIZE * 2) + 1000, 0);
+	
+	std::vector<unsigned char> pattern = { 'T', 'h', 'i', 's', ' ', 'i', 's', ' ', 'a', ' ', 'l', 'o', 'n', 'g', ' ', 'p', 'a', 't', 't', 'e', 'r', 'n', '!' };
+	
+	for(off_t at : { (off_t)(7), (NGramIndex::SEGMENT_SIZE - 11), (NGramIndex::SEGMENT_SIZE * 2) + 977 })
+	{
+		std::copy(pattern.begin(), pattern.end(), (data.begin() + at));
+	}
+	
+	write_file(data);
+	build_index();
+	
+	std::shared_ptr<NGramIndex> index = NGramIndex::open(TMPFILE);
+	ASSERT_NE(index, nullptr);
+	
+	std::vector<off_t> candidates;
+	
+	ASSERT_TRUE(index->find({ pattern }, 0, data.size(), candidates));
+	check_candidates(candidates, std::vector<off_t>({ 7, (NGramIndex::SEGMENT_SIZE - 11), (NGramIndex::SEGMENT_SIZE * 2) + 977 }));
+	EXPECT_LT(candidates.size(), 50U);
+	
+	ASSERT_TRUE(index->find({ pattern }, NGramIndex::SEGMENT_SIZE, data.size(), candidates));
+	check_candidates(candidates, std::vector<off_t>({ (NGramIndex::SEGMENT_SIZE * 2) + 977 }));
+	EXPECT_GE(candidates.front(), (off_t)(NGramIndex::SEGMENT_SIZE));
+	
+	EXPECT_FALSE(index->find({ std::vector<unsigned char>(20, 0) }, 0, data.size(), candidates))
+		<< "Index isn't used for patterns which are too common";
+	
+	remove(NGramIndex::index_filename(TMPFILE).c_str());
+}
+
+TEST(NGramIndex, Stale)
+{
+	write_file(std::vector<unsigned char>(1000, 'x'));
+	
+	EXPECT_EQ(NGramIndex::open(TMPFILE), nullptr) << "Missing index isn't opened";
+	
+	build_index();
+	EXPECT_NE(NGramIndex::open(TMPFILE), nullptr);
+	
+	write_file(std::vector<unsigned char>(1001, 'x'));
+	EXPECT_EQ(NGramIndex::open(TMPFILE), nullptr) << "Index isn't opened once file size changes";
+	
+	build_index();
+	EXPECT_NE(NGramIndex::open(TMPFILE), nullptr);
+	
+	/* Long enough for the modification time to tick over, but most likely within the same
+	 * second.
+	*/
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	
+	write_file(std::vector<unsigned char>(1001, 'y'));
+	EXPECT_EQ(NGramIndex::open(TMPFILE), nullptr) << "Index isn't opened once file is modified";
+	
+	build_index();
+	EXPECT_NE(NGramIndex::open(TMPFILE), nullptr);
+	
+	/* Truncate the index. */
+	
+	FILE *fh = fopen(NGramIndex::index_filename(TMPFILE).c_str(), "r+b");
+	assert(fh != NULL);
+	assert(ftruncate(fileno(fh), 100) == 0);
+	fclose(fh);
+	
+	EXPECT_EQ(NGramIndex::open(TMPFILE), nullptr) << "Incomplete index isn't opened";
+	
+	remove(NGramIndex::index_filename(TMPFILE).c_str());
+}
+
+TEST(NGramIndex, Cancel)
+{
+	write_file(std::vector<unsigned char>(NGramIndex::SEGMENT_SIZE * 4, 'x'));
+	remove(NGramIndex::index_filename(TMPFILE).c_str());
+	
+	{
+		NGramIndex::Builder builder(TMPFILE);
+		builder.cancel();
+		
+		EXPECT_FALSE(builder.finish()) << "Cancelled build doesn't finish";
+	}
+	
+	EXPECT_EQ(NGramIndex::open(TMPFILE), nullptr) << "Cancelled build doesn't leave an index";
+	
+	FILE *tmp = fopen((NGramIndex::index_filename(TMPFILE) + ".tmp").c_str(), "rb");
+	EXPECT_EQ(tmp, (FILE*)(NULL)) << "Cancelled build removes its temporary file";
+	
+	if(tmp != NULL)
+	{
+		fclose(tmp);
+	}
+}
@@ -16,8 +16,13 @@
 */
 
 #include "../src/platform.hpp"
+#include <algorithm>
+#include <chrono>
 #include <gtest/gtest.h>
 #include <iterator>
+#include <map>
+#include <stdio.h>
+#include <vector>
 
 #include "../src/NestedOffsetLengthMap.hpp"
 
@@ -324,7 +329,7 @@ TEST(NestedOffsetLengthMap, DataInserted)
 		EXPECT_EQ(keys_modified,             0U) << "Inserting data after nonzero-length key returns 0 keys modified";
 	}
 }
-	
+
 TEST(NestedOffsetLengthMap, DataErased)
 {
 	{
@@ -473,3 +478,455 @@ TEST(NestedOffsetLengthMap, DataErased)
 		EXPECT_EQ(keys_modified,             0U) << "Erasing data immediately after nonzero-length key returns 0 keys modified";
 	}
 }
+
+TEST(NestedOffsetLengthMap, DataReplaced)
+{
+	NestedOffsetLengthMap<int> map;
+	
+	NestedOffsetLengthMap_set(map,  0, 40, 0);
+	NestedOffsetLengthMap_set(map,  6,  0, 1);
+	NestedOffsetLengthMap_set(map, 10,  4, 2);
+	NestedOffsetLengthMap_set(map, 20,  8, 3);
+	NestedOffsetLengthMap_set(map, 32,  0, 4);
+	
+	/* Replace 4 bytes with 2 at 4, 10 and 30. */
+	size_t keys_modified = NestedOffsetLengthMap_data_replaced(map, std::vector<off_t>({ 4, 10, 30 }), 4, 2);
+	
+	NestedOffsetLengthMap<int> expect;
+	expect[ NestedOffsetLengthMapKey( 0, 34) ] = 0;
+	expect[ NestedOffsetLengthMapKey(16,  8) ] = 3;
+	
+	EXPECT_EQ(map, expect) << "NestedOffsetLengthMap_data_replaced() shifts, resizes and removes keys";
+	EXPECT_EQ(keys_modified, 5U) << "NestedOffsetLengthMap_data_replaced() returns number of keys modified";
+}
+
+TEST(NestedOffsetLengthMap, DataReplacedMatchesEraseInsert)
+{
+	/* Check NestedOffsetLengthMap_data_replaced() gives the same result as erasing and
+	 * inserting each replacement in turn for a bunch of pseudo-random maps.
+	*/
+	
+	unsigned int seed = 1;
+	auto next_rand = [&seed](unsigned int max)
+	{
+		seed = (seed * 1103515245U) + 12345U;
+		return (seed >> 16) % max;
+	};
+	
+	for(int i = 0; i < 200; ++i)
+	{
+		NestedOffsetLengthMap<int> map;
+		
+		for(int j = 0; j < 100; ++j)
+		{
+			NestedOffsetLengthMap_set(map, next_rand(1000), next_rand(50), j);
+		}
+		
+		off_t old_length = next_rand(6);
+		off_t new_length = next_rand(6);
+		
+		std::vector<off_t> offsets;
+		for(off_t off = next_rand(10); off < 1000; off += old_length + next_rand(30) + 1)
+		{
+			offsets.push_back(off);
+		}
+		
+		NestedOffsetLengthMap<int> expect = map;
+		
+		for(size_t j = 0; j < offsets.size(); ++j)
+		{
+			off_t at = offsets[j] + ((off_t)(j) * (new_length - old_length));
+			
+			NestedOffsetLengthMap_data_erased(expect, at, old_length);
+			NestedOffsetLengthMap_data_inserted(expect, at, new_length);
+		}
+		
+		NestedOffsetLengthMap_data_replaced(map, offsets, old_length, new_length);
+		
+		/* Only compare the keys - which value survives when two keys collapse onto the
+		 * same range depends on the order the replacements are applied in.
+		*/
+		
+		std::vector<NestedOffsetLengthMapKey> got_keys, expect_keys;
+		for(auto k = map.begin(); k != map.end(); ++k) { got_keys.push_back(k->first); }
+		for(auto k = expect.begin(); k != expect.end(); ++k) { expect_keys.push_back(k->first); }
+		
+		EXPECT_TRUE(got_keys == expect_keys) << "NestedOffsetLengthMap_data_replaced() matches data_erased()/data_inserted() (iteration " << i << ")";
+	}
+}
+
+TEST(NestedOffsetLengthMap, BulkLoad)
+{
+	std::vector< std::pair<NestedOffsetLengthMapKey, int> > elements = {
+		std::make_pair(NestedOffsetLengthMapKey(20, 10), 1),
+		std::make_pair(NestedOffsetLengthMapKey( 0, 40), 2),
+		std::make_pair(NestedOffsetLengthMapKey(25, 10), 3), /* Overlaps end of 20,10 */
+		std::make_pair(NestedOffsetLengthMapKey(20,  5), 4),
+		std::make_pair(NestedOffsetLengthMapKey(30,  0), 5),
+		std::make_pair(NestedOffsetLengthMapKey(20, 10), 6), /* Replaces value of 20,10 */
+		std::make_pair(NestedOffsetLengthMapKey(35, 10), 7), /* Overlaps end of 0,40 */
+		std::make_pair(NestedOffsetLengthMapKey(40,  2), 8),
+	};
+	
+	NestedOffsetLengthMap<int> map = NestedOffsetLengthMap_bulk_load(elements);
+	
+	NestedOffsetLengthMap<int> expect;
+	expect[ NestedOffsetLengthMapKey( 0, 40) ] = 2;
+	expect[ NestedOffsetLengthMapKey(20,  5) ] = 4;
+	expect[ NestedOffsetLengthMapKey(20, 10) ] = 6;
+	expect[ NestedOffsetLengthMapKey(30,  0) ] = 5;
+	expect[ NestedOffsetLengthMapKey(40,  2) ] = 8;
+	
+	EXPECT_EQ(map, expect) << "NestedOffsetLengthMap_bulk_load() drops overlapping keys and keeps the last value for duplicate keys";
+}
+
+TEST(NestedOffsetLengthMap, BulkLoadMatchesSet)
+{
+	/* Check NestedOffsetLengthMap_bulk_load() gives the same result as inserting each key
+	 * in turn (in the order bulk_load prefers) for a bunch of pseudo-random key sets.
+	*/
+	
+	unsigned int seed = 1;
+	auto next_rand = [&seed](unsigned int max)
+	{
+		seed = (seed * 1103515245U) + 12345U;
+		return (seed >> 16) % max;
+	};
+	
+	for(int i = 0; i < 200; ++i)
+	{
+		std::vector< std::pair<NestedOffsetLengthMapKey, int> > elements;
+		
+		for(int j = 0; j < 100; ++j)
+		{
+			elements.push_back(std::make_pair(NestedOffsetLengthMapKey(next_rand(1000), next_rand(50)), j));
+		}
+		
+		NestedOffsetLengthMap<int> map = NestedOffsetLengthMap_bulk_load(elements);
+		
+		std::stable_sort(elements.begin(), elements.end(),
+			[](const std::pair<NestedOffsetLengthMapKey, int> &a, const std::pair<NestedOffsetLengthMapKey, int> &b)
+			{
+				return a.first.offset == b.first.offset
+					? a.first.length > b.first.length
+					: a.first.offset < b.first.offset;
+			});
+		
+		NestedOffsetLengthMap<int> expect;
+		
+		for(auto e = elements.begin(); e != elements.end(); ++e)
+		{
+			NestedOffsetLengthMap_set(expect, e->first.offset, e->first.length, e->second);
+		}
+		
+		EXPECT_EQ(map, expect) << "NestedOffsetLengthMap_bulk_load() matches NestedOffsetLengthMap_set() (iteration " << i << ")";
+	}
+}
+
+TEST(NestedOffsetLengthMap, DISABLED_BulkLoadBenchmark)
+{
+	/* Load a million comments, nested three deep and in no particular order, as found in a
+	 * large metadata file. Inserting these one at a time with NestedOffsetLengthMap_set()
+	 * takes quadratic time.
+	*/
+	
+	const off_t N_ELEMENTS = 1000000;
+	
+	std::vector< std::pair<NestedOffsetLengthMapKey, int> > elements;
+	elements.reserve(N_ELEMENTS);
+	
+	for(off_t i = 0; i < N_ELEMENTS; i += 10)
+	{
+		off_t base = ((i * 7919) % N_ELEMENTS) * 10;
+		
+		elements.push_back(std::make_pair(NestedOffsetLengthMapKey(base, 100), 0));
+		
+		for(off_t j = 0; j < 3; ++j)
+		{
+			elements.push_back(std::make_pair(NestedOffsetLengthMapKey(base + (j * 30), 30), 1));
+			elements.push_back(std::make_pair(NestedOffsetLengthMapKey(base + (j * 30), 10), 2));
+			elements.push_back(std::make_pair(NestedOffsetLengthMapKey(base + (j * 30) + 10, 0), 3));
+		}
+	}
+	
+	ASSERT_EQ((off_t)(elements.size()), N_ELEMENTS);
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	NestedOffsetLengthMap<int> map = NestedOffsetLengthMap_bulk_load(elements);
+	
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	printf("NestedOffsetLengthMap_bulk_load() loaded %zu elements in %lldms\n", elements.size(), (long long)(elapsed.count()));
+	
+	EXPECT_EQ(map.size(), elements.size()) << "NestedOffsetLengthMap_bulk_load() loads every element";
+	
+	auto i = NestedOffsetLengthMap_get(map, 6665);
+	ASSERT_TRUE(i != map.end());
+	EXPECT_EQ(i->first.offset, 6660);
+	EXPECT_EQ(i->first.length, 10);
+	EXPECT_EQ(i->second, 2);
+}
+
+TEST(NestedOffsetLengthMap, QueriesMatchLinearSearch)
+{
+	/* Check the tree-based searches give the same results as checking every key in turn for
+	 * a bunch of pseudo-random maps, including after keys have been erased.
+	*/
+	
+	unsigned int seed = 1;
+	auto next_rand = [&seed](unsigned int max)
+	{
+		seed = (seed * 1103515245U) + 12345U;
+		return (seed >> 16) % max;
+	};
+	
+	for(int i = 0; i < 100; ++i)
+	{
+		NestedOffsetLengthMap<int> map;
+		
+		for(int j = 0; j < 200; ++j)
+		{
+			NestedOffsetLengthMap_set(map, next_rand(1000), next_rand(100), j);
+		}
+		
+		for(int j = 0; j < 50 && !map.empty(); ++j)
+		{
+			map.erase(std::next(map.begin(), next_rand(map.size())));
+		}
+		
+		for(off_t offset = 0; offset < 1100; ++offset)
+		{
+			auto expect_get = map.end();
+			std::list<NestedOffsetLengthMap<int>::const_iterator> expect_get_all;
+			
+			for(auto k = map.begin(); k != map.end(); ++k)
+			{
+				off_t k_offset = k->first.offset;
+				off_t k_end    = k_offset + k->first.length;
+				
+				if(k_offset <= offset && k_end > offset
+					&& (expect_get == map.end() || k_offset > expect_get->first.offset))
+				{
+					expect_get = k;
+				}
+				
+				if((k_offset <= offset && k_end > offset) || k_offset == offset)
+				{
+					expect_get_all.push_back(k);
+				}
+			}
+			
+			expect_get_all.sort([](NestedOffsetLengthMap<int>::const_iterator a, NestedOffsetLengthMap<int>::const_iterator b)
+			{
+				return a->first.offset == b->first.offset
+					? a->first.length < b->first.length
+					: a->first.offset > b->first.offset;
+			});
+			
+			EXPECT_TRUE(NestedOffsetLengthMap_get(map, offset) == expect_get) << "NestedOffsetLengthMap_get() matches linear search (iteration " << i << ", offset " << offset << ")";
+			EXPECT_EQ(NestedOffsetLengthMap_get_all(map, offset), expect_get_all) << "NestedOffsetLengthMap_get_all() matches linear search (iteration " << i << ", offset " << offset << ")";
+		}
+		
+		for(int j = 0; j < 1000; ++j)
+		{
+			off_t offset = next_rand(1000);
+			off_t length = next_rand(100);
+			off_t end    = offset + length;
+			
+			bool expect_can_set = true;
+			
+			if(map.find(NestedOffsetLengthMapKey(offset, length)) == map.end())
+			{
+				for(auto k = map.begin(); k != map.end(); ++k)
+				{
+					off_t k_offset = k->first.offset;
+					off_t k_end    = k_offset + k->first.length;
+					
+					if((k_offset < offset && k_end > offset && k_end < end)
+						|| (k_offset > offset && k_offset < end && k_end > end))
+					{
+						expect_can_set = false;
+					}
+				}
+			}
+			
+			EXPECT_EQ(NestedOffsetLengthMap_can_set(map, offset, length), expect_can_set) << "NestedOffsetLengthMap_can_set() matches linear search (iteration " << i << ", key " << offset << "," << length << ")";
+		}
+	}
+}
+
+TEST(NestedOffsetLengthMap, DataInsertedErasedMatchRebuild)
+{
+	/* Check moving keys about by inserting/erasing data gives the same result as rebuilding
+	 * the map one key at a time for a bunch of pseudo-random maps and edits.
+	*/
+	
+	unsigned int seed = 1;
+	auto next_rand = [&seed](unsigned int max)
+	{
+		seed = (seed * 1103515245U) + 12345U;
+		return (seed >> 16) % max;
+	};
+	
+	for(int i = 0; i < 100; ++i)
+	{
+		NestedOffsetLengthMap<int> map;
+		std::map<NestedOffsetLengthMapKey, int> expect;
+		
+		for(int j = 0; j < 100; ++j)
+		{
+			off_t offset = next_rand(1000);
+			off_t length = next_rand(100);
+			
+			if(NestedOffsetLengthMap_set(map, offset, length, j))
+			{
+				expect[NestedOffsetLengthMapKey(offset, length)] = j;
+			}
+		}
+		
+		for(int j = 0; j < 50; ++j)
+		{
+			off_t offset = next_rand(1100);
+			off_t length = next_rand(50);
+			
+			std::map<NestedOffsetLengthMapKey, int> new_expect;
+			size_t expect_modified = 0;
+			size_t got_modified;
+			
+			if(next_rand(2))
+			{
+				got_modified = NestedOffsetLengthMap_data_inserted(map, offset, length);
+				
+				for(auto k = expect.begin(); k != expect.end(); ++k)
+				{
+					off_t k_offset = k->first.offset;
+					off_t k_length = k->first.length;
+					
+					if(k_offset >= offset)
+					{
+						k_offset += length;
+						++expect_modified;
+					}
+					else if((k_offset + k_length) > offset)
+					{
+						k_length += length;
+						++expect_modified;
+					}
+					
+					new_expect.emplace(NestedOffsetLengthMapKey(k_offset, k_length), k->second);
+				}
+			}
+			else{
+				got_modified = NestedOffsetLengthMap_data_erased(map, offset, length);
+				
+				off_t end = offset + length;
+				
+				for(auto k = expect.begin(); k != expect.end(); ++k)
+				{
+					off_t k_offset = k->first.offset;
+					off_t k_length = k->first.length;
+					off_t k_end    = k_offset + k_length;
+					
+					if(k_offset >= offset && ((k_length == 0 && k_offset < end) || (k_length > 0 && k_end <= end)))
+					{
+						++expect_modified;
+						continue;
+					}
+					
+					off_t new_offset = k_offset < offset ? k_offset : std::max(offset, (k_offset - length));
+					off_t new_end    = k_end <= offset ? k_end : (k_end >= end ? (k_end - length) : offset);
+					
+					if(new_offset != k_offset || (new_end - new_offset) != k_length)
+					{
+						++expect_modified;
+					}
+					
+					new_expect.emplace(NestedOffsetLengthMapKey(new_offset, (new_end - new_offset)), k->second);
+				}
+			}
+			
+			expect.swap(new_expect);
+			
+			EXPECT_EQ(got_modified, expect_modified) << "Modified key count is correct (iteration " << i << ", edit " << j << ")";
+			
+			ASSERT_EQ(map.size(), expect.size()) << "Map has the expected keys (iteration " << i << ", edit " << j << ")";
+			EXPECT_TRUE(std::equal(map.begin(), map.end(), expect.begin())) << "Map has the expected keys (iteration " << i << ", edit " << j << ")";
+			
+			/* Check the tree is still searchable after keys have been moved. */
+			
+			off_t check_offset = next_rand(1200);
+			
+			std::list<NestedOffsetLengthMap<int>::const_iterator> expect_get_all;
+			
+			for(auto k = map.begin(); k != map.end(); ++k)
+			{
+				if((k->first.offset <= check_offset && (k->first.offset + k->first.length) > check_offset) || k->first.offset == check_offset)
+				{
+					expect_get_all.push_back(k);
+				}
+			}
+			
+			EXPECT_EQ(NestedOffsetLengthMap_get_all(map, check_offset).size(), expect_get_all.size())
+				<< "NestedOffsetLengthMap_get_all() finds moved keys (iteration " << i << ", edit " << j << ")";
+		}
+	}
+}
+
+TEST(NestedOffsetLengthMap, DISABLED_DataInsertedBenchmark)
+{
+	/* Type a thousand characters near the start of a file with a million highlights. */
+	
+	const off_t N_RECORDS = 1000000;
+	
+	std::vector< std::pair<NestedOffsetLengthMapKey, int> > elements;
+	elements.reserve(N_RECORDS);
+	
+	for(off_t i = 0; i < N_RECORDS; ++i)
+	{
+		elements.push_back(std::make_pair(NestedOffsetLengthMapKey((i * 16), 8), 0));
+	}
+	
+	NestedOffsetLengthMap<int> map = NestedOffsetLengthMap_bulk_load(elements);
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	for(off_t i = 0; i < 1000; ++i)
+	{
+		NestedOffsetLengthMap_data_inserted(map, (100 + i), 1);
+	}
+	
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	printf("NestedOffsetLengthMap_data_inserted() updated %zu keys 1000 times in %lldms\n", map.size(), (long long)(elapsed.count()));
+	
+	auto i = std::prev(map.end());
+	EXPECT_EQ(i->first.offset, ((N_RECORDS - 1) * 16) + 1000);
+	EXPECT_EQ(i->first.length, 8);
+}
+
+TEST(NestedOffsetLengthMap, DISABLED_SetBenchmark)
+{
+	/* Highlight a hundred thousand records, each with a couple of nested fields, one at a
+	 * time in the same way as a script marking up a large file would.
+	*/
+	
+	const off_t N_RECORDS = 100000;
+	
+	NestedOffsetLengthMap<int> map;
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	for(off_t i = 0; i < N_RECORDS; ++i)
+	{
+		off_t base = i * 32;
+		
+		ASSERT_TRUE(NestedOffsetLengthMap_set(map, base, 32, 0));
+		ASSERT_TRUE(NestedOffsetLengthMap_set(map, base, 8, 1));
+		ASSERT_TRUE(NestedOffsetLengthMap_set(map, base + 16, 16, 2));
+		ASSERT_FALSE(NestedOffsetLengthMap_set(map, base + 4, 8, 3));
+	}
+	
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	printf("NestedOffsetLengthMap_set() set %zu elements in %lldms\n", map.size(), (long long)(elapsed.count()));
+	
+	EXPECT_EQ(map.size(), (size_t)(N_RECORDS * 3));
+}
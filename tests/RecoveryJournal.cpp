@@ -0,0 +1,309 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#undef NDEBUG
+#include "../src/platform.hpp"
+#include <assert.h>
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "../src/RecoveryJournal.hpp"
+
+using namespace REHex;
+
+#define TMPFILE  "tests/.tmpfile"
+
+static std::vector<unsigned char> read_file(const char *filename)
+{
+	std::vector<unsigned char> data;
+	
+	FILE *fh = fopen(filename, "rb");
+	assert(fh);
+	
+	unsigned char buf[1024];
+	size_t len;
+	while((len = fread(buf, 1, sizeof(buf), fh)) > 0)
+	{
+		data.insert(data.end(), buf, buf + len);
+	}
+	
+	fclose(fh);
+	
+	return data;
+}
+
+static void write_file(const char *filename, const std::vector<unsigned char> &data)
+{
+	FILE *fh = fopen(filename, "wb");
+	assert(fh);
+	
+	if(data.size() > 0)
+		assert(fwrite(data.data(), data.size(), 1, fh) == 1);
+	
+	fclose(fh);
+}
+
+static std::vector<unsigned char> payload_u64(uint64_t value)
+{
+	std::vector<unsigned char> payload;
+	RecoveryJournal::put_u64(payload, value);
+	
+	return payload;
+}
+
+TEST(RecoveryJournal, WriteRead)
+{
+	{
+		RecoveryJournal j(TMPFILE, 1234, 5678);
+		
+		j.append(RecoveryJournal::REC_ERASE,  payload_u64(1));
+		j.append(RecoveryJournal::REC_INSERT, std::vector<unsigned char>());
+		j.append(RecoveryJournal::REC_ERASE,  payload_u64(3));
+		
+		j.sync();
+		EXPECT_TRUE(j.ok());
+	}
+	
+	RecoveryJournal::Reader r(TMPFILE);
+	
+	EXPECT_EQ(r.get_file_size(),  1234);
+	EXPECT_EQ(r.get_file_mtime(), 5678);
+	
+	RecoveryJournal::RecordType type;
+	std::vector<unsigned char> payload;
+	
+	ASSERT_TRUE(r.next(&type, &payload));
+	EXPECT_EQ(type, RecoveryJournal::REC_ERASE);
+	EXPECT_EQ(payload, payload_u64(1));
+	
+	ASSERT_TRUE(r.next(&type, &payload));
+	EXPECT_EQ(type, RecoveryJournal::REC_INSERT);
+	EXPECT_EQ(payload, std::vector<unsigned char>());
+	
+	ASSERT_TRUE(r.next(&type, &payload));
+	EXPECT_EQ(type, RecoveryJournal::REC_ERASE);
+	EXPECT_EQ(payload, payload_u64(3));
+	
+	EXPECT_FALSE(r.next(&type, &payload));
+	
+	EXPECT_EQ(r.get_valid_length(), (off_t)(read_file(TMPFILE).size()));
+}
+
+TEST(RecoveryJournal, ManyRecords)
+{
+	/* Enough records that the writer thread will (probably) be writing some while others
+	 * are still being queued.
+	*/
+	
+	const uint64_t N_RECORDS = 20000;
+	
+	{
+		RecoveryJournal j(TMPFILE, 0, 0);
+		
+		for(uint64_t i = 0; i < N_RECORDS; ++i)
+		{
+			j.append(RecoveryJournal::REC_ERASE, payload_u64(i));
+		}
+		
+		/* Destructor writes out anything still queued. */
+	}
+	
+	RecoveryJournal::Reader r(TMPFILE);
+	
+	RecoveryJournal::RecordType type;
+	std::vector<unsigned char> payload;
+	
+	uint64_t n_read = 0;
+	bool in_order = true;
+	
+	while(r.next(&type, &payload))
+	{
+		in_order = in_order && payload == payload_u64(n_read);
+		++n_read;
+	}
+	
+	EXPECT_EQ(n_read, N_RECORDS) << "Every record was written";
+	EXPECT_TRUE(in_order) << "Records were written in order";
+}
+
+TEST(RecoveryJournal, TruncatedRecord)
+{
+	{
+		RecoveryJournal j(TMPFILE, 0, 0);
+		
+		j.append(RecoveryJournal::REC_ERASE, payload_u64(1));
+		j.append(RecoveryJournal::REC_ERASE, payload_u64(2));
+	}
+	
+	std::vector<unsigned char> data = read_file(TMPFILE);
+	off_t full_length = data.size();
+	
+	/* Chop the last record short, as if we crashed while writing it. */
+	data.resize(data.size() - 3);
+	write_file(TMPFILE, data);
+	
+	off_t valid_length;
+	
+	{
+		RecoveryJournal::Reader r(TMPFILE);
+		
+		RecoveryJournal::RecordType type;
+		std::vector<unsigned char> payload;
+		
+		ASSERT_TRUE(r.next(&type, &payload));
+		EXPECT_EQ(payload, payload_u64(1));
+		
+		EXPECT_FALSE(r.next(&type, &payload)) << "Incomplete record is ignored";
+		
+		valid_length = r.get_valid_length();
+		EXPECT_EQ(valid_length, full_length - 20);
+	}
+	
+	/* Append to the journal, which should discard the partial record first. */
+	
+	{
+		RecoveryJournal j(TMPFILE, valid_length);
+		j.append(RecoveryJournal::REC_ERASE, payload_u64(3));
+	}
+	
+	{
+		RecoveryJournal::Reader r(TMPFILE);
+		
+		RecoveryJournal::RecordType type;
+		std::vector<unsigned char> payload;
+		
+		ASSERT_TRUE(r.next(&type, &payload));
+		EXPECT_EQ(payload, payload_u64(1));
+		
+		ASSERT_TRUE(r.next(&type, &payload));
+		EXPECT_EQ(payload, payload_u64(3)) << "Appended record follows the last complete one";
+		
+		EXPECT_FALSE(r.next(&type, &payload));
+	}
+}
+
+TEST(RecoveryJournal, Compact)
+{
+	{
+		RecoveryJournal j(TMPFILE, 1234, 5678);
+		
+		j.append(RecoveryJournal::REC_ERASE,       payload_u64(1));
+		j.append(RecoveryJournal::REC_COMMENTS,    payload_u64(100));
+		j.append(RecoveryJournal::REC_ERASE,       payload_u64(2));
+		j.append(RecoveryJournal::REC_SET_COMMENT, payload_u64(101));
+		
+		std::vector<RecoveryJournal::Record> records(1);
+		records[0].type    = RecoveryJournal::REC_COMMENTS;
+		records[0].payload = payload_u64(102);
+		
+		j.compact({ RecoveryJournal::REC_COMMENTS, RecoveryJournal::REC_SET_COMMENT }, std::move(records));
+		
+		j.append(RecoveryJournal::REC_SET_COMMENT, payload_u64(103));
+		
+		j.sync();
+		EXPECT_TRUE(j.ok());
+	}
+	
+	RecoveryJournal::Reader r(TMPFILE);
+	
+	EXPECT_EQ(r.get_file_size(),  1234) << "Compacted journal keeps the header";
+	EXPECT_EQ(r.get_file_mtime(), 5678) << "Compacted journal keeps the header";
+	
+	RecoveryJournal::RecordType type;
+	std::vector<unsigned char> payload;
+	
+	ASSERT_TRUE(r.next(&type, &payload));
+	EXPECT_EQ(type, RecoveryJournal::REC_ERASE);
+	EXPECT_EQ(payload, payload_u64(1));
+	
+	ASSERT_TRUE(r.next(&type, &payload));
+	EXPECT_EQ(type, RecoveryJournal::REC_ERASE);
+	EXPECT_EQ(payload, payload_u64(2)) << "Records of other types are kept in order";
+	
+	ASSERT_TRUE(r.next(&type, &payload));
+	EXPECT_EQ(type, RecoveryJournal::REC_COMMENTS);
+	EXPECT_EQ(payload, payload_u64(102)) << "Replacement records follow the kept records";
+	
+	ASSERT_TRUE(r.next(&type, &payload));
+	EXPECT_EQ(type, RecoveryJournal::REC_SET_COMMENT);
+	EXPECT_EQ(payload, payload_u64(103)) << "Records appended after compacting follow the replacements";
+	
+	EXPECT_FALSE(r.next(&type, &payload));
+	
+	FILE *tmp = fopen(TMPFILE ".tmp", "rb");
+	EXPECT_EQ(tmp, (FILE*)(NULL)) << "Compacting doesn't leave a temporary file behind";
+	
+	if(tmp != NULL)
+	{
+		fclose(tmp);
+	}
+}
+
+TEST(RecoveryJournal, Lock)
+{
+	std::unique_ptr<RecoveryJournal::Lock> lock = RecoveryJournal::Lock::acquire(TMPFILE);
+	ASSERT_NE(lock, nullptr);
+	
+	EXPECT_EQ(RecoveryJournal::Lock::acquire(TMPFILE), nullptr) << "Lock can't be acquired while held";
+	
+	lock.reset();
+	
+	lock = RecoveryJournal::Lock::acquire(TMPFILE);
+	EXPECT_NE(lock, nullptr) << "Lock can be acquired once released";
+	
+	lock.reset();
+	
+	FILE *fh = fopen(TMPFILE ".lock", "rb");
+	EXPECT_EQ(fh, nullptr) << "Lock file is removed when released";
+	
+	if(fh != NULL)
+	{
+		fclose(fh);
+	}
+}
+
+TEST(RecoveryJournal, BadHeader)
+{
+	write_file(TMPFILE, std::vector<unsigned char>(64, 'x'));
+	EXPECT_THROW(RecoveryJournal::Reader r(TMPFILE), std::runtime_error);
+	
+	write_file(TMPFILE, std::vector<unsigned char>());
+	EXPECT_THROW(RecoveryJournal::Reader r(TMPFILE), std::runtime_error);
+}
+
+TEST(RecoveryJournal, PayloadReader)
+{
+	std::vector<unsigned char> payload;
+	RecoveryJournal::put_u64(payload, 0x0102030405060708ULL);
+	RecoveryJournal::put_u32(payload, 0xAABBCCDD);
+	RecoveryJournal::put_data(payload, "xyz", 3);
+	
+	EXPECT_EQ(payload.size(), 15U);
+	EXPECT_EQ(payload[0], 0x08) << "Integers are stored little endian";
+	
+	RecoveryJournal::PayloadReader pr(payload);
+	
+	EXPECT_EQ(pr.get_u64(), 0x0102030405060708ULL);
+	EXPECT_EQ(pr.get_u32(), 0xAABBCCDDU);
+	EXPECT_EQ(pr.remain(), 3U);
+	EXPECT_EQ(std::string((const char*)(pr.get_data(3)), 3), "xyz");
+	EXPECT_THROW(pr.get_u32(), std::runtime_error) << "Reading beyond the end of the payload throws";
+}
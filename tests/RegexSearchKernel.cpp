@@ -0,0 +1,371 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "../src/platform.hpp"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <regex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/RegexSearchKernel.hpp"
+
+using namespace REHex;
+
+static ssize_t regex_find(const RegexSearchKernel &kernel, const std::string &haystack, size_t from = 0)
+{
+	const unsigned char *begin = (const unsigned char*)(haystack.data());
+	const unsigned char *match = kernel.find((begin + from), (begin + haystack.size()));
+	
+	return match != NULL ? (match - begin) : -1;
+}
+
+static ssize_t regex_rfind(const RegexSearchKernel &kernel, const std::string &haystack)
+{
+	const unsigned char *begin = (const unsigned char*)(haystack.data());
+	const unsigned char *match = kernel.rfind(begin, (begin + haystack.size()));
+	
+	return match != NULL ? (match - begin) : -1;
+}
+
+TEST(RegexSearchKernel, Literal)
+{
+	RegexSearchKernel k("abc");
+	
+	EXPECT_EQ(k.max_length(), 3U);
+	EXPECT_FALSE(k.matches_empty());
+	
+	EXPECT_EQ(regex_find(k, "abc"), 0);
+	EXPECT_EQ(regex_find(k, "xxabcxxabc"), 2);
+	EXPECT_EQ(regex_find(k, "xxabcxxabc", 3), 7);
+	EXPECT_EQ(regex_find(k, "ab"), -1);
+	EXPECT_EQ(regex_find(k, "ABC"), -1);
+	
+	EXPECT_EQ(regex_rfind(k, "xxabcxxabc"), 7);
+	EXPECT_EQ(regex_rfind(k, "xxabcxxab"), 2);
+}
+
+TEST(RegexSearchKernel, Syntax)
+{
+	EXPECT_EQ(regex_find(RegexSearchKernel("a.c"), "xa\nc"), 1);
+	EXPECT_EQ(regex_find(RegexSearchKernel("a.c", RegexSearchKernel::TEXT), "xa\nc"), -1);
+	
+	EXPECT_EQ(regex_find(RegexSearchKernel("[b-d]+x"), "abcdx"), 1);
+	EXPECT_EQ(regex_find(RegexSearchKernel("[^a-c]"), "abcd"), 3);
+	EXPECT_EQ(regex_find(RegexSearchKernel("[]a]"), "x]"), 1);
+	EXPECT_EQ(regex_find(RegexSearchKernel("[a-]"), "x-"), 1);
+	EXPECT_EQ(regex_find(RegexSearchKernel("[\\x00-\\x1F]{2}"), std::string("ab\x01\x1F", 4)), 2);
+	
+	EXPECT_EQ(regex_find(RegexSearchKernel("\\d+"), "abc123"), 3);
+	EXPECT_EQ(regex_find(RegexSearchKernel("\\D"), "123a"), 3);
+	EXPECT_EQ(regex_find(RegexSearchKernel("\\w\\s\\w"), "a- b c"), 3);
+	EXPECT_EQ(regex_find(RegexSearchKernel("\\x4D\\x5A.{2}PE"), "xxMZ\x90\x00PE"), -1);
+	EXPECT_EQ(regex_find(RegexSearchKernel("\\x4D\\x5A.{2}PE"), std::string("xxMZ\x90\x00PE", 8)), 2);
+	EXPECT_EQ(regex_find(RegexSearchKernel("\\.\\*"), "a.b.*"), 3);
+	
+	EXPECT_EQ(regex_find(RegexSearchKernel("cat|dog"), "hotdog cat"), 3);
+	EXPECT_EQ(regex_find(RegexSearchKernel("(?:ab)+c"), "aababc"), 1);
+	EXPECT_EQ(regex_find(RegexSearchKernel("x(a|b)?y"), "xy xay"), 0);
+	EXPECT_EQ(regex_find(RegexSearchKernel("a{3}"), "aabaaa"), 3);
+	EXPECT_EQ(regex_find(RegexSearchKernel("ba{2,}c"), "bac baac"), 4);
+	EXPECT_EQ(regex_find(RegexSearchKernel("ba{1,2}c"), "baaac bac"), 6);
+	EXPECT_EQ(regex_find(RegexSearchKernel("a{x"), "a{x"), 0);
+	EXPECT_EQ(regex_find(RegexSearchKernel("a+?b"), "xaab"), 1);
+	
+	EXPECT_EQ(regex_find(RegexSearchKernel("hello", RegexSearchKernel::IGNORE_CASE), "Say HeLLo"), 4);
+	EXPECT_EQ(regex_find(RegexSearchKernel("[a-c]+", RegexSearchKernel::IGNORE_CASE), "xyzCAB"), 3);
+	
+	EXPECT_EQ(RegexSearchKernel("ab{2,5}").max_length(), 6U);
+	EXPECT_EQ(RegexSearchKernel("a|bc|").max_length(), 2U);
+	EXPECT_EQ(RegexSearchKernel("ab*").max_length(), (size_t)(RegexSearchKernel::DEFAULT_MAX_LENGTH));
+	EXPECT_EQ(RegexSearchKernel("ab*", 0, 100).max_length(), 100U);
+	
+	EXPECT_TRUE(RegexSearchKernel("a*").matches_empty());
+	EXPECT_TRUE(RegexSearchKernel("a|").matches_empty());
+	EXPECT_FALSE(RegexSearchKernel("a*b").matches_empty());
+}
+
+TEST(RegexSearchKernel, ParseErrors)
+{
+	EXPECT_THROW(RegexSearchKernel("(abc"), RegexSearchKernel::ParseError);
+	EXPECT_THROW(RegexSearchKernel("abc)"), RegexSearchKernel::ParseError);
+	EXPECT_THROW(RegexSearchKernel("[abc"), RegexSearchKernel::ParseError);
+	EXPECT_THROW(RegexSearchKernel("[z-a]"), RegexSearchKernel::ParseError);
+	EXPECT_THROW(RegexSearchKernel("*a"), RegexSearchKernel::ParseError);
+	EXPECT_THROW(RegexSearchKernel("a|+"), RegexSearchKernel::ParseError);
+	EXPECT_THROW(RegexSearchKernel("^abc"), RegexSearchKernel::ParseError);
+	EXPECT_THROW(RegexSearchKernel("abc$"), RegexSearchKernel::ParseError);
+	EXPECT_THROW(RegexSearchKernel("\\q"), RegexSearchKernel::ParseError);
+	EXPECT_THROW(RegexSearchKernel("\\x4"), RegexSearchKernel::ParseError);
+	EXPECT_THROW(RegexSearchKernel("abc\\"), RegexSearchKernel::ParseError);
+	EXPECT_THROW(RegexSearchKernel("a{5,2}"), RegexSearchKernel::ParseError);
+	EXPECT_THROW(RegexSearchKernel("a{1001}"), RegexSearchKernel::ParseError);
+	EXPECT_THROW(RegexSearchKernel("(?=a)"), RegexSearchKernel::ParseError);
+	EXPECT_THROW(RegexSearchKernel("(a{1000}){1000}"), RegexSearchKernel::ParseError);
+}
+
+TEST(RegexSearchKernel, LeftmostMatch)
+{
+	/* The match ending first isn't always the one which begins first. */
+	
+	RegexSearchKernel k("a.*z|b");
+	
+	EXPECT_EQ(regex_find(k, "xa b z"), 1);
+	EXPECT_EQ(regex_find(k, "xa b y"), 3);
+	EXPECT_EQ(regex_rfind(k, "xa b z"), 3);
+	
+	/* Matches longer than the limit are skipped. */
+	
+	RegexSearchKernel limited("a.*z|b", 0, 4);
+	
+	EXPECT_EQ(regex_find(limited, "xa b z"), 3);
+	EXPECT_EQ(regex_find(limited, "xa bz"), 1);
+	EXPECT_EQ(regex_find(limited, "xa.....z"), -1);
+	EXPECT_EQ(regex_rfind(limited, "xa......z"), -1);
+	EXPECT_EQ(regex_rfind(limited, "xaz.....z"), 1);
+}
+
+TEST(RegexSearchKernel, ReverseLimit)
+{
+	RegexSearchKernel k("ab|b");
+	
+	const std::string haystack = "xabxab";
+	const unsigned char *begin = (const unsigned char*)(haystack.data());
+	const unsigned char *end   = begin + haystack.size();
+	
+	EXPECT_EQ(k.rfind(begin, end), begin + 5);
+	EXPECT_EQ(k.rfind(begin, end, begin + 5), begin + 4);
+	EXPECT_EQ(k.rfind(begin, end, begin + 4), begin + 2);
+	EXPECT_EQ(k.rfind(begin, end, begin + 1), (const unsigned char*)(NULL));
+}
+
+TEST(RegexSearchKernel, MatchLength)
+{
+	RegexSearchKernel k("a[0-9]*z?|b");
+	
+	const std::string haystack = "xa123zb a9";
+	const unsigned char *begin = (const unsigned char*)(haystack.data());
+	const unsigned char *end   = begin + haystack.size();
+	
+	EXPECT_EQ(k.match_length((begin + 1), end), 5U) << "Longest match is measured";
+	EXPECT_EQ(k.match_length((begin + 1), (begin + 5)), 4U) << "Match must end by end";
+	EXPECT_EQ(k.match_length((begin + 6), end), 1U);
+	EXPECT_EQ(k.match_length((begin + 8), end), 2U) << "Match may end at end";
+	EXPECT_EQ(k.match_length(begin, end), 0U) << "Zero is returned where there is no match";
+	
+	RegexSearchKernel limited("a[0-9]*", 0, 3);
+	
+	EXPECT_EQ(limited.match_length((begin + 1), end), 3U) << "Match is no longer than the limit";
+}
+
+TEST(RegexSearchKernel, SmallCache)
+{
+	/* Build more DFA states than fit in the cache, so it gets flushed mid-search. The
+	 * expression needs a state for each combination of the last 12 bytes.
+	*/
+	
+	RegexSearchKernel k("a[ab]{11}c");
+	
+	srand(0);
+	
+	std::string haystack;
+	for(int i = 0; i < 100000; ++i)
+	{
+		haystack.push_back("ab"[rand() % 2]);
+	}
+	
+	std::string with_match = haystack + "abbbbbbbbbbbc";
+	
+	EXPECT_EQ(regex_find(k, haystack), -1);
+	EXPECT_EQ(regex_find(k, with_match), (ssize_t)(with_match.size() - 13));
+	EXPECT_EQ(regex_rfind(k, with_match), (ssize_t)(with_match.size() - 13));
+}
+
+TEST(RegexSearchKernel, Threads)
+{
+	/* Copies of a kernel share their DFA caches, each thread searching at once needs its own. */
+	
+	RegexSearchKernel k("a[ab]{8}c");
+	
+	std::string haystack;
+	for(int i = 0; i < 20000; ++i)
+	{
+		haystack.push_back("ab"[rand() % 2]);
+	}
+	
+	haystack += "abbbbbbbbc";
+	
+	std::vector<std::thread> threads;
+	std::vector<ssize_t> results(8, -2);
+	
+	for(size_t i = 0; i < results.size(); ++i)
+	{
+		RegexSearchKernel copy = k;
+		
+		threads.emplace_back([copy, &haystack, &results, i]()
+		{
+			results[i] = (i % 2) == 0 ? regex_find(copy, haystack) : regex_rfind(copy, haystack);
+		});
+	}
+	
+	for(auto t = threads.begin(); t != threads.end(); ++t)
+	{
+		t->join();
+	}
+	
+	EXPECT_EQ(results, std::vector<ssize_t>(results.size(), (ssize_t)(haystack.size() - 10)));
+}
+
+static std::string random_regex(int depth)
+{
+	switch(rand() % (depth > 0 ? 9 : 4))
+	{
+		case 0:
+		case 1:
+			return std::string(1, "ab"[rand() % 2]);
+		
+		case 2:
+			return "[ab]";
+		
+		case 3:
+			return ".";
+		
+		case 4:
+			return random_regex(depth - 1) + random_regex(depth - 1);
+		
+		case 5:
+			return "(" + random_regex(depth - 1) + "|" + random_regex(depth - 1) + ")";
+		
+		case 6:
+			return "(" + random_regex(depth - 1) + ")" + "*+?"[rand() % 3];
+		
+		case 7:
+		{
+			int min = rand() % 3;
+			return "(" + random_regex(depth - 1) + "){" + std::to_string(min) + "," + std::to_string(min + (rand() % 3)) + "}";
+		}
+		
+		default:
+			return random_regex(depth - 1) + "c";
+	}
+}
+
+TEST(RegexSearchKernel, MatchesStdRegex)
+{
+	srand(0);
+	
+	for(int i = 0; i < 3000; ++i)
+	{
+		std::string pattern = random_regex(3);
+		
+		std::string haystack(rand() % 40, 'x');
+		for(auto c = haystack.begin(); c != haystack.end(); ++c)
+		{
+			*c = "abc"[rand() % 3];
+		}
+		
+		RegexSearchKernel k(pattern);
+		std::regex re(pattern);
+		
+		const unsigned char *begin = (const unsigned char*)(haystack.data());
+		const unsigned char *end   = begin + haystack.size();
+		
+		/* Every offset where a match begins. */
+		
+		std::vector<ssize_t> expect;
+		
+		for(size_t at = 0; at <= haystack.size(); ++at)
+		{
+			if(std::regex_search((haystack.begin() + at), haystack.end(), re, std::regex_constants::match_continuous))
+			{
+				expect.push_back(at);
+			}
+		}
+		
+		std::vector<ssize_t> got;
+		
+		for(const unsigned char *p = begin, *match; p <= end && (match = k.find(p, end)) != NULL; p = match + 1)
+		{
+			got.push_back(match - begin);
+		}
+		
+		ASSERT_EQ(got, expect) << "RegexSearchKernel finds same matches as std::regex (pattern " << pattern << ", haystack " << haystack << ")";
+		
+		for(size_t at = 0; at <= haystack.size(); ++at)
+		{
+			bool expect_match = std::find(expect.begin(), expect.end(), (ssize_t)(at)) != expect.end();
+			ASSERT_EQ(k.match_at((begin + at), end), expect_match) << "RegexSearchKernel::match_at() agrees with std::regex (pattern " << pattern << ", haystack " << haystack << ", offset " << at << ")";
+		}
+		
+		got.clear();
+		
+		for(const unsigned char *limit = NULL, *match; (match = k.rfind(begin, end, limit)) != NULL; limit = match)
+		{
+			got.insert(got.begin(), (match - begin));
+			
+			if(match == begin)
+			{
+				break;
+			}
+		}
+		
+		ASSERT_EQ(got, expect) << "RegexSearchKernel::rfind() finds same matches as std::regex (pattern " << pattern << ", haystack " << haystack << ")";
+	}
+}
+
+TEST(RegexSearchKernel, DISABLED_Benchmark)
+{
+	/* Search 64MiB of data for expressions which only match at the end. */
+	
+	const size_t DATA_SIZE = 64 * 1024 * 1024;
+	
+	std::string data(DATA_SIZE, '\0');
+	
+	srand(0);
+	for(size_t i = 0; i < DATA_SIZE; ++i)
+	{
+		data[i] = rand();
+	}
+	
+	const char *END = "MZ\x90\x01PE\x00\x00";
+	data.replace((DATA_SIZE - 8), 8, END, 8);
+	
+	const char *PATTERNS[] = {
+		"MZ.{2}PE\\x00\\x00",
+		"[M-N]Z.{2}PE\\x00\\x00",
+		"(MZ|NE).[\\x00-\\x0F]PE\\x00+",
+	};
+	
+	for(size_t i = 0; i < (sizeof(PATTERNS) / sizeof(*PATTERNS)); ++i)
+	{
+		RegexSearchKernel k(PATTERNS[i]);
+		
+		auto start = std::chrono::steady_clock::now();
+		
+		ssize_t match = regex_find(k, data);
+		
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+		printf("RegexSearchKernel searched %zuMiB for %s in %lldms\n",
+			(DATA_SIZE / (1024 * 1024)), PATTERNS[i], (long long)(elapsed.count()));
+		
+		EXPECT_EQ(match, (ssize_t)(DATA_SIZE - 8));
+	}
+}
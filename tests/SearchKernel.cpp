@@ -0,0 +1,1153 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "../src/platform.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "../src/SearchKernel.hpp"
+
+using namespace REHex;
+
+/* Returns the offset of the first match found by the kernel, or -1. */
+static ssize_t kernel_find(const SearchKernel &kernel, const std::string &haystack, size_t from = 0)
+{
+	const unsigned char *begin = (const unsigned char*)(haystack.data());
+	const unsigned char *end   = begin + haystack.size();
+	
+	const unsigned char *match = kernel.find((begin + from), end);
+	return match != NULL ? (match - begin) : -1;
+}
+
+/* Reference implementation, tests every offset. */
+static ssize_t naive_find(const std::vector<unsigned char> &haystack, const std::vector<unsigned char> &pattern, size_t from, bool ignore_case)
+{
+	auto fold = [&](unsigned char c)
+	{
+		return (ignore_case && c >= 'A' && c <= 'Z') ? (c - 'A' + 'a') : c;
+	};
+	
+	for(size_t at = from; (at + pattern.size()) <= haystack.size(); ++at)
+	{
+		size_t i = 0;
+		while(i < pattern.size() && fold(haystack[at + i]) == fold(pattern[i]))
+		{
+			++i;
+		}
+		
+		if(i == pattern.size())
+		{
+			return at;
+		}
+	}
+	
+	return -1;
+}
+
+/* Reference implementation, returns the last match which ends at or before to. */
+static ssize_t naive_rfind(const std::vector<unsigned char> &haystack, const std::vector<unsigned char> &pattern, size_t to, bool ignore_case)
+{
+	auto fold = [&](unsigned char c)
+	{
+		return (ignore_case && c >= 'A' && c <= 'Z') ? (c - 'A' + 'a') : c;
+	};
+	
+	for(ssize_t at = (ssize_t)(std::min(to, haystack.size())) - (ssize_t)(pattern.size()); at >= 0; --at)
+	{
+		size_t i = 0;
+		while(i < pattern.size() && fold(haystack[at + i]) == fold(pattern[i]))
+		{
+			++i;
+		}
+		
+		if(i == pattern.size())
+		{
+			return at;
+		}
+	}
+	
+	return -1;
+}
+
+TEST(SearchKernel, ShortPattern)
+{
+	SearchKernel k("def", 3);
+	
+	EXPECT_EQ(kernel_find(k, "abcdefghijdef"),      3) << "SearchKernel finds pattern in middle of data";
+	EXPECT_EQ(kernel_find(k, "abcdefghijdef", 4),  10) << "SearchKernel finds pattern at end of data";
+	EXPECT_EQ(kernel_find(k, "def"),                0) << "SearchKernel finds pattern which is whole data";
+	EXPECT_EQ(kernel_find(k, "abcdeghijde"),       -1) << "SearchKernel doesn't find pattern which isn't there";
+	EXPECT_EQ(kernel_find(k, "de"),                -1) << "SearchKernel doesn't find pattern longer than data";
+	EXPECT_EQ(kernel_find(k, "abcDEFghi"),         -1) << "SearchKernel is case sensitive by default";
+}
+
+TEST(SearchKernel, SingleByte)
+{
+	SearchKernel k("x", 1);
+	
+	EXPECT_EQ(kernel_find(k, "abcxdef"),  3);
+	EXPECT_EQ(kernel_find(k, "abcdef"),  -1);
+	EXPECT_EQ(kernel_find(k, ""),        -1);
+	
+	SearchKernel ki("X", 1, true);
+	
+	EXPECT_EQ(kernel_find(ki, "abcxdef"),  3);
+	EXPECT_EQ(kernel_find(ki, "abcXdef"),  3);
+}
+
+TEST(SearchKernel, IgnoreCase)
+{
+	SearchKernel k("HeLLo", 5, true);
+	
+	EXPECT_EQ(kernel_find(k, "say hello"),  4);
+	EXPECT_EQ(kernel_find(k, "say HELLO"),  4);
+	EXPECT_EQ(kernel_find(k, "say hellp"), -1);
+	
+	/* Only ASCII letters are folded. */
+	SearchKernel k2("[", 1, true);
+	EXPECT_EQ(kernel_find(k2, "{"), -1);
+}
+
+TEST(SearchKernel, EmptyPattern)
+{
+	SearchKernel k;
+	
+	EXPECT_EQ(k.length(), 0U);
+	EXPECT_EQ(kernel_find(k, "abc"),    0);
+	EXPECT_EQ(kernel_find(k, "abc", 2), 2);
+}
+
+TEST(SearchKernel, LongPattern)
+{
+	std::string pattern = "The quick brown fox jumps over the lazy dog";
+	ASSERT_GE(pattern.size(), (size_t)(SearchKernel::LONG_PATTERN));
+	
+	SearchKernel k(pattern.data(), pattern.size());
+	
+	std::string haystack = std::string(1000, 'x') + "The quick brown fox jumps over the lazy cat " + pattern + "!";
+	EXPECT_EQ(kernel_find(k, haystack), 1044);
+	
+	SearchKernel ki("THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG", pattern.size(), true);
+	EXPECT_EQ(kernel_find(ki, haystack), 1044);
+}
+
+TEST(SearchKernel, LongPeriodicPattern)
+{
+	/* Searching for a long run of zeros in zeros matches at every offset. */
+	
+	std::vector<unsigned char> zeros(4096, 0);
+	std::string haystack(100000, '\0');
+	
+	SearchKernel k(zeros.data(), zeros.size());
+	
+	EXPECT_EQ(kernel_find(k, haystack),        0);
+	EXPECT_EQ(kernel_find(k, haystack, 1234),  1234);
+	EXPECT_EQ(kernel_find(k, haystack, (haystack.size() - 4096)), (ssize_t)(haystack.size() - 4096));
+	EXPECT_EQ(kernel_find(k, haystack, (haystack.size() - 4095)), -1);
+}
+
+TEST(SearchKernel, Reverse)
+{
+	const std::string haystack = "abcdefabcDEF" + std::string(100, 'x') + "abcdefghijklmnopqrstuvwxyz0123456789" + std::string(100, 'x');
+	const unsigned char *begin = (const unsigned char*)(haystack.data());
+	const unsigned char *end   = begin + haystack.size();
+	
+	SearchKernel def("def", 3);
+	EXPECT_EQ(def.rfind(begin, end), (begin + 115)) << "SearchKernel::rfind() finds last match";
+	EXPECT_EQ(def.rfind(begin, (begin + 117)), (begin + 3)) << "SearchKernel::rfind() doesn't find match which crosses end";
+	EXPECT_EQ(def.rfind((begin + 4), (begin + 117)), (const unsigned char*)(NULL)) << "SearchKernel::rfind() doesn't find match before begin";
+	
+	SearchKernel def_i("DEF", 3, true);
+	EXPECT_EQ(def_i.rfind(begin, (begin + 112)), (begin + 9)) << "SearchKernel::rfind() can ignore case";
+	
+	SearchKernel x("x", 1);
+	EXPECT_EQ(x.rfind(begin, end), (end - 1)) << "SearchKernel::rfind() finds single byte at end of data";
+	
+	SearchKernel alnum("abcdefghijklmnopqrstuvwxyz0123456789", 36);
+	EXPECT_EQ(alnum.rfind(begin, end), (begin + 112)) << "SearchKernel::rfind() finds long pattern";
+	EXPECT_EQ(alnum.rfind(begin, (end - 101)), (const unsigned char*)(NULL)) << "SearchKernel::rfind() doesn't find long pattern which crosses end";
+	
+	SearchKernel empty;
+	EXPECT_EQ(empty.rfind(begin, end), end) << "SearchKernel::rfind() matches empty pattern at end of data";
+}
+
+TEST(SearchKernel, MatchesNaiveSearch)
+{
+	/* Search small alphabets, so there are lots of partial matches, for patterns long and
+	 * short enough to use both algorithms.
+	*/
+	
+	srand(0);
+	
+	for(int i = 0; i < 20000; ++i)
+	{
+		bool ignore_case = (i % 2) == 1;
+		const char *alphabet = ignore_case ? "aAbB" : "abcd";
+		int alphabet_size = 1 + (rand() % 4);
+		
+		std::vector<unsigned char> haystack(rand() % 300);
+		std::vector<unsigned char> pattern(1 + (rand() % ((i % 3) == 0 ? 80 : 12)));
+		
+		for(auto c = haystack.begin(); c != haystack.end(); ++c)
+		{
+			*c = alphabet[rand() % alphabet_size];
+		}
+		
+		for(auto c = pattern.begin(); c != pattern.end(); ++c)
+		{
+			*c = alphabet[rand() % alphabet_size];
+		}
+		
+		if(haystack.size() > pattern.size() && (rand() % 2) == 0)
+		{
+			size_t at = rand() % (haystack.size() - pattern.size() + 1);
+			std::copy(pattern.begin(), pattern.end(), (haystack.begin() + at));
+		}
+		
+		const unsigned char *begin = haystack.data();
+		const unsigned char *end   = begin + haystack.size();
+		
+		/* Check every instruction set the CPU supports. */
+		
+		for(int level = SearchKernel::SIMD_NONE; level <= SearchKernel::detect_simd(); ++level)
+		{
+			SearchKernel k(pattern.data(), pattern.size(), ignore_case);
+			k.limit_simd((SearchKernel::SIMDLevel)(level));
+			
+			for(size_t from = 0;;)
+			{
+				const unsigned char *match = k.find((begin + from), end);
+				ssize_t expect = naive_find(haystack, pattern, from, ignore_case);
+				
+				ASSERT_EQ((match != NULL ? (match - begin) : -1), expect)
+					<< "SearchKernel finds same match as naive search (iteration " << i << ", from " << from << ", SIMD level " << level << ")";
+				
+				if(expect < 0)
+				{
+					break;
+				}
+				
+				from = expect + 1;
+			}
+			
+			for(size_t to = haystack.size();;)
+			{
+				const unsigned char *match = k.rfind(begin, (begin + to));
+				ssize_t expect = naive_rfind(haystack, pattern, to, ignore_case);
+				
+				ASSERT_EQ((match != NULL ? (match - begin) : -1), expect)
+					<< "SearchKernel::rfind() finds same match as naive search (iteration " << i << ", to " << to << ", SIMD level " << level << ")";
+				
+				if(expect < 0)
+				{
+					break;
+				}
+				
+				to = expect + pattern.size() - 1;
+			}
+		}
+	}
+}
+
+TEST(SearchKernel, DISABLED_Benchmark)
+{
+	/* Search 64MiB of data for 4 and 16 byte patterns at the end, using the kernel with each
+	 * instruction set the CPU supports and by comparing at every offset, then backwards for
+	 * the patterns at the start.
+	*/
+	
+	const size_t DATA_SIZE = 64 * 1024 * 1024;
+	const char *PATTERN = "\x7F" "ELF\x02\x01\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00";
+	
+	std::vector<unsigned char> data(DATA_SIZE);
+	
+	srand(0);
+	for(size_t i = 0; i < DATA_SIZE; ++i)
+	{
+		data[i] = rand();
+	}
+	
+	memcpy((data.data() + DATA_SIZE - 16), PATTERN, 16);
+	
+	const char *LEVEL_NAMES[] = { "scalar", "SSE2", "AVX2" };
+	
+	for(size_t length = 4; length <= 16; length += 12)
+	{
+		for(int level = SearchKernel::SIMD_NONE; level <= SearchKernel::detect_simd(); ++level)
+		{
+			SearchKernel k(PATTERN, length);
+			k.limit_simd((SearchKernel::SIMDLevel)(level));
+			
+			auto start = std::chrono::steady_clock::now();
+			
+			const unsigned char *match = k.find(data.data(), (data.data() + DATA_SIZE));
+			
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+			printf("SearchKernel (%s) searched %zuMiB for %zu bytes in %lldms\n",
+				LEVEL_NAMES[level], (DATA_SIZE / (1024 * 1024)), length, (long long)(elapsed.count()));
+			
+			EXPECT_EQ(match, (data.data() + DATA_SIZE - 16));
+		}
+	}
+	
+	const unsigned char *match = data.data() + DATA_SIZE - 16;
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	const unsigned char *naive_match = NULL;
+	for(size_t i = 0; (i + 16) <= DATA_SIZE; ++i)
+	{
+		if(memcmp((data.data() + i), PATTERN, 16) == 0)
+		{
+			naive_match = data.data() + i;
+			break;
+		}
+	}
+	
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	printf("memcmp() at every offset searched %zuMiB in %lldms\n", (DATA_SIZE / (1024 * 1024)), (long long)(elapsed.count()));
+	
+	EXPECT_EQ(naive_match, match);
+	
+	/* Search backwards from the end for a copy of the patterns at the start. */
+	
+	memcpy(data.data(), PATTERN, 16);
+	
+	for(size_t length = 4; length <= 16; length += 12)
+	{
+		for(int level = SearchKernel::SIMD_NONE; level <= SearchKernel::detect_simd(); ++level)
+		{
+			SearchKernel k(PATTERN, length);
+			k.limit_simd((SearchKernel::SIMDLevel)(level));
+			
+			auto start = std::chrono::steady_clock::now();
+			
+			const unsigned char *match = k.rfind(data.data(), (data.data() + DATA_SIZE - 16));
+			
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+			printf("SearchKernel (%s) searched %zuMiB backwards for %zu bytes in %lldms\n",
+				LEVEL_NAMES[level], (DATA_SIZE / (1024 * 1024)), length, (long long)(elapsed.count()));
+			
+			EXPECT_EQ(match, data.data());
+		}
+	}
+}
+
+/* Returns the offset of the first match found by the kernel and the pattern, or -1. */
+static ssize_t multi_find(const MultiSearchKernel &kernel, const std::string &haystack, size_t *pattern_idx = NULL)
+{
+	const unsigned char *begin = (const unsigned char*)(haystack.data());
+	const unsigned char *end   = begin + haystack.size();
+	
+	const unsigned char *match = kernel.find(begin, end, pattern_idx);
+	return match != NULL ? (match - begin) : -1;
+}
+
+static std::vector< std::vector<unsigned char> > make_patterns(const std::vector<std::string> &strings)
+{
+	std::vector< std::vector<unsigned char> > patterns;
+	
+	for(auto s = strings.begin(); s != strings.end(); ++s)
+	{
+		patterns.push_back(std::vector<unsigned char>(s->begin(), s->end()));
+	}
+	
+	return patterns;
+}
+
+TEST(MultiSearchKernel, FindsFirstPattern)
+{
+	auto patterns = make_patterns({ "ghi", "def", "xyz" });
+	
+	/* Check both the per-pattern kernels and the automaton. */
+	
+	for(size_t small_set = 0; small_set <= MultiSearchKernel::SMALL_SET; small_set += MultiSearchKernel::SMALL_SET)
+	{
+		MultiSearchKernel k(patterns, false, small_set);
+		size_t idx = -1;
+		
+		EXPECT_EQ(multi_find(k, "abcdefghi", &idx), 3) << "MultiSearchKernel finds earliest match";
+		EXPECT_EQ(idx, 1U) << "MultiSearchKernel returns index of matching pattern";
+		
+		EXPECT_EQ(multi_find(k, "abcxyz", &idx), 3) << "MultiSearchKernel finds pattern at end of data";
+		EXPECT_EQ(idx, 2U) << "MultiSearchKernel returns index of matching pattern";
+		
+		EXPECT_EQ(multi_find(k, "abcdeghxy"), -1) << "MultiSearchKernel doesn't find patterns which aren't there";
+		EXPECT_EQ(multi_find(k, ""),          -1) << "MultiSearchKernel doesn't find patterns in empty data";
+	}
+	
+	MultiSearchKernel empty;
+	EXPECT_EQ(multi_find(empty, "abc"), -1) << "MultiSearchKernel with no patterns doesn't match";
+}
+
+TEST(MultiSearchKernel, OverlappingPatterns)
+{
+	/* "abcdef" begins first, even though "bc" and "cd" end first. */
+	auto patterns = make_patterns({ "cd", "bc", "abcdef", "abc" });
+	
+	for(size_t small_set = 0; small_set <= MultiSearchKernel::SMALL_SET; small_set += MultiSearchKernel::SMALL_SET)
+	{
+		MultiSearchKernel k(patterns, false, small_set);
+		size_t idx = -1;
+		
+		EXPECT_EQ(multi_find(k, "xxabcdefxx", &idx), 2) << "MultiSearchKernel finds match which begins first";
+		EXPECT_EQ(idx, 2U) << "MultiSearchKernel prefers longest pattern at same offset";
+		
+		EXPECT_EQ(multi_find(k, "xxabcdexx", &idx), 2) << "MultiSearchKernel finds prefix of longer pattern";
+		EXPECT_EQ(idx, 3U) << "MultiSearchKernel returns index of matching pattern";
+		
+		EXPECT_EQ(multi_find(k, "xxbcdxx", &idx), 2) << "MultiSearchKernel finds match which begins first";
+		EXPECT_EQ(idx, 1U) << "MultiSearchKernel returns index of matching pattern";
+	}
+}
+
+TEST(MultiSearchKernel, Reverse)
+{
+	auto patterns = make_patterns({ "cd", "bc", "abcdef", "abc" });
+	
+	const std::string haystack = "xxabcdefxxbcxx";
+	const unsigned char *begin = (const unsigned char*)(haystack.data());
+	const unsigned char *end   = begin + haystack.size();
+	
+	for(size_t small_set = 0; small_set <= MultiSearchKernel::SMALL_SET; small_set += MultiSearchKernel::SMALL_SET)
+	{
+		MultiSearchKernel k(patterns, false, small_set);
+		size_t idx = -1;
+		
+		EXPECT_EQ(k.rfind(begin, end, NULL, &idx), (begin + 10)) << "MultiSearchKernel::rfind() finds last match";
+		EXPECT_EQ(idx, 1U);
+		
+		EXPECT_EQ(k.rfind(begin, end, (begin + 10), &idx), (begin + 4)) << "MultiSearchKernel::rfind() finds last match before limit";
+		EXPECT_EQ(idx, 0U);
+		
+		EXPECT_EQ(k.rfind(begin, end, (begin + 3), &idx), (begin + 2)) << "MultiSearchKernel::rfind() finds longer match which begins before limit";
+		EXPECT_EQ(idx, 2U) << "MultiSearchKernel::rfind() prefers longest pattern at same offset";
+		
+		EXPECT_EQ(k.rfind(begin, (begin + 7), (begin + 3), &idx), (begin + 2)) << "MultiSearchKernel::rfind() finds match which ends before end";
+		EXPECT_EQ(idx, 3U);
+		
+		EXPECT_EQ(k.rfind(begin, end, (begin + 2)), (const unsigned char*)(NULL)) << "MultiSearchKernel::rfind() doesn't find match at or after limit";
+	}
+}
+
+TEST(MultiSearchKernel, IgnoreCase)
+{
+	auto patterns = make_patterns({ "Hello", "w@rld" });
+	
+	for(size_t small_set = 0; small_set <= MultiSearchKernel::SMALL_SET; small_set += MultiSearchKernel::SMALL_SET)
+	{
+		MultiSearchKernel k(patterns, true, small_set);
+		size_t idx = -1;
+		
+		EXPECT_EQ(multi_find(k, "xxhELLOxx", &idx), 2) << "MultiSearchKernel matches letters case-insensitively";
+		EXPECT_EQ(idx, 0U);
+		
+		EXPECT_EQ(multi_find(k, "xxW@RLDxx", &idx), 2) << "MultiSearchKernel matches letters case-insensitively";
+		EXPECT_EQ(idx, 1U);
+		
+		EXPECT_EQ(multi_find(k, "xxW`RLDxx"), -1) << "MultiSearchKernel doesn't fold case of non-letters";
+		
+		const std::string haystack = "HELLO hello";
+		const unsigned char *begin = (const unsigned char*)(haystack.data());
+		const unsigned char *end   = begin + haystack.size();
+		
+		EXPECT_EQ(k.rfind(begin, end, (begin + 6)), begin) << "MultiSearchKernel::rfind() matches letters case-insensitively";
+	}
+	
+	MultiSearchKernel k(patterns, false);
+	EXPECT_EQ(multi_find(k, "xxhELLOxx"), -1) << "MultiSearchKernel is case-sensitive by default";
+}
+
+TEST(MultiSearchKernel, EmptyPattern)
+{
+	auto patterns = make_patterns({ "", "ab" });
+	
+	MultiSearchKernel k(patterns);
+	size_t idx = -1;
+	
+	EXPECT_EQ(multi_find(k, "xab", &idx), 0) << "MultiSearchKernel matches empty pattern at start";
+	EXPECT_EQ(idx, 0U);
+	
+	EXPECT_EQ(multi_find(k, "abx", &idx), 0) << "MultiSearchKernel matches empty pattern at start";
+	EXPECT_EQ(idx, 1U) << "MultiSearchKernel prefers longer pattern to empty one";
+}
+
+TEST(MultiSearchKernel, MatchesNaiveSearch)
+{
+	srand(0);
+	
+	for(int i = 0; i < 10000; ++i)
+	{
+		int alphabet_size = 1 + (rand() % 4);
+		
+		/* Mix the case of letters when searching case-insensitively. */
+		bool ignore_case = (i % 2) == 1;
+		auto random_char = [&]()
+		{
+			unsigned char c = 'a' + (rand() % alphabet_size);
+			return (ignore_case && (rand() % 2) == 0) ? (c - 'a' + 'A') : c;
+		};
+		
+		std::vector<unsigned char> haystack(rand() % 300);
+		std::vector< std::vector<unsigned char> > patterns(1 + (rand() % 12));
+		
+		for(auto c = haystack.begin(); c != haystack.end(); ++c)
+		{
+			*c = random_char();
+		}
+		
+		for(auto p = patterns.begin(); p != patterns.end(); ++p)
+		{
+			p->resize(1 + (rand() % ((i % 3) == 0 ? 40 : 8)));
+			
+			for(auto c = p->begin(); c != p->end(); ++c)
+			{
+				*c = random_char();
+			}
+		}
+		
+		const unsigned char *begin = haystack.data();
+		const unsigned char *end   = begin + haystack.size();
+		
+		for(size_t small_set = 0; small_set <= patterns.size(); small_set += patterns.size())
+		{
+			MultiSearchKernel k(patterns, ignore_case, small_set);
+			
+			for(size_t from = 0;;)
+			{
+				/* The earliest match, preferring the longest pattern at that offset. */
+				
+				ssize_t expect = -1;
+				size_t expect_len = 0;
+				
+				for(auto p = patterns.begin(); p != patterns.end(); ++p)
+				{
+					ssize_t at = naive_find(haystack, *p, from, ignore_case);
+					
+					if(at >= 0 && (expect < 0 || at < expect || (at == expect && p->size() > expect_len)))
+					{
+						expect = at;
+						expect_len = p->size();
+					}
+				}
+				
+				size_t idx = -1;
+				const unsigned char *match = k.find((begin + from), end, &idx);
+				
+				ASSERT_EQ((match != NULL ? (match - begin) : -1), expect)
+					<< "MultiSearchKernel finds same match as naive search (iteration " << i << ", from " << from << ", small_set " << small_set << ")";
+				
+				if(expect < 0)
+				{
+					break;
+				}
+				
+				ASSERT_EQ(patterns[idx].size(), expect_len) << "MultiSearchKernel returns longest pattern at match (iteration " << i << ")";
+				ASSERT_EQ(naive_find(std::vector<unsigned char>(match, (match + expect_len)), patterns[idx], 0, ignore_case), 0) << "MultiSearchKernel returns matching pattern (iteration " << i << ")";
+				
+				from = expect + 1;
+			}
+			
+			for(size_t limit = haystack.size();;)
+			{
+				/* The last match beginning before limit, preferring the longest. */
+				
+				ssize_t expect = -1;
+				size_t expect_len = 0;
+				
+				for(auto p = patterns.begin(); p != patterns.end(); ++p)
+				{
+					ssize_t at = naive_rfind(haystack, *p, std::min(haystack.size(), (limit + p->size() - 1)), ignore_case);
+					
+					if(at >= 0 && (expect < 0 || at > expect || (at == expect && p->size() > expect_len)))
+					{
+						expect = at;
+						expect_len = p->size();
+					}
+				}
+				
+				size_t idx = -1;
+				const unsigned char *match = k.rfind(begin, end, (begin + limit), &idx);
+				
+				ASSERT_EQ((match != NULL ? (match - begin) : -1), expect)
+					<< "MultiSearchKernel::rfind() finds same match as naive search (iteration " << i << ", limit " << limit << ", small_set " << small_set << ")";
+				
+				if(expect < 0)
+				{
+					break;
+				}
+				
+				ASSERT_EQ(patterns[idx].size(), expect_len) << "MultiSearchKernel::rfind() returns longest pattern at match (iteration " << i << ")";
+				ASSERT_EQ(naive_find(std::vector<unsigned char>(match, (match + expect_len)), patterns[idx], 0, ignore_case), 0) << "MultiSearchKernel::rfind() returns matching pattern (iteration " << i << ")";
+				
+				limit = expect;
+			}
+		}
+	}
+}
+
+TEST(MultiSearchKernel, DISABLED_Benchmark)
+{
+	/* Search 64MiB of data for sets of patterns which only match at the end, one pattern at
+	 * a time and using the automaton.
+	*/
+	
+	const size_t DATA_SIZE = 64 * 1024 * 1024;
+	
+	std::vector<unsigned char> data(DATA_SIZE);
+	
+	srand(0);
+	for(size_t i = 0; i < DATA_SIZE; ++i)
+	{
+		data[i] = rand();
+	}
+	
+	for(size_t n_patterns = 2; n_patterns <= 32; n_patterns *= 2)
+	{
+		std::vector< std::vector<unsigned char> > patterns(n_patterns);
+		
+		for(auto p = patterns.begin(); p != patterns.end(); ++p)
+		{
+			p->resize(8);
+			
+			for(auto c = p->begin(); c != p->end(); ++c)
+			{
+				*c = rand();
+			}
+		}
+		
+		memcpy((data.data() + DATA_SIZE - 8), patterns.back().data(), 8);
+		
+		for(int automaton = 0; automaton <= 1; ++automaton)
+		{
+			MultiSearchKernel k(patterns, (automaton ? 0 : n_patterns));
+			
+			auto start = std::chrono::steady_clock::now();
+			
+			const unsigned char *match = k.find(data.data(), (data.data() + DATA_SIZE));
+			
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+			printf("MultiSearchKernel (%s) searched %zuMiB for %zu patterns in %lldms\n",
+				(automaton ? "automaton" : "per-pattern"), (DATA_SIZE / (1024 * 1024)), n_patterns, (long long)(elapsed.count()));
+			
+			EXPECT_EQ(match, (data.data() + DATA_SIZE - 8));
+		}
+	}
+}
+
+static ssize_t masked_find(const MaskedSearchKernel &kernel, const std::string &haystack)
+{
+	const unsigned char *begin = (const unsigned char*)(haystack.data());
+	const unsigned char *match = kernel.find(begin, (begin + haystack.size()));
+	
+	return match != NULL ? (match - begin) : -1;
+}
+
+static ssize_t masked_rfind(const MaskedSearchKernel &kernel, const std::string &haystack)
+{
+	const unsigned char *begin = (const unsigned char*)(haystack.data());
+	const unsigned char *match = kernel.rfind(begin, (begin + haystack.size()));
+	
+	return match != NULL ? (match - begin) : -1;
+}
+
+TEST(MaskedSearchKernel, Wildcards)
+{
+	const unsigned char PATTERN[] = { 'M', 'Z', 0x00, 0x00, 'P', 'E' };
+	const unsigned char MASK[]    = { 0xFF, 0xFF, 0x00, 0x00, 0xFF, 0xFF };
+	
+	MaskedSearchKernel k(PATTERN, MASK, sizeof(PATTERN));
+	
+	EXPECT_EQ(k.length(), 6U);
+	
+	EXPECT_EQ(masked_find(k, "MZ..PE"), 0);
+	EXPECT_EQ(masked_find(k, "xxMZMZabPExx"), 4);
+	EXPECT_EQ(masked_find(k, "MZabP"), -1);
+	EXPECT_EQ(masked_find(k, "xMZabPExxMZcdPE"), 1);
+	EXPECT_EQ(masked_rfind(k, "xMZabPExxMZcdPE"), 9);
+	EXPECT_EQ(masked_rfind(k, "xMZabPExxMZcdP"), 1);
+}
+
+TEST(MaskedSearchKernel, NibbleMask)
+{
+	/* No fixed bytes at all, so the kernel has to probe with the masks. */
+	
+	const unsigned char PATTERN[] = { 0xA0, 0x0B, 0x00 };
+	const unsigned char MASK[]    = { 0xF0, 0x0F, 0x00 };
+	
+	MaskedSearchKernel k(PATTERN, MASK, sizeof(PATTERN));
+	
+	EXPECT_EQ(masked_find(k, "\xA1\x1B"), -1);
+	EXPECT_EQ(masked_find(k, std::string("\x0A\xA1\x1B\x00", 4)), 1);
+	EXPECT_EQ(masked_find(k, "\xAF\xFB\xFF\xA0\x0B\x00"), 0);
+	EXPECT_EQ(masked_rfind(k, "\xAF\xFB\xFF\xA0\x0B\x01"), 3);
+	EXPECT_EQ(masked_find(k, std::string("\xB0\x0B\x00\xA0\x0C\x00", 6)), -1);
+}
+
+TEST(MaskedSearchKernel, EmptyPattern)
+{
+	MaskedSearchKernel k;
+	
+	EXPECT_EQ(masked_find(k, "abc"), 0);
+	EXPECT_EQ(masked_rfind(k, "abc"), 3);
+}
+
+TEST(MaskedSearchKernel, MatchesNaiveSearch)
+{
+	/* Search small alphabets with random masks, so there are lots of partial matches, for
+	 * patterns with and without a run of fixed bytes to anchor on.
+	*/
+	
+	srand(0);
+	
+	for(int i = 0; i < 10000; ++i)
+	{
+		static const unsigned char MASKS[] = { 0xFF, 0xFF, 0xF0, 0x0F, 0x01, 0x00 };
+		
+		int alphabet_size = 1 + (rand() % 4);
+		bool anchored = (i % 2) == 0;
+		
+		std::vector<unsigned char> haystack(rand() % 300);
+		std::vector<unsigned char> pattern(1 + (rand() % ((i % 3) == 0 ? 40 : 8)));
+		std::vector<unsigned char> mask(pattern.size());
+		
+		for(auto c = haystack.begin(); c != haystack.end(); ++c)
+		{
+			*c = 0x60 + (rand() % alphabet_size) * 0x11;
+		}
+		
+		for(size_t j = 0; j < pattern.size(); ++j)
+		{
+			pattern[j] = 0x60 + (rand() % alphabet_size) * 0x11;
+			mask[j] = MASKS[(anchored ? 0 : 2) + (rand() % (anchored ? 6 : 4))];
+		}
+		
+		const unsigned char *begin = haystack.data();
+		const unsigned char *end   = begin + haystack.size();
+		
+		auto naive_match_at = [&](size_t at)
+		{
+			for(size_t j = 0; j < pattern.size(); ++j)
+			{
+				if((haystack[at + j] & mask[j]) != (pattern[j] & mask[j]))
+				{
+					return false;
+				}
+			}
+			
+			return true;
+		};
+		
+		std::vector<ssize_t> expect;
+		
+		for(size_t at = 0; (at + pattern.size()) <= haystack.size(); ++at)
+		{
+			if(naive_match_at(at))
+			{
+				expect.push_back(at);
+			}
+		}
+		
+		for(int level = SearchKernel::SIMD_NONE; level <= SearchKernel::detect_simd(); ++level)
+		{
+			MaskedSearchKernel k(pattern.data(), mask.data(), pattern.size());
+			k.limit_simd((SearchKernel::SIMDLevel)(level));
+			
+			std::vector<ssize_t> got;
+			
+			for(const unsigned char *match = begin; (match = k.find(match, end)) != NULL; ++match)
+			{
+				got.push_back(match - begin);
+			}
+			
+			ASSERT_EQ(got, expect) << "MaskedSearchKernel finds same matches as naive search (iteration " << i << ", SIMD level " << level << ")";
+			
+			got.clear();
+			
+			for(const unsigned char *to = end, *match; (match = k.rfind(begin, to)) != NULL; to = match + pattern.size() - 1)
+			{
+				got.insert(got.begin(), (match - begin));
+			}
+			
+			ASSERT_EQ(got, expect) << "MaskedSearchKernel::rfind() finds same matches as naive search (iteration " << i << ", SIMD level " << level << ")";
+		}
+	}
+}
+
+TEST(MaskedSearchKernel, DISABLED_Benchmark)
+{
+	/* Search 64MiB of data for a pattern with wildcards (anchored on its fixed bytes) and one
+	 * with only nibble masks (probed) at the end, using each instruction set the CPU supports.
+	*/
+	
+	const size_t DATA_SIZE = 64 * 1024 * 1024;
+	
+	std::vector<unsigned char> data(DATA_SIZE);
+	
+	srand(0);
+	for(size_t i = 0; i < DATA_SIZE; ++i)
+	{
+		data[i] = rand();
+	}
+	
+	const unsigned char PATTERN[] = { 0x4D, 0x5A, 0x90, 0x00, 0x03, 0x00, 0x00, 0x00 };
+	
+	const unsigned char ANCHORED_MASK[] = { 0xFF, 0xFF, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0x00 };
+	const unsigned char PROBED_MASK[]   = { 0xF0, 0xFF, 0x0F, 0x00, 0xFF, 0x0F, 0xF0, 0x0F };
+	
+	memcpy((data.data() + DATA_SIZE - sizeof(PATTERN)), PATTERN, sizeof(PATTERN));
+	
+	const char *LEVEL_NAMES[] = { "scalar", "SSE2", "AVX2" };
+	
+	for(int probed = 0; probed <= 1; ++probed)
+	{
+		for(int level = SearchKernel::SIMD_NONE; level <= SearchKernel::detect_simd(); ++level)
+		{
+			MaskedSearchKernel k(PATTERN, (probed ? PROBED_MASK : ANCHORED_MASK), sizeof(PATTERN));
+			k.limit_simd((SearchKernel::SIMDLevel)(level));
+			
+			auto start = std::chrono::steady_clock::now();
+			
+			const unsigned char *match = k.find(data.data(), (data.data() + DATA_SIZE));
+			
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+			printf("MaskedSearchKernel (%s, %s) searched %zuMiB in %lldms\n",
+				(probed ? "probed" : "anchored"), LEVEL_NAMES[level], (DATA_SIZE / (1024 * 1024)), (long long)(elapsed.count()));
+			
+			EXPECT_EQ(match, (data.data() + DATA_SIZE - sizeof(PATTERN)));
+		}
+	}
+}
+
+/* Returns the offset of every value found by the kernel, searching forwards from the start of
+ * the data and backwards from the end.
+*/
+static std::vector<ssize_t> range_find_all(const RangeSearchKernel &k, const std::vector<unsigned char> &data, size_t stride)
+{
+	const unsigned char *begin = data.data();
+	const unsigned char *end   = begin + data.size();
+	
+	std::vector<ssize_t> got;
+	
+	for(const unsigned char *at = begin, *match; (match = k.find(at, end, stride)) != NULL; at = match + stride)
+	{
+		got.push_back(match - begin);
+	}
+	
+	return got;
+}
+
+static std::vector<ssize_t> range_rfind_all(const RangeSearchKernel &k, const std::vector<unsigned char> &data, size_t stride)
+{
+	const unsigned char *begin = data.data();
+	const unsigned char *end   = begin + data.size();
+	
+	std::vector<ssize_t> got;
+	
+	for(const unsigned char *limit = end, *match; (match = k.rfind(begin, end, limit, stride)) != NULL;)
+	{
+		got.insert(got.begin(), (match - begin));
+		
+		if((size_t)(match - begin) < stride)
+		{
+			break;
+		}
+		
+		limit = match - stride + 1;
+	}
+	
+	return got;
+}
+
+TEST(RangeSearchKernel, Integers)
+{
+	const std::vector<unsigned char> DATA = {
+		0x10, 0x00, 0x00, 0x01, 0xFF, 0xFF, 0x7F, 0x80,
+	};
+	
+	for(int level = SearchKernel::SIMD_NONE; level <= SearchKernel::detect_simd(); ++level)
+	{
+		auto check = [&](RangeSearchKernel k, const std::vector<ssize_t> &expect, const char *desc)
+		{
+			k.limit_simd((SearchKernel::SIMDLevel)(level));
+			
+			EXPECT_EQ(range_find_all(k, DATA, 1), expect) << desc << " (SIMD level " << level << ")";
+			EXPECT_EQ(range_rfind_all(k, DATA, 1), expect) << desc << " (SIMD level " << level << ")";
+		};
+		
+		check(RangeSearchKernel::unsigned_range(1, false, 0x7F, 0x80), { 6, 7 }, "RangeSearchKernel finds unsigned 8-bit values");
+		check(RangeSearchKernel::signed_range(1, false, -128, -1), { 4, 5, 7 }, "RangeSearchKernel finds signed 8-bit values");
+		check(RangeSearchKernel::unsigned_range(2, false, 0x0100, 0x0100), { 2 }, "RangeSearchKernel finds unsigned little endian 16-bit values");
+		check(RangeSearchKernel::unsigned_range(2, true, 0x01FF, 0x01FF), { 3 }, "RangeSearchKernel finds unsigned big endian 16-bit values");
+		check(RangeSearchKernel::signed_range(2, false, -129, 16), { 0, 1, 4 }, "RangeSearchKernel finds signed little endian 16-bit values");
+		check(RangeSearchKernel::signed_range(4, true, INT32_MIN, -1), { 4 }, "RangeSearchKernel finds signed big endian 32-bit values");
+		check(RangeSearchKernel::unsigned_range(4, false, 0x7FFFFF00, UINT64_MAX), { 1, 2, 3, 4 }, "RangeSearchKernel clamps range to size of type");
+		check(RangeSearchKernel::unsigned_range(8, true, 0x1000000100000000ULL, 0x10000001FFFFFFFFULL), { 0 }, "RangeSearchKernel finds unsigned big endian 64-bit values");
+		check(RangeSearchKernel::signed_range(8, false, INT64_MIN, 0), { 0 }, "RangeSearchKernel finds signed little endian 64-bit values");
+		check(RangeSearchKernel::unsigned_range(1, false, 0x100, 0x200), {}, "RangeSearchKernel doesn't match range outside type");
+		check(RangeSearchKernel::unsigned_range(1, false, 0x20, 0x10), {}, "RangeSearchKernel doesn't match empty range");
+		check(RangeSearchKernel(), {}, "Default RangeSearchKernel doesn't match");
+	}
+}
+
+TEST(RangeSearchKernel, Floats)
+{
+	std::vector<unsigned char> floats, doubles;
+	
+	auto append_float = [&](float f)
+	{
+		floats.insert(floats.end(), (unsigned char*)(&f), (unsigned char*)(&f + 1));
+	};
+	
+	auto append_double = [&](double d)
+	{
+		doubles.insert(doubles.end(), (unsigned char*)(&d), (unsigned char*)(&d + 1));
+	};
+	
+	append_float(1.5f);
+	append_float(-0.0f);
+	append_float(0.0f);
+	append_float(-2.25f);
+	append_float(NAN);
+	append_float(INFINITY);
+	append_double(3.14159);
+	append_double(NAN);
+	append_double(-1e300);
+	
+	for(int level = SearchKernel::SIMD_NONE; level <= SearchKernel::detect_simd(); ++level)
+	{
+		auto check = [&](RangeSearchKernel k, const std::vector<unsigned char> &data, size_t stride, const std::vector<ssize_t> &expect, const char *desc)
+		{
+			k.limit_simd((SearchKernel::SIMDLevel)(level));
+			
+			EXPECT_EQ(range_find_all(k, data, stride), expect) << desc << " (SIMD level " << level << ")";
+		};
+		
+		check(RangeSearchKernel::float_range(4, false, 1.5 - 1e-6, 1.5 + 1e-6), floats, 4, { 0 }, "RangeSearchKernel finds float within tolerance");
+		check(RangeSearchKernel::float_range(4, false, 0.0, 0.0), floats, 4, { 4, 8 }, "RangeSearchKernel matches -0.0 and 0.0");
+		check(RangeSearchKernel::float_range(4, false, -3.0, -2.0), floats, 4, { 12 }, "RangeSearchKernel finds negative float");
+		check(RangeSearchKernel::float_range(4, false, -INFINITY, INFINITY), floats, 4, { 0, 4, 8, 12, 20 }, "RangeSearchKernel doesn't match NaN");
+		check(RangeSearchKernel::float_range(4, false, 1.5000001, 1.6), floats, 4, {}, "RangeSearchKernel rounds bounds inside range");
+		check(RangeSearchKernel::float_range(8, false, 3.1415, 3.1416), doubles, 8, { 0 }, "RangeSearchKernel finds double within tolerance");
+		check(RangeSearchKernel::float_range(8, false, -INFINITY, INFINITY), doubles, 8, { 0, 16 }, "RangeSearchKernel doesn't match NaN double");
+		check(RangeSearchKernel::float_range(8, false, -INFINITY, -1e299), doubles, 8, { 16 }, "RangeSearchKernel finds negative double");
+		check(RangeSearchKernel::float_range(4, false, NAN, 1.0), floats, 4, {}, "RangeSearchKernel with NaN bound doesn't match");
+	}
+	
+	std::vector<unsigned char> be_data = { 0x3F, 0xC0, 0x00, 0x00 };
+	EXPECT_TRUE(RangeSearchKernel::float_range(4, true, 1.5, 1.5).match_at(be_data.data())) << "RangeSearchKernel matches big endian float";
+}
+
+TEST(RangeSearchKernel, Stride)
+{
+	std::vector<unsigned char> data(100, 0x00);
+	
+	for(size_t i = 0; i < data.size(); i += 3)
+	{
+		data[i] = 0x01;
+	}
+	
+	for(int level = SearchKernel::SIMD_NONE; level <= SearchKernel::detect_simd(); ++level)
+	{
+		RangeSearchKernel k = RangeSearchKernel::unsigned_range(1, false, 1, 1);
+		k.limit_simd((SearchKernel::SIMDLevel)(level));
+		
+		EXPECT_EQ(range_find_all(k, data, 4), std::vector<ssize_t>({ 0, 12, 24, 36, 48, 60, 72, 84, 96 }))
+			<< "RangeSearchKernel only finds values on stride (SIMD level " << level << ")";
+		
+		EXPECT_EQ(k.rfind(data.data(), (data.data() + data.size()), (data.data() + 97), 4), (data.data() + 96))
+			<< "RangeSearchKernel::rfind() finds value at (limit - 1) (SIMD level " << level << ")";
+		
+		EXPECT_EQ(k.rfind(data.data(), (data.data() + data.size()), (data.data() + 96), 4), (data.data() + 87))
+			<< "RangeSearchKernel::rfind() only finds values on stride below (limit - 1) (SIMD level " << level << ")";
+	}
+}
+
+TEST(RangeSearchKernel, MatchesNaiveSearch)
+{
+	srand(0);
+	
+	for(int i = 0; i < 20000; ++i)
+	{
+		static const size_t WIDTHS[]  = { 1, 2, 4, 8 };
+		static const size_t STRIDES[] = { 1, 1, 2, 3, 4, 8, 16, 32, 64 };
+		
+		RangeSearchKernel::Type type = (RangeSearchKernel::Type)(rand() % 3);
+		size_t width  = (type == RangeSearchKernel::FLOAT) ? WIDTHS[2 + (rand() % 2)] : WIDTHS[rand() % 4];
+		size_t stride = STRIDES[rand() % 9];
+		bool big_endian = (rand() % 2) == 0;
+		
+		/* Use few distinct bytes so values often fall within the range. */
+		
+		std::vector<unsigned char> data(rand() % 400);
+		static const unsigned char BYTES[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF, 0x3F, 0xBF, 0xC0 };
+		
+		for(auto c = data.begin(); c != data.end(); ++c)
+		{
+			*c = (rand() % 4) == 0 ? rand() : BYTES[rand() % 8];
+		}
+		
+		/* Reads the value at an offset, as an integer (sign extended if signed) and as a
+		 * floating point value.
+		*/
+		auto value_at = [&](const unsigned char *h, uint64_t *i, double *d)
+		{
+			uint64_t v = 0;
+			for(size_t j = 0; j < width; ++j)
+			{
+				v |= (uint64_t)(h[j]) << (8 * (big_endian ? (width - 1 - j) : j));
+			}
+			
+			if(type == RangeSearchKernel::SIGNED && width < 8 && (v & (1ULL << (width * 8 - 1))))
+			{
+				v |= ~((1ULL << (width * 8)) - 1);
+			}
+			
+			*i = v;
+			
+			if(width == 4)
+			{
+				uint32_t v32 = v;
+				float f;
+				memcpy(&f, &v32, sizeof(f));
+				*d = f;
+			}
+			else{
+				memcpy(d, &v, sizeof(*d));
+			}
+		};
+		
+		/* Take the bounds from values in the data. */
+		
+		std::vector<unsigned char> bounds(16);
+		for(auto c = bounds.begin(); c != bounds.end(); ++c)
+		{
+			*c = (rand() % 4) == 0 ? rand() : BYTES[rand() % 8];
+		}
+		
+		uint64_t i_min, i_max;
+		double d_min, d_max;
+		value_at(bounds.data(), &i_min, &d_min);
+		value_at((bounds.data() + 8), &i_max, &d_max);
+		
+		RangeSearchKernel k;
+		std::function<bool(const unsigned char*)> naive_match_at;
+		
+		if(type == RangeSearchKernel::UNSIGNED)
+		{
+			if(i_min > i_max) { std::swap(i_min, i_max); }
+			
+			k = RangeSearchKernel::unsigned_range(width, big_endian, i_min, i_max);
+			naive_match_at = [&](const unsigned char *h) { uint64_t v; double d; value_at(h, &v, &d); return v >= i_min && v <= i_max; };
+		}
+		else if(type == RangeSearchKernel::SIGNED)
+		{
+			if((int64_t)(i_min) > (int64_t)(i_max)) { std::swap(i_min, i_max); }
+			
+			k = RangeSearchKernel::signed_range(width, big_endian, i_min, i_max);
+			naive_match_at = [&](const unsigned char *h) { uint64_t v; double d; value_at(h, &v, &d); return (int64_t)(v) >= (int64_t)(i_min) && (int64_t)(v) <= (int64_t)(i_max); };
+		}
+		else{
+			if(std::isnan(d_min)) { d_min = -1.0; }
+			if(std::isnan(d_max)) { d_max = 1.0; }
+			if(d_min > d_max) { std::swap(d_min, d_max); }
+			
+			k = RangeSearchKernel::float_range(width, big_endian, d_min, d_max);
+			naive_match_at = [&](const unsigned char *h) { uint64_t v; double d; value_at(h, &v, &d); return d >= d_min && d <= d_max; };
+		}
+		
+		std::vector<ssize_t> expect_forward, expect_backward;
+		
+		for(size_t at = 0; (at + width) <= data.size(); at += stride)
+		{
+			if(naive_match_at(data.data() + at))
+			{
+				expect_forward.push_back(at);
+			}
+		}
+		
+		for(size_t at = (data.size() + stride - 1) % stride; (at + width) <= data.size(); at += stride)
+		{
+			if(at < data.size() && naive_match_at(data.data() + at))
+			{
+				expect_backward.push_back(at);
+			}
+		}
+		
+		for(int level = SearchKernel::SIMD_NONE; level <= SearchKernel::detect_simd(); ++level)
+		{
+			k.limit_simd((SearchKernel::SIMDLevel)(level));
+			
+			ASSERT_EQ(range_find_all(k, data, stride), expect_forward)
+				<< "RangeSearchKernel finds same matches as naive search (iteration " << i << ", type " << type << ", width " << width
+				<< ", stride " << stride << ", SIMD level " << level << ")";
+			
+			ASSERT_EQ(range_rfind_all(k, data, stride), expect_backward)
+				<< "RangeSearchKernel::rfind() finds same matches as naive search (iteration " << i << ", type " << type << ", width " << width
+				<< ", stride " << stride << ", SIMD level " << level << ")";
+		}
+	}
+}
+
+TEST(RangeSearchKernel, DISABLED_Benchmark)
+{
+	/* Search 64MiB of data for a 32-bit value in a range at every offset, and aligned to 4
+	 * bytes, using each instruction set the CPU supports.
+	*/
+	
+	const size_t DATA_SIZE = 64 * 1024 * 1024;
+	
+	std::vector<unsigned char> data(DATA_SIZE);
+	
+	srand(0);
+	for(size_t i = 0; i < DATA_SIZE; ++i)
+	{
+		data[i] = rand() | 0x80;
+	}
+	
+	const unsigned char VALUE[] = { 0x10, 0x20, 0x30, 0x40 };
+	memcpy((data.data() + DATA_SIZE - sizeof(VALUE)), VALUE, sizeof(VALUE));
+	
+	const char *LEVEL_NAMES[] = { "scalar", "SSE2", "AVX2" };
+	
+	for(size_t stride = 1; stride <= 4; stride += 3)
+	{
+		for(int level = SearchKernel::SIMD_NONE; level <= SearchKernel::detect_simd(); ++level)
+		{
+			RangeSearchKernel k = RangeSearchKernel::signed_range(4, false, 0x40000000, 0x40302010);
+			k.limit_simd((SearchKernel::SIMDLevel)(level));
+			
+			auto start = std::chrono::steady_clock::now();
+			
+			const unsigned char *match = k.find(data.data(), (data.data() + DATA_SIZE), stride);
+			
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+			printf("RangeSearchKernel (stride %zu, %s) searched %zuMiB in %lldms\n",
+				stride, LEVEL_NAMES[level], (DATA_SIZE / (1024 * 1024)), (long long)(elapsed.count()));
+			
+			EXPECT_EQ(match, (data.data() + DATA_SIZE - sizeof(VALUE)));
+		}
+	}
+}
@@ -0,0 +1,172 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "../src/platform.hpp"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <string.h>
+#include <vector>
+#include <wx/frame.h>
+
+#include "../src/document.hpp"
+#include "../src/DocumentCtrl.hpp"
+#include "../src/search.hpp"
+#include "../src/SearchResultsPanel.hpp"
+#include "../src/SharedDocumentPointer.hpp"
+
+using namespace REHex;
+
+class SearchResultsPanelTest: public ::testing::Test
+{
+	protected:
+		wxFrame frame;
+		
+		SharedDocumentPointer doc;
+		DocumentCtrl *main_doc_ctrl;
+		
+		SearchResultsPanelTest():
+			frame(NULL, wxID_ANY, "REHex Tests"),
+			doc(SharedDocumentPointer::make())
+		{
+			main_doc_ctrl = new DocumentCtrl(&frame, doc);
+		}
+};
+
+TEST_F(SearchResultsPanelTest, AddMatches)
+{
+	SearchResultsPanel *results = new SearchResultsPanel(&frame, doc, main_doc_ctrl);
+	
+	std::vector<SearchMatch> batch;
+	
+	batch = { SearchMatch(40, 4), SearchMatch(10, 4), SearchMatch(30, 2) };
+	results->add_matches(batch);
+	
+	EXPECT_TRUE(batch.empty()) << "SearchResultsPanel::add_matches() empties batch";
+	EXPECT_EQ(results->get_matches(), std::vector<SearchMatch>({
+		SearchMatch(10, 4), SearchMatch(30, 2), SearchMatch(40, 4) })) << "SearchResultsPanel::add_matches() sorts batch";
+	
+	batch = { SearchMatch(60, 1), SearchMatch(50, 4) };
+	results->add_matches(batch);
+	
+	EXPECT_EQ(results->get_matches(), std::vector<SearchMatch>({
+		SearchMatch(10, 4), SearchMatch(30, 2), SearchMatch(40, 4), SearchMatch(50, 4), SearchMatch(60, 1) })) << "SearchResultsPanel::add_matches() appends batch after existing matches";
+	
+	batch = { SearchMatch(70, 4), SearchMatch(20, 4), SearchMatch(0, 3), SearchMatch(35, 4) };
+	results->add_matches(batch);
+	
+	EXPECT_EQ(results->get_matches(), std::vector<SearchMatch>({
+		SearchMatch(0, 3), SearchMatch(10, 4), SearchMatch(20, 4), SearchMatch(30, 2), SearchMatch(35, 4),
+		SearchMatch(40, 4), SearchMatch(50, 4), SearchMatch(60, 1), SearchMatch(70, 4) })) << "SearchResultsPanel::add_matches() merges batch with existing matches";
+}
+
+TEST_F(SearchResultsPanelTest, FindAll)
+{
+	std::vector<unsigned char> data(4096, 0x00);
+	
+	for(size_t i = 0; i < data.size(); i += 100)
+	{
+		data[i] = 0xAA;
+		data[i + 1] = 0xAA;
+		data[i + 2] = 0xAA;
+	}
+	
+	doc->insert_data(0, data.data(), data.size());
+	
+	const unsigned char SEARCH_DATA[] = { 0xAA, 0xAA };
+	Search::ByteSequence s(&frame, doc, std::vector<unsigned char>(SEARCH_DATA, SEARCH_DATA + 2));
+	
+	std::vector<SearchMatch> expect_matches;
+	for(off_t i = 0; i < (off_t)(data.size()); i += 100)
+	{
+		expect_matches.push_back(SearchMatch(i, 2));
+		expect_matches.push_back(SearchMatch((i + 1), 2));
+	}
+	
+	{
+		/* Small windows, so matches are found by many threads and some span windows. */
+		
+		SearchResultsPanel *results = new SearchResultsPanel(&frame, doc, main_doc_ctrl);
+		s.find_all(results, 64);
+		
+		EXPECT_EQ(results->get_matches(), expect_matches) << "Search::find_all() lists every match, including overlapping ones";
+	}
+	
+	{
+		SearchResultsPanel *results = new SearchResultsPanel(&frame, doc, main_doc_ctrl);
+		
+		s.limit_range(1000, 2000);
+		s.require_alignment(2);
+		s.find_all(results, 64);
+		
+		std::vector<SearchMatch> expect_aligned;
+		std::copy_if(expect_matches.begin(), expect_matches.end(), std::back_inserter(expect_aligned),
+			[](const SearchMatch &m) { return m.offset >= 1000 && (m.offset + 2) <= 2000 && (m.offset % 2) == 0; });
+		
+		EXPECT_EQ(results->get_matches(), expect_aligned) << "Search::find_all() honours search range and alignment";
+	}
+}
+
+TEST_F(SearchResultsPanelTest, FindAllLengths)
+{
+	const char *DATA = "xxabbbxxaxxabx";
+	doc->insert_data(0, (const unsigned char*)(DATA), strlen(DATA));
+	
+	Search::Regex s(&frame, doc, "ab*");
+	
+	SearchResultsPanel *results = new SearchResultsPanel(&frame, doc, main_doc_ctrl);
+	s.find_all(results, 4);
+	
+	EXPECT_EQ(results->get_matches(), std::vector<SearchMatch>({
+		SearchMatch(2, 4), SearchMatch(8, 1), SearchMatch(11, 2) })) << "Search::find_all() reports the length of each match";
+}
+
+TEST_F(SearchResultsPanelTest, DataModified)
+{
+	std::vector<unsigned char> data(1024, 0x00);
+	doc->insert_data(0, data.data(), data.size());
+	
+	SearchResultsPanel *results = new SearchResultsPanel(&frame, doc, main_doc_ctrl);
+	
+	std::vector<SearchMatch> batch = { SearchMatch(10, 4), SearchMatch(96, 4), SearchMatch(100, 1), SearchMatch(200, 4), SearchMatch(300, 4) };
+	results->add_matches(batch);
+	
+	doc->insert_data(101, data.data(), 10);
+	EXPECT_EQ(results->get_matches(), std::vector<SearchMatch>({
+		SearchMatch(10, 4), SearchMatch(96, 4), SearchMatch(100, 1), SearchMatch(210, 4), SearchMatch(310, 4) })) << "SearchResultsPanel keeps matches ending before insert and moves later ones";
+	
+	doc->insert_data(98, data.data(), 10);
+	EXPECT_EQ(results->get_matches(), std::vector<SearchMatch>({
+		SearchMatch(10, 4), SearchMatch(110, 1), SearchMatch(220, 4), SearchMatch(320, 4) })) << "SearchResultsPanel drops match split by insert and moves later ones";
+	
+	doc->insert_data(220, data.data(), 5);
+	EXPECT_EQ(results->get_matches(), std::vector<SearchMatch>({
+		SearchMatch(10, 4), SearchMatch(110, 1), SearchMatch(225, 4), SearchMatch(325, 4) })) << "SearchResultsPanel moves match at insert point";
+	
+	doc->erase_data(111, 114);
+	EXPECT_EQ(results->get_matches(), std::vector<SearchMatch>({
+		SearchMatch(10, 4), SearchMatch(110, 1), SearchMatch(111, 4), SearchMatch(211, 4) })) << "SearchResultsPanel keeps matches ending before and starting at end of erase";
+	
+	doc->erase_data(112, 5);
+	EXPECT_EQ(results->get_matches(), std::vector<SearchMatch>({
+		SearchMatch(10, 4), SearchMatch(110, 1), SearchMatch(206, 4) })) << "SearchResultsPanel drops match overlapping erase and moves later ones";
+	
+	doc->erase_data(0, 7);
+	EXPECT_EQ(results->get_matches(), std::vector<SearchMatch>({
+		SearchMatch(3, 4), SearchMatch(103, 1), SearchMatch(199, 4) })) << "SearchResultsPanel moves matches after erase";
+}
@@ -18,6 +18,7 @@
 #undef NDEBUG
 #include "../src/platform.hpp"
 #include <assert.h>
+#include <string.h>
 
 #include <gtest/gtest.h>
 #include <wx/frame.h>
@@ -768,3 +769,110 @@ TEST(SearchValue, SearchFor1664EE)
 		EXPECT_TRUE(s.test(&check, sizeof(check))) << "Matches 64-bit big endian value";
 	}
 }
+
+TEST(SearchValue, SearchForIntegerRange)
+{
+	wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+	REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make());
+	
+	REHex::Search::ValueRange s(&frame, doc);
+	s.configure("-10", "300", REHex::RangeSearchKernel::SIGNED, 2, REHex::Search::ValueRange::FMT_LE);
+	
+	{
+		int16_t check = htole16s(-10);
+		EXPECT_TRUE(s.test(&check, sizeof(check))) << "Matches start of range";
+	}
+	
+	{
+		int16_t check = htole16s(300);
+		EXPECT_TRUE(s.test(&check, sizeof(check))) << "Matches end of range";
+	}
+	
+	{
+		int16_t check = htole16s(-11);
+		EXPECT_FALSE(s.test(&check, sizeof(check))) << "Doesn't match value before range";
+	}
+	
+	{
+		int16_t check = htole16s(301);
+		EXPECT_FALSE(s.test(&check, sizeof(check))) << "Doesn't match value after range";
+	}
+	
+	{
+		int16_t check = htobe16s(200);
+		EXPECT_FALSE(s.test(&check, sizeof(check))) << "Doesn't match big endian value";
+	}
+	
+	{
+		uint8_t check = 5;
+		EXPECT_FALSE(s.test(&check, sizeof(check))) << "Doesn't match truncated value";
+	}
+	
+	s.configure("40000", "", REHex::RangeSearchKernel::UNSIGNED, 4, (REHex::Search::ValueRange::FMT_LE | REHex::Search::ValueRange::FMT_BE));
+	
+	{
+		uint32_t check = htole32(40000);
+		EXPECT_TRUE(s.test(&check, sizeof(check))) << "Matches single little endian value";
+	}
+	
+	{
+		uint32_t check = htobe32(40000);
+		EXPECT_TRUE(s.test(&check, sizeof(check))) << "Matches single big endian value";
+	}
+	
+	{
+		uint32_t check = htole32(40001);
+		EXPECT_FALSE(s.test(&check, sizeof(check))) << "Doesn't match different value";
+	}
+}
+
+TEST(SearchValue, SearchForFloatRange)
+{
+	wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+	REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make());
+	
+	REHex::Search::ValueRange s(&frame, doc);
+	s.configure("3.14159", "", REHex::RangeSearchKernel::FLOAT, 4, REHex::Search::ValueRange::FMT_LE, "0.001");
+	
+	EXPECT_EQ(s.test_max_window(), 4U);
+	
+	{
+		float f = 3.1412f;
+		uint32_t check;
+		memcpy(&check, &f, sizeof(check));
+		check = htole32(check);
+		
+		EXPECT_TRUE(s.test(&check, sizeof(check))) << "Matches value within tolerance";
+	}
+	
+	{
+		float f = 3.14f;
+		uint32_t check;
+		memcpy(&check, &f, sizeof(check));
+		check = htole32(check);
+		
+		EXPECT_FALSE(s.test(&check, sizeof(check))) << "Doesn't match value outside tolerance";
+	}
+	
+	s.configure("-1", "1", REHex::RangeSearchKernel::FLOAT, 8, REHex::Search::ValueRange::FMT_BE);
+	
+	EXPECT_EQ(s.test_max_window(), 8U);
+	
+	{
+		double d = -0.5;
+		uint64_t check;
+		memcpy(&check, &d, sizeof(check));
+		check = htobe64(check);
+		
+		EXPECT_TRUE(s.test(&check, sizeof(check))) << "Matches big endian double in range";
+	}
+	
+	{
+		double d = 1.5;
+		uint64_t check;
+		memcpy(&check, &d, sizeof(check));
+		check = htobe64(check);
+		
+		EXPECT_FALSE(s.test(&check, sizeof(check))) << "Doesn't match big endian double out of range";
+	}
+}
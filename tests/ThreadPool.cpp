@@ -0,0 +1,268 @@
+/* Reverse Engineer's Hex Editor
+ * Copyright (C) 2020 Daniel Collins <solemnwarning@solemnwarning.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#undef NDEBUG
+#include "../src/platform.hpp"
+#include <assert.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "../src/ThreadPool.hpp"
+
+using namespace REHex;
+
+/* Blocks each caller until the given number of threads have reached it. */
+class Barrier
+{
+	private:
+		std::mutex lock;
+		std::condition_variable cv;
+		unsigned int waiting;
+		
+	public:
+		const unsigned int count;
+		
+		Barrier(unsigned int count): waiting(0), count(count) {}
+		
+		void wait()
+		{
+			std::unique_lock<std::mutex> l(lock);
+			
+			if(++waiting >= count)
+			{
+				cv.notify_all();
+			}
+			
+			cv.wait(l, [this]() { return waiting >= count; });
+		}
+};
+
+TEST(ThreadPool, JobRunsOnWorkers)
+{
+	ThreadPool pool(4);
+	ASSERT_EQ(pool.size(), 4U);
+	
+	/* Each call claims items until there are none left, but not until every worker has
+	 * started the job, since no more are started once one call returns.
+	*/
+	
+	std::atomic<int> next_item(0);
+	std::vector<int> items(64, 0);
+	
+	std::mutex lock;
+	std::set<std::thread::id> threads;
+	
+	Barrier started(4);
+	
+	auto job = pool.submit([&]()
+	{
+		{
+			std::unique_lock<std::mutex> l(lock);
+			threads.insert(std::this_thread::get_id());
+		}
+		
+		started.wait();
+		
+		for(int i; (i = next_item++) < (int)(items.size());)
+		{
+			++items[i];
+		}
+	});
+	
+	job->wait();
+	
+	EXPECT_TRUE(job->finished());
+	EXPECT_EQ(items, std::vector<int>(64, 1)) << "Every item was processed once";
+	
+	EXPECT_EQ(threads.size(), 4U) << "Job ran on every worker";
+	EXPECT_EQ(threads.count(std::this_thread::get_id()), 0U) << "Job didn't run on the submitting thread";
+}
+
+TEST(ThreadPool, MaxWorkers)
+{
+	ThreadPool pool(4);
+	
+	std::atomic<int> running(0), max_running(0);
+	std::atomic<int> next_item(0);
+	
+	/* Hold each call until both workers have started the job, then keep them running
+	 * long enough that any other worker which was (wrongly) going to start it does.
+	*/
+	
+	Barrier started(2);
+	
+	auto job = pool.submit([&]()
+	{
+		int r = ++running;
+		
+		for(int m = max_running; r > m && !max_running.compare_exchange_weak(m, r);) {}
+		
+		started.wait();
+		
+		while(next_item++ < 32)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+		
+		--running;
+	}, 2);
+	
+	job->wait();
+	
+	EXPECT_EQ(max_running, 2) << "Job doesn't run on more workers than requested";
+}
+
+TEST(ThreadPool, WorkersArePersistent)
+{
+	ThreadPool pool(2);
+	
+	std::mutex lock;
+	std::set<std::thread::id> threads;
+	
+	for(int i = 0; i < 200; ++i)
+	{
+		auto job = pool.submit([&]()
+		{
+			std::unique_lock<std::mutex> l(lock);
+			threads.insert(std::this_thread::get_id());
+		});
+		
+		job->wait();
+	}
+	
+	EXPECT_LE(threads.size(), 2U) << "Jobs are run on the same workers";
+}
+
+TEST(ThreadPool, Cancel)
+{
+	ThreadPool pool(1);
+	
+	/* Keep the only worker busy so the next job can't start. */
+	
+	std::atomic<bool> release(false);
+	
+	auto busy = pool.submit([&]()
+	{
+		while(!release)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	});
+	
+	std::atomic<int> calls(0);
+	
+	auto job = pool.submit([&]() { ++calls; });
+	
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	EXPECT_FALSE(job->finished()) << "Job waits for a free worker";
+	
+	job->cancel();
+	
+	EXPECT_TRUE(job->finished()) << "Cancelled job which hadn't started finishes immediately";
+	job->wait();
+	
+	release = true;
+	busy->wait();
+	
+	/* Run another job through the worker so it has had a chance to pick up anything left
+	 * in the queue.
+	*/
+	pool.submit([]() {})->wait();
+	
+	EXPECT_EQ(calls, 0) << "Cancelled job which hadn't started never runs";
+}
+
+TEST(ThreadPool, CancelRunning)
+{
+	ThreadPool pool(2);
+	
+	std::atomic<int> calls(0);
+	std::atomic<bool> stop(false);
+	
+	auto job = pool.submit([&]()
+	{
+		++calls;
+		
+		while(!stop)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}, 1);
+	
+	while(calls == 0)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	
+	job->cancel();
+	
+	EXPECT_FALSE(job->finished()) << "Cancelled job isn't finished until running calls return";
+	
+	stop = true;
+	job->wait();
+	
+	EXPECT_TRUE(job->finished());
+	EXPECT_EQ(calls, 1);
+}
+
+TEST(ThreadPool, JobsStartInOrder)
+{
+	ThreadPool pool(1);
+	
+	std::mutex lock;
+	std::vector<int> order;
+	
+	std::vector< std::shared_ptr<ThreadPool::Job> > jobs;
+	
+	for(int i = 0; i < 10; ++i)
+	{
+		jobs.push_back(pool.submit([&, i]()
+		{
+			std::unique_lock<std::mutex> l(lock);
+			order.push_back(i);
+		}));
+	}
+	
+	for(auto j = jobs.begin(); j != jobs.end(); ++j)
+	{
+		(*j)->wait();
+	}
+	
+	EXPECT_EQ(order, std::vector<int>({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 }));
+}
+
+TEST(ThreadPool, Shared)
+{
+	ThreadPool &pool = ThreadPool::get_shared();
+	
+	EXPECT_EQ(&pool, &(ThreadPool::get_shared())) << "get_shared() always returns the same pool";
+	EXPECT_GE(pool.size(), 1U);
+	
+	std::atomic<int> calls(0);
+	
+	auto job = pool.submit([&]() { ++calls; });
+	job->wait();
+	
+	EXPECT_GE(calls, 1);
+}
@@ -2376,6 +2376,135 @@ TEST(Buffer, InsertMultiBlockFileBeyondEnd)
 	);
 }
 
+TEST(Buffer, ReplaceMultiBlockFileShrink)
+{
+	const std::vector<unsigned char> BEGIN_DATA = {
+		0x06, 0x96, 0x64, 0x58, 0xC9, 0xB5, 0x99, 0x4E,
+		0xE7, 0xA8, 0x06, 0x24, 0xEC, 0xB6, 0x8C, 0xD1,
+		0xE0, 0x3B, 0x0F, 0x7C, 0xAD, 0x80, 0xB3, 0xB4,
+		0x51, 0xA0, 0x0D, 0xAD, 0x67, 0xC9,
+	};
+	
+	const std::vector<unsigned char> END_DATA = {
+		0x06, 0x96, /* 0x64, 0x58, 0xC9, */ 0xAA, 0xB5, 0x99, /* 0x4E,
+		0xE7, 0xA8, */ 0xAA, 0x06, 0x24, 0xEC, 0xB6, 0x8C, 0xD1,
+		0xE0, 0x3B, 0x0F, 0x7C, /* 0xAD, 0x80, 0xB3, */ 0xAA, 0xB4,
+		0x51, 0xA0, 0x0D, 0xAD, 0x67, 0xC9,
+	};
+	
+	const std::vector<off_t> OFFSETS = { 2, 7, 20 };
+	const std::vector<unsigned char> NEW_DATA = { 0xAA };
+	
+	TEST_BUFFER_MANIP(
+		{
+			EXPECT_TRUE(b.replace_data(OFFSETS, 3, NEW_DATA.data(), NEW_DATA.size(), 0)) << "Buffer::replace_data() returns true";
+			
+			TEST_BLOCKS({
+				TEST_BLOCK_DEF(DIRTY,    0,  6);
+				TEST_BLOCK_DEF(DIRTY,    6,  6);
+				TEST_BLOCK_DEF(DIRTY,    12, 6);
+				TEST_BLOCK_DEF(UNLOADED, 18, 6);
+			});
+			
+			TEST_LENGTH(24);
+		}
+	);
+}
+
+TEST(Buffer, ReplaceMultiBlockFileGrow)
+{
+	const std::vector<unsigned char> BEGIN_DATA = {
+		0x06, 0x96, 0x64, 0x58, 0xC9, 0xB5, 0x99, 0x4E,
+		0xE7, 0xA8, 0x06, 0x24, 0xEC, 0xB6, 0x8C, 0xD1,
+		0xE0, 0x3B, 0x0F, 0x7C, 0xAD, 0x80, 0xB3, 0xB4,
+		0x51, 0xA0, 0x0D, 0xAD, 0x67, 0xC9,
+	};
+	
+	const std::vector<unsigned char> END_DATA = {
+		/* 0x06, */ 0x11, 0x22, 0x96, 0x64, 0x58, 0xC9, 0xB5, 0x99, 0x4E,
+		/* 0xE7, */ 0x33, 0x44, 0xA8, 0x06, 0x24, 0xEC, 0xB6, 0x8C, 0xD1,
+		0xE0, 0x3B, 0x0F, 0x7C, 0xAD, 0x80, 0xB3, 0xB4,
+		0x51, 0xA0, 0x0D, 0xAD, 0x67, /* 0xC9, */ 0x55, 0x66,
+	};
+	
+	const std::vector<off_t> OFFSETS = { 0, 8, 29 };
+	const std::vector<unsigned char> NEW_DATA = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+	
+	TEST_BUFFER_MANIP(
+		{
+			EXPECT_TRUE(b.replace_data(OFFSETS, 1, NEW_DATA.data(), 2, 2)) << "Buffer::replace_data() returns true";
+			
+			TEST_BLOCKS({
+				TEST_BLOCK_DEF(DIRTY,    0,  9);
+				TEST_BLOCK_DEF(DIRTY,    9,  9);
+				TEST_BLOCK_DEF(UNLOADED, 18, 8);
+				TEST_BLOCK_DEF(DIRTY,    26, 7);
+			});
+			
+			TEST_LENGTH(33);
+		}
+	);
+}
+
+TEST(Buffer, ReplaceMultiBlockFileAcrossBlocks)
+{
+	const std::vector<unsigned char> BEGIN_DATA = {
+		0x06, 0x96, 0x64, 0x58, 0xC9, 0xB5, 0x99, 0x4E,
+		0xE7, 0xA8, 0x06, 0x24, 0xEC, 0xB6, 0x8C, 0xD1,
+		0xE0, 0x3B, 0x0F, 0x7C, 0xAD, 0x80, 0xB3, 0xB4,
+		0x51, 0xA0, 0x0D, 0xAD, 0x67, 0xC9,
+	};
+	
+	const std::vector<unsigned char> END_DATA = {
+		0x06, 0x96, 0x64, 0x58, 0xC9, 0xB5, /* 0x99, 0x4E, */ 0xFF,
+		/* 0xE7, 0xA8, 0x06, 0x24, 0xEC, 0xB6, 0x8C, 0xD1, */
+		/* 0xE0, 0x3B, */ 0x0F, 0x7C, 0xAD, 0x80, 0xB3, 0xB4,
+		0x51, 0xA0, 0x0D, 0xAD, 0x67, 0xC9,
+	};
+	
+	const std::vector<off_t> OFFSETS = { 6 };
+	const std::vector<unsigned char> NEW_DATA = { 0xFF };
+	
+	TEST_BUFFER_MANIP(
+		{
+			EXPECT_TRUE(b.replace_data(OFFSETS, 12, NEW_DATA.data(), NEW_DATA.size(), 0)) << "Buffer::replace_data() returns true";
+			
+			TEST_BLOCKS({
+				TEST_BLOCK_DEF(DIRTY,    0,  7);
+				TEST_BLOCK_DEF(DIRTY,    7,  0);
+				TEST_BLOCK_DEF(DIRTY,    7,  6);
+				TEST_BLOCK_DEF(UNLOADED, 13, 6);
+			});
+			
+			TEST_LENGTH(19);
+		}
+	);
+}
+
+TEST(Buffer, ReplaceBadRanges)
+{
+	const std::vector<unsigned char> BEGIN_DATA = {
+		0x06, 0x96, 0x64, 0x58, 0xC9, 0xB5, 0x99, 0x4E,
+		0xE7, 0xA8, 0x06, 0x24, 0xEC, 0xB6, 0x8C, 0xD1,
+		0xE0, 0x3B, 0x0F, 0x7C, 0xAD, 0x80, 0xB3, 0xB4,
+		0x51, 0xA0, 0x0D, 0xAD, 0x67, 0xC9,
+	};
+	
+	const std::vector<unsigned char> END_DATA = BEGIN_DATA;
+	
+	const std::vector<unsigned char> NEW_DATA = { 0xFF };
+	
+	TEST_BUFFER_MANIP(
+		{
+			EXPECT_FALSE(b.replace_data(std::vector<off_t>({ 4, 2 }), 1, NEW_DATA.data(), NEW_DATA.size(), 0)) << "Buffer::replace_data() rejects unordered ranges";
+			EXPECT_FALSE(b.replace_data(std::vector<off_t>({ 2, 3 }), 2, NEW_DATA.data(), NEW_DATA.size(), 0)) << "Buffer::replace_data() rejects overlapping ranges";
+			EXPECT_FALSE(b.replace_data(std::vector<off_t>({ 2, 28 }), 3, NEW_DATA.data(), NEW_DATA.size(), 0)) << "Buffer::replace_data() rejects ranges past end of buffer";
+			
+			TEST_LENGTH(30);
+		}
+	);
+}
+
 /* Verifies we can read/write files containing any bytes without any funky
  * behaviour occuring (see 52de6b2a41d7ad82761764e250f92b359cafd072).
 */
@@ -19,13 +19,23 @@
 #include "../src/platform.hpp"
 #include <assert.h>
 
+#include <atomic>
+#include <chrono>
 #include <gtest/gtest.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <thread>
 #include <vector>
 #include <wx/init.h>
 #include <wx/wx.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
+
 #include "../src/document.hpp"
+#include "../src/NGramIndex.hpp"
 #include "../src/search.hpp"
 #include "../src/SharedDocumentPointer.hpp"
 
@@ -273,6 +283,18 @@ TEST(Search, ByteSequence)
 		EXPECT_EQ(s.find_next(0), -1) << "REHEX::Search::ByteSequence::find_next() doesn't find byte sequences which aren't relatively aligned to a later offset";
 	}
 	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		const unsigned char SEARCH_DATA[] = { 0x02, 0x03, 0x04 };
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>(SEARCH_DATA, SEARCH_DATA + 3));
+		
+		s.require_alignment(4, 10);
+		
+		EXPECT_EQ(s.find_next(0), 2) << "REHEX::Search::ByteSequence::find_next() finds byte sequences which are relatively aligned to a later offset at the start of the search";
+	}
+	
 	/* Window sizing */
 	
 	{
@@ -314,4 +336,523 @@ TEST(Search, ByteSequence)
 		
 		EXPECT_EQ(s.find_next(0, 4), 6) << "REHEX::Search::ByteSequence::find_next() finds search-window-sized byte sequences which span two windows";
 	}
+	
+	/* Backwards search */
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		const unsigned char SEARCH_DATA[] = { 0x20, 0x21, 0x22, 0x23 };
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>(SEARCH_DATA, SEARCH_DATA + 4));
+		
+		EXPECT_EQ(s.find_prev(128 + 0x100), (128 + 0x20)) << "REHEX::Search::ByteSequence::find_prev() finds last byte sequence before from_offset";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		const unsigned char SEARCH_DATA[] = { 0x20, 0x21, 0x22, 0x23 };
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>(SEARCH_DATA, SEARCH_DATA + 4));
+		
+		EXPECT_EQ(s.find_prev(128 + 0x20), 0x20) << "REHEX::Search::ByteSequence::find_prev() doesn't find byte sequence starting at from_offset";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		const unsigned char SEARCH_DATA[] = { 0x20, 0x21, 0x22, 0x23 };
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>(SEARCH_DATA, SEARCH_DATA + 4));
+		
+		EXPECT_EQ(s.find_prev(0x20), -1) << "REHEX::Search::ByteSequence::find_prev() doesn't find byte sequence starting after from_offset";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		const unsigned char SEARCH_DATA[] = { 0xFE, 0xFF };
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>(SEARCH_DATA, SEARCH_DATA + 2));
+		
+		EXPECT_EQ(s.find_prev(128 + 0x100), (128 + 0xFE)) << "REHEX::Search::ByteSequence::find_prev() finds byte sequence at end of file";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		const unsigned char SEARCH_DATA[] = { 0x00, 0x01, 0x02 };
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>(SEARCH_DATA, SEARCH_DATA + 3));
+		
+		EXPECT_EQ(s.find_prev(128), 0) << "REHEX::Search::ByteSequence::find_prev() finds byte sequence at start of file";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		const unsigned char SEARCH_DATA[] = { 0x14, 0x15, 0x16 };
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>(SEARCH_DATA, SEARCH_DATA + 3));
+		
+		s.limit_range(0x14, 0x14 + 20);
+		
+		EXPECT_EQ(s.find_prev(128 + 0x100), 0x14) << "REHEX::Search::ByteSequence::find_prev() finds byte sequence at start of range";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		const unsigned char SEARCH_DATA[] = { 0x14, 0x15, 0x16 };
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>(SEARCH_DATA, SEARCH_DATA + 3));
+		
+		s.limit_range(0x12, 0x12 + 4);
+		
+		EXPECT_EQ(s.find_prev(128 + 0x100), -1) << "REHEX::Search::ByteSequence::find_prev() doesn't find byte sequence ending beyond range";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		const unsigned char SEARCH_DATA[] = { 0x03, 0x04, 0x05 };
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>(SEARCH_DATA, SEARCH_DATA + 3));
+		
+		s.require_alignment(3);
+		
+		EXPECT_EQ(s.find_prev(128 + 0x100), 3) << "REHEX::Search::ByteSequence::find_prev() skips byte sequences which aren't aligned";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		const unsigned char SEARCH_DATA[] = { 0x03, 0x04, 0x05 };
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>(SEARCH_DATA, SEARCH_DATA + 3));
+		
+		s.require_alignment(3);
+		
+		EXPECT_EQ(s.find_prev(128 + 0x100, 4), 3) << "REHEX::Search::ByteSequence::find_prev() skips byte sequences which aren't aligned in small search windows";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		const unsigned char SEARCH_DATA[] = { 0x20, 0x21, 0x22, 0x23 };
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>(SEARCH_DATA, SEARCH_DATA + 4));
+		
+		EXPECT_EQ(s.find_prev(128 + 0x100, 4), (128 + 0x20)) << "REHEX::Search::ByteSequence::find_prev() finds byte sequences beyond the first search window";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		const unsigned char SEARCH_DATA[] = { 0x06, 0x07, 0x08, 0x09 };
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>(SEARCH_DATA, SEARCH_DATA + 4));
+		
+		EXPECT_EQ(s.find_prev(128, 4), 6) << "REHEX::Search::ByteSequence::find_prev() finds search-window-sized byte sequences which span two windows";
+	}
+}
+
+TEST(Search, MaskedByteSequence)
+{
+	FILE *tmp = fopen(TMPFILE, "wb");
+	assert(tmp != NULL);
+	for(int c = 0; c < 128; ++c) { fputc(c, tmp); }
+	for(int c = 0; c < 256; ++c) { fputc(c, tmp); }
+	fclose(tmp);
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::Masked s(&frame, doc,
+			std::vector<unsigned char>({ 0x20, 0x00, 0x22 }),
+			std::vector<unsigned char>({ 0xFF, 0x00, 0xFF }));
+		
+		EXPECT_EQ(s.find_next(0), 0x20) << "REHEX::Search::Masked::find_next() finds byte sequence with wildcard bytes";
+		EXPECT_EQ(s.find_next(0x21), (128 + 0x20)) << "REHEX::Search::Masked::find_next() finds repeated byte sequence with wildcard bytes";
+		EXPECT_EQ(s.find_prev(128 + 0x20), 0x20) << "REHEX::Search::Masked::find_prev() finds byte sequence with wildcard bytes";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::Masked s(&frame, doc,
+			std::vector<unsigned char>({ 0x90, 0x01 }),
+			std::vector<unsigned char>({ 0xF0, 0x0F }));
+		
+		EXPECT_EQ(s.find_next(0), (128 + 0x90)) << "REHEX::Search::Masked::find_next() finds byte sequence with nibble masks";
+		EXPECT_EQ(s.find_next(128 + 0x91), -1) << "REHEX::Search::Masked::find_next() doesn't find byte sequence not matching nibble masks";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::Masked s(&frame, doc,
+			std::vector<unsigned char>({ 0x06, 0x00, 0x00, 0x09 }),
+			std::vector<unsigned char>({ 0xFF, 0x00, 0x00, 0xFF }));
+		
+		EXPECT_EQ(s.find_next(0, 4), 6) << "REHEX::Search::Masked::find_next() finds byte sequences which span two windows";
+	}
+}
+
+TEST(Search, ByteSequenceReplaceAll)
+{
+	const unsigned char FILE_DATA[] = { 0x00, 0x01, 0x02, 0x01, 0x02, 0x01, 0x02, 0x03 };
+	
+	FILE *tmp = fopen(TMPFILE, "wb");
+	assert(tmp != NULL);
+	assert(fwrite(FILE_DATA, sizeof(FILE_DATA), 1, tmp) == 1);
+	fclose(tmp);
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>({ 0x01, 0x02, 0x01 }));
+		
+		std::vector<off_t> matches;
+		EXPECT_TRUE(s.find_all(matches, 2)) << "REHex::Search::ByteSequence::find_all() succeeds";
+		EXPECT_EQ(matches, std::vector<off_t>({ 1 })) << "REHex::Search::ByteSequence::find_all() skips matches which overlap an earlier one";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>({ 0x01, 0x02 }));
+		
+		EXPECT_EQ(s.replace_all(std::vector<unsigned char>(), 2), 3U) << "REHex::Search::ByteSequence::replace_all() returns number of replacements";
+		
+		EXPECT_EQ(doc->read_data(0, 1024), std::vector<unsigned char>({ 0x00, 0x03 })) << "REHex::Search::ByteSequence::replace_all() erases every match when replacing with nothing";
+		
+		doc->undo();
+		
+		EXPECT_EQ(doc->read_data(0, 1024), std::vector<unsigned char>(FILE_DATA, FILE_DATA + sizeof(FILE_DATA))) << "REHex::Search::ByteSequence::replace_all() is undone in a single step";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>({ 0x01, 0x02 }));
+		s.require_alignment(2, 1);
+		
+		EXPECT_EQ(s.replace_all(std::vector<unsigned char>({ 0xAA, 0xBB }), 2), 3U) << "REHex::Search::ByteSequence::replace_all() returns number of replacements";
+		
+		EXPECT_EQ(doc->read_data(0, 1024), std::vector<unsigned char>({ 0x00, 0xAA, 0xBB, 0xAA, 0xBB, 0xAA, 0xBB, 0x03 })) << "REHex::Search::ByteSequence::replace_all() overwrites every match with same-length data";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>({ 0x01, 0x02 }));
+		
+		s.begin_replace_all(std::vector<unsigned char>({ 0xAA, 0xBB }), 2);
+		
+		const unsigned char INSERT_DATA[] = { 0xFF };
+		doc->insert_data(0, INSERT_DATA, sizeof(INSERT_DATA));
+		
+		EXPECT_EQ(s.wait_for_replace_all(), 0U) << "REHex::Search::ByteSequence::replace_all() replaces nothing if the document is modified during the search";
+		
+		std::vector<unsigned char> expect_data(FILE_DATA, FILE_DATA + sizeof(FILE_DATA));
+		expect_data.insert(expect_data.begin(), 0xFF);
+		
+		EXPECT_EQ(doc->read_data(0, 1024), expect_data) << "REHex::Search::ByteSequence::replace_all() replaces nothing if the document is modified during the search";
+	}
+}
+
+TEST(Search, ByteSequenceIndexed)
+{
+	const std::vector<unsigned char> PATTERN = {
+		0xDE, 0xAD, 0xBE, 0xEF, 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB,
+		0xCD, 0xEF, 0xFE, 0xDC, 0xBA, 0x98, 0x76, 0x54, 0x32, 0x10,
+	};
+	
+	std::vector<unsigned char> data(1024 * 1024);
+	
+	srand(1);
+	for(auto d = data.begin(); d != data.end(); ++d) { *d = rand(); }
+	
+	for(off_t at : { 1000, 500000, 1048000 })
+	{
+		std::copy(PATTERN.begin(), PATTERN.end(), (data.begin() + at));
+	}
+	
+	FILE *tmp = fopen(TMPFILE, "wb");
+	assert(tmp != NULL);
+	assert(fwrite(data.data(), data.size(), 1, tmp) == 1);
+	fclose(tmp);
+	
+	{
+		REHex::NGramIndex::Builder builder(TMPFILE);
+		ASSERT_TRUE(builder.finish());
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::ByteSequence s(&frame, doc, PATTERN);
+		
+		EXPECT_EQ(s.find_next(0), 1000) << "REHex::Search::ByteSequence::find_next() finds first match using index";
+		EXPECT_EQ(s.find_next(1001), 500000) << "REHex::Search::ByteSequence::find_next() finds next match using index";
+		EXPECT_EQ(s.find_next(1048001), -1) << "REHex::Search::ByteSequence::find_next() returns -1 when no match after from_offset using index";
+		
+		EXPECT_EQ(s.find_prev(1048000), 500000) << "REHex::Search::ByteSequence::find_prev() finds previous match using index";
+		EXPECT_EQ(s.find_prev(1000), -1) << "REHex::Search::ByteSequence::find_prev() returns -1 when no match before from_offset using index";
+		
+		std::vector<off_t> matches;
+		EXPECT_TRUE(s.find_all(matches));
+		EXPECT_EQ(matches, std::vector<off_t>({ 1000, 500000, 1048000 })) << "REHex::Search::ByteSequence::find_all() finds every match using index";
+		
+		s.limit_range(1001, 1048019);
+		EXPECT_EQ(s.find_next(0), 500000) << "REHex::Search::ByteSequence::find_next() respects range using index";
+		EXPECT_EQ(s.find_prev(1048019), 500000) << "REHex::Search::ByteSequence::find_prev() respects range using index";
+	}
+	
+	#ifndef _WIN32
+	{
+		/* Put another match before the first one without the index noticing, to check
+		 * the index is being used.
+		*/
+		
+		struct stat st;
+		assert(stat(TMPFILE, &st) == 0);
+		
+		tmp = fopen(TMPFILE, "r+b");
+		assert(tmp != NULL);
+		assert(fseek(tmp, 10, SEEK_SET) == 0);
+		assert(fwrite(PATTERN.data(), PATTERN.size(), 1, tmp) == 1);
+		fclose(tmp);
+		
+		#ifdef __APPLE__
+		struct timespec times[] = { st.st_atimespec, st.st_mtimespec };
+		#else
+		struct timespec times[] = { st.st_atim, st.st_mtim };
+		#endif
+		
+		assert(utimensat(AT_FDCWD, TMPFILE, times, 0) == 0);
+		
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::ByteSequence s(&frame, doc, PATTERN);
+		
+		EXPECT_EQ(s.find_next(0), 1000) << "REHex::Search::ByteSequence::find_next() only checks positions in the index";
+		
+		doc->overwrite_data(2000, "x", 1);
+		
+		EXPECT_EQ(s.find_next(0), 10) << "REHex::Search::ByteSequence::find_next() doesn't use the index once the document is modified";
+	}
+	#endif
+	
+	remove(REHex::NGramIndex::index_filename(TMPFILE).c_str());
+}
+
+TEST(Search, ByteSequenceFindAllDocuments)
+{
+	const unsigned char FILE_DATA[] = { 0x00, 0x01, 0x02, 0x01, 0x02, 0x01, 0x02, 0x03 };
+	
+	FILE *tmp = fopen(TMPFILE, "wb");
+	assert(tmp != NULL);
+	assert(fwrite(FILE_DATA, sizeof(FILE_DATA), 1, tmp) == 1);
+	fclose(tmp);
+	
+	wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+	
+	REHex::SharedDocumentPointer doc1(REHex::SharedDocumentPointer::make(TMPFILE));
+	REHex::SharedDocumentPointer doc2(REHex::SharedDocumentPointer::make());
+	REHex::SharedDocumentPointer doc3(REHex::SharedDocumentPointer::make());
+	
+	std::vector<unsigned char> data2(100000, 0xFF);
+	data2[0] = 0x01; data2[1] = 0x02;
+	data2[99997] = 0x01; data2[99998] = 0x02;
+	doc2->insert_data(0, data2.data(), data2.size());
+	
+	std::vector<unsigned char> data3(1000, 0x01);
+	doc3->insert_data(0, data3.data(), data3.size());
+	
+	REHex::Search::ByteSequence s(&frame, doc1, std::vector<unsigned char>({ 0x01, 0x02 }));
+	
+	std::vector< std::vector<REHex::SearchMatch> > matches;
+	EXPECT_TRUE(s.find_all_documents({ doc1, doc2, doc3 }, matches, NULL, 64)) << "REHex::Search::ByteSequence::find_all_documents() succeeds";
+	
+	ASSERT_EQ(matches.size(), 3U);
+	EXPECT_EQ(matches[0], std::vector<REHex::SearchMatch>({ REHex::SearchMatch(1, 2), REHex::SearchMatch(3, 2), REHex::SearchMatch(5, 2) })) << "REHex::Search::ByteSequence::find_all_documents() finds matches in the first document";
+	EXPECT_EQ(matches[1], std::vector<REHex::SearchMatch>({ REHex::SearchMatch(0, 2), REHex::SearchMatch(99997, 2) })) << "REHex::Search::ByteSequence::find_all_documents() finds matches in other documents";
+	EXPECT_EQ(matches[2], std::vector<REHex::SearchMatch>()) << "REHex::Search::ByteSequence::find_all_documents() finds nothing in documents without matches";
+	
+	s.limit_range(2, 6);
+	s.require_alignment(2, 1);
+	
+	EXPECT_TRUE(s.find_all_documents({ doc2, doc1 }, matches, NULL, 64)) << "REHex::Search::ByteSequence::find_all_documents() succeeds";
+	
+	ASSERT_EQ(matches.size(), 2U);
+	EXPECT_EQ(matches[0], std::vector<REHex::SearchMatch>({ REHex::SearchMatch(0, 2), REHex::SearchMatch(99997, 2) })) << "REHex::Search::ByteSequence::find_all_documents() ignores range and alignment";
+	EXPECT_EQ(matches[1], std::vector<REHex::SearchMatch>({ REHex::SearchMatch(1, 2), REHex::SearchMatch(3, 2), REHex::SearchMatch(5, 2) })) << "REHex::Search::ByteSequence::find_all_documents() ignores range and alignment";
+	
+	std::vector<off_t> own_matches;
+	EXPECT_TRUE(s.find_all(own_matches, 64));
+	EXPECT_EQ(own_matches, std::vector<off_t>({ 3 })) << "REHex::Search::ByteSequence::find_all_documents() leaves range and alignment set for the search's own document";
+	
+	EXPECT_TRUE(s.find_all_documents({}, matches)) << "REHex::Search::ByteSequence::find_all_documents() succeeds with no documents";
+	EXPECT_TRUE(matches.empty());
+}
+
+TEST(Search, ByteSequenceFindAllSlices)
+{
+	wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+	REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make());
+	
+	/* Windows are scanned in 64KiB slices, put matches either side of and across the slice
+	 * boundaries.
+	*/
+	
+	std::vector<unsigned char> data(300000, 0x00);
+	
+	const off_t MATCHES[] = { 0, 65534, 65536, 131070, 196608, 299996 };
+	for(size_t i = 0; i < (sizeof(MATCHES) / sizeof(*MATCHES)); ++i)
+	{
+		data[MATCHES[i]]     = 0x01;
+		data[MATCHES[i] + 1] = 0x02;
+		data[MATCHES[i] + 2] = 0x03;
+		data[MATCHES[i] + 3] = 0x04;
+	}
+	
+	doc->insert_data(0, data.data(), data.size());
+	
+	REHex::Search::ByteSequence s(&frame, doc, std::vector<unsigned char>({ 0x01, 0x02, 0x03, 0x04 }));
+	
+	std::vector<off_t> matches;
+	EXPECT_TRUE(s.find_all(matches));
+	EXPECT_EQ(matches, std::vector<off_t>(MATCHES, (MATCHES + (sizeof(MATCHES) / sizeof(*MATCHES)))))
+		<< "REHex::Search::ByteSequence::find_all() finds matches in every slice of a window, including ones spanning slices";
+}
+
+/* Search which only implements test(), so it is found by the default Search::scan() and
+ * Search::rscan() implementations.
+*/
+class TestOnlySearch: public REHex::Search
+{
+	public:
+		TestOnlySearch(wxWindow *parent, REHex::SharedDocumentPointer &doc):
+			Search(parent, doc, "Test search")
+		{
+			setup_window();
+		}
+		
+	protected:
+		virtual bool test(const void *data, size_t data_size) override
+		{
+			return data_size >= 1 && *(const unsigned char*)(data) == 0x01;
+		}
+		
+		virtual size_t test_max_window() override
+		{
+			return 1;
+		}
+		
+		virtual void setup_window_controls(wxWindow *parent, wxSizer *sizer) override {}
+		virtual bool read_window_controls() override { return true; }
+};
+
+TEST(Search, DefaultScanStride)
+{
+	wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+	REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make());
+	
+	const unsigned char DATA[] = { 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00 };
+	doc->insert_data(0, DATA, sizeof(DATA));
+	
+	TestOnlySearch s(&frame, doc);
+	s.require_alignment(3);
+	
+	EXPECT_EQ(s.find_next(4), 6) << "Search::scan() finds the first aligned match";
+	EXPECT_EQ(s.find_prev(10), 9) << "Search::rscan() finds an aligned match just below limit";
+	EXPECT_EQ(s.find_prev(9), 6) << "Search::rscan() finds an aligned match a whole stride below limit";
+}
+
+TEST(Search, AlignmentBeforeBase)
+{
+	wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+	REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make());
+	
+	const unsigned char DATA[] = { 0x00, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x00 };
+	doc->insert_data(0, DATA, sizeof(DATA));
+	
+	TestOnlySearch s(&frame, doc);
+	s.require_alignment(4, 10);
+	
+	EXPECT_EQ(s.find_next(0), 2) << "Search::find_next() rounds offsets before the alignment base up correctly";
+	EXPECT_EQ(s.find_prev(9), 6) << "Search::find_prev() rounds offsets before the alignment base down correctly";
+	EXPECT_EQ(s.find_prev(6), 2) << "Search::find_prev() rounds offsets before the alignment base down correctly";
+	
+	std::vector<off_t> matches;
+	EXPECT_TRUE(s.find_all(matches, 4));
+	EXPECT_EQ(matches, std::vector<off_t>({ 2, 6, 10 })) << "Search::find_all() finds aligned matches either side of the alignment base";
+}
+
+/* Search which takes about a millisecond to test each KiB of data. */
+class SlowSearch: public TestOnlySearch
+{
+	public:
+		std::atomic<size_t> tests;
+		
+		SlowSearch(wxWindow *parent, REHex::SharedDocumentPointer &doc):
+			TestOnlySearch(parent, doc), tests(0) {}
+		
+		void begin_incremental(size_t window_size)
+		{
+			begin_incremental_search(false, window_size);
+		}
+		
+	protected:
+		virtual bool test(const void *data, size_t data_size) override
+		{
+			if((++tests % 1024) == 0)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			
+			return TestOnlySearch::test(data, data_size);
+		}
+};
+
+TEST(Search, CancelIncrementalSearchInWindow)
+{
+	wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+	REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make());
+	
+	const size_t DATA_SIZE = 16 * 1024 * 1024;
+	
+	std::vector<unsigned char> data(DATA_SIZE, 0x00);
+	doc->insert_data(0, data.data(), data.size());
+	
+	/* Search the whole document as one window, which would take over 15 seconds. */
+	SlowSearch s(&frame, doc);
+	s.begin_incremental(DATA_SIZE);
+	
+	while(s.tests == 0)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	
+	auto cancel_begin = std::chrono::steady_clock::now();
+	
+	const unsigned char NEW_DATA[] = { 0x02 };
+	doc->overwrite_data(0, NEW_DATA, sizeof(NEW_DATA));
+	
+	auto cancel_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - cancel_begin);
+	
+	EXPECT_LT(cancel_time.count(), 2000) << "Modifying the document cancels an incremental search part way through a window";
+	EXPECT_LT(s.tests.load(), (DATA_SIZE / 4)) << "Modifying the document cancels an incremental search part way through a window";
 }
@@ -287,3 +287,227 @@ TEST(Search, Text)
 		EXPECT_EQ(s.find_next(0, 4), 4) << "REHEX::Search::Text::find_next() finds strings which span an entire search window";
 	}
 }
+
+TEST(Search, TextEncodings)
+{
+	/* "Hi" in UTF-16LE, "hi" in UTF-16BE, then "ab" followed by U+0141 and U+0161 in UTF-16LE,
+	 * whose low bytes are the letters 'A' and 'a'.
+	*/
+	const unsigned char FILE_DATA[] = {
+		'x', 'H', 0x00, 'i', 0x00, 'x',
+		0x00, 'h', 0x00, 'i', 'x',
+		'a', 0x00, 'b', 0x00, 0x41, 0x01, 'a', 0x00, 'b', 0x00, 0x61, 0x01,
+	};
+	
+	FILE *tmp = fopen(TMPFILE, "wb");
+	assert(tmp != NULL);
+	assert(fwrite(FILE_DATA, sizeof(FILE_DATA), 1, tmp) == 1);
+	fclose(tmp);
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::Text s(&frame, doc, "Hi", true, REHex::Search::Text::ENC_UTF16LE);
+		
+		EXPECT_EQ(s.find_next(0), 1) << "REHEX::Search::Text::find_next() finds UTF-16LE text";
+		EXPECT_EQ(s.find_next(2), -1) << "REHEX::Search::Text::find_next() only finds text in selected encodings";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::Text s(&frame, doc, "HI", false, (REHex::Search::Text::ENC_UTF16LE | REHex::Search::Text::ENC_UTF16BE));
+		
+		EXPECT_EQ(s.find_next(0), 1) << "REHEX::Search::Text::find_next() finds text in any selected encoding";
+		EXPECT_EQ(s.find_next(2), 6) << "REHEX::Search::Text::find_next() finds text in any selected encoding";
+		EXPECT_EQ(s.find_prev(23), 7) << "REHEX::Search::Text::find_prev() finds text in any selected encoding";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		/* "ab" followed by U+0161 */
+		REHex::Search::Text s(&frame, doc, "AB\xC5\xA1", false, REHex::Search::Text::ENC_UTF16LE);
+		
+		EXPECT_EQ(s.find_next(0), 17) << "REHEX::Search::Text::find_next() only folds case of ASCII characters in UTF-16";
+		EXPECT_EQ(s.find_prev(17), -1) << "REHEX::Search::Text::find_prev() only folds case of ASCII characters in UTF-16";
+	}
+}
+
+TEST(Search, Regex)
+{
+	FILE *tmp = fopen(TMPFILE, "wb");
+	assert(tmp != NULL);
+	assert(fwrite("abcdefghijklmnop", 16, 1, tmp) == 1);
+	fclose(tmp);
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::Regex s(&frame, doc, "[d-f]+h|c.e");
+		
+		EXPECT_EQ(s.find_next(0), 2) << "REHEX::Search::Regex::find_next() finds leftmost match";
+		EXPECT_EQ(s.find_next(3), -1) << "REHEX::Search::Regex::find_next() doesn't find match starting before from_offset";
+		EXPECT_EQ(s.find_prev(16), 2) << "REHEX::Search::Regex::find_prev() finds match";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::Regex s(&frame, doc, "[e-z]{3}");
+		
+		EXPECT_EQ(s.find_next(0, 4), 4) << "REHEX::Search::Regex::find_next() finds match beyond the first search window";
+		EXPECT_EQ(s.find_prev(16, 4), 13) << "REHEX::Search::Regex::find_prev() finds last match in range";
+		EXPECT_EQ(s.find_prev(6, 4), 5) << "REHEX::Search::Regex::find_prev() finds match spanning search windows";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::Regex s(&frame, doc, "GHI", REHex::RegexSearchKernel::IGNORE_CASE);
+		
+		EXPECT_EQ(s.find_next(0), 6) << "REHEX::Search::Regex::find_next() is case-insensitive when requested";
+	}
+}
+
+TEST(Search, TextReplaceAll)
+{
+	FILE *tmp = fopen(TMPFILE, "wb");
+	assert(tmp != NULL);
+	assert(fwrite("abcXabcabcYYabXab", 17, 1, tmp) == 1);
+	fclose(tmp);
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::Text s(&frame, doc, "abc");
+		
+		std::vector<off_t> matches;
+		EXPECT_TRUE(s.find_all(matches, 4)) << "REHex::Search::Text::find_all() succeeds";
+		EXPECT_EQ(matches, std::vector<off_t>({ 0, 4, 7 })) << "REHex::Search::Text::find_all() finds every match across search windows";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::Text s(&frame, doc, "abcabc");
+		
+		std::vector<off_t> matches;
+		EXPECT_TRUE(s.find_all(matches, 4)) << "REHex::Search::Text::find_all() succeeds";
+		EXPECT_EQ(matches, std::vector<off_t>({ 4 })) << "REHex::Search::Text::find_all() finds matches which span search windows";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::Text s(&frame, doc, "abc");
+		
+		const std::string REPLACE = "Hello";
+		EXPECT_EQ(s.replace_all(std::vector<unsigned char>(REPLACE.begin(), REPLACE.end()), 4), 3U) << "REHex::Search::Text::replace_all() returns number of replacements";
+		
+		std::vector<unsigned char> data = doc->read_data(0, 1024);
+		EXPECT_EQ(std::string(data.begin(), data.end()), "HelloXHelloHelloYYabXab") << "REHex::Search::Text::replace_all() replaces every match with longer data";
+		
+		doc->undo();
+		
+		data = doc->read_data(0, 1024);
+		EXPECT_EQ(std::string(data.begin(), data.end()), "abcXabcabcYYabXab") << "REHex::Search::Text::replace_all() is undone in a single step";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::Text s(&frame, doc, "ab");
+		
+		EXPECT_EQ(s.replace_all(std::vector<unsigned char>({ 'Z' }), 4), 5U) << "REHex::Search::Text::replace_all() returns number of replacements";
+		
+		std::vector<unsigned char> data = doc->read_data(0, 1024);
+		EXPECT_EQ(std::string(data.begin(), data.end()), "ZcXZcZcYYZXZ") << "REHex::Search::Text::replace_all() replaces every match with shorter data";
+	}
+	
+	{
+		wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+		REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+		
+		REHex::Search::Text s(&frame, doc, "nope");
+		
+		EXPECT_EQ(s.replace_all(std::vector<unsigned char>({ 'Z' }), 4), 0U) << "REHex::Search::Text::replace_all() returns zero when nothing matches";
+		EXPECT_FALSE(doc->is_dirty()) << "REHex::Search::Text::replace_all() doesn't modify the document when nothing matches";
+	}
+}
+
+TEST(Search, TextSearchAsYouType)
+{
+	FILE *tmp = fopen(TMPFILE, "wb");
+	assert(tmp != NULL);
+	assert(fwrite("abXYabcdZZabcXYab", 17, 1, tmp) == 1);
+	fclose(tmp);
+	
+	wxFrame frame(NULL, wxID_ANY, wxT("Unit tests"));
+	REHex::SharedDocumentPointer doc(REHex::SharedDocumentPointer::make(TMPFILE));
+	
+	REHex::Search::Text s(&frame, doc);
+	
+	std::vector< std::pair<off_t, off_t> > highlighted;
+	s.set_match_highlighter([&](off_t offset, off_t length)
+	{
+		highlighted.push_back(std::make_pair(offset, length));
+		
+		if(offset >= 0)
+		{
+			doc->set_cursor_position(offset);
+		}
+	});
+	
+	doc->set_cursor_position(1);
+	
+	s.search_as_you_type("ab", true, REHex::Search::Text::ENC_UTF8);
+	EXPECT_EQ(s.wait_for_incremental_search(), 4) << "Search as you type finds first match after the cursor";
+	
+	s.search_as_you_type("abc", true, REHex::Search::Text::ENC_UTF8);
+	EXPECT_EQ(s.wait_for_incremental_search(), 4) << "Search as you type keeps the current match when it still matches";
+	
+	s.search_as_you_type("abcX", true, REHex::Search::Text::ENC_UTF8);
+	EXPECT_EQ(s.wait_for_incremental_search(), 10) << "Search as you type moves on to the next match when the current one no longer matches";
+	
+	s.search_as_you_type("ab", true, REHex::Search::Text::ENC_UTF8);
+	EXPECT_EQ(s.wait_for_incremental_search(), 4) << "Search as you type searches from where it started when the text is shortened";
+	
+	s.search_as_you_type("abX", true, REHex::Search::Text::ENC_UTF8);
+	EXPECT_EQ(s.wait_for_incremental_search(), 0) << "Search as you type wraps around to the start of the file";
+	
+	s.search_as_you_type("abXQ", true, REHex::Search::Text::ENC_UTF8);
+	EXPECT_EQ(s.wait_for_incremental_search(), -1) << "Search as you type returns -1 when nothing matches";
+	
+	highlighted.clear();
+	
+	s.search_as_you_type("abXQQ", true, REHex::Search::Text::ENC_UTF8);
+	EXPECT_EQ(s.wait_for_incremental_search(), -1) << "Search as you type returns -1 when the text extends a search which found nothing";
+	EXPECT_EQ(highlighted, std::vector< std::pair<off_t, off_t> >({ std::make_pair(-1, 5) })) << "Search as you type clears the highlight when nothing matches";
+	
+	EXPECT_EQ(doc->get_cursor_position(), 0) << "Search as you type doesn't move the cursor when nothing matches";
+	
+	s.search_as_you_type("ABXY", true, REHex::Search::Text::ENC_UTF8);
+	EXPECT_EQ(s.wait_for_incremental_search(), -1) << "Search as you type is case sensitive when requested";
+	
+	s.search_as_you_type("ABXY", false, REHex::Search::Text::ENC_UTF8);
+	EXPECT_EQ(s.wait_for_incremental_search(), 0) << "Search as you type is case insensitive when requested";
+	
+	s.search_as_you_type("abXQ", true, REHex::Search::Text::ENC_UTF8);
+	EXPECT_EQ(s.wait_for_incremental_search(), -1);
+	
+	doc->overwrite_data(10, "abXQQ", 5);
+	
+	s.search_as_you_type("abXQQ", true, REHex::Search::Text::ENC_UTF8);
+	EXPECT_EQ(s.wait_for_incremental_search(), 10) << "Search as you type searches again when the text extends a search which found nothing before the document was modified";
+}
@@ -44,6 +44,12 @@
 #define PARSE_HEX_STRING_BAD(hex) \
 	EXPECT_THROW(REHex::parse_hex_string(hex), REHex::ParseError) << "REHex::parse_hex_string(" #hex ") throws ParseError";
 
+#define PARSE_MASKED_HEX_STRING_BAD(hex) \
+{ \
+	std::vector<unsigned char> mask; \
+	EXPECT_THROW(REHex::parse_masked_hex_string(hex, &mask), REHex::ParseError) << "REHex::parse_masked_hex_string(" #hex ") throws ParseError"; \
+}
+
 using namespace REHex;
 
 TEST(Util, parse_ascii_nibble)
@@ -117,6 +123,62 @@ TEST(Util, parse_hex_string)
 	PARSE_HEX_STRING_BAD("g");
 }
 
+TEST(Util, parse_masked_hex_string)
+{
+	std::vector<unsigned char> mask;
+	
+	EXPECT_EQ(parse_masked_hex_string("", &mask), std::vector<unsigned char>());
+	EXPECT_EQ(mask, std::vector<unsigned char>());
+	
+	EXPECT_EQ(parse_masked_hex_string("4D5A", &mask), std::vector<unsigned char>({ 0x4D, 0x5A }));
+	EXPECT_EQ(mask, std::vector<unsigned char>({ 0xFF, 0xFF }));
+	
+	EXPECT_EQ(parse_masked_hex_string("4D 5A ?? ?? 50 45", &mask), std::vector<unsigned char>({ 0x4D, 0x5A, 0x00, 0x00, 0x50, 0x45 }));
+	EXPECT_EQ(mask, std::vector<unsigned char>({ 0xFF, 0xFF, 0x00, 0x00, 0xFF, 0xFF }));
+	
+	EXPECT_EQ(parse_masked_hex_string("A? ?b", &mask), std::vector<unsigned char>({ 0xA0, 0x0B }));
+	EXPECT_EQ(mask, std::vector<unsigned char>({ 0xF0, 0x0F }));
+	
+	EXPECT_EQ(parse_masked_hex_string("? ?", &mask), std::vector<unsigned char>({ 0x00 }));
+	EXPECT_EQ(mask, std::vector<unsigned char>({ 0x00 }));
+	
+	PARSE_MASKED_HEX_STRING_BAD("?");
+	PARSE_MASKED_HEX_STRING_BAD("A??");
+	PARSE_MASKED_HEX_STRING_BAD("*0");
+	PARSE_MASKED_HEX_STRING_BAD("G?");
+}
+
+TEST(Util, encode_text)
+{
+	typedef std::vector<unsigned char> V;
+	
+	EXPECT_EQ(encode_text("", ENCODING_UTF16LE), V());
+	
+	EXPECT_EQ(encode_text("Ab", ENCODING_UTF8),    V({ 'A', 'b' }));
+	EXPECT_EQ(encode_text("Ab", ENCODING_UTF16LE), V({ 'A', 0x00, 'b', 0x00 }));
+	EXPECT_EQ(encode_text("Ab", ENCODING_UTF16BE), V({ 0x00, 'A', 0x00, 'b' }));
+	EXPECT_EQ(encode_text("Ab", ENCODING_LATIN1),  V({ 'A', 'b' }));
+	
+	/* U+00E9 (e with acute) */
+	EXPECT_EQ(encode_text("\xC3\xA9", ENCODING_UTF8),    V({ 0xC3, 0xA9 }));
+	EXPECT_EQ(encode_text("\xC3\xA9", ENCODING_UTF16LE), V({ 0xE9, 0x00 }));
+	EXPECT_EQ(encode_text("\xC3\xA9", ENCODING_LATIN1),  V({ 0xE9 }));
+	
+	/* U+20AC (euro sign) */
+	EXPECT_EQ(encode_text("\xE2\x82\xAC", ENCODING_UTF16LE), V({ 0xAC, 0x20 }));
+	EXPECT_EQ(encode_text("\xE2\x82\xAC", ENCODING_UTF16BE), V({ 0x20, 0xAC }));
+	EXPECT_THROW(encode_text("\xE2\x82\xAC", ENCODING_LATIN1), REHex::ParseError) << "REHex::encode_text() throws ParseError for characters outside Latin-1";
+	
+	/* U+1F600 (outside the BMP, encoded as a surrogate pair) */
+	EXPECT_EQ(encode_text("\xF0\x9F\x98\x80", ENCODING_UTF16LE), V({ 0x3D, 0xD8, 0x00, 0xDE }));
+	EXPECT_EQ(encode_text("\xF0\x9F\x98\x80", ENCODING_UTF16BE), V({ 0xD8, 0x3D, 0xDE, 0x00 }));
+	
+	EXPECT_THROW(encode_text("\x80", ENCODING_UTF8), REHex::ParseError) << "REHex::encode_text() throws ParseError for stray continuation byte";
+	EXPECT_THROW(encode_text("\xC3", ENCODING_UTF8), REHex::ParseError) << "REHex::encode_text() throws ParseError for truncated character";
+	EXPECT_THROW(encode_text("\xC0\x80", ENCODING_UTF8), REHex::ParseError) << "REHex::encode_text() throws ParseError for overlong character";
+	EXPECT_THROW(encode_text("\xED\xA0\x80", ENCODING_UTF16LE), REHex::ParseError) << "REHex::encode_text() throws ParseError for encoded surrogate";
+}
+
 TEST(Util, format_offset)
 {
 	EXPECT_EQ(format_offset(0, OFFSET_BASE_HEX, 0), "0000:0000");